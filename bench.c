@@ -0,0 +1,1494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fluid_cpu.h"
+#include "fluid_sample.h"
+#include "fluid_sat.h"
+#include "fluid_speed.h"
+
+// Physac stepped by hand, with room for the biggest debris pile below
+#define PHYSAC_IMPLEMENTATION
+#define PHYSAC_NO_THREADS
+#define PHYSAC_MAX_BODIES (10000 + 16)
+#define PHYSAC_MAX_MANIFOLDS (1 << 18)
+#include "physac.h"
+#include "physac_broadphase.h"
+
+// nvst_bench: CPU fluid and physics benchmarks, runs without a window or GL context
+//
+//     cc -O2 bench.c -o nvst_bench -lm -lpthread
+//     ./nvst_bench kernels
+//     ./nvst_bench threads
+//     ./nvst_bench blocked
+//     ./nvst_bench storage
+//     ./nvst_bench layout
+//     ./nvst_bench sparse
+//     ./nvst_bench speed
+//     ./nvst_bench advection [frames]
+//     ./nvst_bench multigrid [cycles]
+//     ./nvst_bench boundary [frames]
+//     ./nvst_bench solid
+//     ./nvst_bench sweep [frames] [csv|json] > sweep.csv
+//     ./nvst_bench sampler
+//     ./nvst_bench sat
+//     ./nvst_bench physics [steps]
+
+#define BENCH_WIDTH (1920)
+#define BENCH_HEIGHT (1080)
+#define BENCH_SAMPLES (1 << 20)
+
+// Sweep grid, from a quarter of 1080p up to 4K
+static const int bench_resolutions[][2] = {
+    {480, 270}, {960, 540}, {1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}
+};
+static const int bench_substeps[] = {1, 2, 4, 6, 8, 12};
+
+// Debris piles for the broadphase. Physac's own step keeps a manifold for every pair
+// and finds each one an id by searching the rest, so it only gets run on the smallest.
+static const int bench_body_counts[] = {100, 300, 1000, 3000, 10000};
+#define BENCH_ALL_PAIRS_MAX (100)
+#define BENCH_PHYSICS_SPACING (24.0f)
+#define BENCH_PHYSICS_CELL (64.0f)      // Same as the game's PHYSICS_HASH_CELL
+#define BENCH_PHYSICS_PAIRS (8)
+#define BENCH_PHYSICS_QUERIES (1024)
+
+// Parts of a game frame timed by the sweep
+typedef enum NV_BenchPhase {
+    BENCH_PHASE_INJECT,     // Filling the emitter list, once per frame like frameUpdateFluidBuffer
+    BENCH_PHASE_STEP,       // Every substep of the solver
+    BENCH_PHASE_READBACK,   // Field to RGBA16F image, what the GL path gets from LoadImageFromTexture
+    BENCH_PHASE_DECODE,     // RGBA16F image back to floats
+    BENCH_PHASE_SAMPLE,     // Five point force sampling for each player
+    BENCH_PHASE_COUNT
+} BenchPhase;
+
+static const char* bench_phase_names[BENCH_PHASE_COUNT] = {
+    "inject", "step", "readback", "decode", "sample"
+};
+
+// Results get written here so the compiler can't drop the work that made them
+static volatile float bench_sink;
+
+//----------------------------------------------------------------------------------
+// Local Functions Declaration
+//----------------------------------------------------------------------------------
+static double benchTime(void);
+static void benchFillField(FluidCPU* cpu);
+static void benchKernels(int repeats);
+static void benchThreads(int repeats);
+static void benchBlocked(int repeats);
+static void benchStorage(int repeats);
+static void benchLayout(int repeats);
+static void benchSparse(int repeats);
+static void benchSpeed(int repeats);
+static void benchAdvection(int frames);
+static void benchMultigrid(int cycles);
+static void benchBoundary(int frames);
+static void benchSolid(int repeats);
+static void benchSweep(int frames, int json);
+static void benchSampler(int repeats);
+static void benchSAT(int repeats);
+static void benchPhysics(int steps);
+// A frame's substeps one full sweep at a time and then in row bands, which have to
+// come out the same. GB/s is what the field would move through memory if nothing
+// stayed in cache: a sweep reads the four planes, the boundary and its neighbours'
+// planes again, and writes four, blocking does that once a frame.
+static void benchBlocked(int repeats) {
+    static const int substeps[] = {2, 3, 4, 6};
+    static const int bands[] = {16, 32, 64, 128};
+    double cells = (double)BENCH_WIDTH*BENCH_HEIGHT;
+    double bytes = cells*(8*sizeof(float) + sizeof(unsigned char));
+
+    printf("%-6s %-6s %10s %10s %8s %8s %9s\n", "steps", "rows", "ms/frame", "GB/s", "speedup", "exact", "fallbacks");
+    for (int s = 0; s < (int)(sizeof(substeps)/sizeof(substeps[0])); s++) {
+        int count = substeps[s];
+
+        FluidCPU naive = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+        benchFillField(&naive);
+        stepFluidCPU(&naive);
+
+        double start = benchTime();
+        for (int r = 0; r < repeats; r++) stepFluidCPUSubsteps(&naive, count);
+        double naive_time = (benchTime() - start) / repeats;
+        printf("%-6d %-6s %10.2f %10.2f\n", count, "-", naive_time*1e3, count*bytes / naive_time * 1e-9);
+
+        for (int b = 0; b < (int)(sizeof(bands)/sizeof(bands[0])); b++) {
+            FluidCPU blocked = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+            benchFillField(&blocked);
+            stepFluidCPU(&blocked);
+            blocked.block_rows = bands[b];
+
+            start = benchTime();
+            for (int r = 0; r < repeats; r++) stepFluidCPUSubsteps(&blocked, count);
+            double time = (benchTime() - start) / repeats;
+
+            // Both ran the same frames from the same start, so every bit should match
+            FluidCPUField* x = &naive.field[naive.front];
+            FluidCPUField* y = &blocked.field[blocked.front];
+            size_t plane = (size_t)BENCH_WIDTH*BENCH_HEIGHT*sizeof(float);
+            int exact = naive.front == blocked.front
+                && memcmp(x->x, y->x, plane) == 0 && memcmp(x->y, y->y, plane) == 0
+                && memcmp(x->z, y->z, plane) == 0 && memcmp(x->w, y->w, plane) == 0;
+
+            printf(
+                "%-6d %-6d %10.2f %10.2f %7.2fx %8s %9lld\n",
+                count, bands[b], time*1e3, count*bytes / time * 1e-9, naive_time / time,
+                exact ? "yes" : "NO", blocked.block_fallbacks
+            );
+            unloadFluidCPU(&blocked);
+        }
+        unloadFluidCPU(&naive);
+    }
+}
+
+static int compareBenchTimes(const void* a, const void* b);
+static double benchPercentile(double* times, int count, double percentile);
+
+//----------------------------------------------------------------------------------
+// Main entry point
+//----------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    const char* suite = (argc > 1) ? argv[1] : "kernels";
+    int repeats = (argc > 2) ? atoi(argv[2]) : 20;
+
+    if (strcmp(suite, "kernels") == 0) {
+        benchKernels(repeats);
+    } else if (strcmp(suite, "threads") == 0) {
+        benchThreads(repeats);
+    } else if (strcmp(suite, "blocked") == 0) {
+        benchBlocked(repeats);
+    } else if (strcmp(suite, "storage") == 0) {
+        benchStorage(repeats);
+    } else if (strcmp(suite, "layout") == 0) {
+        benchLayout(repeats);
+    } else if (strcmp(suite, "sparse") == 0) {
+        benchSparse(repeats);
+    } else if (strcmp(suite, "speed") == 0) {
+        benchSpeed(repeats);
+    } else if (strcmp(suite, "advection") == 0) {
+        benchAdvection(repeats);
+    } else if (strcmp(suite, "multigrid") == 0) {
+        benchMultigrid(repeats);
+    } else if (strcmp(suite, "boundary") == 0) {
+        benchBoundary(repeats);
+    } else if (strcmp(suite, "solid") == 0) {
+        benchSolid(repeats);
+    } else if (strcmp(suite, "sweep") == 0) {
+        benchSweep(repeats, (argc > 3) && strcmp(argv[3], "json") == 0);
+    } else if (strcmp(suite, "sampler") == 0) {
+        benchSampler(repeats);
+    } else if (strcmp(suite, "sat") == 0) {
+        benchSAT(repeats);
+    } else if (strcmp(suite, "physics") == 0) {
+        benchPhysics(repeats);
+    } else {
+        printf("usage: nvst_bench [kernels|threads|blocked|storage|layout|sparse|speed|advection|multigrid|boundary|solid|sweep|sampler|sat|physics] [repeats] [csv|json]\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static double benchTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static FluidEmitter bench_emitters[FLUID_MAX_EMITTERS];
+
+// Smooth swirling field with a few solids and emitters so every branch gets hit
+static void benchFillField(FluidCPU* cpu) {
+    for (int y = 0; y < cpu->height; y++) {
+        for (int x = 0; x < cpu->width; x++) {
+            size_t i = (size_t)y*cpu->width + x;
+            cpu->field[0].x[i] = 20*sinf(x*0.013f + y*0.007f);
+            cpu->field[0].y[i] = 15*cosf(x*0.011f - y*0.017f);
+            cpu->field[0].z[i] = 1 + 0.5f*sinf(x*0.03f)*cosf(y*0.02f);
+            cpu->field[0].w[i] = 1;
+        }
+    }
+    cpu->front = 0;
+
+    cpu->draw_target = FLUID_CPU_TARGET_BOUNDARY;
+    drawFluidCPURectanglePro(cpu, (Rectangle){cpu->width/2, cpu->height/2, cpu->width/2, 20}, (Vector2){cpu->width/4, 10}, 10, RED);
+    drawFluidCPUCircle(cpu, cpu->width/5, cpu->height/4, cpu->height/10, RED);
+    cpu->draw_target = FLUID_CPU_TARGET_FIELD;
+    updateFluidCPUSolid(cpu);
+
+    bench_emitters[0] = createFluidEmitterRectanglePro(
+        cpu->height, (Rectangle){cpu->width/3, cpu->height/3, 100, 4}, (Vector2){0, 2}, -30, (Vector2){18, 4}
+    );
+    Vector2 at = {cpu->width*0.7f, cpu->height*0.3f};
+    bench_emitters[1] = createFluidEmitterCapsule(cpu->height, at, at, 10, (Vector2){0.5f, 0.5f});
+    bench_emitters[1].shape = FLUID_EMITTER_CAPSULE | FLUID_EMITTER_HOLD;
+    cpu->emitters = bench_emitters;
+    cpu->emitter_count = 2;
+
+    cpu->time = 2.0f;
+}
+
+// Cells per second of the advection pass and of each row kernel, checked against scalar
+static void benchKernels(int repeats) {
+    FluidCPU cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 1);
+    benchFillField(&cpu);
+
+    int width = cpu.width;
+    int height = cpu.height;
+    size_t count = (size_t)width * height;
+    FluidCPUField* src = &cpu.field[0];
+    FluidCPUField* dst = &cpu.field[1];
+    FluidCPUBand band = getFluidCPUFieldBand(&cpu, 0);
+
+    // The kernels only need each row's advection, so do it once up front
+    float* adv = malloc(count*FLUID_CPU_SCRATCH_ROWS*sizeof(float));
+    double start = benchTime();
+    for (int r = 0; r < repeats; r++) {
+        for (int y = 0; y < height; y++) {
+            size_t row = (size_t)y*width;
+            const float* c[4];
+            const float* u[4];
+            const float* d[4];
+            getFluidCPUBandRow(&band, width, y, c);
+            getFluidCPUBandRow(&band, width, wrapFluidCPUIndex(y + 1, height), u);
+            getFluidCPUBandRow(&band, width, wrapFluidCPUIndex(y - 1, height), d);
+            advectFluidCPURow(
+                &cpu, &band, y, c, u, d,
+                adv + row, adv + count + row, adv + 2*count + row, adv + 3*count + row, adv + 4*count + row, 0, width
+            );
+        }
+    }
+    double advect_time = (benchTime() - start) / repeats;
+    printf("%-8s %10.1f Mcells/s\n", "advect", count / advect_time * 1e-6);
+
+    float* reference = malloc(count*4*sizeof(float));
+    double scalar_time = 0;
+    FluidCPUISA best = detectFluidCPUISA();
+
+    for (int isa = FLUID_ISA_SCALAR; isa <= (int)best; isa++) {
+        setFluidCPUISA(isa);
+        FluidRowKernel kernel = getFluidRowKernel();
+
+        start = benchTime();
+        for (int r = 0; r < repeats; r++) {
+            for (int y = 1; y < height - 1; y++) {
+                size_t row = (size_t)y*width;
+                size_t row_u = row + width;
+                size_t row_d = row - width;
+                FluidCPURow args = {
+                    .c = {src->x + row, src->y + row, src->z + row, src->w + row},
+                    .u = {src->x + row_u, src->y + row_u, src->z + row_u, src->w + row_u},
+                    .d = {src->x + row_d, src->y + row_d, src->z + row_d, src->w + row_d},
+                    .solid = cpu.solid + row,
+                    .adv_x = adv + row,
+                    .adv_y = adv + count + row,
+                    .ext_x = adv + 2*count + row,
+                    .ext_y = adv + 3*count + row,
+                    .emit = adv + 4*count + row,
+                    .out = {dst->x + row, dst->y + row, dst->z + row, dst->w + row},
+                    .params = &cpu.params,
+                };
+                kernel(&args, 1, width - 1);
+            }
+        }
+        double time = (benchTime() - start) / repeats;
+        if (isa == FLUID_ISA_SCALAR) scalar_time = time;
+
+        // Everything has to match the scalar path bit for bit
+        size_t mismatches = 0;
+        float* planes[4] = {dst->x, dst->y, dst->z, dst->w};
+        for (int p = 0; p < 4; p++) {
+            if (isa == FLUID_ISA_SCALAR) {
+                memcpy(reference + p*count, planes[p], count*sizeof(float));
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    mismatches += memcmp(&reference[p*count + i], &planes[p][i], sizeof(float)) != 0;
+                }
+            }
+        }
+
+        printf(
+            "%-8s %10.1f Mcells/s  %5.2fx scalar  %zu mismatches\n",
+            fluidCPUISAName(isa),
+            (width - 2)*(height - 2) / time * 1e-6,
+            scalar_time / time,
+            mismatches
+        );
+    }
+
+    free(adv);
+    free(reference);
+    unloadFluidCPU(&cpu);
+}
+
+// Whole substeps with 1, 2, 4, ... workers up to every core
+static void benchThreads(int repeats) {
+    int cores = getFluidCPUCoreCount();
+    double single_time = 0;
+
+    printf("%d cores, %s kernels\n", cores, fluidCPUISAName(detectFluidCPUISA()));
+
+    int threads = 1;
+    while (threads <= cores) {
+        FluidCPU cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, threads);
+        benchFillField(&cpu);
+
+        // Warm up so the workers are awake and the pages are in
+        stepFluidCPU(&cpu);
+
+        double start = benchTime();
+        for (int r = 0; r < repeats; r++) {
+            stepFluidCPU(&cpu);
+        }
+        double time = (benchTime() - start) / repeats;
+        if (threads == 1) single_time = time;
+
+        printf(
+            "%3d threads %8.2f ms/substep %10.1f Mcells/s  %5.2fx  %5.1f%% efficiency\n",
+            threads,
+            time*1e3,
+            (double)cpu.width*cpu.height / time * 1e-6,
+            single_time / time,
+            100*single_time / time / threads
+        );
+
+        unloadFluidCPU(&cpu);
+
+        // Powers of two, always finishing on the full core count
+        threads = (threads < cores && threads*2 > cores) ? cores : threads*2;
+    }
+}
+
+// Float against half storage of the same field: memory, substeps and export to the
+// RGBA16F image. The export of half storage has to read back exactly what
+// getFluidCPUValue gives, and drift is how far it ends up from float storage.
+static void benchStorage(int repeats) {
+    static const char* names[] = {"f32", "f16"};
+    size_t count = (size_t)BENCH_WIDTH*BENCH_HEIGHT;
+    FluidCPU cpus[2];
+    double step_times[2];
+
+    printf("%-5s %10s %12s %10s %10s %12s %10s\n", "store", "field MB", "ms/substep", "Mcells/s", "GB/s", "export ms", "readback");
+    for (int s = 0; s < 2; s++) {
+        FluidCPU* cpu = &cpus[s];
+        *cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+        benchFillField(cpu);
+        setFluidCPUStorage(cpu, s ? FLUID_CPU_STORAGE_F16 : FLUID_CPU_STORAGE_F32);
+        stepFluidCPU(cpu);
+
+        double start = benchTime();
+        for (int r = 0; r < repeats; r++) stepFluidCPU(cpu);
+        step_times[s] = (benchTime() - start) / repeats;
+
+        Image image = { 0 };
+        exportFluidCPUImage(cpu, &image);
+        start = benchTime();
+        for (int r = 0; r < repeats; r++) exportFluidCPUImage(cpu, &image);
+        double export_time = (benchTime() - start) / repeats;
+
+        // Same decode getCPUImgValue does on a GL readback
+        const unsigned short* half = (const unsigned short*)image.data;
+        size_t mismatches = 0;
+        for (int y = 0; y < cpu->height; y++) {
+            for (int x = 0; x < cpu->width; x++) {
+                Vector4 v = getFluidCPUValue(cpu, x, y);
+                const unsigned short* h = half + ((size_t)y*cpu->width + x)*4;
+                float e[4] = {v.x, v.y, v.z, v.w};
+                for (int c = 0; c < 4; c++) {
+                    float decoded = convertFloat16ToNativeFloat(h[c]);
+                    // Float storage rounds on export, halves have to come back as they are
+                    if (s ? decoded != e[c] : h[c] != convertNativeFloatToFloat16(e[c])) mismatches++;
+                }
+            }
+        }
+        free(image.data);
+
+        // A substep reads a cell's four channels and writes four
+        double bytes = 2.0*getFluidCPUFieldBytes(cpu)/2;
+        printf(
+            "%-5s %10.1f %12.2f %10.1f %10.2f %12.2f %10s\n",
+            names[s], getFluidCPUFieldBytes(cpu)/1048576.0, step_times[s]*1e3, count / step_times[s] * 1e-6,
+            bytes / step_times[s] * 1e-9, export_time*1e3, mismatches ? "MISMATCH" : "exact"
+        );
+    }
+
+    // Both have run the same substeps from the same start
+    double drift = 0;
+    double speed = 0;
+    for (int y = 0; y < BENCH_HEIGHT; y++) {
+        for (int x = 0; x < BENCH_WIDTH; x++) {
+            Vector4 a = getFluidCPUValue(&cpus[0], x, y);
+            Vector4 b = getFluidCPUValue(&cpus[1], x, y);
+            drift = fmax(drift, fmax(fabsf(a.x - b.x), fabsf(a.y - b.y)));
+            speed = fmax(speed, fmax(fabsf(a.x), fabsf(a.y)));
+        }
+    }
+    printf("f16 is %.2fx f32, velocity drifted by up to %.4f of %.2f after %d substeps\n", step_times[0] / step_times[1], drift, speed, repeats + 1);
+
+    unloadFluidCPU(&cpus[0]);
+    unloadFluidCPU(&cpus[1]);
+}
+
+// Row planes against tiles at a few flow speeds. Faster flow sends the advection
+// taps further from the cell, which is where tiles should keep more of them in
+// cache. Both have to end up with the same bits.
+static void benchLayout(int repeats) {
+    static const float speeds[] = {1, 5, 20, 50};
+    static const char* names[] = {"rows", "tiles"};
+
+    printf("%-6s %-6s %10s %12s %10s %8s %8s\n", "speed", "layout", "field MB", "ms/substep", "Mcells/s", "speedup", "exact");
+    for (int v = 0; v < (int)(sizeof(speeds)/sizeof(speeds[0])); v++) {
+        FluidCPU cpus[2];
+        double times[2];
+
+        for (int l = 0; l < 2; l++) {
+            FluidCPU* cpu = &cpus[l];
+            *cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+            benchFillField(cpu);
+            size_t count = (size_t)cpu->width*cpu->height;
+            for (size_t i = 0; i < count; i++) {
+                cpu->field[0].x[i] *= speeds[v];
+                cpu->field[0].y[i] *= speeds[v];
+            }
+            if (l) setFluidCPUStorage(cpu, FLUID_CPU_STORAGE_F32_TILES);
+            stepFluidCPU(cpu);
+
+            double start = benchTime();
+            for (int r = 0; r < repeats; r++) stepFluidCPU(cpu);
+            times[l] = (benchTime() - start) / repeats;
+        }
+
+        // Same substeps from the same start
+        size_t mismatches = 0;
+        for (int y = 0; y < BENCH_HEIGHT; y++) {
+            for (int x = 0; x < BENCH_WIDTH; x++) {
+                Vector4 a = getFluidCPUValue(&cpus[0], x, y);
+                Vector4 b = getFluidCPUValue(&cpus[1], x, y);
+                if (memcmp(&a, &b, sizeof(a)) != 0) mismatches++;
+            }
+        }
+
+        for (int l = 0; l < 2; l++) {
+            printf(
+                "%-6.0f %-6s %10.1f %12.2f %10.1f %7.2fx %8s\n",
+                speeds[v], names[l], getFluidCPUFieldBytes(&cpus[l])/1048576.0, times[l]*1e3,
+                (double)BENCH_WIDTH*BENCH_HEIGHT / times[l] * 1e-6, times[0] / times[l],
+                l == 0 ? "-" : (mismatches ? "NO" : "yes")
+            );
+            unloadFluidCPU(&cpus[l]);
+        }
+    }
+}
+
+// Still air with one swirl and an emitter sweeping across, which is what most of a
+// match looks like. Sparse stepping with both thresholds at 0 has to end up the
+// same as dense, the defaults let it drift by a little.
+static void benchSparse(int repeats) {
+    static const char* names[] = {"dense", "exact", "default"};
+    FluidCPU cpus[3];
+    double times[3];
+    double awake[3];
+
+    printf("%-8s %12s %10s %8s %10s\n", "mode", "ms/substep", "awake %", "speedup", "drift");
+    for (int m = 0; m < 3; m++) {
+        FluidCPU* cpu = &cpus[m];
+        *cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+        for (int y = 0; y < cpu->height; y++) {
+            for (int x = 0; x < cpu->width; x++) {
+                size_t i = (size_t)y*cpu->width + x;
+                float r = hypotf(x - cpu->width/4.0f, y - cpu->height/2.0f);
+                float swirl = (r < 100) ? 1 - r/100 : 0;
+                cpu->field[0].x[i] = 20*swirl;
+                cpu->field[0].y[i] = -10*swirl;
+                cpu->field[0].z[i] = 1 + 0.3f*swirl;
+                cpu->field[0].w[i] = 1;
+            }
+        }
+        cpu->front = 0;
+        cpu->time = 1;
+        if (m) setFluidCPUSparse(cpu, 1);
+        if (m == 1) {
+            cpu->sleep_speed = 0;
+            cpu->sleep_change = 0;
+        }
+        cpu->emitters = bench_emitters;
+
+        double total = 0;
+        awake[m] = 0;
+        for (int r = 0; r < repeats; r++) {
+            Vector2 at = {cpu->width/2.0f + 20*r, cpu->height/3.0f};
+            bench_emitters[0] = createFluidEmitterCapsule(cpu->height, at, at, 12, (Vector2){0, 30});
+            cpu->emitter_count = 1;
+
+            double start = benchTime();
+            stepFluidCPU(cpu);
+            total += benchTime() - start;
+            awake[m] += (double)getFluidCPUAwakeCells(cpu) / ((size_t)cpu->width*cpu->height);
+        }
+        times[m] = total / repeats;
+    }
+
+    for (int m = 0; m < 3; m++) {
+        double drift = 0;
+        for (int y = 0; y < BENCH_HEIGHT; y++) {
+            for (int x = 0; x < BENCH_WIDTH; x++) {
+                Vector4 a = getFluidCPUValue(&cpus[0], x, y);
+                Vector4 b = getFluidCPUValue(&cpus[m], x, y);
+                drift = fmax(drift, fmax(fabsf(a.x - b.x), fabsf(a.y - b.y)));
+            }
+        }
+        printf(
+            "%-8s %12.2f %10.1f %7.2fx %10.4f\n",
+            names[m], times[m]*1e3, 100*awake[m] / repeats, times[0] / times[m], drift
+        );
+    }
+    for (int m = 0; m < 3; m++) unloadFluidCPU(&cpus[m]);
+}
+
+// Max speed reduction over float planes and RGBA16F, scalar against AVX2, then the
+// whole field over the pool the way pickFluidSubsteps does it every frame. Every
+// variant has to find the same speed.
+static void benchSpeed(int repeats) {
+    FluidCPU cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+    benchFillField(&cpu);
+    stepFluidCPU(&cpu);
+    size_t count = (size_t)cpu.width*cpu.height;
+
+    Image image = { 0 };
+    exportFluidCPUImage(&cpu, &image);
+    const unsigned short* half = (const unsigned short*)image.data;
+    const FluidCPUField* field = &cpu.field[cpu.front];
+
+    // Rounding to half can only move the fastest cell to its nearest half
+    float expected = maxFluidSpeedPlanesScalar(field->x, field->y, 0, count, 0);
+    float expected_half = convertFloat16ToNativeFloat(convertNativeFloatToFloat16(expected));
+
+    printf("%-8s %-8s %10s %10s %10s %8s\n", "source", "isa", "ms", "Gcells/s", "GB/s", "exact");
+    FluidCPUISA isas[2] = {FLUID_ISA_SCALAR, detectFluidCPUISA()};
+    for (int k = 0; k < 2; k++) {
+        setFluidCPUISA(isas[k]);
+        const char* isa = useFluidSpeedAVX2() ? "avx2" : "scalar";
+        float speed = 0;
+        double start = benchTime();
+        for (int r = 0; r < repeats; r++) speed = maxFluidSpeedPlanes(field->x, field->y, count);
+        double time = (benchTime() - start) / repeats;
+        printf(
+            "%-8s %-8s %10.3f %10.2f %10.2f %8s\n", "f32", isa, time*1e3,
+            count / time * 1e-9, count*2*sizeof(float) / time * 1e-9, speed == expected ? "yes" : "NO"
+        );
+
+        start = benchTime();
+        for (int r = 0; r < repeats; r++) speed = maxFluidSpeedHalves(half, count);
+        time = (benchTime() - start) / repeats;
+        printf(
+            "%-8s %-8s %10.3f %10.2f %10.2f %8s\n", "f16", isa, time*1e3,
+            count / time * 1e-9, count*4*sizeof(unsigned short) / time * 1e-9, speed == expected_half ? "yes" : "NO"
+        );
+    }
+    setFluidCPUISA(FLUID_ISA_COUNT);
+
+    float speed = 0;
+    double start = benchTime();
+    for (int r = 0; r < repeats; r++) speed = getFluidCPUMaxSpeed(&cpu);
+    double time = (benchTime() - start) / repeats;
+    printf(
+        "%-8s %-8d %10.3f %10.2f %10.2f %8s\n", "field", cpu.pool->count, time*1e3,
+        count / time * 1e-9, count*2*sizeof(float) / time * 1e-9, speed == expected ? "yes" : "NO"
+    );
+
+    // What main.c would pick for it at its best level
+    int substeps = getFluidCFLSubsteps(speed, FLUID_DEFAULT_DT*6, 1.0f, 4.0f, 1, 12);
+    printf("max speed %.2f, %d substeps at 1920x1080 with a CFL of 4\n", speed, substeps);
+
+    free(image.data);
+    unloadFluidCPU(&cpu);
+}
+
+// The field of a game level at the bench's speeds, swirls a few texels across on
+// top of the big ones so there's something to smear
+static FluidCPU createBenchAdvectionField(FluidAdvection advection, int substeps) {
+    FluidCPU cpu = createFluidCPU(960, 540, 0);
+    benchFillField(&cpu);
+    for (int y = 0; y < cpu.height; y++) {
+        for (int x = 0; x < cpu.width; x++) {
+            size_t i = (size_t)y*cpu.width + x;
+            cpu.field[0].x[i] += 4*sinf(x*0.21f)*cosf(y*0.17f);
+            cpu.field[0].y[i] += 4*cosf(x*0.19f)*sinf(y*0.23f);
+        }
+    }
+    cpu.params.advection = advection;
+    cpu.params.dt = FLUID_DEFAULT_DT*6 / substeps;
+    return cpu;
+}
+
+// Only the advection lookups of frames frames, the velocity they find goes straight
+// back into the field. The rest of a substep is the same whichever advection it
+// uses, and it isn't consistent in dt, so the two can only be told apart like this.
+static void runBenchTransport(FluidCPU* cpu, int substeps, int frames) {
+    int width = cpu->width;
+    int height = cpu->height;
+    float* scratch = malloc((size_t)width*3*sizeof(float));
+    cpu->emitter_count = 0;
+
+    for (int s = 0; s < frames*substeps; s++) {
+        FluidCPUBand band = getFluidCPUFieldBand(cpu, cpu->front);
+        FluidCPUField* dst = &cpu->field[1 - cpu->front];
+        for (int y = 0; y < height; y++) {
+            size_t row = (size_t)y*width;
+            const float* c[4];
+            const float* u[4];
+            const float* d[4];
+            getFluidCPUBandRow(&band, width, y, c);
+            getFluidCPUBandRow(&band, width, wrapFluidCPUIndex(y + 1, height), u);
+            getFluidCPUBandRow(&band, width, wrapFluidCPUIndex(y - 1, height), d);
+            advectFluidCPURow(
+                cpu, &band, y, c, u, d, dst->x + row, dst->y + row, scratch, scratch + width, scratch + 2*width, 0, width
+            );
+        }
+        cpu->front = 1 - cpu->front;
+    }
+    free(scratch);
+}
+
+// Mean |curl| of the velocity, what advection smears away first
+static double benchAdvectionDetail(FluidCPU* cpu) {
+    double curl = 0;
+    for (int y = 1; y < cpu->height - 1; y++) {
+        for (int x = 1; x < cpu->width - 1; x++) {
+            Vector4 r = getFluidCPUValue(cpu, x + 1, y);
+            Vector4 l = getFluidCPUValue(cpu, x - 1, y);
+            Vector4 u = getFluidCPUValue(cpu, x, y + 1);
+            Vector4 d = getFluidCPUValue(cpu, x, y - 1);
+            curl += fabsf(r.y - l.y - u.x + d.x);
+        }
+    }
+    return curl / ((double)(cpu->width - 2)*(cpu->height - 2));
+}
+
+// Semi-Lagrangian against MacCormack at a few substep counts, over frames frames of
+// FLUID_DEFAULT_DT*6 at 960x540. ms/frame is the whole solver. Error is how far the
+// advection alone ends up from MacCormack at 48 substeps, the closest this gets to
+// the real flow: semi-Lagrangian smears about as much whatever the substeps, it's
+// the bilinear lookup that does it. Detail is how much of the reference's curl is
+// left. Then the cheapest MacCormack at least as close as the game's 6 substeps of
+// semi-Lagrangian.
+static void benchAdvection(int frames) {
+    static const char* names[] = {"semi", "maccormack"};
+    static const int counts[] = {1, 2, 3, 4, 6, 8, 12};
+    int count_total = sizeof(counts) / sizeof(counts[0]);
+
+    FluidCPU reference = createBenchAdvectionField(FLUID_ADVECTION_MACCORMACK, 48);
+    runBenchTransport(&reference, 48, frames);
+    double reference_detail = benchAdvectionDetail(&reference);
+
+    double times[2][7];
+    double errors[2][7];
+    printf("%-11s %9s %10s %10s %8s\n", "advection", "substeps", "ms/frame", "error", "detail");
+    for (int a = 0; a < 2; a++) {
+        for (int n = 0; n < count_total; n++) {
+            FluidCPU cpu = createBenchAdvectionField((FluidAdvection)a, counts[n]);
+            double start = benchTime();
+            for (int f = 0; f < frames; f++) stepFluidCPUSubsteps(&cpu, counts[n]);
+            times[a][n] = (benchTime() - start)*1e3 / frames;
+            unloadFluidCPU(&cpu);
+
+            cpu = createBenchAdvectionField((FluidAdvection)a, counts[n]);
+            runBenchTransport(&cpu, counts[n], frames);
+            double sum = 0;
+            for (int y = 0; y < cpu.height; y++) {
+                for (int x = 0; x < cpu.width; x++) {
+                    Vector4 v = getFluidCPUValue(&cpu, x, y);
+                    Vector4 r = getFluidCPUValue(&reference, x, y);
+                    sum += (v.x - r.x)*(v.x - r.x) + (v.y - r.y)*(v.y - r.y);
+                }
+            }
+            errors[a][n] = sqrt(sum / ((size_t)cpu.width*cpu.height));
+            printf(
+                "%-11s %9d %10.2f %10.4f %7.1f%%\n", names[a], counts[n], times[a][n], errors[a][n],
+                100*benchAdvectionDetail(&cpu) / reference_detail
+            );
+            unloadFluidCPU(&cpu);
+        }
+    }
+
+    // Semi-Lagrangian at 6 is what the game runs at its best level
+    int baseline = 4;
+    for (int n = 0; n < count_total; n++) {
+        if (errors[1][n] > errors[0][baseline]) continue;
+        printf(
+            "maccormack at %d substeps is as close as semi at %d: %.2f against %.2f ms a frame, %.2fx\n",
+            counts[n], counts[baseline], times[1][n], times[0][baseline], times[0][baseline] / times[1][n]
+        );
+        break;
+    }
+    unloadFluidCPU(&reference);
+}
+
+// RMS of the divergence the projection goes by, over the fluid cells
+static double benchDivergence(FluidCPU* cpu) {
+    FluidMultigrid* mg = getFluidCPUMultigrid(cpu);
+    updateFluidCPUSolid(cpu);
+    runFluidThreadPool(cpu->pool, divergeFluidCPUJob, cpu);
+
+    const FluidMultigridLevel* level = &mg->levels[0];
+    double sum = 0;
+    size_t cells = 0;
+    for (size_t i = 0; i < (size_t)level->width*level->height; i++) {
+        if (cpu->solid[i] & FLUID_SOLID_SELF) continue;
+        sum += (double)level->rhs[i]*level->rhs[i];
+        cells++;
+    }
+    return cells ? sqrt(sum / cells) : 0;
+}
+
+// Pressure projection on a frame of the game's field at 960x540. Residual is the RMS
+// of rhs - lap(p) over the fluid after each V-cycle, and how much the cycle cut it
+// by. Then how many red-black sweeps of the top level alone it takes to get as far,
+// and the whole projection run to the default tolerance with the divergence it leaves.
+// That can't go to 0: the gradient is central like the divergence, which sees twice
+// the spacing the solve does.
+static void benchMultigrid(int cycles) {
+    if (cycles > FLUID_MULTIGRID_MAX_CYCLES) cycles = FLUID_MULTIGRID_MAX_CYCLES;
+    FluidCPU cpu = createBenchAdvectionField(FLUID_ADVECTION_SEMI_LAGRANGIAN, 6);
+    stepFluidCPUSubsteps(&cpu, 6);
+
+    FluidMultigrid* mg = getFluidCPUMultigrid(&cpu);
+    printf("%dx%d, %d levels down to %dx%d, %d threads\n", cpu.width, cpu.height, mg->level_count,
+        mg->levels[mg->level_count - 1].width, mg->levels[mg->level_count - 1].height, cpu.pool->count);
+
+    // Starts from p at 0 like a projection does
+    double divergence = benchDivergence(&cpu);
+    mg->cycles = 0;
+    solveFluidMultigrid(mg, cpu.pool);
+    float residual = getFluidMultigridRMS(mg, cpu.pool);
+    double total = 0;
+    printf("%-6s %12s %10s %10s\n", "cycle", "residual", "reduction", "ms");
+    printf("%-6d %12.4e %10s %10s\n", 0, residual, "", "");
+    for (int i = 1; i <= cycles; i++) {
+        double start = benchTime();
+        cycleFluidMultigrid(mg, cpu.pool, 0);
+        double time = benchTime() - start;
+        total += time;
+
+        float next = getFluidMultigridRMS(mg, cpu.pool);
+        printf("%-6d %12.4e %10.3f %10.3f\n", i, next, next / residual, time*1e3);
+        residual = next;
+    }
+
+    // Single grid, checked every few sweeps outside the timing
+    solveFluidMultigrid(mg, cpu.pool);
+    int sweeps = 0;
+    double single = 0;
+    float reached = getFluidMultigridRMS(mg, cpu.pool);
+    while (reached > residual && sweeps < 4000) {
+        double start = benchTime();
+        smoothFluidMultigrid(mg, cpu.pool, 0, 10);
+        single += benchTime() - start;
+        sweeps += 10;
+        reached = getFluidMultigridRMS(mg, cpu.pool);
+    }
+    printf(
+        "red-black sweeps alone: %d%s to %.4e, %.2f ms against %.2f ms, %.1fx\n", sweeps, (reached > residual) ? " (gave up)" : "",
+        reached, single*1e3, total*1e3, single / total
+    );
+
+    // What the solver runs after every substep
+    int repeats = 10;
+    mg->cycles = FLUID_MULTIGRID_CYCLES;
+    FluidCPU copy = createBenchAdvectionField(FLUID_ADVECTION_SEMI_LAGRANGIAN, 6);
+    stepFluidCPUSubsteps(&copy, 6);
+    double start = benchTime();
+    for (int r = 0; r < repeats; r++) projectFluidCPU(&cpu);
+    double time = (benchTime() - start) / repeats;
+    projectFluidCPU(&copy);
+    printf(
+        "projection to %g of the residual: %d cycles, %.2f ms, divergence rms %.4f before, %.4f after\n",
+        FLUID_MULTIGRID_TOLERANCE, copy.multigrid.residual_count - 1, time*1e3, divergence, benchDivergence(&copy)
+    );
+    unloadFluidCPU(&copy);
+    unloadFluidCPU(&cpu);
+}
+
+#define BENCH_BOUNDARY_SHAPES (50)
+
+// Bounding box of a box drawn round its centre, a texel bigger all round like
+// getEnvironmentObjFluidRect
+static Rectangle getBenchBoxRect(Rectangle box, float rotation) {
+    float s = fabsf(sinf(rotation*DEG2RAD));
+    float c = fabsf(cosf(rotation*DEG2RAD));
+    float x = c*box.width/2 + s*box.height/2;
+    float y = s*box.width/2 + c*box.height/2;
+    return (Rectangle){box.x - x - 1, box.y - y - 1, 2*x + 2, 2*y + 2};
+}
+
+static int overlapBenchRects(Rectangle a, Rectangle b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static void drawBenchBoxes(FluidCPU* cpu, const Rectangle* boxes, const float* rotations, Rectangle clip) {
+    for (int i = 0; i < BENCH_BOUNDARY_SHAPES; i++) {
+        if (!overlapBenchRects(getBenchBoxRect(boxes[i], rotations[i]), clip)) continue;
+        Vector2 origin = {boxes[i].width/2, boxes[i].height/2};
+        drawFluidCPURectanglePro(cpu, boxes[i], origin, rotations[i], RED);
+    }
+}
+
+// Boxes moving over a 1080p boundary, redrawn whole every frame and only where
+// they moved like frameUpdateFluidBoundaries, with the solid flags built again
+// after. Both have to end up the same.
+static void benchBoundary(int frames) {
+    static const int moving[] = {1, 4, 16, 50};
+    Rectangle grid = {0, 0, BENCH_WIDTH, BENCH_HEIGHT};
+    size_t cells = (size_t)BENCH_WIDTH*BENCH_HEIGHT;
+
+    printf("%d boxes, %d frames\n", BENCH_BOUNDARY_SHAPES, frames);
+    printf("%-7s %10s %10s %9s %11s %6s\n", "moving", "full ms", "dirty ms", "speedup", "dirty cells", "same");
+    for (int m = 0; m < (int)(sizeof(moving)/sizeof(moving[0])); m++) {
+        FluidCPU full = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+        FluidCPU dirty = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+        full.draw_target = FLUID_CPU_TARGET_BOUNDARY;
+        dirty.draw_target = FLUID_CPU_TARGET_BOUNDARY;
+
+        Rectangle boxes[BENCH_BOUNDARY_SHAPES];
+        float rotations[BENCH_BOUNDARY_SHAPES];
+        srand(7);
+        for (int i = 0; i < BENCH_BOUNDARY_SHAPES; i++) {
+            boxes[i] = (Rectangle){rand() % BENCH_WIDTH, rand() % BENCH_HEIGHT, 40 + rand() % 300, 6 + rand() % 30};
+            rotations[i] = rand() % 360;
+        }
+        drawBenchBoxes(&dirty, boxes, rotations, grid);
+
+        double full_time = 0;
+        double dirty_time = 0;
+        double dirty_cells = 0;
+        for (int f = 0; f < frames; f++) {
+            Rectangle was[BENCH_BOUNDARY_SHAPES];
+            for (int i = 0; i < moving[m]; i++) {
+                was[i] = getBenchBoxRect(boxes[i], rotations[i]);
+                boxes[i].x += 3*sinf(f*0.1f + i);
+                boxes[i].y += 3*cosf(f*0.13f + i);
+                rotations[i] += 2;
+            }
+
+            double start = benchTime();
+            memset(full.boundary, 0, cells*sizeof(Color));
+            markFluidCPUSolid(&full, 0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+            drawBenchBoxes(&full, boxes, rotations, grid);
+            updateFluidCPUSolid(&full);
+            full_time += benchTime() - start;
+
+            // One rectangle over where each was and is, they only move a few texels
+            start = benchTime();
+            for (int i = 0; i < moving[m]; i++) {
+                Rectangle now = getBenchBoxRect(boxes[i], rotations[i]);
+                float x0 = fminf(was[i].x, now.x);
+                float y0 = fminf(was[i].y, now.y);
+                float x1 = fmaxf(was[i].x + was[i].width, now.x + now.width);
+                float y1 = fmaxf(was[i].y + was[i].height, now.y + now.height);
+                Rectangle region = {floorf(x0), floorf(y0), ceilf(x1) - floorf(x0), ceilf(y1) - floorf(y0)};
+                clipFluidCPUDraws(&dirty, region.x, region.y, region.width, region.height);
+                clearFluidCPUBoundaryClip(&dirty);
+                drawBenchBoxes(&dirty, boxes, rotations, region);
+                dirty_cells += (double)(dirty.clip_x1 - dirty.clip_x0)*(dirty.clip_y1 - dirty.clip_y0);
+            }
+            unclipFluidCPUDraws(&dirty);
+            updateFluidCPUSolid(&dirty);
+            dirty_time += benchTime() - start;
+        }
+
+        int same = memcmp(full.boundary, dirty.boundary, cells*sizeof(Color)) == 0 && memcmp(full.solid, dirty.solid, cells) == 0;
+        printf(
+            "%-7d %10.3f %10.3f %8.1fx %10.2f%% %6s\n", moving[m], full_time / frames*1e3, dirty_time / frames*1e3,
+            full_time / dirty_time, dirty_cells / frames / cells*100, same ? "yes" : "NO"
+        );
+        unloadFluidCPU(&dirty);
+        unloadFluidCPU(&full);
+    }
+}
+
+// The boundary reads of a substep the way the kernels took them before the flags,
+// five Color taps a cell, and what they decide. Summed so none of it gets dropped.
+static unsigned int benchSolidColors(const FluidCPU* cpu) {
+    unsigned int sum = 0;
+    for (int y = 0; y < cpu->height; y++) {
+        const Color* c = cpu->boundary + (size_t)y*cpu->width;
+        const Color* u = cpu->boundary + (size_t)wrapFluidCPUIndex(y + 1, cpu->height)*cpu->width;
+        const Color* d = cpu->boundary + (size_t)wrapFluidCPUIndex(y - 1, cpu->height)*cpu->width;
+        for (int x = 1; x < cpu->width - 1; x++) {
+            int block_x = c[x - 1].r > 0 || c[x + 1].r > 0;
+            int block_y = u[x].r > 0 || d[x].r > 0;
+            sum += block_x + 2*block_y + 4*(c[x].r > 0) + 8*(c[x].g >= 128);
+        }
+    }
+    return sum;
+}
+
+// Same from the one byte a cell they read now
+static unsigned int benchSolidFlags(const FluidCPU* cpu) {
+    unsigned int sum = 0;
+    for (int y = 0; y < cpu->height; y++) {
+        const unsigned char* flags = cpu->solid + (size_t)y*cpu->width;
+        for (int x = 1; x < cpu->width - 1; x++) {
+            int block_x = (flags[x] & (FLUID_SOLID_LEFT | FLUID_SOLID_RIGHT)) != 0;
+            int block_y = (flags[x] & (FLUID_SOLID_DOWN | FLUID_SOLID_UP)) != 0;
+            sum += block_x + 2*block_y + 4*(flags[x] & FLUID_SOLID_SELF) + 8*((flags[x] & FLUID_SOLID_CLEAR) != 0);
+        }
+    }
+    return sum;
+}
+
+// What packing the boundaries into flags saves at 1080p. First the boundary reads of
+// a substep both ways on one thread, which have to decide the same, and the bytes a
+// cell each streams through memory: the three rows of Colors stay cached between
+// rows, so that's 4 against 1. Then building the flags, whole and for a box that
+// moved. Last, an arena mostly walled off, stepped dense and sparse with the
+// thresholds at 0: the solid tiles never step, and it still has to match dense bit
+// for bit.
+static void benchSolid(int repeats) {
+    FluidCPU cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+    benchFillField(&cpu);
+    double cells = (double)BENCH_WIDTH*BENCH_HEIGHT;
+
+    unsigned int colors_sum = 0;
+    unsigned int flags_sum = 0;
+    double start = benchTime();
+    for (int r = 0; r < repeats; r++) colors_sum = benchSolidColors(&cpu);
+    double colors_time = (benchTime() - start) / repeats;
+    start = benchTime();
+    for (int r = 0; r < repeats; r++) flags_sum = benchSolidFlags(&cpu);
+    double flags_time = (benchTime() - start) / repeats;
+    bench_sink += colors_sum + flags_sum;
+
+    printf("%-8s %10s %10s %12s %6s\n", "reads", "ms", "bytes/cell", "MB/substep", "same");
+    printf("%-8s %10.2f %10d %12.2f\n", "colors", colors_time*1e3, (int)sizeof(Color), cells*sizeof(Color)*1e-6);
+    printf(
+        "%-8s %10.2f %10d %12.2f %6s\n", "flags", flags_time*1e3, 1, cells*1e-6,
+        colors_sum == flags_sum ? "yes" : "NO"
+    );
+
+    start = benchTime();
+    for (int r = 0; r < repeats; r++) {
+        markFluidCPUSolid(&cpu, 0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+        updateFluidCPUSolid(&cpu);
+    }
+    double build_time = (benchTime() - start) / repeats;
+    start = benchTime();
+    for (int r = 0; r < repeats; r++) {
+        markFluidCPUSolid(&cpu, 900, 500, 964, 564);
+        updateFluidCPUSolid(&cpu);
+    }
+    double region_time = (benchTime() - start) / repeats;
+    printf("\nbuilding the flags: %.3f ms whole, %.3f ms for 64x64\n\n", build_time*1e3, region_time*1e3);
+    unloadFluidCPU(&cpu);
+
+    // Walls a quarter of the height thick top and bottom, and a pillar down the middle
+    static const char* names[] = {"dense", "sparse"};
+    FluidCPU cpus[2];
+    double times[2];
+    double awake[2];
+    for (int m = 0; m < 2; m++) {
+        FluidCPU* arena = &cpus[m];
+        *arena = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 0);
+        benchFillField(arena);
+        arena->draw_target = FLUID_CPU_TARGET_BOUNDARY;
+        drawFluidCPURectangle(arena, 0, 0, BENCH_WIDTH, BENCH_HEIGHT/4, RED);
+        drawFluidCPURectangle(arena, 0, BENCH_HEIGHT*3/4, BENCH_WIDTH, BENCH_HEIGHT/4, RED);
+        drawFluidCPURectangle(arena, BENCH_WIDTH*3/8, 0, BENCH_WIDTH/4, BENCH_HEIGHT, RED);
+        arena->draw_target = FLUID_CPU_TARGET_FIELD;
+        if (m) {
+            setFluidCPUSparse(arena, 1);
+            arena->sleep_speed = 0;
+            arena->sleep_change = 0;
+        }
+
+        double total = 0;
+        awake[m] = 0;
+        for (int r = 0; r < repeats; r++) {
+            start = benchTime();
+            stepFluidCPU(arena);
+            total += benchTime() - start;
+            awake[m] += (double)getFluidCPUAwakeCells(arena) / cells;
+        }
+        times[m] = total / repeats;
+    }
+
+    int tiles = cpus[1].sleep_tiles_x*cpus[1].sleep_tiles_y;
+    size_t plane = (size_t)BENCH_WIDTH*BENCH_HEIGHT*sizeof(float);
+    FluidCPUField* x = &cpus[0].field[cpus[0].front];
+    FluidCPUField* y = &cpus[1].field[cpus[1].front];
+    int exact = cpus[0].front == cpus[1].front
+        && memcmp(x->x, y->x, plane) == 0 && memcmp(x->y, y->y, plane) == 0
+        && memcmp(x->z, y->z, plane) == 0 && memcmp(x->w, y->w, plane) == 0;
+
+    printf("arena with %.1f%% of its tiles solid, %d substeps\n", 100.0*getFluidCPUSolidTiles(&cpus[1]) / tiles, repeats);
+    printf("%-8s %12s %10s %8s\n", "mode", "ms/substep", "awake %", "speedup");
+    for (int m = 0; m < 2; m++) {
+        printf("%-8s %12.2f %10.1f %7.2fx\n", names[m], times[m]*1e3, 100*awake[m] / repeats, times[0] / times[m]);
+    }
+    printf("same as dense: %s\n", exact ? "yes" : "NO");
+    for (int m = 0; m < 2; m++) unloadFluidCPU(&cpus[m]);
+}
+
+static int compareBenchTimes(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank on sorted times, 50 gives the median
+static double benchPercentile(double* times, int count, double percentile) {
+    int rank = (int)ceil(percentile / 100.0 * count) - 1;
+    if (rank < 0) rank = 0;
+    if (rank >= count) rank = count - 1;
+    return times[rank];
+}
+
+// Every resolution and substep count, timing each phase of a frame separately
+static void benchSweep(int frames, int json) {
+    int resolution_count = sizeof(bench_resolutions) / sizeof(bench_resolutions[0]);
+    int substep_count = sizeof(bench_substeps) / sizeof(bench_substeps[0]);
+    const char* isa = fluidCPUISAName(detectFluidCPUISA());
+    int threads = getFluidCPUCoreCount();
+    int first = 1;
+
+    double* times[BENCH_PHASE_COUNT];
+    for (int p = 0; p < BENCH_PHASE_COUNT; p++) {
+        times[p] = malloc(frames*sizeof(double));
+    }
+
+    if (json) {
+        printf("{\n  \"backend\": \"cpu\",\n  \"isa\": \"%s\",\n  \"threads\": %d,\n  \"frames\": %d,\n  \"results\": [\n", isa, threads, frames);
+    } else {
+        printf("backend,isa,threads,width,height,substeps,phase,median_ms,p99_ms\n");
+    }
+
+    for (int r = 0; r < resolution_count; r++) {
+        int width = bench_resolutions[r][0];
+        int height = bench_resolutions[r][1];
+        float scale = (float)width / BENCH_WIDTH;
+
+        FluidCPU cpu = createFluidCPU(width, height, threads);
+        Image image = { 0 };
+        float* decoded = malloc((size_t)width*height*4*sizeof(float));
+
+        for (int n = 0; n < substep_count; n++) {
+            int substeps = bench_substeps[n];
+            benchFillField(&cpu);
+
+            for (int f = 0; f < frames; f++) {
+                double start, phase[BENCH_PHASE_COUNT] = { 0 };
+
+                // Two players worth of flamethrower, sized like the game's at 1920x1080
+                start = benchTime();
+                for (int j = 0; j < 2; j++) {
+                    float aim = 7.0f*f + 180.0f*j;
+                    Rectangle rec = {(0.3f + 0.4f*j)*width, 0.5f*height, 25*scale, 4*scale};
+                    Vector2 push = {29, 0};
+                    for (int k = 0; k < 3; k++) {
+                        bench_emitters[j*3 + k] = createFluidEmitterRectanglePro(
+                            height, rec, (Vector2){0, 2*scale}, aim + 15*(k - 1), push
+                        );
+                    }
+                }
+                cpu.emitter_count = 6;
+                phase[BENCH_PHASE_INJECT] = benchTime() - start;
+
+                for (int i = 0; i < substeps; i++) {
+                    start = benchTime();
+                    stepFluidCPU(&cpu);
+                    phase[BENCH_PHASE_STEP] += benchTime() - start;
+                }
+
+                start = benchTime();
+                exportFluidCPUImage(&cpu, &image);
+                phase[BENCH_PHASE_READBACK] = benchTime() - start;
+
+                start = benchTime();
+                short int* halfs = (short int*)image.data;
+                for (size_t i = 0; i < (size_t)width*height*4; i++) {
+                    decoded[i] = convertFloat16ToNativeFloat(halfs[i]);
+                }
+                phase[BENCH_PHASE_DECODE] = benchTime() - start;
+
+                // Center and four corners per player, like frameUpdatePhysics
+                start = benchTime();
+                Vector2 force = { 0 };
+                for (int j = 0; j < 2; j++) {
+                    int x = (0.3f + 0.4f*j)*width;
+                    int y = 0.5f*height;
+                    int dx = 10*scale;
+                    int dy = 30*scale;
+                    int points[5][2] = {{x, y}, {x + dx, y + dy}, {x - dx, y + dy}, {x + dx, y - dy}, {x - dx, y - dy}};
+                    for (int k = 0; k < 5; k++) {
+                        Vector4 value = getFluidCPUValue(&cpu, points[k][0], points[k][1]);
+                        force.x += value.x / 5.0f;
+                        force.y += value.y / 5.0f;
+                    }
+                }
+                phase[BENCH_PHASE_SAMPLE] = benchTime() - start;
+
+                bench_sink = force.x + force.y + decoded[0];
+
+                for (int p = 0; p < BENCH_PHASE_COUNT; p++) {
+                    times[p][f] = phase[p]*1e3;
+                }
+            }
+
+            for (int p = 0; p < BENCH_PHASE_COUNT; p++) {
+                qsort(times[p], frames, sizeof(double), compareBenchTimes);
+                double median = benchPercentile(times[p], frames, 50);
+                double p99 = benchPercentile(times[p], frames, 99);
+
+                if (json) {
+                    printf(
+                        "%s    {\"width\": %d, \"height\": %d, \"substeps\": %d, \"phase\": \"%s\", \"median_ms\": %.4f, \"p99_ms\": %.4f}",
+                        first ? "" : ",\n", width, height, substeps, bench_phase_names[p], median, p99
+                    );
+                } else {
+                    printf(
+                        "cpu,%s,%d,%d,%d,%d,%s,%.4f,%.4f\n",
+                        isa, threads, width, height, substeps, bench_phase_names[p], median, p99
+                    );
+                }
+                first = 0;
+            }
+            fflush(stdout);
+        }
+
+        free(decoded);
+        free(image.data);
+        unloadFluidCPU(&cpu);
+    }
+
+    if (json) printf("\n  ]\n}\n");
+
+    for (int p = 0; p < BENCH_PHASE_COUNT; p++) {
+        free(times[p]);
+    }
+}
+
+// Counts results that differ from reference in any bit
+static size_t benchMismatches(const Vector2* reference, const Vector2* result, int count) {
+    size_t mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        mismatches += memcmp(&reference[i], &result[i], sizeof(Vector2)) != 0;
+    }
+    return mismatches;
+}
+
+// Velocity lookups per second from a readback-style RGBA16F image, its float32 mirror
+// and the CPU field planes, scalar against AVX2 + F16C
+static void benchSampler(int repeats) {
+    FluidCPU cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 1);
+    benchFillField(&cpu);
+    for (int i = 0; i < 4; i++) stepFluidCPU(&cpu);
+
+    Image image = { 0 };
+    exportFluidCPUImage(&cpu, &image);
+    const unsigned short* half = (const unsigned short*)image.data;
+    size_t halfs = (size_t)cpu.width*cpu.height*4;
+    float* mirror = malloc(halfs*sizeof(float));
+
+    // Mostly inside the field, some off every edge
+    Vector2* positions = malloc(BENCH_SAMPLES*sizeof(Vector2));
+    Vector2* result = malloc(BENCH_SAMPLES*sizeof(Vector2));
+    Vector2* reference[3];
+    for (int s = 0; s < 3; s++) {
+        reference[s] = malloc(BENCH_SAMPLES*sizeof(Vector2));
+    }
+    srand(1);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        positions[i].x = (rand() / (float)RAND_MAX)*(cpu.width + 20) - 10;
+        positions[i].y = (rand() / (float)RAND_MAX)*(cpu.height + 20) - 10;
+    }
+
+    // What getCPUImgValue costs per position: nearest texel, decoded one at a time
+    double start = benchTime();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            int x = positions[i].x;
+            int y = positions[i].y;
+            if (x < 0 || x >= cpu.width || y < 0 || y >= cpu.height) {
+                result[i] = (Vector2){0, 0};
+                continue;
+            }
+            size_t index = ((size_t)y*cpu.width + x)*4;
+            result[i] = (Vector2){convertFloat16ToNativeFloat(half[index]), convertFloat16ToNativeFloat(half[index + 1])};
+        }
+    }
+    printf("%-16s %-8s %8.1f Msamples/s\n", "nearest", "scalar", (double)BENCH_SAMPLES*repeats / (benchTime() - start) * 1e-6);
+
+    FluidSampleSource sources[3] = {
+        {.half = half, .width = cpu.width, .height = cpu.height},
+        {.x = mirror, .y = mirror + 1, .stride = 4, .width = cpu.width, .height = cpu.height},
+        {.x = cpu.field[cpu.front].x, .y = cpu.field[cpu.front].y, .stride = 1, .width = cpu.width, .height = cpu.height},
+    };
+    const char* source_names[3] = {"bilinear f16", "bilinear mirror", "bilinear planes"};
+    FluidCPUISA isas[2] = {FLUID_ISA_SCALAR, detectFluidCPUISA()};
+
+    for (int k = 0; k < 2; k++) {
+        setFluidCPUISA(isas[k]);
+        const char* path = useFluidSampleSIMD() ? "avx2" : "scalar";
+        if (k == 1 && !useFluidSampleSIMD()) break;
+
+        start = benchTime();
+        for (int r = 0; r < repeats; r++) {
+            decodeFluidHalfImage(half, mirror, halfs);
+        }
+        double time = (benchTime() - start) / repeats;
+        printf("%-16s %-8s %8.1f GB/s out\n", "mirror decode", path, halfs*sizeof(float) / time * 1e-9);
+
+        for (int s = 0; s < 3; s++) {
+            Vector2* out = (k == 0) ? reference[s] : result;
+
+            start = benchTime();
+            for (int r = 0; r < repeats; r++) {
+                sampleFluidVelocityBatch(&sources[s], positions, out, BENCH_SAMPLES);
+            }
+            time = (benchTime() - start) / repeats;
+
+            // Vector paths have to match scalar on the same source, and the mirror has to match f16
+            size_t mismatches = 0;
+            if (k == 1) mismatches = benchMismatches(reference[s], out, BENCH_SAMPLES);
+            else if (s == 1) mismatches = benchMismatches(reference[0], out, BENCH_SAMPLES);
+            printf("%-16s %-8s %8.1f Msamples/s  %zu mismatches\n", source_names[s], path, BENCH_SAMPLES / time * 1e-6, mismatches);
+        }
+    }
+
+    setFluidCPUISA(FLUID_ISA_COUNT);
+    free(positions);
+    free(result);
+    for (int s = 0; s < 3; s++) {
+        free(reference[s]);
+    }
+    free(mirror);
+    free(image.data);
+    unloadFluidCPU(&cpu);
+}
+
+// Summed-area table build time from a readback and from the CPU field, then region
+// queries against a per-texel loop over the same boxes
+static void benchSAT(int repeats) {
+    FluidCPU cpu = createFluidCPU(BENCH_WIDTH, BENCH_HEIGHT, 1);
+    benchFillField(&cpu);
+    for (int i = 0; i < 4; i++) stepFluidCPU(&cpu);
+
+    Image image = { 0 };
+    exportFluidCPUImage(&cpu, &image);
+
+    FluidSampleSource sources[2] = {
+        {.half = (const unsigned short*)image.data, .width = cpu.width, .height = cpu.height},
+        {.x = cpu.field[cpu.front].x, .y = cpu.field[cpu.front].y, .stride = 1, .width = cpu.width, .height = cpu.height},
+    };
+    const char* source_names[2] = {"f16 readback", "cpu field"};
+
+    FluidSAT sat = createFluidSAT(cpu.width, cpu.height, 0);
+    printf("%d threads\n", sat.pool->count);
+
+    for (int s = 0; s < 2; s++) {
+        FluidCPUISA isas[2] = {FLUID_ISA_SCALAR, detectFluidCPUISA()};
+        for (int k = 0; k < 2; k++) {
+            setFluidCPUISA(isas[k]);
+            double start = benchTime();
+            for (int r = 0; r < repeats; r++) {
+                buildFluidSAT(&sat, &sources[s]);
+            }
+            double time = (benchTime() - start) / repeats;
+            printf("%-16s %-8s %8.2f ms build\n", source_names[s], fluidCPUISAName(fluid_cpu_isa), time*1e3);
+        }
+    }
+    setFluidCPUISA(FLUID_ISA_COUNT);
+
+    // Random boxes from a few texels up to most of the field, some hanging off the edges
+    int queries = 1 << 16;
+    int (*boxes)[4] = malloc(queries*sizeof(*boxes));
+    srand(2);
+    for (int i = 0; i < queries; i++) {
+        boxes[i][2] = 1 + rand() % ((i % 64 == 0) ? cpu.width : 64);
+        boxes[i][3] = 1 + rand() % ((i % 64 == 0) ? cpu.height : 64);
+        boxes[i][0] = rand() % (cpu.width + 40) - 20 - boxes[i][2]/2;
+        boxes[i][1] = rand() % (cpu.height + 40) - 20 - boxes[i][3]/2;
+    }
+
+    FluidRegion sum = { 0 };
+    double start = benchTime();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < queries; i++) {
+            FluidRegion region = queryFluidSAT(&sat, boxes[i][0], boxes[i][1], boxes[i][2], boxes[i][3]);
+            sum.velocity.x += region.velocity.x;
+        }
+    }
+    double time = (benchTime() - start) / repeats;
+    bench_sink = sum.velocity.x;
+    printf("%-16s %8.1f Mqueries/s\n", "sat query", queries / time * 1e-6);
+
+    // Per-texel loop on the first few hundred boxes, also checks the table
+    int checked = 256;
+    double worst = 0;
+    start = benchTime();
+    for (int i = 0; i < checked; i++) {
+        double vx = 0, vy = 0, e = 0;
+        for (int y = boxes[i][1]; y < boxes[i][1] + boxes[i][3]; y++) {
+            for (int x = boxes[i][0]; x < boxes[i][0] + boxes[i][2]; x++) {
+                if (x < 0 || x >= cpu.width || y < 0 || y >= cpu.height) continue;
+                Vector4 v = getFluidCPUValue(&cpu, x, y);
+                vx += v.x;
+                vy += v.y;
+                e += (double)v.x*v.x + (double)v.y*v.y;
+            }
+        }
+        double cells = (double)boxes[i][2]*boxes[i][3];
+        FluidRegion region = queryFluidSAT(&sat, boxes[i][0], boxes[i][1], boxes[i][2], boxes[i][3]);
+        double errors[3] = {
+            fabs(region.velocity.x - vx/cells) / (fabs(vx/cells) + 1e-3),
+            fabs(region.velocity.y - vy/cells) / (fabs(vy/cells) + 1e-3),
+            fabs(region.energy - e/cells) / (fabs(e/cells) + 1e-3),
+        };
+        for (int k = 0; k < 3; k++) {
+            if (errors[k] > worst) worst = errors[k];
+        }
+    }
+    time = (benchTime() - start) / checked;
+    printf("%-16s %8.1f kqueries/s  worst relative error %.2e\n", "per-texel loop", 1e-3 / time, worst);
+
+    free(boxes);
+    unloadFluidSAT(&sat);
+    free(image.data);
+    unloadFluidCPU(&cpu);
+}
+
+// Debris packed into a block that grows with the count, on a floor between two walls.
+// Spaced a bit closer than the biggest ones are across so neighbours touch from the first
+// step, shapes and sizes off the index like the game's addSceneDebris.
+static void createBenchDebris(int count) {
+    int columns = (int)ceilf(sqrtf(2.0f*count));
+    int rows = (count + columns - 1) / columns;
+    float width = columns*BENCH_PHYSICS_SPACING;
+    float height = rows*BENCH_PHYSICS_SPACING;
+
+    PhysicsBody walls[3] = {
+        CreatePhysicsBodyRectangle((Vector2){0, 40}, width + 200, 40, 10),
+        CreatePhysicsBodyRectangle((Vector2){-width/2 - 40, -height/2}, 40, height + 200, 10),
+        CreatePhysicsBodyRectangle((Vector2){width/2 + 40, -height/2}, 40, height + 200, 10),
+    };
+    for (int i = 0; i < 3; i++) walls[i]->enabled = false;
+
+    for (int i = 0; i < count; i++) {
+        unsigned int h = (unsigned int)i*2654435761u;
+        Vector2 position = {
+            (i % columns - columns/2.0f + 0.5f)*BENCH_PHYSICS_SPACING + (float)(h % 7) - 3,
+            -(i / columns + 0.5f)*BENCH_PHYSICS_SPACING
+        };
+        float radius = 6 + (h >> 24) % 10;
+        if (i % 2) CreatePhysicsBodyPolygon(position, radius, 3 + (h >> 8) % 4, 1);
+        else CreatePhysicsBodyCircle(position, radius, 1);
+    }
+}
+
+// Somewhere between the walls and under the top of them, off the index. The floor
+// and walls are the first bodies hashed.
+static Rectangle getBenchQueryArea(const SpatialHash* hash, int index) {
+    unsigned int h = (unsigned int)index*2654435761u;
+    Rectangle floor = hash->bounds[0];
+    Rectangle wall = hash->bounds[1];
+    return (Rectangle){
+        floor.x + (h % 1024)/1024.0f*floor.width,
+        wall.y + (h >> 22)/1024.0f*wall.height,
+        48, 48
+    };
+}
+
+// Physac stepped over the pairs a spatial hash finds, against Physac's own step over
+// every pair for the counts where that finishes. Both start from the same bodies and
+// have to end up with the same ones. Then what the fluid side asks of the hash, the objects
+// under a thousand small rectangles, against checking every box.
+static void benchPhysics(int steps) {
+    int sizes = sizeof(bench_body_counts) / sizeof(bench_body_counts[0]);
+    printf("%d steps, %.0f unit cells\n", steps, BENCH_PHYSICS_CELL);
+    printf("%-8s %9s %9s %9s %9s %10s %8s %6s %9s %9s\n",
+        "bodies", "pairs", "manifolds", "hash ms", "step ms", "physac ms", "speedup", "same", "query us", "scan us");
+
+    for (int s = 0; s < sizes; s++) {
+        InitPhysics();
+        createBenchDebris(bench_body_counts[s]);
+        int count = (int)physicsBodiesCount;
+
+        PhysicsBodyData* start = malloc(count*sizeof(PhysicsBodyData));
+        PhysicsBodyData* result = malloc(count*sizeof(PhysicsBodyData));
+        for (int i = 0; i < count; i++) memcpy(&start[i], bodies[i], sizeof(PhysicsBodyData));
+
+        SceneArena counter = { 0 };
+        createSpatialHash(&counter, count, BENCH_PHYSICS_PAIRS*count, BENCH_PHYSICS_CELL);
+        SceneArena arena = createSceneArena(counter.used);
+        SpatialHash hash = createSpatialHash(&arena, count, BENCH_PHYSICS_PAIRS*count, BENCH_PHYSICS_CELL);
+
+        double hash_time = 0, step_time = 0;
+        long long pairs = 0, manifolds = 0;
+        int overflow = 0;
+        for (int k = 0; k < steps; k++) {
+            double t0 = benchTime();
+            hashPhysacBodies(&hash);
+            findSpatialHashPairs(&hash);
+            double t1 = benchTime();
+            stepPhysacPairs(hash.pairs, hash.pair_count);
+            double t2 = benchTime();
+
+            hash_time += t1 - t0;
+            step_time += t2 - t1;
+            pairs += hash.pair_count;
+            manifolds += physicsManifoldsCount;
+            overflow |= hash.pair_overflow;
+        }
+        for (int i = 0; i < count; i++) memcpy(&result[i], bodies[i], sizeof(PhysicsBodyData));
+
+        double all_time = 0;
+        const char* same = "-";
+        if (bench_body_counts[s] <= BENCH_ALL_PAIRS_MAX) {
+            for (int i = 0; i < count; i++) memcpy(bodies[i], &start[i], sizeof(PhysicsBodyData));
+
+            double t0 = benchTime();
+            for (int k = 0; k < steps; k++) PhysicsStep();
+            all_time = benchTime() - t0;
+
+            int exact = !overflow;
+            for (int i = 0; i < count; i++) exact &= memcmp(bodies[i], &result[i], sizeof(PhysicsBodyData)) == 0;
+            same = exact ? "yes" : "NO";
+        }
+
+        // Small rectangles scattered over the hashed bodies, each answered both ways
+        int queries = BENCH_PHYSICS_QUERIES;
+        long long found = 0, scanned = 0;
+        double t0 = benchTime();
+        for (int q = 0; q < queries; q++) {
+            Rectangle area = getBenchQueryArea(&hash, q);
+            found += querySpatialHash(&hash, area);
+        }
+        double query_time = benchTime() - t0;
+        t0 = benchTime();
+        for (int q = 0; q < queries; q++) {
+            Rectangle area = getBenchQueryArea(&hash, q);
+            for (int i = 0; i < hash.count; i++) scanned += isSpatialHashOverlap(hash.bounds[i], area);
+        }
+        double scan_time = benchTime() - t0;
+        if (found != scanned) same = "NO";
+
+        char all_text[16] = "-";
+        char speedup_text[16] = "-";
+        if (bench_body_counts[s] <= BENCH_ALL_PAIRS_MAX) {
+            snprintf(all_text, sizeof(all_text), "%.2f", all_time / steps*1e3);
+            snprintf(speedup_text, sizeof(speedup_text), "%.1fx", all_time / (hash_time + step_time));
+        }
+        printf("%-8d %9lld %9lld %9.3f %9.3f %10s %8s %6s %9.2f %9.2f%s\n",
+            count, pairs / steps, manifolds / steps, hash_time / steps*1e3, step_time / steps*1e3,
+            all_text, speedup_text, same, query_time / queries*1e6, scan_time / queries*1e6,
+            overflow ? "  pairs overflowed" : "");
+
+        unloadSceneArena(&arena);
+        free(start);
+        free(result);
+        ClosePhysics();
+    }
+}
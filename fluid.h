@@ -6,158 +6,507 @@
 #define GRAPHICS_API_OPENGL_33
 #include "rlgl.h"
 
+// 0 leaves the CPU solver out, for builds that only ever run on GL
+#ifndef FLUID_CPU_BACKEND
+#define FLUID_CPU_BACKEND (1)
+#endif
+
+#if FLUID_CPU_BACKEND
+#include "fluid_cpu.h"
+#endif
+#include "fluid_compute.h"
+#include "fluid_emitter.h"
+#include "fluid_readback.h"
+#include "fluid_sample.h"
+#include "fluid_sat.h"
+#include "fluid_speed.h"
+#include "fluid_timer.h"
+#include "fluid_governor.h"
+#include "fluid_projection.h"
+
 #define RENDER_FORMAT PIXELFORMAT_UNCOMPRESSED_R16G16B16A16
+#define FLUID_MAX_PROBES (64)   // Has to match uProbes in fluid_probe.glsl
+#define FLUID_SPEED_LEVELS (8)  // A quarter the size each way every level, plenty for any field
+
+// Where the solver runs, picked when the body is created
+typedef enum NV_FluidBackend {
+    FLUID_BACKEND_GL,   // fluid_comp.glsl on render textures
+    FLUID_BACKEND_CPU   // fluid_cpu.h, needs no GL context or FLUID_CPU_BACKEND
+} FluidBackend;
 
 typedef struct NV_Fluid {
-    Shader shader;
+    FluidBackend backend;
+#if FLUID_CPU_BACKEND
+    FluidCPU cpu;
+#endif
+    FluidPass pass;             // fluid_comp.glsl, see updateFluidBufferSubsteps
+    FluidCompute compute;       // Used instead of pass when there's GL 4.3
     Shader render_shader;
     RenderTexture2D boundary_tex;
-    RenderTexture2D fluid_tex;
-    RenderTexture2D fluid_tex_b;
-    Image cpu_image;
-    int sample_to_cpu;
-    int active_buffer_i;
-    int time_uniform;
-    int boundary_uniform;
-    int fluid_uniform;
+    RenderTexture2D solid_tex;      // FLUID_SOLID_* a texel, what the solver reads, see updateFluidSolid
+    Shader solid_shader;
+    int solid_boundaries_uniform;
+    Rectangle boundary_region;      // Set by beginFluidBoundaryRegion, in whole texels
+    RenderTexture2D field_tex[2];   // Ping-pong, steps go from front to the other one
+    int front;
+    FluidReadback readback;     // Whole field, only made if full_readback is set
+    int full_readback;
+    float* mirror;              // RGBA32F copy of the last full readback or a tiled CPU field
+    long long mirror_landed;    // Which readback the mirror holds
+    FluidSAT sat;               // Region sums, see updateFluidSAT
+    long long sat_landed;
+
+    // Probes gathered on the GPU so only a few pixels come back, see addFluidProbe
+    Shader probe_shader;
+    RenderTexture2D probe_tex;
+    FluidReadback probe_readback;
+    int probe_uniform;
+    int probe_fluid_uniform;
+    Vector4 probes[FLUID_MAX_PROBES];
+    int probe_count;
+    float time;
     int final_render_uniform;
+
+    // Fastest flow, reduced on the GPU so only one pixel comes back, see pickFluidSubsteps
+    Shader speed_shader;
+    int speed_input_uniform;
+    RenderTexture2D speed_levels[FLUID_SPEED_LEVELS];
+    int speed_level_count;
+    FluidReadback speed_readback;
+    int track_speed;            // Only reduced once something asks for it
+    float max_speed;            // What the last pick went by
+    int substeps;               // How many the last updateFluidBufferSubsteps ran
+
+    // Multigrid pressure solve, its levels are only made once it's switched on, see setFluidPressure
+    FluidProjection projection;
+
+    FluidParams params;         // Solver constants, see setFluidParams
+    FluidTimer solver_timer;    // See beginFluidSolverTiming
+    FluidTimer submit_timer;    // CPU time spent issuing the GL substeps
+
+    // Read by every substep, see addFluidEmitter
+    FluidEmitter emitters[FLUID_MAX_EMITTERS];
+    int emitter_count;
+    int emitters_dirty;         // GL uploads them on the next step
+
     Rectangle bounds;
     int x_resolution;
     int y_resolution;
 } FluidBody;
 
+// Half float velocity texture with its own framebuffer, raylib's render textures are 8 bit
+static RenderTexture2D loadFluidFieldTexture(int width, int height) {
+    RenderTexture2D target = { 0 };
+
+    target.id = rlLoadFramebuffer();
+    rlEnableFramebuffer(target.id);
+    target.texture.id = rlLoadTexture(0, width, height, RENDER_FORMAT, 1);
+    SetTextureFilter(target.texture, TEXTURE_FILTER_TRILINEAR);
+    target.texture.width = width;
+    target.texture.height = height;
+    target.texture.format = RENDER_FORMAT;
+    target.texture.mipmaps = 1;
+
+    rlFramebufferAttach(
+        target.id, 
+        target.texture.id,
+        RL_ATTACHMENT_COLOR_CHANNEL0, 
+        RL_ATTACHMENT_TEXTURE2D, 
+        0
+    );
+    rlDisableFramebuffer();
+
+    return target;
+}
+
+// RGBA32F with its own framebuffer, for results that have to come back exactly
+static RenderTexture2D loadFluidFloatTarget(int width, int height) {
+    RenderTexture2D target = { 0 };
+
+    target.id = rlLoadFramebuffer();
+    rlEnableFramebuffer(target.id);
+    target.texture.id = rlLoadTexture(0, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+    target.texture.width = width;
+    target.texture.height = height;
+    target.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+    target.texture.mipmaps = 1;
+
+    rlFramebufferAttach(
+        target.id,
+        target.texture.id,
+        RL_ATTACHMENT_COLOR_CHANNEL0,
+        RL_ATTACHMENT_TEXTURE2D,
+        0
+    );
+    rlDisableFramebuffer();
+
+    return target;
+}
+
+// A quarter of the field each way, then a quarter of that, down to one pixel
+static void loadFluidSpeedLevels(FluidBody* fluid) {
+    int width = fluid->x_resolution;
+    int height = fluid->y_resolution;
+    fluid->speed_level_count = 0;
+    do {
+        width = (width + 3)/4;
+        height = (height + 3)/4;
+        fluid->speed_levels[fluid->speed_level_count++] = loadFluidFloatTarget(width, height);
+    } while ((width > 1 || height > 1) && fluid->speed_level_count < FLUID_SPEED_LEVELS);
+}
+
+static void unloadFluidSpeedLevels(FluidBody* fluid) {
+    for (int i = 0; i < fluid->speed_level_count; i++) {
+        UnloadRenderTexture(fluid->speed_levels[i]);
+    }
+    fluid->speed_level_count = 0;
+}
+
+// One byte a texel for the solid flags
+static RenderTexture2D loadFluidSolidTarget(int width, int height) {
+    RenderTexture2D target = { 0 };
+
+    target.id = rlLoadFramebuffer();
+    rlEnableFramebuffer(target.id);
+    target.texture.id = rlLoadTexture(0, width, height, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE, 1);
+    target.texture.width = width;
+    target.texture.height = height;
+    target.texture.format = PIXELFORMAT_UNCOMPRESSED_GRAYSCALE;
+    target.texture.mipmaps = 1;
+
+    rlFramebufferAttach(
+        target.id,
+        target.texture.id,
+        RL_ATTACHMENT_COLOR_CHANNEL0,
+        RL_ATTACHMENT_TEXTURE2D,
+        0
+    );
+    rlDisableFramebuffer();
+
+    return target;
+}
+
+// Builds the flags again from boundary_tex where it changed, x0 to x1 - 1 and y0
+// to y1 - 1 in draw space, and a texel further each way for the neighbours that see
+// it. Past an edge it wraps round, so that takes the whole way across.
+static void updateFluidSolid(FluidBody* fluid, int x0, int y0, int x1, int y1) {
+    x0--;
+    y0--;
+    x1++;
+    y1++;
+    if (x0 < 0 || x1 > fluid->x_resolution) {
+        x0 = 0;
+        x1 = fluid->x_resolution;
+    }
+    if (y0 < 0 || y1 > fluid->y_resolution) {
+        y0 = 0;
+        y1 = fluid->y_resolution;
+    }
+
+    BeginTextureMode(fluid->solid_tex);
+    BeginScissorMode(x0, y0, x1 - x0, y1 - y0);
+    rlDisableColorBlend();
+    BeginShaderMode(fluid->solid_shader);
+    SetShaderValueTexture(fluid->solid_shader, fluid->solid_boundaries_uniform, fluid->boundary_tex.texture);
+    DrawRectangle(0, 0, fluid->x_resolution, fluid->y_resolution, WHITE);
+    EndShaderMode();
+    rlEnableColorBlend();
+    EndScissorMode();
+    EndTextureMode();
+
+    // Texels count up from the bottom
+    if (fluid->compute.sparse) {
+        wakeFluidComputeTileRect(&fluid->compute, x0, fluid->y_resolution - y1, x1 - 1, fluid->y_resolution - 1 - y0);
+    }
+}
+
+// Two float targets for every multigrid level of the field, and the residual history
+static void loadFluidProjectionLevels(FluidBody* fluid) {
+    FluidProjection* projection = &fluid->projection;
+    int widths[FLUID_MULTIGRID_LEVELS];
+    int heights[FLUID_MULTIGRID_LEVELS];
+    projection->level_count = getFluidMultigridSizes(fluid->x_resolution, fluid->y_resolution, widths, heights);
+    for (int i = 0; i < projection->level_count; i++) {
+        projection->levels[i][0] = loadFluidFloatTarget(widths[i], heights[i]);
+        projection->levels[i][1] = loadFluidFloatTarget(widths[i], heights[i]);
+        projection->current[i] = 0;
+    }
+    projection->history = loadFluidFloatTarget(FLUID_MULTIGRID_MAX_CYCLES + 1, 1);
+    projection->history_readback = createFluidReadback(FLUID_MULTIGRID_MAX_CYCLES + 1, 1, GL_FLOAT);
+    projection->needed = projection->cycles;
+}
+
+static void unloadFluidProjectionLevels(FluidBody* fluid) {
+    FluidProjection* projection = &fluid->projection;
+    if (projection->level_count == 0) return;
+    for (int i = 0; i < projection->level_count; i++) {
+        UnloadRenderTexture(projection->levels[i][0]);
+        UnloadRenderTexture(projection->levels[i][1]);
+    }
+    UnloadRenderTexture(projection->history);
+    unloadFluidReadback(&projection->history_readback);
+    projection->history_readback = (FluidReadback){ 0 };
+    projection->level_count = 0;
+}
+
 FluidBody createFluidBody(
     int x_resolution,
     int y_resolution,
     int x_position,
     int y_position,
     int width,
-    int height
+    int height,
+    FluidBackend backend
 ) {
     FluidBody fluid = { 0 };
+    fluid.backend = backend;
 
-    // Sampler that yoinks the render texture from the GPU
-    fluid.sample_to_cpu = 0;
-    fluid.cpu_image = GenImageColor(x_resolution, y_resolution, BLANK);
-    fluid.cpu_image.width = x_resolution;
-    fluid.cpu_image.height = y_resolution;
-    fluid.cpu_image.format = PIXELFORMAT_UNCOMPRESSED_R16G16B16A16;
+#if !FLUID_CPU_BACKEND
+    if (backend == FLUID_BACKEND_CPU) {
+        TraceLog(LOG_WARNING, "FLUID: Built without the CPU backend, using GL");
+        fluid.backend = FLUID_BACKEND_GL;
+    }
+#else
+    // CPU backend keeps everything in its own buffers, nothing is loaded on the GPU
+    if (backend == FLUID_BACKEND_CPU) {
+        fluid.x_resolution = x_resolution;
+        fluid.y_resolution = y_resolution;
+        fluid.bounds = (Rectangle){x_position, y_position, width, height};
+        fluid.cpu = createFluidCPU(x_resolution, y_resolution, 0);
+        fluid.params = fluid.cpu.params;
+        fluid.solver_timer = createFluidTimer(0);
+        return fluid;
+    }
+#endif
 
     // Load params
     fluid.x_resolution = x_resolution;
     fluid.y_resolution = y_resolution;
     fluid.bounds = (Rectangle){x_position, y_position, width, height};
 
-    // Create the textures
-    fluid.fluid_tex = LoadRenderTexture(x_resolution, y_resolution);
-    fluid.fluid_tex.id = rlLoadFramebuffer();
-    rlEnableFramebuffer(fluid.fluid_tex.id);
-    fluid.fluid_tex.texture.id = rlLoadTexture(0, x_resolution, y_resolution, RENDER_FORMAT, 1);
-    SetTextureFilter(fluid.fluid_tex.texture, TEXTURE_FILTER_TRILINEAR);
-    fluid.fluid_tex.texture.width = x_resolution;
-    fluid.fluid_tex.texture.height = y_resolution;
-    fluid.fluid_tex.texture.format = RENDER_FORMAT;
-    fluid.fluid_tex.texture.mipmaps = 1;
+    // Create the textures, the first step reads field_tex[0]
+    fluid.field_tex[0] = loadFluidFieldTexture(x_resolution, y_resolution);
+    fluid.field_tex[1] = loadFluidFieldTexture(x_resolution, y_resolution);
+    fluid.front = 0;
+    fluid.boundary_tex = LoadRenderTexture(x_resolution, y_resolution);
+    fluid.solid_tex = loadFluidSolidTarget(x_resolution, y_resolution);
 
-    rlFramebufferAttach(
-        fluid.fluid_tex.id, 
-        fluid.fluid_tex.texture.id,
-        RL_ATTACHMENT_COLOR_CHANNEL0, 
-        RL_ATTACHMENT_TEXTURE2D, 
-        0
-    );
+    // Load shaders, the solver's uniforms all go up with the substeps
+    fluid.pass = loadFluidPass("fluid_comp.glsl");
+    fluid.compute = loadFluidCompute("fluid_compute.glsl");
+    if (fluid.compute.program) loadFluidComputeTiles(&fluid.compute, "fluid_tiles.glsl");
+    fluid.render_shader = LoadShader(0, "fluid_render.glsl");
+    fluid.emitters_dirty = 1;
+    fluid.params = (FluidParams){
+        .dt = FLUID_DEFAULT_DT,
+        .k = FLUID_DEFAULT_K,
+        .viscosity = FLUID_DEFAULT_VISCOSITY,
+        .cell_size = (float)FLUID_REFERENCE_WIDTH / x_resolution,
+    };
 
-    rlDisableFramebuffer();
+    // Get render uniform
+    fluid.final_render_uniform = GetShaderLocation(fluid.render_shader, "uFluid");
 
-    fluid.fluid_tex_b = LoadRenderTexture(x_resolution, y_resolution);
-    fluid.fluid_tex_b.id = rlLoadFramebuffer();
-    rlEnableFramebuffer(fluid.fluid_tex_b.id);
-    fluid.fluid_tex_b.texture.id = rlLoadTexture(0, x_resolution, y_resolution, RENDER_FORMAT, 1);
-    SetTextureFilter(fluid.fluid_tex_b.texture, TEXTURE_FILTER_TRILINEAR);
-    fluid.fluid_tex_b.texture.width = x_resolution;
-    fluid.fluid_tex_b.texture.height = y_resolution;
-    fluid.fluid_tex_b.texture.format = RENDER_FORMAT;
-    fluid.fluid_tex_b.texture.mipmaps = 1;
+    // Probe gather writes one float pixel per probe
+    fluid.probe_shader = LoadShader(0, "fluid_probe.glsl");
+    fluid.probe_uniform = GetShaderLocation(fluid.probe_shader, "uProbes");
+    fluid.probe_fluid_uniform = GetShaderLocation(fluid.probe_shader, "uFluid");
 
+    fluid.probe_tex.id = rlLoadFramebuffer();
+    rlEnableFramebuffer(fluid.probe_tex.id);
+    fluid.probe_tex.texture.id = rlLoadTexture(0, FLUID_MAX_PROBES, 1, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+    fluid.probe_tex.texture.width = FLUID_MAX_PROBES;
+    fluid.probe_tex.texture.height = 1;
+    fluid.probe_tex.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+    fluid.probe_tex.texture.mipmaps = 1;
     rlFramebufferAttach(
-        fluid.fluid_tex_b.id, 
-        fluid.fluid_tex_b.texture.id,
-        RL_ATTACHMENT_COLOR_CHANNEL0, 
-        RL_ATTACHMENT_TEXTURE2D, 
+        fluid.probe_tex.id,
+        fluid.probe_tex.texture.id,
+        RL_ATTACHMENT_COLOR_CHANNEL0,
+        RL_ATTACHMENT_TEXTURE2D,
         0
     );
     rlDisableFramebuffer();
 
-    fluid.fluid_uniform = GetShaderLocation(fluid.shader, "uFluid");
-    SetShaderValueTexture(fluid.shader, fluid.fluid_uniform, fluid.fluid_tex.texture);
+    fluid.probe_readback = createFluidReadback(FLUID_MAX_PROBES, 1, GL_FLOAT);
 
-    // Set the double buffering
-    fluid.active_buffer_i = 1;
-    // 1 -> fluid_tex
-    // 0 -> fluid_tex_b
+    fluid.speed_shader = LoadShader(0, "fluid_speed.glsl");
+    fluid.speed_input_uniform = GetShaderLocation(fluid.speed_shader, "uInput");
+    loadFluidSpeedLevels(&fluid);
+    fluid.speed_readback = createFluidReadback(1, 1, GL_FLOAT);
 
-    // Load shader
-    fluid.shader = LoadShader(0, "fluid_comp.glsl");
-    fluid.render_shader = LoadShader(0, "fluid_render.glsl");
+    fluid.projection = loadFluidProjection("fluid_projection.glsl");
 
-    // Set time uniform
-    float time = 0.0;
-    fluid.time_uniform = GetShaderLocation(fluid.shader, "uTime");
-    SetShaderValue(fluid.shader, fluid.time_uniform, &time, SHADER_UNIFORM_INT);
+    // Nothing's solid until the boundaries are drawn
+    fluid.solid_shader = LoadShader(0, "fluid_solid.glsl");
+    fluid.solid_boundaries_uniform = GetShaderLocation(fluid.solid_shader, "uBoundaries");
+    updateFluidSolid(&fluid, 0, 0, x_resolution, y_resolution);
 
-    // Set uniform for boundaries
-    fluid.boundary_uniform = GetShaderLocation(fluid.shader, "uBoundaries");
-    fluid.boundary_tex = LoadRenderTexture(x_resolution, y_resolution);
-
-    // Get render uniform
-    fluid.final_render_uniform = GetShaderLocation(fluid.render_shader, "uFluid");
+    fluid.solver_timer = createFluidTimer(1);
+    fluid.submit_timer = createFluidTimer(0);
 
     return fluid;
 }
 
 void unloadFluidBody (FluidBody* fluid) {
-    UnloadShader(fluid->shader);
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        if (fluid->sat.vx) unloadFluidSAT(&fluid->sat);
+        unloadFluidCPU(&fluid->cpu);
+        unloadFluidTimer(&fluid->solver_timer);
+        free(fluid->mirror);
+        return;
+    }
+#endif
+
+    unloadFluidPass(&fluid->pass);
+    unloadFluidCompute(&fluid->compute);
     UnloadShader(fluid->render_shader);
 
-    UnloadImage(fluid->cpu_image);
+    if (fluid->full_readback) unloadFluidReadback(&fluid->readback);
+    free(fluid->mirror);
+    if (fluid->sat.vx) unloadFluidSAT(&fluid->sat);
+    unloadFluidReadback(&fluid->probe_readback);
+    unloadFluidTimer(&fluid->solver_timer);
+    UnloadShader(fluid->probe_shader);
+    rlUnloadFramebuffer(fluid->probe_tex.id);
+    rlUnloadTexture(fluid->probe_tex.texture.id);
+    UnloadShader(fluid->speed_shader);
+    unloadFluidSpeedLevels(fluid);
+    unloadFluidReadback(&fluid->speed_readback);
+    unloadFluidProjection(&fluid->projection);
+    unloadFluidProjectionLevels(fluid);
 
-    UnloadRenderTexture(fluid->fluid_tex);
-    UnloadRenderTexture(fluid->fluid_tex_b);
+    UnloadRenderTexture(fluid->field_tex[0]);
+    UnloadRenderTexture(fluid->field_tex[1]);
     UnloadRenderTexture(fluid->boundary_tex);
+    UnloadRenderTexture(fluid->solid_tex);
+    UnloadShader(fluid->solid_shader);
+}
+
+// Builds the shaders again from their files, anything that fails is left as it was
+void reloadFluidShaders(FluidBody* fluid) {
+    if (fluid->backend == FLUID_BACKEND_CPU) return;
+
+    FluidPass pass = loadFluidPass("fluid_comp.glsl");
+    if (pass.program) {
+        unloadFluidPass(&fluid->pass);
+        fluid->pass = pass;
+    }
+
+    FluidCompute compute = loadFluidCompute("fluid_compute.glsl");
+    if (compute.program) {
+        loadFluidComputeTiles(&compute, "fluid_tiles.glsl");
+        int sparse = fluid->compute.sparse;
+        unloadFluidCompute(&fluid->compute);
+        fluid->compute = compute;
+        setFluidComputeSparse(&fluid->compute, sparse, fluid->x_resolution, fluid->y_resolution);
+    }
+
+    Shader render_shader = LoadShader(0, "fluid_render.glsl");
+    if (IsShaderValid(render_shader)) {
+        UnloadShader(fluid->render_shader);
+        fluid->render_shader = render_shader;
+        fluid->final_render_uniform = GetShaderLocation(fluid->render_shader, "uFluid");
+    }
+
+    Shader speed_shader = LoadShader(0, "fluid_speed.glsl");
+    if (IsShaderValid(speed_shader)) {
+        UnloadShader(fluid->speed_shader);
+        fluid->speed_shader = speed_shader;
+        fluid->speed_input_uniform = GetShaderLocation(fluid->speed_shader, "uInput");
+    }
+
+    Shader solid_shader = LoadShader(0, "fluid_solid.glsl");
+    if (IsShaderValid(solid_shader)) {
+        UnloadShader(fluid->solid_shader);
+        fluid->solid_shader = solid_shader;
+        fluid->solid_boundaries_uniform = GetShaderLocation(fluid->solid_shader, "uBoundaries");
+        updateFluidSolid(fluid, 0, 0, fluid->x_resolution, fluid->y_resolution);
+    }
+
+    // Levels and cycles stay, only the program changes
+    FluidProjection projection = loadFluidProjection("fluid_projection.glsl");
+    if (projection.program) {
+        unloadFluidProjection(&fluid->projection);
+        fluid->projection.program = projection.program;
+        fluid->projection.vao = projection.vao;
+        fluid->projection.uniforms = projection.uniforms;
+    }
+
+    fluid->emitters_dirty = 1;
+}
+
+// Averages every probe into probe_tex and starts reading it back
+static void gatherFluidProbes(FluidBody* fluid) {
+    pollFluidReadback(&fluid->probe_readback);
+    if (fluid->probe_count == 0) return;
+
+    BeginTextureMode(fluid->probe_tex);
+    // Averages have to land as they are, not blended by their w
+    rlDisableColorBlend();
+    BeginShaderMode(fluid->probe_shader);
+    SetShaderValueV(fluid->probe_shader, fluid->probe_uniform, fluid->probes, SHADER_UNIFORM_VEC4, fluid->probe_count);
+    SetShaderValueTexture(
+        fluid->probe_shader,
+        fluid->probe_fluid_uniform,
+        fluid->field_tex[fluid->front].texture
+    );
+    DrawRectangle(0, 0, fluid->probe_count, 1, WHITE);
+    EndShaderMode();
+    rlEnableColorBlend();
+    EndTextureMode();
 
-    rlUnloadFramebuffer(fluid->fluid_tex.id);
-    rlUnloadFramebuffer(fluid->fluid_tex_b.id);
-    rlUnloadTexture(fluid->fluid_tex.texture.id);
-    rlUnloadTexture(fluid->fluid_tex_b.texture.id);
+    queueFluidReadback(&fluid->probe_readback, fluid->probe_tex.id);
+}
+
+// Takes the field down the chain of levels to one pixel and starts reading it back
+static void reduceFluidSpeed(FluidBody* fluid) {
+    pollFluidReadback(&fluid->speed_readback);
+    if (!fluid->track_speed || fluid->speed_level_count == 0) return;
+
+    Texture2D input = fluid->field_tex[fluid->front].texture;
+    for (int i = 0; i < fluid->speed_level_count; i++) {
+        RenderTexture2D* level = &fluid->speed_levels[i];
+        BeginTextureMode(*level);
+        rlDisableColorBlend();
+        BeginShaderMode(fluid->speed_shader);
+        SetShaderValueTexture(fluid->speed_shader, fluid->speed_input_uniform, input);
+        DrawRectangle(0, 0, level->texture.width, level->texture.height, WHITE);
+        EndShaderMode();
+        rlEnableColorBlend();
+        EndTextureMode();
+        input = level->texture;
+    }
+
+    queueFluidReadback(&fluid->speed_readback, fluid->speed_levels[fluid->speed_level_count - 1].id);
 }
 
 // Draw the fluid
 void drawFluidBody(FluidBody* fluid) {
-    fluid->sample_to_cpu = (fluid->sample_to_cpu + 1) % 2;
-    // Runs the rendering pass
-    BeginShaderMode(fluid->render_shader);
-    // Would be better to do this with two pointers (front and back buffer) but Im lazy
-    if (fluid->active_buffer_i) {
-        SetShaderValueTexture(fluid->render_shader, fluid->final_render_uniform, fluid->fluid_tex.texture);
-        if (fluid->sample_to_cpu == 0) {
-            UnloadImage(fluid->cpu_image);
-            fluid->cpu_image = LoadImageFromTexture(
-                fluid->fluid_tex.texture
-            );
-        }
-    } else {
-        SetShaderValueTexture(fluid->render_shader, fluid->final_render_uniform, fluid->fluid_tex_b.texture);
-        if (fluid->sample_to_cpu == 0) {
-            UnloadImage(fluid->cpu_image);
-            fluid->cpu_image = LoadImageFromTexture(
-                fluid->fluid_tex_b.texture
-            );
+    // Nothing to draw or read back, the CPU field is read directly
+    if (fluid->backend == FLUID_BACKEND_CPU) return;
+
+    gatherFluidProbes(fluid);
+    reduceFluidSpeed(fluid);
+
+    // Pick up whatever read has finished, then start one for this frame
+    if (fluid->full_readback) {
+        if (fluid->readback.width == 0) {
+            fluid->readback = createFluidReadback(fluid->x_resolution, fluid->y_resolution, GL_HALF_FLOAT);
         }
+        pollFluidReadback(&fluid->readback);
+        queueFluidReadback(&fluid->readback, fluid->field_tex[fluid->front].id);
     }
 
+    // Runs the rendering pass
+    Texture2D front = fluid->field_tex[fluid->front].texture;
+    BeginShaderMode(fluid->render_shader);
+    SetShaderValueTexture(fluid->render_shader, fluid->final_render_uniform, front);
+
     DrawTexturePro(
-        fluid->fluid_tex.texture,
-        (Rectangle){0, 0, fluid->fluid_tex.texture.width, fluid->fluid_tex.texture.height},
+        front,
+        (Rectangle){0, 0, front.width, front.height},
         fluid->bounds,
         (Vector2){fluid->bounds.width / 2, fluid->bounds.height / 2},
         0.0,
@@ -168,86 +517,511 @@ void drawFluidBody(FluidBody* fluid) {
     EndShaderMode();
 }
 
-// Draws the fluid back to it's own texture 
-void updateFluidBuffer(FluidBody* fluid) {
-    BeginShaderMode(fluid->shader);
-    // fluid_tex
-    if (fluid->active_buffer_i) {
-        BeginTextureMode(fluid->fluid_tex_b);
-        ClearBackground(BLANK);
-        DrawTexturePro(
-            fluid->fluid_tex.texture,
-            (Rectangle){0, fluid->y_resolution, fluid->x_resolution, -fluid->y_resolution},
-            (Rectangle){0, 0, fluid->x_resolution, fluid->y_resolution},
-            (Vector2){0, 0},
-            0.0,
-            BLANK
-        );
-        EndTextureMode();
-        fluid->active_buffer_i = 0;
-    } 
-    // fluid_tex_b
-    else {
-        BeginTextureMode(fluid->fluid_tex);
-        ClearBackground(BLANK);
-        DrawTexturePro(
-            fluid->fluid_tex_b.texture,
-            (Rectangle){0, fluid->y_resolution, fluid->x_resolution, -fluid->y_resolution},
-            (Rectangle){0, 0, fluid->x_resolution, fluid->y_resolution},
-            (Vector2){0, 0},
-            0.0,
-            BLANK
-        );
+// Projects the front field into the back one and flips them
+static void projectFluidBodyGL(FluidBody* fluid) {
+    runFluidProjection(
+        &fluid->projection,
+        fluid->field_tex[fluid->front].texture.id,
+        fluid->field_tex[!fluid->front].id,
+        fluid->solid_tex.texture.id,
+        fluid->params.cell_size
+    );
+    fluid->front = !fluid->front;
+}
 
-        EndTextureMode();
-        fluid->active_buffer_i = 1;
-    }
+// Runs the substeps on GL, as few compute dispatches as it takes or one pass each.
+// Nothing goes through raylib's batch, and its state is put back after. Projection
+// comes after every substep, so compute shaders only do one a dispatch then.
+static void stepFluidBodyGL(FluidBody* fluid, int substeps) {
+    beginFluidTimer(&fluid->submit_timer);
+    unsigned int solid = fluid->solid_tex.texture.id;
 
-    EndShaderMode();
+    // The first substeps reset the whole field
+    int project = fluid->params.pressure == FLUID_PRESSURE_PROJECTION && fluid->projection.level_count > 0 && fluid->time >= 0.1;
+
+    if (fluid->compute.program) {
+        FluidPassState state = getFluidPassState();
+        beginFluidCompute(&fluid->compute, fluid->params, fluid->time, fluid->x_resolution, fluid->y_resolution);
+        if (fluid->emitters_dirty) setFluidComputeEmitters(&fluid->compute, fluid->emitters, fluid->emitter_count);
 
-    if (fluid->active_buffer_i) {
-        SetShaderValueTexture(fluid->shader, fluid->fluid_uniform, fluid->fluid_tex.texture);
+        int sparse = fluid->compute.sparse && fluid->time >= 0.1 && !project;
+        int most = project ? 1 : FLUID_COMPUTE_SUBSTEPS;
+        while (substeps > 0) {
+            int count = (substeps < most) ? substeps : most;
+            RenderTexture2D* front = &fluid->field_tex[fluid->front];
+            RenderTexture2D* back = &fluid->field_tex[!fluid->front];
+            if (sparse) {
+                dispatchFluidComputeSparse(&fluid->compute, front->texture.id, back->texture.id, solid, count);
+            } else {
+                dispatchFluidCompute(
+                    &fluid->compute,
+                    front->texture.id,
+                    back->texture.id,
+                    solid,
+                    fluid->x_resolution,
+                    fluid->y_resolution,
+                    count
+                );
+            }
+            fluid->front = !fluid->front;
+            substeps -= count;
+
+            if (project) {
+                projectFluidBodyGL(fluid);
+                fluid_gl.UseProgram(fluid->compute.program);
+            }
+        }
+        endFluidCompute();
+        if (project) endFluidPasses(state);
+        if (fluid->compute.sparse && !sparse) wakeFluidComputeTiles(&fluid->compute);
     } else {
-        SetShaderValueTexture(fluid->shader, fluid->fluid_uniform, fluid->fluid_tex_b.texture);
+        FluidPassState state = beginFluidPasses(&fluid->pass, solid, fluid->x_resolution, fluid->y_resolution);
+        setFluidSolverParams(&fluid->pass.uniforms, fluid->params, fluid->time, fluid->x_resolution, fluid->y_resolution);
+        if (fluid->emitters_dirty) setFluidSolverEmitters(&fluid->pass.uniforms, fluid->emitters, fluid->emitter_count);
+
+        for (int i = 0; i < substeps; i++) {
+            runFluidPass(fluid->field_tex[fluid->front].texture.id, fluid->field_tex[!fluid->front].id);
+            fluid->front = !fluid->front;
+
+            if (project) {
+                projectFluidBodyGL(fluid);
+                bindFluidPasses(&fluid->pass, solid, fluid->x_resolution, fluid->y_resolution);
+            }
+        }
+        endFluidPasses(state);
+    }
+
+    fluid->emitters_dirty = 0;
+    endFluidTimer(&fluid->submit_timer);
+}
+
+// Steps the fluid once
+void updateFluidBuffer(FluidBody* fluid) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.emitters = fluid->emitters;
+        fluid->cpu.emitter_count = fluid->emitter_count;
+        stepFluidCPU(&fluid->cpu);
+        return;
     }
+#endif
+    stepFluidBodyGL(fluid, 1);
+}
+
+// Same as calling updateFluidBuffer that many times, but on GL the setup is only
+// done once and compute shaders fit a few substeps in each pass. The CPU can run
+// them in row bands, see stepFluidCPUSubsteps.
+void updateFluidBufferSubsteps(FluidBody* fluid, int substeps) {
+    fluid->substeps = substeps;
+    if (fluid->backend == FLUID_BACKEND_GL) {
+        stepFluidBodyGL(fluid, substeps);
+        return;
+    }
+
+#if FLUID_CPU_BACKEND
+    fluid->cpu.emitters = fluid->emitters;
+    fluid->cpu.emitter_count = fluid->emitter_count;
+    stepFluidCPUSubsteps(&fluid->cpu, substeps);
+#endif
 }
 
 void setFluidUniforms(FluidBody* fluid, float* time) {
-    SetShaderValue(fluid->shader, fluid->time_uniform, time, SHADER_UNIFORM_FLOAT);
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.time = *time;
+        return;
+    }
+#endif
+
+    fluid->time = *time;
+}
+
+// Cell size comes from the resolution and stays put, so only these can change
+void setFluidParams(FluidBody* fluid, float dt, float k, float viscosity) {
+    FluidParams params = fluid->params;
+    params.dt = dt;
+    params.k = k;
+    params.viscosity = viscosity;
+
+    fluid->params = params;
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) fluid->cpu.params = params;
+#endif
+}
+
+#if FLUID_CPU_BACKEND
+// How the CPU backend keeps its field, GL always has RGBA16F textures
+void setFluidStorage(FluidBody* fluid, FluidCPUStorage storage) {
+    if (fluid->backend == FLUID_BACKEND_CPU) setFluidCPUStorage(&fluid->cpu, storage);
+}
+#endif
+
+// Only steps the parts of the field that are moving or next to something that is.
+// On GL that needs compute shaders, the fragment solver always does everything.
+void setFluidSparse(FluidBody* fluid, int sparse) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        setFluidCPUSparse(&fluid->cpu, sparse);
+        return;
+    }
+#endif
+    setFluidComputeSparse(&fluid->compute, sparse, fluid->x_resolution, fluid->y_resolution);
+}
+
+// MacCormack advection keeps the detail semi-Lagrangian smears away, for about twice
+// the lookups. The substeps still have to be short enough for the trace back, it's
+// first order either way. See advectFluidCPUMacCormack in fluid_cpu.h.
+void setFluidAdvection(FluidBody* fluid, FluidAdvection advection) {
+    fluid->params.advection = advection;
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) fluid->cpu.params.advection = advection;
+#endif
+}
+
+// Projection solves for the pressure that takes the divergence out of the flow after
+// every substep, with multigrid V-cycles that go round solids. The density push
+// still runs, so it's on top of what k does. Costs a few passes over the field and
+// its levels a substep, see fluid_multigrid.h. GL needs its level targets for it,
+// they're made here the first time.
+void setFluidPressure(FluidBody* fluid, FluidPressure pressure) {
+    fluid->params.pressure = pressure;
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.params.pressure = pressure;
+        return;
+    }
+#endif
+    if (pressure == FLUID_PRESSURE_PROJECTION && fluid->projection.program && fluid->projection.level_count == 0) {
+        loadFluidProjectionLevels(fluid);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Substeps from the flow speed, see fluid_speed.h
+//----------------------------------------------------------------------------------
+
+// Fastest the field moves along either axis. On GL it's from the last reduction
+// that made it back, a frame or two old, and 0 before the first one.
+float getFluidFieldSpeed(FluidBody* fluid) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) return getFluidCPUMaxSpeed(&fluid->cpu);
+#endif
+
+    fluid->track_speed = 1;
+    const float* data = (const float*)fluid->speed_readback.data;
+    return data ? data[0] : 0;
+}
+
+// Picks this frame's substeps so none carries the fastest flow more than cfl
+// texels, and shares frame_dt out between them as the time step. Call it once the
+// frame's emitters are in, holding ones count straight away where the field on GL lags.
+// Pass the result to updateFluidBufferSubsteps.
+int pickFluidSubsteps(FluidBody* fluid, float frame_dt, float cfl, int min_substeps, int max_substeps) {
+    float speed = getFluidFieldSpeed(fluid);
+    for (int i = 0; i < fluid->emitter_count; i++) {
+        // Pushing ones only speed the fluid up over time, which the field shows
+        if (!isFluidEmitterHolding(&fluid->emitters[i])) continue;
+        Vector2 velocity = fluid->emitters[i].force;
+        speed = fmaxf(speed, fmaxf(fabsf(velocity.x), fabsf(velocity.y)));
+    }
+    fluid->max_speed = speed;
+
+    int substeps = getFluidCFLSubsteps(speed, frame_dt, fluid->params.cell_size, cfl, min_substeps, max_substeps);
+    setFluidParams(fluid, frame_dt / substeps, fluid->params.k, fluid->params.viscosity);
+    return substeps;
+}
+
+// Substeps the last frame ran, and the speed they were picked for
+int getFluidSubsteps(FluidBody* fluid) {
+    return fluid->substeps;
+}
+
+float getFluidMaxSpeed(FluidBody* fluid) {
+    return fluid->max_speed;
+}
+
+//----------------------------------------------------------------------------------
+// Resolution and timing, see fluid_governor.h
+//----------------------------------------------------------------------------------
+
+// Wrap the substeps in these. On GL the batch is flushed on both ends so only the
+// solver's own draws land inside the query.
+void beginFluidSolverTiming(FluidBody* fluid) {
+    if (fluid->backend == FLUID_BACKEND_GL) rlDrawRenderBatchActive();
+    beginFluidTimer(&fluid->solver_timer);
 }
 
-// Conversion shit
-union FP32
-{
-    uint32_t u;
-    float f;
-};
+void endFluidSolverTiming(FluidBody* fluid) {
+    if (fluid->backend == FLUID_BACKEND_GL) rlDrawRenderBatchActive();
+    endFluidTimer(&fluid->solver_timer);
+}
 
-float convertFloat16ToNativeFloat(short int value)
-{
-    const union FP32 magic = { (254UL - 15UL) << 23 };
-    const union FP32 was_inf_nan = { (127UL + 16UL) << 23 };
-    union FP32 out;
+// Milliseconds the last timed substeps took, a frame or two old on GL
+float getFluidSolverTime(FluidBody* fluid) {
+    return fluid->solver_timer.ms;
+}
 
-    out.u = (value & 0x7FFFU) << 13;
-    out.f *= magic.f;
-    if (out.f >= was_inf_nan.f)
-    {
-        out.u |= 255UL << 23;
+// Milliseconds the CPU spent issuing the last GL substeps, 0 on the CPU backend
+float getFluidSubmitTime(FluidBody* fluid) {
+    return fluid->submit_timer.ms;
+}
+
+// Changes the grid size and resamples the flow into it. Boundaries are cleared and
+// have to be drawn again, and anything read back at the old size is dropped.
+void resizeFluidBody(FluidBody* fluid, int x_resolution, int y_resolution) {
+    if (x_resolution == fluid->x_resolution && y_resolution == fluid->y_resolution) return;
+
+    if (fluid->sat.vx) unloadFluidSAT(&fluid->sat);
+    fluid->sat = (FluidSAT){ 0 };
+    fluid->sat_landed = 0;
+
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        resizeFluidCPU(&fluid->cpu, x_resolution, y_resolution);
+        fluid->params = fluid->cpu.params;
+        free(fluid->mirror);
+        fluid->mirror = NULL;
+        fluid->x_resolution = x_resolution;
+        fluid->y_resolution = y_resolution;
+        return;
     }
-    out.u |= (value & 0x8000UL) << 16;
+#endif
+
+    // Readbacks get made again at the new size by drawFluidBody
+    if (fluid->readback.width) unloadFluidReadback(&fluid->readback);
+    fluid->readback = (FluidReadback){ 0 };
+    free(fluid->mirror);
+    fluid->mirror = NULL;
+    fluid->mirror_landed = 0;
 
-    return out.f;
+    // Stretch the live buffer over the new one, no blending so w comes through as it is
+    RenderTexture2D* active = &fluid->field_tex[fluid->front];
+    RenderTexture2D* other = &fluid->field_tex[!fluid->front];
+    RenderTexture2D resized = loadFluidFieldTexture(x_resolution, y_resolution);
+
+    BeginTextureMode(resized);
+    rlDisableColorBlend();
+    DrawTexturePro(
+        active->texture,
+        (Rectangle){0, fluid->y_resolution, fluid->x_resolution, -fluid->y_resolution},
+        (Rectangle){0, 0, x_resolution, y_resolution},
+        (Vector2){0, 0},
+        0.0,
+        WHITE
+    );
+    rlDrawRenderBatchActive();
+    rlEnableColorBlend();
+    EndTextureMode();
+
+    UnloadRenderTexture(*active);
+    UnloadRenderTexture(*other);
+    *active = resized;
+    *other = loadFluidFieldTexture(x_resolution, y_resolution);
+
+    UnloadRenderTexture(fluid->boundary_tex);
+    fluid->boundary_tex = LoadRenderTexture(x_resolution, y_resolution);
+    BeginTextureMode(fluid->boundary_tex);
+    ClearBackground(BLANK);
+    EndTextureMode();
+    UnloadRenderTexture(fluid->solid_tex);
+    fluid->solid_tex = loadFluidSolidTarget(x_resolution, y_resolution);
+
+    fluid->x_resolution = x_resolution;
+    fluid->y_resolution = y_resolution;
+    fluid->params.cell_size = (float)FLUID_REFERENCE_WIDTH / x_resolution;
+    unloadFluidSpeedLevels(fluid);
+    loadFluidSpeedLevels(fluid);
+    if (fluid->projection.level_count > 0) {
+        unloadFluidProjectionLevels(fluid);
+        loadFluidProjectionLevels(fluid);
+    }
+    if (fluid->compute.sparse) resizeFluidComputeTiles(&fluid->compute, x_resolution, y_resolution);
+    updateFluidSolid(fluid, 0, 0, x_resolution, y_resolution);
+}
+
+//----------------------------------------------------------------------------------
+// Emitters, see fluid_emitter.h. Positions and sizes are in the same draw space as
+// the drawFluid* functions below.
+//----------------------------------------------------------------------------------
+
+// Emitters stay until cleared, the game clears and refills them once a frame
+void clearFluidEmitters(FluidBody* fluid) {
+    fluid->emitter_count = 0;
+    fluid->emitters_dirty = 1;
+}
+
+// Returns the new emitter, or -1 if they're all taken
+int addFluidEmitter(FluidBody* fluid, FluidEmitter emitter) {
+    if (fluid->emitter_count >= FLUID_MAX_EMITTERS) return -1;
+    fluid->emitters[fluid->emitter_count] = emitter;
+    fluid->emitters_dirty = 1;
+    return fluid->emitter_count++;
+}
+
+int addFluidEmitterRectanglePro(FluidBody* fluid, Rectangle rec, Vector2 origin, float rotation, Vector2 force) {
+    return addFluidEmitter(fluid, createFluidEmitterRectanglePro(fluid->y_resolution, rec, origin, rotation, force));
+}
+
+int addFluidEmitterRectangle(FluidBody* fluid, float x, float y, float width, float height, Vector2 force) {
+    return addFluidEmitterRectanglePro(fluid, (Rectangle){x, y, width, height}, (Vector2){0, 0}, 0, force);
+}
+
+int addFluidEmitterCapsule(FluidBody* fluid, Vector2 a, Vector2 b, float radius, Vector2 force) {
+    return addFluidEmitter(fluid, createFluidEmitterCapsule(fluid->y_resolution, a, b, radius, force));
+}
+
+int addFluidEmitterCircle(FluidBody* fluid, float center_x, float center_y, float radius, Vector2 force) {
+    Vector2 center = {center_x, center_y};
+    return addFluidEmitterCapsule(fluid, center, center, radius, force);
 }
 
-// Reads a pixel value
+// Makes an emitter set the velocity of what it covers to its force rather than
+// push it, so it stops whatever flows in. Takes what the add functions returned.
+void holdFluidEmitter(FluidBody* fluid, int emitter) {
+    if (emitter < 0) return;
+    FluidEmitter* held = &fluid->emitters[emitter];
+    held->shape = (float)((int)held->shape | FLUID_EMITTER_HOLD);
+    fluid->emitters_dirty = 1;
+}
+
+//----------------------------------------------------------------------------------
+// Drawing into the fluid, works the same on either backend
+//----------------------------------------------------------------------------------
+
+// Solids are drawn into the boundary buffer
+void beginFluidBoundaries(FluidBody* fluid) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.draw_target = FLUID_CPU_TARGET_BOUNDARY;
+        return;
+    }
+#endif
+    BeginTextureMode(fluid->boundary_tex);
+}
+
+void endFluidBoundaries(FluidBody* fluid) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.draw_target = FLUID_CPU_TARGET_FIELD;
+        return;
+    }
+#endif
+    EndTextureMode();
+    updateFluidSolid(fluid, 0, 0, fluid->x_resolution, fluid->y_resolution);
+
+    // The CPU wakes tiles as it draws, here it's simpler to wake them all
+    if (fluid->compute.sparse) wakeFluidComputeTiles(&fluid->compute);
+}
+
+// Same, but only region of the boundaries changes. It's cleared first, so everything
+// that overlaps it has to be drawn again, and draws only land inside it. Costs what
+// the region covers rather than the whole grid, for solids that move.
+void beginFluidBoundaryRegion(FluidBody* fluid, Rectangle region) {
+    int x0 = (int)floorf(region.x);
+    int y0 = (int)floorf(region.y);
+    int x1 = (int)ceilf(region.x + region.width);
+    int y1 = (int)ceilf(region.y + region.height);
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 > fluid->x_resolution) ? fluid->x_resolution : x1;
+    y1 = (y1 > fluid->y_resolution) ? fluid->y_resolution : y1;
+    if (x1 < x0) x1 = x0;
+    if (y1 < y0) y1 = y0;
+    fluid->boundary_region = (Rectangle){x0, y0, x1 - x0, y1 - y0};
+
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.draw_target = FLUID_CPU_TARGET_BOUNDARY;
+        clipFluidCPUDraws(&fluid->cpu, x0, y0, x1 - x0, y1 - y0);
+        clearFluidCPUBoundaryClip(&fluid->cpu);
+        return;
+    }
+#endif
+
+    // The scissor clips the clear as well as the draws
+    BeginTextureMode(fluid->boundary_tex);
+    BeginScissorMode(x0, y0, x1 - x0, y1 - y0);
+    ClearBackground(BLANK);
+}
+
+void endFluidBoundaryRegion(FluidBody* fluid) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        fluid->cpu.draw_target = FLUID_CPU_TARGET_FIELD;
+        unclipFluidCPUDraws(&fluid->cpu);
+        return;
+    }
+#endif
+    EndScissorMode();
+    EndTextureMode();
+
+    // Wakes the compute tiles under it too
+    Rectangle region = fluid->boundary_region;
+    if (region.width > 0 && region.height > 0) {
+        updateFluidSolid(fluid, region.x, region.y, region.x + region.width, region.y + region.height);
+    }
+}
+
+void drawFluidRectanglePro(FluidBody* fluid, Rectangle rec, Vector2 origin, float rotation, Color color) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        drawFluidCPURectanglePro(&fluid->cpu, rec, origin, rotation, color);
+        return;
+    }
+#endif
+    DrawRectanglePro(rec, origin, rotation, color);
+}
+
+void drawFluidRectangle(FluidBody* fluid, int x, int y, int width, int height, Color color) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        drawFluidCPURectangle(&fluid->cpu, x, y, width, height, color);
+        return;
+    }
+#endif
+    DrawRectangle(x, y, width, height, color);
+}
+
+void drawFluidCircle(FluidBody* fluid, int center_x, int center_y, float radius, Color color) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        drawFluidCPUCircle(&fluid->cpu, center_x, center_y, radius, color);
+        return;
+    }
+#endif
+    DrawCircle(center_x, center_y, radius, color);
+}
+
+void drawFluidPoly(FluidBody* fluid, Vector2 center, int sides, float radius, float rotation, Color color) {
+#if FLUID_CPU_BACKEND
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        drawFluidCPUPoly(&fluid->cpu, center, sides, radius, rotation, color);
+        return;
+    }
+#endif
+    DrawPoly(center, sides, radius, rotation, color);
+}
+
+// Reads a pixel value, the GL backend needs full_readback set
 Vector4 getCPUImgValue(FluidBody* fluid, int x, int y) {
     if (x < 0 || x >= fluid->x_resolution || y < 0 || y >= fluid->y_resolution) {
         return (Vector4){0, 0, 0, 0};
     }
 
+#if FLUID_CPU_BACKEND
+    // No readback on the CPU backend
+    if (fluid->backend == FLUID_BACKEND_CPU) {
+        return getFluidCPUValue(&fluid->cpu, x, y);
+    }
+#endif
+
+    // Nothing has come back from the GPU yet
+    if (fluid->readback.data == NULL) {
+        return (Vector4){0, 0, 0, 0};
+    }
+
     int base_index = (y*fluid->x_resolution + x) * (4); // (y*xres + x) * (4 components)
-    short int* f16_cpu_image = (short int*)fluid->cpu_image.data;
+    const short int* f16_cpu_image = (const short int*)fluid->readback.data;
     short int r = f16_cpu_image[base_index];
     short int g = f16_cpu_image[base_index + 1];
     short int b = f16_cpu_image[base_index + 2];
@@ -262,4 +1036,128 @@ Vector4 getCPUImgValue(FluidBody* fluid, int x, int y) {
     return output;
 }
 
+//----------------------------------------------------------------------------------
+// Batch sampling, see fluid_sample.h
+//----------------------------------------------------------------------------------
+
+// Decodes the last full readback into float32 so sampling skips the half conversion.
+// Worth it when a lot of samples are taken per frame, the CPU backend is already float.
+void updateFluidMirror(FluidBody* fluid) {
+    if (fluid->backend == FLUID_BACKEND_CPU || fluid->readback.data == NULL) return;
+    if (fluid->mirror && fluid->mirror_landed == fluid->readback.landed) return;
+
+    size_t count = (size_t)fluid->x_resolution*fluid->y_resolution*4;
+    if (fluid->mirror == NULL) fluid->mirror = malloc(count*sizeof(float));
+    decodeFluidHalfImage(fluid->readback.data, fluid->mirror, count);
+    fluid->mirror_landed = fluid->readback.landed;
+}
+
+// Freshest data on the CPU, zero-sized if the GL backend hasn't read anything back yet
+FluidSampleSource getFluidSampleSource(FluidBody* fluid) {
+    FluidSampleSource source = { 0 };
+
+    if (0) {
+#if FLUID_CPU_BACKEND
+    } else if (fluid->backend == FLUID_BACKEND_CPU && fluid->cpu.storage == FLUID_CPU_STORAGE_F16) {
+        source.half = fluid->cpu.half[fluid->cpu.front];
+    } else if (fluid->backend == FLUID_BACKEND_CPU && fluid->cpu.storage == FLUID_CPU_STORAGE_F32_TILES) {
+        // Samplers walk rows, so tiles get copied out into the mirror every call
+        if (fluid->mirror == NULL) fluid->mirror = malloc((size_t)fluid->x_resolution*fluid->y_resolution*4*sizeof(float));
+        exportFluidCPUFloats(&fluid->cpu, fluid->mirror);
+        source.x = fluid->mirror;
+        source.y = fluid->mirror + 1;
+        source.stride = 4;
+    } else if (fluid->backend == FLUID_BACKEND_CPU) {
+        FluidCPUField* field = &fluid->cpu.field[fluid->cpu.front];
+        source.x = field->x;
+        source.y = field->y;
+        source.stride = 1;
+#endif
+    } else if (fluid->mirror && fluid->mirror_landed == fluid->readback.landed) {
+        source.x = fluid->mirror;
+        source.y = fluid->mirror + 1;
+        source.stride = 4;
+    } else if (fluid->readback.data) {
+        source.half = fluid->readback.data;
+    } else {
+        return source;
+    }
+
+    source.width = fluid->x_resolution;
+    source.height = fluid->y_resolution;
+    return source;
+}
+
+// Bilinear velocities at positions in texels, rows counted like getCPUImgValue.
+// The GL backend needs full_readback set.
+void sampleFluidVelocities(FluidBody* fluid, const Vector2* positions, Vector2* velocities, int count) {
+    FluidSampleSource source = getFluidSampleSource(fluid);
+    sampleFluidVelocityBatch(&source, positions, velocities, count);
+}
+
+// Rebuilds the region sums from the freshest data, at most once per readback on GL.
+// The CPU field changes every substep so it's rebuilt on every call there.
+void updateFluidSAT(FluidBody* fluid) {
+    FluidSampleSource source = getFluidSampleSource(fluid);
+    if (source.width == 0) return;
+    if (fluid->backend == FLUID_BACKEND_GL && fluid->sat.built && fluid->sat_landed == fluid->readback.landed) return;
+
+    if (fluid->sat.vx == NULL) fluid->sat = createFluidSAT(fluid->x_resolution, fluid->y_resolution, 0);
+    buildFluidSAT(&fluid->sat, &source);
+    fluid->sat_landed = fluid->readback.landed;
+}
+
+// Mean velocity and energy over texels x to x + width - 1, y to y + height - 1,
+// summed in double precision, rows counted like getCPUImgValue. Zero until updateFluidSAT has run.
+FluidRegion queryFluidRegion(FluidBody* fluid, int x, int y, int width, int height) {
+    return queryFluidSAT(&fluid->sat, x, y, width, height);
+}
+
+//----------------------------------------------------------------------------------
+// Probes, a few averaged samples per entity instead of the whole field
+//----------------------------------------------------------------------------------
+
+// Returns the new probe, or -1 if they're all taken
+int addFluidProbe(FluidBody* fluid) {
+    if (fluid->probe_count >= FLUID_MAX_PROBES) return -1;
+    fluid->probes[fluid->probe_count] = (Vector4){0, 0, 0, 0};
+    return fluid->probe_count++;
+}
+
+// Center and half size in texels, rows counted the same way as getCPUImgValue
+void setFluidProbe(FluidBody* fluid, int probe, int x, int y, int half_width, int half_height) {
+    fluid->probes[probe] = (Vector4){x, y, half_width, half_height};
+}
+
+// Average of the probe's center and four corners. On GL this is from the last gather
+// that made it back, a frame or two old, and zero before the first one.
+Vector4 getFluidProbe(FluidBody* fluid, int probe) {
+    if (fluid->backend == FLUID_BACKEND_GL) {
+        const float* data = (const float*)fluid->probe_readback.data;
+        if (data == NULL) return (Vector4){0, 0, 0, 0};
+        return (Vector4){data[probe*4], data[probe*4 + 1], data[probe*4 + 2], data[probe*4 + 3]};
+    }
+
+    int x = fluid->probes[probe].x;
+    int y = fluid->probes[probe].y;
+    int w = fluid->probes[probe].z;
+    int h = fluid->probes[probe].w;
+    Vector4 samples[5] = {
+        getCPUImgValue(fluid, x, y),
+        getCPUImgValue(fluid, x + w, y + h),
+        getCPUImgValue(fluid, x - w, y + h),
+        getCPUImgValue(fluid, x + w, y - h),
+        getCPUImgValue(fluid, x - w, y - h),
+    };
+
+    Vector4 sum = { 0 };
+    for (int i = 0; i < 5; i++) {
+        sum.x += samples[i].x;
+        sum.y += samples[i].y;
+        sum.z += samples[i].z;
+        sum.w += samples[i].w;
+    }
+    return (Vector4){sum.x / 5.0f, sum.y / 5.0f, sum.z / 5.0f, sum.w / 5.0f};
+}
+
 #endif
\ No newline at end of file
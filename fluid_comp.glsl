@@ -6,8 +6,25 @@ in vec4 fragColor;
 
 // Uniforms
 uniform float uTime = 0;
-uniform sampler2D uBoundaries;
+uniform sampler2D uSolid;            // Flags built from the boundaries by fluid_solid.glsl
 uniform sampler2D uFluid;
+uniform vec2 uTexelSize;            // 1/resolution
+uniform float uDt = 0.1;
+uniform float uK = 0.03;
+uniform float uViscosity = 0.19;
+uniform float uCellSize = 1.0;      // Reference texels per texel, velocity is in reference texels
+uniform int uAdvection = 0;         // FluidAdvection, 1 for MacCormack
+
+// Same as FLUID_SOLID_*
+#define SOLID_SELF 1
+#define SOLID_X 6                   // Left or right
+#define SOLID_Y 24                  // Down or up
+#define SOLID_CLEAR 32
+
+#define MAX_EMITTERS 64             // Same as FLUID_MAX_EMITTERS
+#define EMITTER_LIFT 1.0            // Same as FLUID_EMITTER_LIFT
+uniform vec4 uEmitters[2*MAX_EMITTERS];  // Line a.xy b.xy, then radius, shape, force.xy, see fluid_emitter.h
+uniform int uEmitterCount = 0;
 
 // Output fragment color
 out vec4 finalColor;
@@ -25,6 +42,58 @@ vec2 point2(float t) {
     return vec2(0.88,0.5 + cos(t + 1.5708)*0.2);
 }
 
+// MacCormack on top of the lookup at uv - back*w that gave advect: the lookup gets
+// traced forward again with this cell's velocity and half of what the round trip
+// lost goes back in, clamped to the texels the lookup blended. The integer part of
+// the trace cancels, so the way forward only reads the 3x3 round the cell. Same as
+// advectFluidCPUMacCormack in fluid_cpu.h.
+vec2 correctAdvection(vec2 uv, vec2 w, vec2 back, vec2 here, vec2 advect) {
+    vec2 t = fract(back);
+    vec2 q = uv - t*w;
+    vec2 s00 = textureLod(uFluid, q, 0.0).xy;
+    vec2 s10 = textureLod(uFluid, q + vec2(w.x, 0), 0.0).xy;
+    vec2 s01 = textureLod(uFluid, q + vec2(0, w.y), 0.0).xy;
+    vec2 s11 = textureLod(uFluid, q + w, 0.0).xy;
+    vec2 round_trip = mix(mix(s00, s10, t.x), mix(s01, s11, t.x), t.y);
+
+    vec4 gx = textureGather(uFluid, uv - back*w, 0);
+    vec4 gy = textureGather(uFluid, uv - back*w, 1);
+    vec2 lo = vec2(min(min(gx.x, gx.y), min(gx.z, gx.w)), min(min(gy.x, gy.y), min(gy.z, gy.w)));
+    vec2 hi = vec2(max(max(gx.x, gx.y), max(gx.z, gx.w)), max(max(gy.x, gy.y), max(gy.z, gy.w)));
+    return clamp(advect + 0.5*(here - round_trip), lo, hi);
+}
+
+// Same test as isFluidEmitterCovering, the last emitter over p wins
+bool emitterAt(vec2 p, out vec2 force, out bool hold) {
+    bool covered = false;
+    force = vec2(0);
+    hold = false;
+
+    for (int i = 0; i < uEmitterCount; i++) {
+        vec4 line = uEmitters[2*i];
+        vec4 info = uEmitters[2*i + 1];
+        int shape = int(info.y);
+        vec2 ab = line.zw - line.xy;
+        vec2 ap = p - line.xy;
+        float len2 = dot(ab, ab);
+        float t = (len2 > 0.0) ? dot(ap, ab)/len2 : 0.0;
+
+        if ((shape & 1) != 0) {
+            if (t < 0.0 || t > 1.0) continue;   // Box, square ends
+        } else {
+            t = clamp(t, 0.0, 1.0);             // Capsule, round ends
+        }
+
+        vec2 d = ap - ab*t;
+        if (dot(d, d) <= info.x*info.x) {
+            covered = true;
+            force = info.zw;
+            hold = (shape & 2) != 0;
+        }
+    }
+    return covered;
+}
+
 void main() {
     if (uTime < 0.1)
     {
@@ -33,10 +102,19 @@ void main() {
     }
 
     vec2 uv = fragTexCoord - vec2(0, 1); // UV Sampling
-    vec2 w = 1.0/vec2(1920.0, 1080.0);  // TODO: Replace with uniforms
-    float dt = 0.1;              // TODO: Replace with uniforms
-    const float K = 0.03;
-	const float v = 0.19;
+
+    // Solids don't step at all, fetched so they come through exactly
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    int solid = int(texelFetch(uSolid, texel, 0).r*255.0 + 0.5);
+    if ((solid & SOLID_SELF) != 0) {
+        finalColor = texelFetch(uFluid, texel, 0);
+        return;
+    }
+    vec2 w = uTexelSize;
+    float dt = uDt;
+    float K = uK;
+    float v = uViscosity;
+    float inv_h = 1.0/uCellSize;
     
     vec4 data = textureLod(uFluid, uv, 0.0);
     vec4 tr = textureLod(uFluid, uv + vec2(w.x , 0), 0.0);
@@ -44,15 +122,17 @@ void main() {
     vec4 tu = textureLod(uFluid, uv + vec2(0 , w.y), 0.0);
     vec4 td = textureLod(uFluid, uv - vec2(0 , w.y), 0.0);
     
-    vec3 dx = (tr.xyz - tl.xyz)*0.5;
-    vec3 dy = (tu.xyz - td.xyz)*0.5;
+    vec3 dx = (tr.xyz - tl.xyz)*0.5*inv_h;
+    vec3 dy = (tu.xyz - td.xyz)*0.5*inv_h;
     vec2 densDif = vec2(dx.z, dy.z);
     
     data.z -= dt*dot(vec3(densDif, dx.x + dy.y), data.xyz); //density
-    vec2 laplacian = tu.xy + td.xy + tr.xy + tl.xy - 4.0*data.xy;
+    vec2 laplacian = (tu.xy + td.xy + tr.xy + tl.xy - 4.0*data.xy)*inv_h*inv_h;
     vec2 viscForce = vec2(v)*laplacian;
 
-    vec4 advect = textureLod(uFluid, uv - dt*data.xy*w, 0.0);
+    vec2 back = dt*data.xy*inv_h;
+    vec4 advect = textureLod(uFluid, uv - back*w, 0.0);
+    if (uAdvection == 1) advect.xy = correctAdvection(uv, w, back, data.xy, advect.xy);
     data.xy = advect.xy; //advection
 
     // float center_circle = smoothstep(0.006, 0.004, length(fragTexCoord + vec2(-0.5 + 0.3*cos(uTime*0.5), -1.5 + 0.3*sin(uTime*0.5))));
@@ -65,11 +145,18 @@ void main() {
     // external_forces.xy += 0.75*vec2(.0003, 0.00015)/(mag2(uv-point1(uTime))+0.0001);
     // external_forces.xy -= 0.75*vec2(.0003, 0.00015)/(mag2(uv-point2(uTime))+0.0001);
 
-    if (data.w < 1) {
-        external_forces.xy += 100*(data.xy - 0.5 + vec2(0, 0.01));
-        external_forces.xy += 10*cos(uTime*uv*-93.472*sin(uv*10983.29) + 239132);
+    // Emitters push and stir the fluid, holding ones set the velocity outright
+    vec2 emitter_force;
+    bool emitter_hold;
+    bool emitter = emitterAt(gl_FragCoord.xy, emitter_force, emitter_hold);
+    if (emitter) {
+        if (emitter_hold) {
+            data.xy = emitter_force;
+        } else {
+            external_forces.xy += emitter_force + vec2(0, EMITTER_LIFT);
+            external_forces.xy += 10*cos(uTime*uv*-93.472*sin(uv*10983.29) + 239132);
+        }
         data.z = 0;
-        data.w = 0;
     }
 
     // data.z += center_circle;
@@ -77,7 +164,7 @@ void main() {
     data.xy += dt*(viscForce.xy - K/dt*densDif + 8*external_forces); //update velocity
     data.xy = max(vec2(0), abs(data.xy)-0.0008)*sign(data.xy); //linear velocity decay
 
-    float curl = (tr.y - tl.y - tu.x + td.x);
+    float curl = (tr.y - tl.y - tu.x + td.x)*inv_h;
     vec2 vort = vec2(abs(tu.w) - abs(td.w), abs(tl.w) - abs(tr.w));
     vort *= -0.2/length(vort + 1e-9)*curl;
     data.xy += vort;
@@ -87,25 +174,20 @@ void main() {
     data = clamp(data, vec4(vec2(-100000), 0.5 , -10.), vec4(vec2(100000), 15.0 , 10.));
 
     // Horizontal boundary conditions
-    if (
-        (textureLod(uBoundaries, uv + vec2(w.x, 0), 0.0).x > 0) || // Right blocked
-        (textureLod(uBoundaries, uv - vec2(w.x, 0), 0.0).x > 0)    // Left blocked
-    ) {
+    if ((solid & SOLID_X) != 0) {
         data.x = 0;
     }
 
     // Vertical boundary conditions
-    if (
-        (textureLod(uBoundaries, uv + vec2(0, w.y), 0.0).x > 0) || // Right blocked
-        (textureLod(uBoundaries, uv - vec2(0, w.y), 0.0).x > 0)    // Left blocked
-    ) {
+    if ((solid & SOLID_Y) != 0) {
         data.y = 0;
     }
 
     // Clear the pressure of blocked areas
-    data *= (1 - texture(uBoundaries, uv).y);
+    if ((solid & SOLID_CLEAR) != 0) data = vec4(0);
 
-    finalColor = vec4(data.xyz, 1);
-    // finalColor = texture(uBoundaries, uv);
+    // w marks emitter cells for the vorticity of the next step
+    finalColor = vec4(data.xyz, emitter ? 0.0 : 1.0);
+    // finalColor = texture(uSolid, uv);
     // finalColor = vec4(uv - data.xy*w, 0, 1);
 }
\ No newline at end of file
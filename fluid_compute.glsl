@@ -0,0 +1,301 @@
+#version 430
+
+// Compute version of fluid_comp.glsl that runs up to MAX_SUBSTEPS substeps per
+// dispatch. Each group loads its tile and a halo around it into shared memory
+// once, then steps it there. Every substep only needs STEP_HALO cells around
+// it, so the valid part shrinks by that much each time and what's left after
+// the last one is the tile. The field in between is packed to halves like the
+// texture the fragment solver would have written.
+//
+// The catch is that advection can only look ADVECT_REACH texels back, anything
+// faster gets clamped to that. The game picks its substeps so the fastest flow
+// moves at most FLUID_CFL, 4 texels a substep, so that's what the reach covers.
+//
+// With uSparse set the groups are only the tiles fluid_tiles.glsl listed, and each
+// one notes whether its tile was still moving for the next list.
+
+#define GROUP_SIZE 16
+#define MAX_SUBSTEPS 3              // Same as FLUID_COMPUTE_SUBSTEPS
+#define ADVECT_REACH 4
+#define STEP_HALO (ADVECT_REACH + 1)
+#define TILE_SIZE 34                // Same as FLUID_COMPUTE_TILE
+#define SHARED_SIZE (TILE_SIZE + 2*MAX_SUBSTEPS*STEP_HALO)  // 64, at 8 bytes a cell that's all 32K
+#define FIRST_SIZE (SHARED_SIZE - 2*STEP_HALO)              // Cells the first substep works out
+#define CELLS_PER_THREAD ((FIRST_SIZE*FIRST_SIZE + GROUP_SIZE*GROUP_SIZE - 1)/(GROUP_SIZE*GROUP_SIZE))
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+// Uniforms
+layout(rgba16f, binding = 0) uniform writeonly image2D uOutput;
+uniform sampler2D uFluid;
+uniform sampler2D uSolid;            // Same as fluid_comp.glsl
+uniform ivec2 uResolution;
+uniform vec2 uTexelSize;            // 1/resolution
+uniform int uSubsteps = 1;          // 1 to MAX_SUBSTEPS
+uniform float uTime = 0;
+uniform float uDt = 0.1;
+uniform float uK = 0.03;
+uniform float uViscosity = 0.19;
+uniform float uCellSize = 1.0;
+uniform int uAdvection = 0;         // FluidAdvection, 1 for MacCormack
+uniform int uSparse = 0;
+uniform float uSleepSpeed = 0.05;   // Same as FLUID_COMPUTE_SLEEP_SPEED
+uniform float uSleepChange = 0.001;
+
+#define MAX_EMITTERS 64             // Same as FLUID_MAX_EMITTERS
+#define EMITTER_LIFT 1.0            // Same as FLUID_EMITTER_LIFT
+uniform vec4 uEmitters[2*MAX_EMITTERS];
+uniform int uEmitterCount = 0;
+
+// Tile for each group when sparse, the top bit set for ones that only get copied
+layout(std430, binding = 0) readonly buffer TileList { uint uTileList[]; };
+layout(std430, binding = 1) coherent buffer TileActive { uint uTileActive[]; };
+#define COPY_BIT 0x80000000u
+
+shared uvec2 cells[SHARED_SIZE*SHARED_SIZE];
+
+vec4 loadCell(ivec2 p) {
+    uvec2 cell = cells[p.y*SHARED_SIZE + p.x];
+    return vec4(unpackHalf2x16(cell.x), unpackHalf2x16(cell.y));
+}
+
+uvec2 packCell(vec4 data) {
+    return uvec2(packHalf2x16(data.xy), packHalf2x16(data.zw));
+}
+
+// Textures repeat, so the halo wraps round the edges the same way
+ivec2 wrapTexel(ivec2 p) {
+    return p - uResolution*ivec2(floor(vec2(p)/vec2(uResolution)));
+}
+
+// Bilinear like textureLod, q in shared cells with centers on the half
+vec4 sampleCells(vec2 q) {
+    vec2 base = q - 0.5;
+    ivec2 i = ivec2(floor(base));
+    vec2 f = base - vec2(i);
+    vec4 bottom = mix(loadCell(i), loadCell(i + ivec2(1, 0)), f.x);
+    vec4 top = mix(loadCell(i + ivec2(0, 1)), loadCell(i + ivec2(1, 1)), f.x);
+    return mix(bottom, top, f.y);
+}
+
+// Same as correctAdvection in fluid_comp.glsl, q is where the lookup that gave
+// advect was. The way forward stays in the 3x3 round p, which the halo has anyway.
+vec2 correctAdvection(ivec2 p, vec2 q, vec2 back, vec2 here, vec2 advect) {
+    vec2 t = fract(back);
+    vec2 r = vec2(p) + 0.5 - t;
+    vec2 s00 = sampleCells(r).xy;
+    vec2 s10 = sampleCells(r + vec2(1, 0)).xy;
+    vec2 s01 = sampleCells(r + vec2(0, 1)).xy;
+    vec2 s11 = sampleCells(r + vec2(1, 1)).xy;
+    vec2 round_trip = mix(mix(s00, s10, t.x), mix(s01, s11, t.x), t.y);
+
+    ivec2 i = ivec2(floor(q - 0.5));
+    vec2 c00 = loadCell(i).xy;
+    vec2 c10 = loadCell(i + ivec2(1, 0)).xy;
+    vec2 c01 = loadCell(i + ivec2(0, 1)).xy;
+    vec2 c11 = loadCell(i + ivec2(1, 1)).xy;
+    vec2 lo = min(min(c00, c10), min(c01, c11));
+    vec2 hi = max(max(c00, c10), max(c01, c11));
+    return clamp(advect + 0.5*(here - round_trip), lo, hi);
+}
+
+// Same as FLUID_SOLID_*
+#define SOLID_SELF 1
+#define SOLID_X 6
+#define SOLID_Y 24
+#define SOLID_CLEAR 32
+
+int solidAt(ivec2 texel) {
+    return int(texelFetch(uSolid, texel, 0).r*255.0 + 0.5);
+}
+
+// Same as emitterAt in fluid_comp.glsl
+bool emitterAt(vec2 p, out vec2 force, out bool hold) {
+    bool covered = false;
+    force = vec2(0);
+    hold = false;
+
+    for (int i = 0; i < uEmitterCount; i++) {
+        vec4 line = uEmitters[2*i];
+        vec4 info = uEmitters[2*i + 1];
+        int shape = int(info.y);
+        vec2 ab = line.zw - line.xy;
+        vec2 ap = p - line.xy;
+        float len2 = dot(ab, ab);
+        float t = (len2 > 0.0) ? dot(ap, ab)/len2 : 0.0;
+
+        if ((shape & 1) != 0) {
+            if (t < 0.0 || t > 1.0) continue;
+        } else {
+            t = clamp(t, 0.0, 1.0);
+        }
+
+        vec2 d = ap - ab*t;
+        if (dot(d, d) <= info.x*info.x) {
+            covered = true;
+            force = info.zw;
+            hold = (shape & 2) != 0;
+        }
+    }
+    return covered;
+}
+
+// One substep of the cell at p in shared memory, texel is where that is in the field.
+// Follows main in fluid_comp.glsl line for line.
+vec4 stepCell(ivec2 p, ivec2 texel) {
+    vec2 uv = (vec2(texel) + 0.5)*uTexelSize - vec2(0, 1);
+    float dt = uDt;
+    float K = uK;
+    float v = uViscosity;
+    float inv_h = 1.0/uCellSize;
+
+    // Solids don't step at all
+    vec4 data = loadCell(p);
+    int solid = solidAt(texel);
+    if ((solid & SOLID_SELF) != 0) return data;
+    vec4 tr = loadCell(p + ivec2(1, 0));
+    vec4 tl = loadCell(p - ivec2(1, 0));
+    vec4 tu = loadCell(p + ivec2(0, 1));
+    vec4 td = loadCell(p - ivec2(0, 1));
+
+    vec3 dx = (tr.xyz - tl.xyz)*0.5*inv_h;
+    vec3 dy = (tu.xyz - td.xyz)*0.5*inv_h;
+    vec2 densDif = vec2(dx.z, dy.z);
+
+    data.z -= dt*dot(vec3(densDif, dx.x + dy.y), data.xyz); //density
+    vec2 laplacian = (tu.xy + td.xy + tr.xy + tl.xy - 4.0*data.xy)*inv_h*inv_h;
+    vec2 viscForce = vec2(v)*laplacian;
+
+    // Only ADVECT_REACH texels of the halo are there to look back into
+    vec2 back = clamp(dt*data.xy*inv_h, vec2(-ADVECT_REACH), vec2(ADVECT_REACH));
+    vec2 q = vec2(p) + 0.5 - back;
+    vec4 advect = sampleCells(q);
+    if (uAdvection == 1) advect.xy = correctAdvection(p, q, back, data.xy, advect.xy);
+    data.xy = advect.xy; //advection
+
+    vec2 external_forces = vec2(0);
+
+    vec2 emitter_force;
+    bool emitter_hold;
+    bool emitter = emitterAt(vec2(texel) + 0.5, emitter_force, emitter_hold);
+    if (emitter) {
+        if (emitter_hold) {
+            data.xy = emitter_force;
+        } else {
+            external_forces.xy += emitter_force + vec2(0, EMITTER_LIFT);
+            external_forces.xy += 10*cos(uTime*uv*-93.472*sin(uv*10983.29) + 239132);
+        }
+        data.z = 0;
+    }
+
+    data.xy += dt*(viscForce.xy - K/dt*densDif + 8*external_forces); //update velocity
+    data.xy = max(vec2(0), abs(data.xy)-0.0008)*sign(data.xy); //linear velocity decay
+
+    float curl = (tr.y - tl.y - tu.x + td.x)*inv_h;
+    vec2 vort = vec2(abs(tu.w) - abs(td.w), abs(tl.w) - abs(tr.w));
+    vort *= -0.2/length(vort + 1e-9)*curl;
+    data.xy += vort;
+
+    data = clamp(data, vec4(vec2(-100000), 0.5 , -10.), vec4(vec2(100000), 15.0 , 10.));
+
+    // Horizontal boundary conditions
+    if ((solid & SOLID_X) != 0) {
+        data.x = 0;
+    }
+
+    // Vertical boundary conditions
+    if ((solid & SOLID_Y) != 0) {
+        data.y = 0;
+    }
+
+    // Clear the pressure of blocked areas
+    if ((solid & SOLID_CLEAR) != 0) data = vec4(0);
+
+    return vec4(data.xyz, emitter ? 0.0 : 1.0);
+}
+
+void main() {
+    int thread = int(gl_LocalInvocationIndex);
+    ivec2 group = ivec2(gl_WorkGroupID.xy);
+    uint entry = 0u;
+    if (uSparse != 0) {
+        int tiles_x = (uResolution.x + TILE_SIZE - 1)/TILE_SIZE;
+        entry = uTileList[gl_WorkGroupID.x];
+        int index = int(entry & ~COPY_BIT);
+        group = ivec2(index % tiles_x, index / tiles_x);
+    }
+    ivec2 tile = group*TILE_SIZE;
+    ivec2 origin = tile - MAX_SUBSTEPS*STEP_HALO;
+
+    // A tile that just went to sleep has the older field in the output, bring it level
+    if ((entry & COPY_BIT) != 0u) {
+        for (int i = thread; i < TILE_SIZE*TILE_SIZE; i += GROUP_SIZE*GROUP_SIZE) {
+            ivec2 texel = tile + ivec2(i % TILE_SIZE, i / TILE_SIZE);
+            if (all(lessThan(texel, uResolution))) imageStore(uOutput, texel, texelFetch(uFluid, texel, 0));
+        }
+        return;
+    }
+
+    if (uTime < 0.1) {
+        for (int i = thread; i < TILE_SIZE*TILE_SIZE; i += GROUP_SIZE*GROUP_SIZE) {
+            ivec2 texel = tile + ivec2(i % TILE_SIZE, i / TILE_SIZE);
+            if (all(lessThan(texel, uResolution))) imageStore(uOutput, texel, vec4(0.0, 0.0, 0.0, 1.0));
+        }
+        return;
+    }
+
+    // Shared memory is full, so whether the tile moves is gathered straight into the buffer
+    if (uSparse != 0 && thread == 0) uTileActive[entry] = 0u;
+    for (int i = thread; i < SHARED_SIZE*SHARED_SIZE; i += GROUP_SIZE*GROUP_SIZE) {
+        ivec2 p = ivec2(i % SHARED_SIZE, i / SHARED_SIZE);
+        cells[i] = packCell(texelFetch(uFluid, wrapTexel(origin + p), 0));
+    }
+    memoryBarrierBuffer();
+    barrier();
+
+    // Fewer substeps start further in so the last one always lands on the tile
+    vec4 result[CELLS_PER_THREAD];
+    for (int s = 0; s < uSubsteps; s++) {
+        int margin = (MAX_SUBSTEPS - uSubsteps + s + 1)*STEP_HALO;
+        int size = SHARED_SIZE - 2*margin;
+
+        for (int c = 0; c < CELLS_PER_THREAD; c++) {
+            int i = thread + c*GROUP_SIZE*GROUP_SIZE;
+            if (i >= size*size) break;
+            ivec2 p = ivec2(margin) + ivec2(i % size, i / size);
+            result[c] = stepCell(p, wrapTexel(origin + p));
+        }
+        if (s + 1 == uSubsteps) break;
+
+        // Everyone has to be done reading before the cells get overwritten
+        barrier();
+        for (int c = 0; c < CELLS_PER_THREAD; c++) {
+            int i = thread + c*GROUP_SIZE*GROUP_SIZE;
+            if (i >= size*size) break;
+            ivec2 p = ivec2(margin) + ivec2(i % size, i / size);
+            cells[p.y*SHARED_SIZE + p.x] = packCell(result[c]);
+        }
+        barrier();
+    }
+
+    // The last substep worked out the tile in the same order, what it started from
+    // is still in the cells
+    bool moving = false;
+    for (int c = 0; c < CELLS_PER_THREAD; c++) {
+        int i = thread + c*GROUP_SIZE*GROUP_SIZE;
+        if (i >= TILE_SIZE*TILE_SIZE) break;
+        ivec2 q = ivec2(i % TILE_SIZE, i / TILE_SIZE);
+        ivec2 texel = tile + q;
+        if (any(greaterThanEqual(texel, uResolution))) continue;
+        imageStore(uOutput, texel, result[c]);
+
+        if (uSparse != 0) {
+            uvec2 half_cell = packCell(result[c]);
+            vec4 stored = vec4(unpackHalf2x16(half_cell.x), unpackHalf2x16(half_cell.y));
+            vec4 before = loadCell(ivec2(MAX_SUBSTEPS*STEP_HALO) + q);
+            moving = moving || max(abs(stored.x), abs(stored.y)) > uSleepSpeed;
+            moving = moving || max(abs(stored.z - before.z), abs(stored.w - before.w)) > uSleepChange;
+        }
+    }
+    if (moving) atomicOr(uTileActive[entry], 1u);
+}
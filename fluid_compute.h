@@ -0,0 +1,280 @@
+#ifndef NVST_FLUID_COMPUTE
+#define NVST_FLUID_COMPUTE
+
+#include <stdlib.h>
+
+#include "raylib.h"
+
+#include "fluid_pass.h"
+
+// Steps the GL backend with fluid_compute.glsl instead of one full screen draw per
+// substep. A dispatch does up to FLUID_COMPUTE_SUBSTEPS substeps out of shared
+// memory, so six substeps are two dispatches and the field is read and written
+// twice rather than six times. Needs GL 4.3. Without it, or if the shader fails
+// to build, program stays 0 and the fragment solver is used like before.
+//
+// It can also run sparse, see setFluidComputeSparse. Before each dispatch
+// fluid_tiles.glsl lists the tiles that are moving or next to one that is, and the
+// dispatch is sized from that list on the GPU, so calm air costs nothing.
+
+#define FLUID_COMPUTE_SUBSTEPS (3)  // Has to match MAX_SUBSTEPS in fluid_compute.glsl
+#define FLUID_COMPUTE_TILE (34)     // Has to match TILE_SIZE, texels each group writes a side
+#define FLUID_COMPUTE_SLEEP_SPEED (0.05f)   // Same as FLUID_CPU_SLEEP_SPEED
+#define FLUID_COMPUTE_SLEEP_CHANGE (0.001f)
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidCompute {
+    unsigned int program;   // 0 if compute shaders aren't there
+    FluidSolverUniforms uniforms;
+
+    // Sparse stepping, the tile program is 0 if it didn't build and then it's always dense
+    unsigned int tile_program;
+    FluidSolverUniforms tile_uniforms;
+    int sparse;
+    int tiles_x;
+    int tiles_y;
+    float sleep_speed;
+    float sleep_change;
+    unsigned int tile_list;     // Tile for each group
+    unsigned int tile_active;   // Whether each tile was moving after its last dispatch
+    unsigned int tile_synced;   // Whether both textures hold the same there
+    unsigned int tile_dispatch; // Group count for the indirect dispatch
+} FluidCompute;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Needs a current context. Check program before using it.
+FluidCompute loadFluidCompute(const char* path) {
+    FluidCompute compute = { 0 };
+    loadFluidGL();
+
+    int major = 0;
+    int minor = 0;
+    fluid_gl.GetIntegerv(GL_MAJOR_VERSION, &major);
+    fluid_gl.GetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major*10 + minor < 43) return compute;
+
+    char* code = LoadFileText(path);
+    if (code == NULL) return compute;
+    unsigned int shader = compileFluidShader(GL_COMPUTE_SHADER, code);
+    UnloadFileText(code);
+
+    compute.program = linkFluidProgram(&shader, 1);
+    if (compute.program) compute.uniforms = getFluidSolverUniforms(compute.program);
+    compute.sleep_speed = FLUID_COMPUTE_SLEEP_SPEED;
+    compute.sleep_change = FLUID_COMPUTE_SLEEP_CHANGE;
+    return compute;
+}
+
+// The tile lister for sparse stepping, after loadFluidCompute worked
+void loadFluidComputeTiles(FluidCompute* compute, const char* path) {
+    char* code = LoadFileText(path);
+    if (code == NULL) return;
+    unsigned int shader = compileFluidShader(GL_COMPUTE_SHADER, code);
+    UnloadFileText(code);
+
+    compute->tile_program = linkFluidProgram(&shader, 1);
+    if (compute->tile_program) compute->tile_uniforms = getFluidSolverUniforms(compute->tile_program);
+}
+
+static void unloadFluidComputeTileBuffers(FluidCompute* compute) {
+    unsigned int buffers[4] = {compute->tile_list, compute->tile_active, compute->tile_synced, compute->tile_dispatch};
+    if (buffers[0]) fluid_gl.DeleteBuffers(4, buffers);
+    compute->tile_list = 0;
+    compute->tile_active = 0;
+    compute->tile_synced = 0;
+    compute->tile_dispatch = 0;
+}
+
+void unloadFluidCompute(FluidCompute* compute) {
+    if (compute->program) fluid_gl.DeleteProgram(compute->program);
+    if (compute->tile_program) fluid_gl.DeleteProgram(compute->tile_program);
+    unloadFluidComputeTileBuffers(compute);
+    compute->program = 0;
+    compute->tile_program = 0;
+}
+
+// Every tile steps on the next sparse dispatch, for when the textures changed some
+// other way. Both textures are taken to differ everywhere.
+void wakeFluidComputeTiles(FluidCompute* compute) {
+    if (compute->tile_active == 0) return;
+    size_t count = (size_t)compute->tiles_x*compute->tiles_y;
+    unsigned int* flags = malloc(count*sizeof(unsigned int));
+
+    for (size_t i = 0; i < count; i++) flags[i] = 1;
+    fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, compute->tile_active);
+    fluid_gl.BufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count*sizeof(unsigned int), flags);
+
+    memset(flags, 0, count*sizeof(unsigned int));
+    fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, compute->tile_synced);
+    fluid_gl.BufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count*sizeof(unsigned int), flags);
+    fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    free(flags);
+}
+
+// Same for only the tiles under texels x0 to x1 and y0 to y1, ends included, with
+// y up like the texture. A run of flags for each row of tiles.
+void wakeFluidComputeTileRect(FluidCompute* compute, int x0, int y0, int x1, int y1) {
+    if (compute->tile_active == 0) return;
+    int tx0 = (x0 < 0) ? 0 : x0/FLUID_COMPUTE_TILE;
+    int ty0 = (y0 < 0) ? 0 : y0/FLUID_COMPUTE_TILE;
+    int tx1 = x1/FLUID_COMPUTE_TILE;
+    int ty1 = y1/FLUID_COMPUTE_TILE;
+    if (tx1 >= compute->tiles_x) tx1 = compute->tiles_x - 1;
+    if (ty1 >= compute->tiles_y) ty1 = compute->tiles_y - 1;
+    if (tx1 < tx0 || ty1 < ty0) return;
+
+    int run = tx1 - tx0 + 1;
+    unsigned int* flags = malloc(2*run*sizeof(unsigned int));
+    for (int i = 0; i < run; i++) {
+        flags[i] = 1;
+        flags[run + i] = 0;
+    }
+    for (int ty = ty0; ty <= ty1; ty++) {
+        size_t offset = ((size_t)ty*compute->tiles_x + tx0)*sizeof(unsigned int);
+        fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, compute->tile_active);
+        fluid_gl.BufferSubData(GL_SHADER_STORAGE_BUFFER, offset, run*sizeof(unsigned int), flags);
+        fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, compute->tile_synced);
+        fluid_gl.BufferSubData(GL_SHADER_STORAGE_BUFFER, offset, run*sizeof(unsigned int), flags + run);
+    }
+    fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    free(flags);
+}
+
+// Makes the tile buffers for a field this size, awake. Needed again after a resize.
+void resizeFluidComputeTiles(FluidCompute* compute, int width, int height) {
+    unloadFluidComputeTileBuffers(compute);
+    compute->tiles_x = (width + FLUID_COMPUTE_TILE - 1)/FLUID_COMPUTE_TILE;
+    compute->tiles_y = (height + FLUID_COMPUTE_TILE - 1)/FLUID_COMPUTE_TILE;
+    size_t size = (size_t)compute->tiles_x*compute->tiles_y*sizeof(unsigned int);
+
+    unsigned int buffers[4];
+    fluid_gl.GenBuffers(4, buffers);
+    compute->tile_list = buffers[0];
+    compute->tile_active = buffers[1];
+    compute->tile_synced = buffers[2];
+    compute->tile_dispatch = buffers[3];
+    for (int i = 0; i < 4; i++) {
+        fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[i]);
+        fluid_gl.BufferData(GL_SHADER_STORAGE_BUFFER, (i == 3) ? 3*sizeof(unsigned int) : size, NULL, GL_DYNAMIC_COPY);
+    }
+    fluid_gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    wakeFluidComputeTiles(compute);
+
+    fluid_gl.UseProgram(compute->tile_program);
+    fluid_gl.Uniform2i(compute->tile_uniforms.tiles, compute->tiles_x, compute->tiles_y);
+    fluid_gl.Uniform2i(compute->tile_uniforms.resolution, width, height);
+    fluid_gl.UseProgram(0);
+}
+
+// Turns sparse stepping on or off for a field this size. Stays off without the tile program.
+void setFluidComputeSparse(FluidCompute* compute, int sparse, int width, int height) {
+    compute->sparse = sparse && compute->program && compute->tile_program;
+    if (compute->sparse) resizeFluidComputeTiles(compute, width, height);
+    else unloadFluidComputeTileBuffers(compute);
+}
+
+// Uniforms for the dispatches that follow, leaves the program in use
+void beginFluidCompute(FluidCompute* compute, FluidParams params, float time, int width, int height) {
+    fluid_gl.UseProgram(compute->program);
+    setFluidSolverParams(&compute->uniforms, params, time, width, height);
+    fluid_gl.Uniform1f(compute->uniforms.sleep_speed, compute->sleep_speed);
+    fluid_gl.Uniform1f(compute->uniforms.sleep_change, compute->sleep_change);
+}
+
+// Both programs read the list, leaves the stepping one in use
+void setFluidComputeEmitters(FluidCompute* compute, const FluidEmitter* emitters, int count) {
+    if (compute->tile_program) {
+        fluid_gl.UseProgram(compute->tile_program);
+        setFluidSolverEmitters(&compute->tile_uniforms, emitters, count);
+    }
+    fluid_gl.UseProgram(compute->program);
+    setFluidSolverEmitters(&compute->uniforms, emitters, count);
+}
+
+void endFluidCompute(void) {
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 1);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+    fluid_gl.UseProgram(0);
+}
+
+static void bindFluidComputeTextures(
+    FluidCompute* compute, unsigned int source, unsigned int target, unsigned int solid, int substeps
+) {
+    fluid_gl.Uniform1i(compute->uniforms.substeps, substeps);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 1);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, solid);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, source);
+    fluid_gl.BindImageTexture(0, target, 0, 0, 0, GL_WRITE_ONLY, GL_RGBA16F);
+}
+
+// Steps source into target, both RGBA16F textures of the same size, between
+// beginFluidCompute and endFluidCompute. Leaves texture unit 0 active.
+void dispatchFluidCompute(
+    FluidCompute* compute,
+    unsigned int source,
+    unsigned int target,
+    unsigned int solid,
+    int width,
+    int height,
+    int substeps
+) {
+    bindFluidComputeTextures(compute, source, target, solid, substeps);
+    fluid_gl.Uniform1i(compute->uniforms.sparse, 0);
+
+    fluid_gl.DispatchCompute(
+        (width + FLUID_COMPUTE_TILE - 1)/FLUID_COMPUTE_TILE,
+        (height + FLUID_COMPUTE_TILE - 1)/FLUID_COMPUTE_TILE,
+        1
+    );
+
+    // The next dispatch samples it, drawing and readback go through framebuffers
+    fluid_gl.MemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Same as dispatchFluidCompute but only for the tiles that need it, once
+// setFluidComputeSparse has made the buffers. Lists them first, then steps the
+// list with a dispatch the GPU sizes itself.
+void dispatchFluidComputeSparse(
+    FluidCompute* compute,
+    unsigned int source,
+    unsigned int target,
+    unsigned int solid,
+    int substeps
+) {
+    static const unsigned int empty[3] = {0, 1, 1};
+    fluid_gl.BindBuffer(GL_DISPATCH_INDIRECT_BUFFER, compute->tile_dispatch);
+    fluid_gl.BufferSubData(GL_DISPATCH_INDIRECT_BUFFER, 0, sizeof(empty), empty);
+    fluid_gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, compute->tile_list);
+    fluid_gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, compute->tile_active);
+    fluid_gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, compute->tile_synced);
+    fluid_gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, compute->tile_dispatch);
+
+    fluid_gl.UseProgram(compute->tile_program);
+    fluid_gl.DispatchCompute((compute->tiles_x*compute->tiles_y + 63)/64, 1, 1);
+    fluid_gl.MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    fluid_gl.UseProgram(compute->program);
+    bindFluidComputeTextures(compute, source, target, solid, substeps);
+    fluid_gl.Uniform1i(compute->uniforms.sparse, 1);
+    fluid_gl.DispatchComputeIndirect(0);
+
+    // The next list reads which tiles moved
+    fluid_gl.MemoryBarrier(
+        GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT
+    );
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.BindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+#endif
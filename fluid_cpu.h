@@ -0,0 +1,1682 @@
+#ifndef NVST_FLUID_CPU
+#define NVST_FLUID_CPU
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "raylib.h"
+
+#include "fluid_emitter.h"
+#include "fluid_half.h"
+#include "fluid_multigrid.h"
+#include "fluid_simd.h"
+#include "fluid_speed.h"
+#include "fluid_threads.h"
+
+// CPU reference implementation of the step in fluid_comp.glsl. Fields are stored
+// as separate float planes in the same row order as the GL texture (row 0 is the
+// bottom of the fluid), so image coordinates mean the same thing on both backends.
+// They can also be kept as RGBA16F like the texture, or in square tiles so the
+// scattered reads of advection stay closer together, see setFluidCPUStorage.
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+// One full copy of the fluid state, rgba of the GL texture split into planes
+typedef struct NV_FluidCPUField {
+    float* x;   // Velocity x
+    float* y;   // Velocity y
+    float* z;   // Density
+    float* w;   // 0 where an emitter covered the cell last step, 1 everywhere else
+} FluidCPUField;
+
+// Rows first to first + count - 1 of a field, wrapping past the top. The whole field
+// is a band starting at row 0 with every row in it.
+typedef struct NV_FluidCPUBand {
+    FluidCPUField rows;     // Start of the band's first row
+    const unsigned short* half;     // Same with half storage, rows is empty then
+    int tiles_x;            // Tiles across if rows is tiled, 0 if it's row by row
+    int first;
+    int count;
+    int escaped;            // Set if advection wanted a row the band doesn't have
+} FluidCPUBand;
+
+typedef enum NV_FluidCPUStorage {
+    FLUID_CPU_STORAGE_F32,  // Float planes in field
+    FLUID_CPU_STORAGE_F16,  // RGBA16F in half, stepped in float a row at a time
+    FLUID_CPU_STORAGE_F32_TILES     // Float planes in field made of FLUID_CPU_TILE square tiles
+} FluidCPUStorage;
+
+typedef enum NV_FluidCPUTarget {
+    FLUID_CPU_TARGET_FIELD,
+    FLUID_CPU_TARGET_BOUNDARY
+} FluidCPUTarget;
+
+typedef struct NV_FluidCPU {
+    int width;
+    int height;
+
+    // Double buffering, same as fluid_tex and fluid_tex_b. Only field or half is
+    // allocated, depending on storage.
+    FluidCPUStorage storage;
+    FluidCPUField field[2];
+    unsigned short* half[2];
+    int front;
+
+    // Solid cells, same layout as boundary_tex
+    Color* boundary;
+
+    // What the step reads instead, FLUID_SOLID_* of every cell. Built again around
+    // whatever got drawn into boundary since, see updateFluidCPUSolid.
+    unsigned char* solid;
+    unsigned char* solid_tiles;     // Sleep tiles that are solid all over, they never step
+    int solid_x0, solid_y0, solid_x1, solid_y1;     // Rows and columns drawn since, see markFluidCPUSolid
+
+    // Workers split the rows into bands, each has FLUID_CPU_WORKER_ROWS scratch rows
+    FluidThreadPool* pool;
+    float* row_scratch;
+    float* worker_results;  // One float a worker for reductions, see getFluidCPUMaxSpeed
+
+    // Temporal blocking, see stepFluidCPUSubsteps. Rows per band, 0 (the default) steps
+    // the whole field each time. It's only faster where memory is what holds the step back.
+    int block_rows;
+    float* block_scratch;       // Two bands per worker, grown as needed
+    size_t block_scratch_size;
+    long long block_fallbacks;  // Frames advection outran the halo and ran unblocked
+
+    // Sparse stepping, see setFluidCPUSparse. The field is split into tiles of
+    // FLUID_CPU_SLEEP_TILE cells, and ones that have gone calm sleep until something
+    // next to them moves.
+    int sparse;
+    float sleep_speed;          // Tiles with any velocity over this stay awake
+    float sleep_change;         // Same for density or emitter coverage changing by more
+    int sleep_tiles_x;
+    int sleep_tiles_y;
+    unsigned char* sleep_active;    // Tiles the last substep found moving, written by the workers
+    unsigned char* sleep_state;     // FLUID_CPU_SLEEP_SYNCED and FLUID_CPU_SLEEP_WOKEN
+    int* sleep_jobs;            // This substep's tiles, the ones below 0 only get copied
+    int sleep_job_count;
+    int awake_tiles;            // Stepped on the last substep
+
+    // Pressure solve of FLUID_PRESSURE_PROJECTION, made the first time it's needed
+    FluidMultigrid multigrid;
+
+    // Owned by whoever fills them, read on every step
+    const FluidEmitter* emitters;
+    int emitter_count;
+
+    float time;
+    FluidParams params;
+    FluidCPUTarget draw_target;
+
+    // Draws only land inside, in draw space, see clipFluidCPUDraws
+    int clip_x0, clip_y0, clip_x1, clip_y1;
+} FluidCPU;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Side of a tile with FLUID_CPU_STORAGE_F32_TILES, a tile row of floats is half a cache line
+#define FLUID_CPU_TILE_SHIFT (3)
+#define FLUID_CPU_TILE (1 << FLUID_CPU_TILE_SHIFT)
+
+static inline int getFluidCPUTilesX(int width) {
+    return (width + FLUID_CPU_TILE - 1) >> FLUID_CPU_TILE_SHIFT;
+}
+
+// Tiles go row by row and so do the cells in each one
+static inline size_t getFluidCPUTileIndex(int tiles_x, int x, int y) {
+    size_t tile = (size_t)(y >> FLUID_CPU_TILE_SHIFT)*tiles_x + (x >> FLUID_CPU_TILE_SHIFT);
+    return (tile << (2*FLUID_CPU_TILE_SHIFT)) + ((y & (FLUID_CPU_TILE - 1)) << FLUID_CPU_TILE_SHIFT) + (x & (FLUID_CPU_TILE - 1));
+}
+
+// Cells in a plane, tiled ones are padded out to whole tiles
+static size_t getFluidCPUPlaneSize(const FluidCPU* cpu) {
+    if (cpu->storage != FLUID_CPU_STORAGE_F32_TILES) return (size_t)cpu->width*cpu->height;
+
+    size_t tiles_y = (cpu->height + FLUID_CPU_TILE - 1) >> FLUID_CPU_TILE_SHIFT;
+    return (size_t)getFluidCPUTilesX(cpu->width)*tiles_y*FLUID_CPU_TILE*FLUID_CPU_TILE;
+}
+
+// Pages are only reserved here, the workers touch them first in clearFluidCPUJob
+static FluidCPUField allocFluidCPUField(size_t count) {
+    FluidCPUField field;
+
+    field.x = malloc(count*sizeof(float));
+    field.y = malloc(count*sizeof(float));
+    field.z = malloc(count*sizeof(float));
+    field.w = malloc(count*sizeof(float));
+
+    return field;
+}
+
+static void freeFluidCPUField(FluidCPUField* field) {
+    free(field->x);
+    free(field->y);
+    free(field->z);
+    free(field->w);
+    *field = (FluidCPUField){ 0 };
+}
+
+// Both fields, however storage says they're kept
+static void allocFluidCPUStorage(FluidCPU* cpu) {
+    size_t count = getFluidCPUPlaneSize(cpu);
+    for (int i = 0; i < 2; i++) {
+        if (cpu->storage == FLUID_CPU_STORAGE_F16) cpu->half[i] = malloc(count*4*sizeof(unsigned short));
+        else cpu->field[i] = allocFluidCPUField(count);
+    }
+}
+
+static void freeFluidCPUStorage(FluidCPU* cpu) {
+    for (int i = 0; i < 2; i++) {
+        freeFluidCPUField(&cpu->field[i]);
+        free(cpu->half[i]);
+        cpu->half[i] = NULL;
+    }
+}
+
+// Advection x and y, emitter force x and y, and emitter coverage
+#define FLUID_CPU_SCRATCH_ROWS (5)
+// Then for half and tiled storage three loaded rows and the stepped one, four planes each
+#define FLUID_CPU_WORKER_ROWS (FLUID_CPU_SCRATCH_ROWS + 16)
+
+#define FLUID_CPU_SLEEP_TILE (32)
+#define FLUID_CPU_SLEEP_SPEED (0.05f)   // A twentieth of a reference texel per time unit
+#define FLUID_CPU_SLEEP_CHANGE (0.001f)
+
+#define FLUID_CPU_SLEEP_SYNCED (1)      // Both fields hold the same in this tile
+#define FLUID_CPU_SLEEP_WOKEN (2)       // Something was drawn into it, step it next time
+
+// Every tile steps on the next sparse substep, for when the field changed behind
+// the tiles' back
+void wakeFluidCPUTiles(FluidCPU* cpu) {
+    size_t count = (size_t)cpu->sleep_tiles_x*cpu->sleep_tiles_y;
+    memset(cpu->sleep_active, 1, count);
+    memset(cpu->sleep_state, 0, count);
+    cpu->awake_tiles = (int)count;
+}
+
+static void allocFluidCPUSleep(FluidCPU* cpu) {
+    cpu->sleep_tiles_x = (cpu->width + FLUID_CPU_SLEEP_TILE - 1)/FLUID_CPU_SLEEP_TILE;
+    cpu->sleep_tiles_y = (cpu->height + FLUID_CPU_SLEEP_TILE - 1)/FLUID_CPU_SLEEP_TILE;
+    size_t count = (size_t)cpu->sleep_tiles_x*cpu->sleep_tiles_y;
+    cpu->sleep_active = malloc(count);
+    cpu->sleep_state = malloc(count);
+    cpu->sleep_jobs = malloc(count*sizeof(int));
+    cpu->sleep_job_count = 0;
+    wakeFluidCPUTiles(cpu);
+}
+
+static void freeFluidCPUSleep(FluidCPU* cpu) {
+    free(cpu->sleep_active);
+    free(cpu->sleep_state);
+    free(cpu->sleep_jobs);
+}
+
+// The kernels load a whole vector of flags at a time, which can run past the last cell
+#define FLUID_CPU_SOLID_PADDING (64)
+
+// Everything gets built on the first step
+static void allocFluidCPUSolid(FluidCPU* cpu) {
+    cpu->solid = calloc((size_t)cpu->width*cpu->height + FLUID_CPU_SOLID_PADDING, 1);
+    cpu->solid_tiles = calloc((size_t)cpu->sleep_tiles_x*cpu->sleep_tiles_y, 1);
+    cpu->solid_x0 = cpu->solid_y0 = 0;
+    cpu->solid_x1 = cpu->width;
+    cpu->solid_y1 = cpu->height;
+}
+
+// Zeroes the worker's share of field index, in whole rows of tiles when it's tiled
+static void clearFluidCPUFieldRange(FluidCPU* cpu, int index, int worker, int workers) {
+    size_t start, count;
+    if (cpu->storage == FLUID_CPU_STORAGE_F32_TILES) {
+        size_t tile_row = (size_t)getFluidCPUTilesX(cpu->width)*FLUID_CPU_TILE*FLUID_CPU_TILE;
+        int t0, t1;
+        getFluidThreadRange((cpu->height + FLUID_CPU_TILE - 1) >> FLUID_CPU_TILE_SHIFT, worker, workers, &t0, &t1);
+        start = t0*tile_row;
+        count = (t1 - t0)*tile_row;
+    } else {
+        int y0, y1;
+        getFluidThreadRange(cpu->height, worker, workers, &y0, &y1);
+        start = (size_t)y0*cpu->width;
+        count = (size_t)(y1 - y0)*cpu->width;
+    }
+
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) {
+        memset(cpu->half[index] + start*4, 0, count*4*sizeof(unsigned short));
+        return;
+    }
+    memset(cpu->field[index].x + start, 0, count*sizeof(float));
+    memset(cpu->field[index].y + start, 0, count*sizeof(float));
+    memset(cpu->field[index].z + start, 0, count*sizeof(float));
+    memset(cpu->field[index].w + start, 0, count*sizeof(float));
+}
+
+// Every worker zeroes the rows it will later step, so on NUMA machines those
+// pages end up on the node of the thread that uses them
+static void clearFluidCPUJob(void* arg, int worker, int workers) {
+    FluidCPU* cpu = (FluidCPU*)arg;
+    int y0, y1;
+    getFluidThreadRange(cpu->height, worker, workers, &y0, &y1);
+
+    clearFluidCPUFieldRange(cpu, 0, worker, workers);
+    clearFluidCPUFieldRange(cpu, 1, worker, workers);
+    memset(cpu->boundary + (size_t)y0*cpu->width, 0, (size_t)(y1 - y0)*cpu->width*sizeof(Color));
+    memset(cpu->row_scratch + (size_t)worker*cpu->width*FLUID_CPU_WORKER_ROWS, 0, (size_t)cpu->width*FLUID_CPU_WORKER_ROWS*sizeof(float));
+}
+
+// threads <= 0 uses every core
+FluidCPU createFluidCPU(int width, int height, int threads) {
+    FluidCPU cpu = { 0 };
+
+    cpu.width = width;
+    cpu.height = height;
+    cpu.storage = FLUID_CPU_STORAGE_F32;
+    allocFluidCPUStorage(&cpu);
+    cpu.front = 0;
+    cpu.boundary = malloc((size_t)width * height * sizeof(Color));
+    cpu.time = 0;
+    cpu.params = (FluidParams){
+        .dt = FLUID_DEFAULT_DT,
+        .k = FLUID_DEFAULT_K,
+        .viscosity = FLUID_DEFAULT_VISCOSITY,
+        .cell_size = (float)FLUID_REFERENCE_WIDTH / width,
+    };
+    cpu.draw_target = FLUID_CPU_TARGET_FIELD;
+    cpu.clip_x1 = width;
+    cpu.clip_y1 = height;
+    cpu.sleep_speed = FLUID_CPU_SLEEP_SPEED;
+    cpu.sleep_change = FLUID_CPU_SLEEP_CHANGE;
+    allocFluidCPUSleep(&cpu);
+    allocFluidCPUSolid(&cpu);
+    cpu.multigrid.cycles = FLUID_MULTIGRID_CYCLES;
+    cpu.multigrid.tolerance = FLUID_MULTIGRID_TOLERANCE;
+
+    cpu.pool = createFluidThreadPool(threads);
+    cpu.row_scratch = malloc((size_t)cpu.pool->count * width * FLUID_CPU_WORKER_ROWS * sizeof(float));
+    cpu.worker_results = malloc(cpu.pool->count*sizeof(float));
+    runFluidThreadPool(cpu.pool, clearFluidCPUJob, &cpu);
+
+    return cpu;
+}
+
+void unloadFluidCPU(FluidCPU* cpu) {
+    unloadFluidThreadPool(cpu->pool);
+    freeFluidCPUStorage(cpu);
+    free(cpu->boundary);
+    free(cpu->solid);
+    free(cpu->solid_tiles);
+    free(cpu->row_scratch);
+    free(cpu->worker_results);
+    free(cpu->block_scratch);
+    freeFluidCPUSleep(cpu);
+    unloadFluidMultigrid(&cpu->multigrid);
+}
+
+// Wraps like GL_REPEAT, which is what the fluid textures are sampled with
+static inline int wrapFluidCPUIndex(int i, int n) {
+    i %= n;
+    return (i < 0) ? i + n : i;
+}
+
+// Field 0 or 1 as a band
+static FluidCPUBand getFluidCPUFieldBand(FluidCPU* cpu, int index) {
+    int tiles_x = (cpu->storage == FLUID_CPU_STORAGE_F32_TILES) ? getFluidCPUTilesX(cpu->width) : 0;
+    return (FluidCPUBand){cpu->field[index], cpu->half[index], tiles_x, 0, cpu->height, 0};
+}
+
+// Row y of field index into four float rows, whatever the storage
+static void loadFluidCPURow(const FluidCPU* cpu, int index, int y, float* const dst[4]) {
+    int width = cpu->width;
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) {
+        decodeFluidHalfRow(cpu->half[index] + (size_t)y*width*4, dst, width);
+        return;
+    }
+
+    const FluidCPUField* field = &cpu->field[index];
+    const float* planes[4] = {field->x, field->y, field->z, field->w};
+    if (cpu->storage == FLUID_CPU_STORAGE_F32) {
+        for (int c = 0; c < 4; c++) memcpy(dst[c], planes[c] + (size_t)y*width, width*sizeof(float));
+        return;
+    }
+
+    // A row is a run of FLUID_CPU_TILE cells in each tile it goes through, whole
+    // tiles are fixed size copies the compiler can inline
+    int tiles_x = getFluidCPUTilesX(width);
+    int full = width & ~(FLUID_CPU_TILE - 1);
+    for (int c = 0; c < 4; c++) {
+        const float* tile = planes[c] + getFluidCPUTileIndex(tiles_x, 0, y);
+        for (int x = 0; x < full; x += FLUID_CPU_TILE) {
+            memcpy(dst[c] + x, tile, FLUID_CPU_TILE*sizeof(float));
+            tile += FLUID_CPU_TILE*FLUID_CPU_TILE;
+        }
+        if (full < width) memcpy(dst[c] + full, tile, (width - full)*sizeof(float));
+    }
+}
+
+static void storeFluidCPURow(FluidCPU* cpu, int index, int y, const float* const src[4]) {
+    int width = cpu->width;
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) {
+        encodeFluidHalfRow(src, cpu->half[index] + (size_t)y*width*4, width);
+        return;
+    }
+
+    FluidCPUField* field = &cpu->field[index];
+    float* planes[4] = {field->x, field->y, field->z, field->w};
+    if (cpu->storage == FLUID_CPU_STORAGE_F32) {
+        for (int c = 0; c < 4; c++) memcpy(planes[c] + (size_t)y*width, src[c], width*sizeof(float));
+        return;
+    }
+
+    int tiles_x = getFluidCPUTilesX(width);
+    int full = width & ~(FLUID_CPU_TILE - 1);
+    for (int c = 0; c < 4; c++) {
+        float* tile = planes[c] + getFluidCPUTileIndex(tiles_x, 0, y);
+        for (int x = 0; x < full; x += FLUID_CPU_TILE) {
+            memcpy(tile, src[c] + x, FLUID_CPU_TILE*sizeof(float));
+            tile += FLUID_CPU_TILE*FLUID_CPU_TILE;
+        }
+        if (full < width) memcpy(tile, src[c] + full, (width - full)*sizeof(float));
+    }
+}
+
+// Where row local of a band starts in each plane, float storage only
+static inline void getFluidCPUBandRow(const FluidCPUBand* band, int width, int local, const float* row[4]) {
+    size_t i = (size_t)local*width;
+    row[0] = band->rows.x + i;
+    row[1] = band->rows.y + i;
+    row[2] = band->rows.z + i;
+    row[3] = band->rows.w + i;
+}
+
+// Bilinear sample of the velocity at a texel-space position (texel centers on integers)
+static inline Vector2 sampleFluidCPUVelocity(FluidCPU* cpu, FluidCPUBand* band, float sx, float sy) {
+    float fx = floorf(sx);
+    float fy = floorf(sy);
+    float tx = sx - fx;
+    float ty = sy - fy;
+
+    int x0 = wrapFluidCPUIndex((int)fx, cpu->width);
+    int y0 = wrapFluidCPUIndex((int)fy, cpu->height) - band->first;
+    if (y0 < 0) y0 += cpu->height;
+    int x1 = (x0 + 1 == cpu->width) ? 0 : x0 + 1;
+    int y1 = (y0 + 1 == cpu->height) ? 0 : y0 + 1;
+
+    if (y0 >= band->count || y1 >= band->count) {
+        band->escaped = 1;
+        return (Vector2){0, 0};
+    }
+    const FluidCPUField* field = &band->rows;
+
+    int i00 = y0*cpu->width + x0;
+    int i10 = y0*cpu->width + x1;
+    int i01 = y1*cpu->width + x0;
+    int i11 = y1*cpu->width + x1;
+
+    Vector2 out;
+    if (band->tiles_x) {
+        size_t j00 = getFluidCPUTileIndex(band->tiles_x, x0, y0);
+        size_t j10 = getFluidCPUTileIndex(band->tiles_x, x1, y0);
+        size_t j01 = getFluidCPUTileIndex(band->tiles_x, x0, y1);
+        size_t j11 = getFluidCPUTileIndex(band->tiles_x, x1, y1);
+        out.x = (field->x[j00]*(1 - tx) + field->x[j10]*tx)*(1 - ty) + (field->x[j01]*(1 - tx) + field->x[j11]*tx)*ty;
+        out.y = (field->y[j00]*(1 - tx) + field->y[j10]*tx)*(1 - ty) + (field->y[j01]*(1 - tx) + field->y[j11]*tx)*ty;
+        return out;
+    }
+    if (band->half) {
+        const unsigned short* half = band->half;
+        const float* table = fluid_half_table;
+        float c00_x = table[half[i00*4]], c00_y = table[half[i00*4 + 1]];
+        float c10_x = table[half[i10*4]], c10_y = table[half[i10*4 + 1]];
+        float c01_x = table[half[i01*4]], c01_y = table[half[i01*4 + 1]];
+        float c11_x = table[half[i11*4]], c11_y = table[half[i11*4 + 1]];
+        out.x = (c00_x*(1 - tx) + c10_x*tx)*(1 - ty) + (c01_x*(1 - tx) + c11_x*tx)*ty;
+        out.y = (c00_y*(1 - tx) + c10_y*tx)*(1 - ty) + (c01_y*(1 - tx) + c11_y*tx)*ty;
+        return out;
+    }
+    out.x = (field->x[i00]*(1 - tx) + field->x[i10]*tx)*(1 - ty) + (field->x[i01]*(1 - tx) + field->x[i11]*tx)*ty;
+    out.y = (field->y[i00]*(1 - tx) + field->y[i10]*tx)*(1 - ty) + (field->y[i01]*(1 - tx) + field->y[i11]*tx)*ty;
+    return out;
+}
+
+// The four texels sampleFluidCPUVelocity would blend at texel-space fx, fy, which
+// are already floored. x of 00 10 01 11 then y of the same. Returns 0 if the band
+// doesn't have them. Kept apart so the plain lookup stays as lean as it was.
+static inline int gatherFluidCPUVelocity(FluidCPU* cpu, FluidCPUBand* band, float fx, float fy, float taps[8]) {
+    int x0 = wrapFluidCPUIndex((int)fx, cpu->width);
+    int y0 = wrapFluidCPUIndex((int)fy, cpu->height) - band->first;
+    if (y0 < 0) y0 += cpu->height;
+    int x1 = (x0 + 1 == cpu->width) ? 0 : x0 + 1;
+    int y1 = (y0 + 1 == cpu->height) ? 0 : y0 + 1;
+
+    if (y0 >= band->count || y1 >= band->count) {
+        band->escaped = 1;
+        return 0;
+    }
+    const FluidCPUField* field = &band->rows;
+
+    if (band->tiles_x) {
+        size_t j[4] = {
+            getFluidCPUTileIndex(band->tiles_x, x0, y0),
+            getFluidCPUTileIndex(band->tiles_x, x1, y0),
+            getFluidCPUTileIndex(band->tiles_x, x0, y1),
+            getFluidCPUTileIndex(band->tiles_x, x1, y1),
+        };
+        for (int i = 0; i < 4; i++) {
+            taps[i] = field->x[j[i]];
+            taps[4 + i] = field->y[j[i]];
+        }
+        return 1;
+    }
+
+    int i[4] = {
+        y0*cpu->width + x0,
+        y0*cpu->width + x1,
+        y1*cpu->width + x0,
+        y1*cpu->width + x1,
+    };
+    if (band->half) {
+        const unsigned short* half = band->half;
+        const float* table = fluid_half_table;
+        for (int k = 0; k < 4; k++) {
+            taps[k] = table[half[i[k]*4]];
+            taps[4 + k] = table[half[i[k]*4 + 1]];
+        }
+        return 1;
+    }
+    for (int k = 0; k < 4; k++) {
+        taps[k] = field->x[i[k]];
+        taps[4 + k] = field->y[i[k]];
+    }
+    return 1;
+}
+
+static inline Vector2 blendFluidCPUVelocity(const float taps[8], float tx, float ty) {
+    Vector2 out;
+    out.x = (taps[0]*(1 - tx) + taps[1]*tx)*(1 - ty) + (taps[2]*(1 - tx) + taps[3]*tx)*ty;
+    out.y = (taps[4]*(1 - tx) + taps[5]*tx)*(1 - ty) + (taps[6]*(1 - tx) + taps[7]*tx)*ty;
+    return out;
+}
+
+// One row's part of the MacCormack round trip at x, see advectFluidCPUMacCormack
+static inline float blurFluidCPURow(const float* row, int x, int left, int right, float a) {
+    return row[x] + a*(row[left] - 2*row[x] + row[right]);
+}
+
+// MacCormack advection of the cell at x, y, which traces back bx, by texels. c, u and
+// d are the row and the ones above and below it. The semi-Lagrangian lookup is traced
+// forward again and half of what the round trip lost goes back in. The way forward
+// uses this cell's velocity, so the integer part of the trace cancels and the round
+// trip comes out as a 3x3 blur with t(1 - t) on the sides, t being the fraction of
+// the trace. The result is clamped to the four texels the lookup blended, so it can't
+// overshoot. Same as correctAdvection in fluid_comp.glsl.
+static inline Vector2 advectFluidCPUMacCormack(
+    FluidCPU* cpu, FluidCPUBand* band, const float* const c[4], const float* const u[4], const float* const d[4],
+    int x, int y, float bx, float by
+) {
+    float sx = x - bx;
+    float sy = y - by;
+    float fx = floorf(sx);
+    float fy = floorf(sy);
+    float tx = sx - fx;
+    float ty = sy - fy;
+    float taps[8];
+    if (!gatherFluidCPUVelocity(cpu, band, fx, fy, taps)) return (Vector2){0, 0};
+    Vector2 advect = blendFluidCPUVelocity(taps, tx, ty);
+
+    // The lookup's fraction is 1 - t, t(1 - t) comes out the same
+    float ax = tx*(1 - tx);
+    float ay = ty*(1 - ty);
+    int left = (x == 0) ? cpu->width - 1 : x - 1;
+    int right = (x + 1 == cpu->width) ? 0 : x + 1;
+
+    float round_trip[2];
+    for (int k = 0; k < 2; k++) {
+        float below = blurFluidCPURow(d[k], x, left, right, ax);
+        float here = blurFluidCPURow(c[k], x, left, right, ax);
+        float above = blurFluidCPURow(u[k], x, left, right, ax);
+        round_trip[k] = here + ay*(below - 2*here + above);
+    }
+
+    float out[2] = {advect.x + 0.5f*(c[0][x] - round_trip[0]), advect.y + 0.5f*(c[1][x] - round_trip[1])};
+    for (int k = 0; k < 2; k++) {
+        const float* t = taps + 4*k;
+        float lo = (t[0] < t[1]) ? t[0] : t[1];
+        float hi = (t[0] < t[1]) ? t[1] : t[0];
+        lo = (t[2] < lo) ? t[2] : lo;
+        hi = (t[2] > hi) ? t[2] : hi;
+        lo = (t[3] < lo) ? t[3] : lo;
+        hi = (t[3] > hi) ? t[3] : hi;
+        out[k] = (out[k] < lo) ? lo : (out[k] > hi) ? hi : out[k];
+    }
+    return (Vector2){out[0], out[1]};
+}
+
+// Advection lookup and emitters for columns x0 to x1 - 1 of a row, the parts the row
+// kernels don't vectorize. y is the row in the field, c the row and u and d the ones
+// above and below it, and src where it samples.
+static void advectFluidCPURow(
+    FluidCPU* cpu, FluidCPUBand* src, int y, const float* const c[4], const float* const u[4], const float* const d[4],
+    float* adv_x, float* adv_y, float* ext_x, float* ext_y, float* emit, int x0, int x1
+) {
+    const float* row_x = c[0];
+    const float* row_y = c[1];
+    const float dt = cpu->params.dt;
+    const float inv_h = 1.0f/cpu->params.cell_size;
+    int width = cpu->width;
+    int height = cpu->height;
+
+    int maccormack = (cpu->params.advection == FLUID_ADVECTION_MACCORMACK);
+
+    for (int x = x0; x < x1; x++) {
+        // Velocity is in reference texels, so it moves fewer real ones on a coarser grid
+        Vector2 advect = maccormack
+            ? advectFluidCPUMacCormack(cpu, src, c, u, d, x, y, dt*row_x[x]*inv_h, dt*row_y[x]*inv_h)
+            : sampleFluidCPUVelocity(cpu, src, x - dt*row_x[x]*inv_h, y - dt*row_y[x]*inv_h);
+        adv_x[x] = advect.x;
+        adv_y[x] = advect.y;
+        ext_x[x] = 0;
+        ext_y[x] = 0;
+        emit[x] = 0;
+    }
+
+    // Covered cells get the emitter's force plus some noise, or its velocity if it's
+    // holding. Last in the list first, so the last emitter over a cell wins.
+    float py = y + 0.5f;
+    float uv_y = py / height - 1.0f;
+    float noise_y = 0;
+    int noise_ready = 0;
+    for (int i = cpu->emitter_count - 1; i >= 0; i--) {
+        const FluidEmitter* emitter = &cpu->emitters[i];
+        Rectangle bounds = getFluidEmitterBounds(emitter);
+        if (py < bounds.y || py > bounds.y + bounds.height) continue;
+        int hold = isFluidEmitterHolding(emitter);
+
+        int start = (int)fmaxf(floorf(bounds.x), x0);
+        int end = (int)fminf(ceilf(bounds.x + bounds.width), x1);
+        if (start < end && !noise_ready) {
+            noise_y = 10*cosf(cpu->time*uv_y*-93.472f*sinf(uv_y*10983.29f) + 239132);
+            noise_ready = 1;
+        }
+        for (int x = start; x < end; x++) {
+            if (emit[x] > 0 || !isFluidEmitterCovering(emitter, x + 0.5f, py)) continue;
+            emit[x] = 1;
+            if (hold) {
+                adv_x[x] = emitter->force.x;
+                adv_y[x] = emitter->force.y;
+                continue;
+            }
+
+            float uv_x = (x + 0.5f) / width;
+            ext_x[x] = emitter->force.x + 10*cosf(cpu->time*uv_x*-93.472f*sinf(uv_x*10983.29f) + 239132);
+            ext_y[x] = emitter->force.y + FLUID_EMITTER_LIFT + noise_y;
+        }
+    }
+}
+
+// Steps columns x0 to x1 - 1 of row y of the field into out. c, u and d are the row
+// and the ones above and below it, src is where advection samples from, scratch is
+// FLUID_CPU_SCRATCH_ROWS rows. Only those columns of out and scratch are touched.
+static void stepFluidCPUSpan(
+    FluidCPU* cpu, FluidRowKernel kernel, FluidCPUBand* src, int y,
+    const float* const c[4], const float* const u[4], const float* const d[4], float* const out[4], float* scratch,
+    int x0, int x1
+) {
+    int width = cpu->width;
+    float* adv_x = scratch;
+    float* adv_y = adv_x + width;
+    float* ext_x = adv_y + width;
+    float* ext_y = ext_x + width;
+    float* emit = ext_y + width;
+
+    advectFluidCPURow(cpu, src, y, c, u, d, adv_x, adv_y, ext_x, ext_y, emit, x0, x1);
+
+    FluidCPURow args = {
+        .c = {c[0], c[1], c[2], c[3]},
+        .u = {u[0], u[1], u[2], u[3]},
+        .d = {d[0], d[1], d[2], d[3]},
+        .solid = cpu->solid + (size_t)y*width,
+        .adv_x = adv_x,
+        .adv_y = adv_y,
+        .ext_x = ext_x,
+        .ext_y = ext_y,
+        .emit = emit,
+        .out = {out[0], out[1], out[2], out[3]},
+        .params = &cpu->params,
+    };
+
+    // Interior in vectors, the two wrapping edge columns one at a time
+    int start = (x0 > 1) ? x0 : 1;
+    int end = (x1 < width - 1) ? x1 : width - 1;
+    if (start < end) kernel(&args, start, end);
+    if (x0 == 0) stepFluidCPUCell(&args, 0, width - 1, 1);
+    if (x1 == width) stepFluidCPUCell(&args, width - 1, width - 2, 0);
+}
+
+// The whole of row y
+static inline void stepFluidCPURow(
+    FluidCPU* cpu, FluidRowKernel kernel, FluidCPUBand* src, int y,
+    const float* const c[4], const float* const u[4], const float* const d[4], float* const out[4], float* scratch
+) {
+    stepFluidCPUSpan(cpu, kernel, src, y, c, u, d, out, scratch, 0, cpu->width);
+}
+
+// Shared by all workers for one substep, src and dst are field indices
+typedef struct NV_FluidCPUStep {
+    FluidCPU* cpu;
+    int src;
+    int dst;
+    FluidRowKernel kernel;
+} FluidCPUStep;
+
+// Half and tiled storage load the rows around y into three slots of float rows and
+// move down a row at a time, so every row is loaded once and stored once a substep
+static void stepFluidCPUStagedRows(FluidCPUStep* step, int worker, int y0, int y1) {
+    FluidCPU* cpu = step->cpu;
+    int width = cpu->width;
+    int height = cpu->height;
+    FluidCPUBand src = getFluidCPUFieldBand(cpu, step->src);
+
+    float* scratch = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS;
+    float* planes = scratch + (size_t)width*FLUID_CPU_SCRATCH_ROWS;
+    float* slots[3][4];
+    float* out[4];
+    for (int i = 0; i < 4; i++) {
+        for (int k = 0; k < 3; k++) slots[k][i] = planes + (size_t)(4*k + i)*width;
+        out[i] = planes + (size_t)(12 + i)*width;
+    }
+
+    if (cpu->time < 0.1) {
+        for (int x = 0; x < width; x++) {
+            out[0][x] = 0;
+            out[1][x] = 0;
+            out[2][x] = 0;
+            out[3][x] = 1;
+        }
+        for (int y = y0; y < y1; y++) storeFluidCPURow(cpu, step->dst, y, (const float* const*)out);
+        return;
+    }
+
+    // Slot of row y is (y - y0 + 1) % 3, the row below y0 is in slot 0
+    loadFluidCPURow(cpu, step->src, wrapFluidCPUIndex(y0 - 1, height), slots[0]);
+    loadFluidCPURow(cpu, step->src, y0, slots[1]);
+
+    for (int y = y0; y < y1; y++) {
+        float* const* d = slots[(y - y0) % 3];
+        float* const* c = slots[(y - y0 + 1) % 3];
+        float* const* u = slots[(y - y0 + 2) % 3];
+        loadFluidCPURow(cpu, step->src, wrapFluidCPUIndex(y + 1, height), u);
+
+        stepFluidCPURow(cpu, step->kernel, &src, y, (const float* const*)c, (const float* const*)u, (const float* const*)d, out, scratch);
+        storeFluidCPURow(cpu, step->dst, y, (const float* const*)out);
+    }
+}
+
+static void stepFluidCPUJob(void* arg, int worker, int workers) {
+    FluidCPUStep* step = (FluidCPUStep*)arg;
+    FluidCPU* cpu = step->cpu;
+    FluidCPUField* dst = &cpu->field[step->dst];
+    int width = cpu->width;
+    int height = cpu->height;
+
+    int y0, y1;
+    getFluidThreadRange(height, worker, workers, &y0, &y1);
+
+    if (cpu->storage != FLUID_CPU_STORAGE_F32) {
+        stepFluidCPUStagedRows(step, worker, y0, y1);
+        return;
+    }
+
+    if (cpu->time < 0.1) {
+        size_t start = (size_t)y0*width;
+        size_t count = (size_t)(y1 - y0)*width;
+        memset(dst->x + start, 0, count*sizeof(float));
+        memset(dst->y + start, 0, count*sizeof(float));
+        memset(dst->z + start, 0, count*sizeof(float));
+        for (size_t i = start; i < start + count; i++) dst->w[i] = 1;
+        return;
+    }
+
+    FluidCPUBand src = getFluidCPUFieldBand(cpu, step->src);
+    float* scratch = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS;
+
+    for (int y = y0; y < y1; y++) {
+        size_t row = (size_t)y*width;
+        float* out[4] = {dst->x + row, dst->y + row, dst->z + row, dst->w + row};
+        const float* c[4];
+        const float* u[4];
+        const float* d[4];
+        getFluidCPUBandRow(&src, width, y, c);
+        getFluidCPUBandRow(&src, width, wrapFluidCPUIndex(y + 1, height), u);
+        getFluidCPUBandRow(&src, width, wrapFluidCPUIndex(y - 1, height), d);
+        stepFluidCPURow(cpu, step->kernel, &src, y, c, u, d, out, scratch);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Solids
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidCPUSolidUpdate {
+    FluidCPU* cpu;
+    int x0, y0, x1, y1;
+} FluidCPUSolidUpdate;
+
+static void updateFluidCPUSolidJob(void* arg, int worker, int workers) {
+    FluidCPUSolidUpdate* update = (FluidCPUSolidUpdate*)arg;
+    FluidCPU* cpu = update->cpu;
+    int width = cpu->width;
+
+    int r0, r1;
+    getFluidThreadRange(update->y1 - update->y0, worker, workers, &r0, &r1);
+    for (int y = update->y0 + r0; y < update->y0 + r1; y++) {
+        const Color* c = cpu->boundary + (size_t)y*width;
+        const Color* u = cpu->boundary + (size_t)wrapFluidCPUIndex(y + 1, cpu->height)*width;
+        const Color* d = cpu->boundary + (size_t)wrapFluidCPUIndex(y - 1, cpu->height)*width;
+        unsigned char* out = cpu->solid + (size_t)y*width;
+        for (int x = update->x0; x < update->x1; x++) {
+            int left = (x == 0) ? width - 1 : x - 1;
+            int right = (x + 1 == width) ? 0 : x + 1;
+            out[x] = FLUID_SOLID_SELF*(c[x].r > 0) |
+                     FLUID_SOLID_LEFT*(c[left].r > 0) |
+                     FLUID_SOLID_RIGHT*(c[right].r > 0) |
+                     FLUID_SOLID_DOWN*(d[x].r > 0) |
+                     FLUID_SOLID_UP*(u[x].r > 0) |
+                     FLUID_SOLID_CLEAR*(c[x].g >= 128);
+        }
+    }
+}
+
+// Builds the flags again wherever boundary was drawn since the last time, and a
+// cell further each way for the neighbours that see it. Those tiles wake, and the
+// ones solid all over get noted so sparse stepping leaves them out. Steps and
+// projections call it first, anything else reading solid has to as well.
+void updateFluidCPUSolid(FluidCPU* cpu) {
+    if (cpu->solid_x1 <= cpu->solid_x0) return;
+
+    // Past an edge it wraps round, easier to take the whole way across
+    int x0 = cpu->solid_x0 - 1;
+    int y0 = cpu->solid_y0 - 1;
+    int x1 = cpu->solid_x1 + 1;
+    int y1 = cpu->solid_y1 + 1;
+    if (x0 < 0 || x1 > cpu->width) {
+        x0 = 0;
+        x1 = cpu->width;
+    }
+    if (y0 < 0 || y1 > cpu->height) {
+        y0 = 0;
+        y1 = cpu->height;
+    }
+    cpu->solid_x0 = cpu->solid_y0 = cpu->solid_x1 = cpu->solid_y1 = 0;
+
+    FluidCPUSolidUpdate update = {cpu, x0, y0, x1, y1};
+    runFluidThreadPool(cpu->pool, updateFluidCPUSolidJob, &update);
+
+    // Mostly the first cell that isn't solid ends the search
+    for (int ty = y0/FLUID_CPU_SLEEP_TILE; ty <= (y1 - 1)/FLUID_CPU_SLEEP_TILE; ty++) {
+        int cy0 = ty*FLUID_CPU_SLEEP_TILE;
+        int cy1 = (cy0 + FLUID_CPU_SLEEP_TILE < cpu->height) ? cy0 + FLUID_CPU_SLEEP_TILE : cpu->height;
+        for (int tx = x0/FLUID_CPU_SLEEP_TILE; tx <= (x1 - 1)/FLUID_CPU_SLEEP_TILE; tx++) {
+            int cx0 = tx*FLUID_CPU_SLEEP_TILE;
+            int cx1 = (cx0 + FLUID_CPU_SLEEP_TILE < cpu->width) ? cx0 + FLUID_CPU_SLEEP_TILE : cpu->width;
+            int solid = 1;
+            for (int y = cy0; y < cy1 && solid; y++) {
+                const unsigned char* row = cpu->solid + (size_t)y*cpu->width;
+                for (int x = cx0; x < cx1; x++) {
+                    if (!(row[x] & FLUID_SOLID_SELF)) {
+                        solid = 0;
+                        break;
+                    }
+                }
+            }
+
+            int tile = ty*cpu->sleep_tiles_x + tx;
+            cpu->solid_tiles[tile] = solid;
+            cpu->sleep_state[tile] |= FLUID_CPU_SLEEP_WOKEN;
+        }
+    }
+}
+
+// Cells x0 to x1 - 1 of rows y0 to y1 - 1 of boundary changed. Ones that overlap
+// what's waiting add up, anything apart gets what's waiting built first, so a few
+// regions far apart don't turn into one box over all of them. Building early is
+// fine, whatever changes after gets marked again.
+static void markFluidCPUSolid(FluidCPU* cpu, int x0, int y0, int x1, int y1) {
+    if (x1 <= x0 || y1 <= y0) return;
+    if (cpu->solid_x1 > cpu->solid_x0) {
+        int apart = x1 < cpu->solid_x0 || cpu->solid_x1 < x0 || y1 < cpu->solid_y0 || cpu->solid_y1 < y0;
+        if (!apart) {
+            if (x0 < cpu->solid_x0) cpu->solid_x0 = x0;
+            if (y0 < cpu->solid_y0) cpu->solid_y0 = y0;
+            if (x1 > cpu->solid_x1) cpu->solid_x1 = x1;
+            if (y1 > cpu->solid_y1) cpu->solid_y1 = y1;
+            return;
+        }
+        updateFluidCPUSolid(cpu);
+    }
+    cpu->solid_x0 = x0;
+    cpu->solid_y0 = y0;
+    cpu->solid_x1 = x1;
+    cpu->solid_y1 = y1;
+}
+
+// Same, in draw space like the clip
+static void markFluidCPUSolidDraw(FluidCPU* cpu, int x0, int y0, int x1, int y1) {
+    markFluidCPUSolid(cpu, x0, cpu->height - y1, x1, cpu->height - y0);
+}
+
+// Sleep tiles solid all over, as of the last update
+int getFluidCPUSolidTiles(const FluidCPU* cpu) {
+    int count = 0;
+    for (int i = 0; i < cpu->sleep_tiles_x*cpu->sleep_tiles_y; i++) count += cpu->solid_tiles[i];
+    return count;
+}
+
+//----------------------------------------------------------------------------------
+// Pressure projection
+//----------------------------------------------------------------------------------
+
+// Divergence of the front field into the multigrid's top level, and which faces are
+// open. Solid cells don't move, so their velocity counts as 0. Rows go through three slots like
+// stepFluidCPUStagedRows, whatever the storage.
+static void divergeFluidCPUJob(void* arg, int worker, int workers) {
+    FluidCPU* cpu = (FluidCPU*)arg;
+    FluidMultigridLevel* level = &cpu->multigrid.levels[0];
+    const unsigned char* solid = cpu->solid;
+    int width = cpu->width;
+    int height = cpu->height;
+    float scale = 0.5f/level->h;
+
+    float* planes = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS + (size_t)width*FLUID_CPU_SCRATCH_ROWS;
+    float* slots[3][4];
+    for (int i = 0; i < 4; i++) {
+        for (int k = 0; k < 3; k++) slots[k][i] = planes + (size_t)(4*k + i)*width;
+    }
+
+    int y0, y1;
+    getFluidThreadRange(height, worker, workers, &y0, &y1);
+    loadFluidCPURow(cpu, cpu->front, wrapFluidCPUIndex(y0 - 1, height), slots[0]);
+    loadFluidCPURow(cpu, cpu->front, y0, slots[1]);
+
+    for (int y = y0; y < y1; y++) {
+        float* const* d = slots[(y - y0) % 3];
+        float* const* c = slots[(y - y0 + 1) % 3];
+        float* const* u = slots[(y - y0 + 2) % 3];
+        loadFluidCPURow(cpu, cpu->front, wrapFluidCPUIndex(y + 1, height), u);
+
+        size_t row = (size_t)y*width;
+        for (int x = 0; x < width; x++) {
+            size_t i = row + x;
+            int left = (x == 0) ? width - 1 : x - 1;
+            int right = (x + 1 == width) ? 0 : x + 1;
+            unsigned char flags = solid[i];
+            int fluid = !(flags & FLUID_SOLID_SELF);
+            level->p[i] = 0;
+            level->right[i] = fluid && !(flags & FLUID_SOLID_RIGHT);
+            level->up[i] = fluid && !(flags & FLUID_SOLID_UP);
+            if (!fluid) {
+                level->rhs[i] = 0;
+                continue;
+            }
+
+            float vl = (flags & FLUID_SOLID_LEFT) ? 0 : c[0][left];
+            float vr = (flags & FLUID_SOLID_RIGHT) ? 0 : c[0][right];
+            float vd = (flags & FLUID_SOLID_DOWN) ? 0 : d[1][x];
+            float vu = (flags & FLUID_SOLID_UP) ? 0 : u[1][x];
+            level->rhs[i] = (vr - vl + vu - vd)*scale;
+        }
+    }
+}
+
+// Takes the gradient of the solved pressure off the front field's velocity. A solid
+// neighbour has the cell's own pressure, so nothing gets pushed into walls.
+static void subtractFluidCPUGradientJob(void* arg, int worker, int workers) {
+    FluidCPU* cpu = (FluidCPU*)arg;
+    const FluidMultigridLevel* level = &cpu->multigrid.levels[0];
+    const unsigned char* solid = cpu->solid;
+    const float* p = level->p;
+    int width = cpu->width;
+    int height = cpu->height;
+    float scale = 0.5f/level->h;
+
+    float* planes = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS + (size_t)width*FLUID_CPU_SCRATCH_ROWS;
+    float* c[4];
+    for (int i = 0; i < 4; i++) c[i] = planes + (size_t)i*width;
+
+    int y0, y1;
+    getFluidThreadRange(height, worker, workers, &y0, &y1);
+    for (int y = y0; y < y1; y++) {
+        loadFluidCPURow(cpu, cpu->front, y, c);
+
+        size_t row = (size_t)y*width;
+        size_t up = (size_t)wrapFluidCPUIndex(y + 1, height)*width;
+        size_t down = (size_t)wrapFluidCPUIndex(y - 1, height)*width;
+        for (int x = 0; x < width; x++) {
+            size_t i = row + x;
+            if (solid[i] & FLUID_SOLID_SELF) continue;
+
+            int left = (x == 0) ? width - 1 : x - 1;
+            int right = (x + 1 == width) ? 0 : x + 1;
+            float pl = level->right[row + left] ? p[row + left] : p[i];
+            float pr = level->right[i] ? p[row + right] : p[i];
+            float pd = level->up[down + x] ? p[down + x] : p[i];
+            float pu = level->up[i] ? p[up + x] : p[i];
+            c[0][x] -= (pr - pl)*scale;
+            c[1][x] -= (pu - pd)*scale;
+        }
+        storeFluidCPURow(cpu, cpu->front, y, (const float* const*)c);
+    }
+}
+
+// Makes the multigrid for the current size if there isn't one, keeping its settings
+FluidMultigrid* getFluidCPUMultigrid(FluidCPU* cpu) {
+    FluidMultigrid* mg = &cpu->multigrid;
+    if (mg->level_count == 0) {
+        int cycles = mg->cycles;
+        float tolerance = mg->tolerance;
+        *mg = createFluidMultigrid(cpu->width, cpu->height, cpu->params.cell_size);
+        mg->cycles = cycles;
+        mg->tolerance = tolerance;
+    }
+    return mg;
+}
+
+// Takes the divergence out of the front field's velocity, with V-cycles of
+// fluid_multigrid.h until its residual is down to multigrid.tolerance. Solids come
+// from the same flags that stop the step.
+void projectFluidCPU(FluidCPU* cpu) {
+    FluidMultigrid* mg = getFluidCPUMultigrid(cpu);
+    updateFluidCPUSolid(cpu);
+    runFluidThreadPool(cpu->pool, divergeFluidCPUJob, cpu);
+    solveFluidMultigrid(mg, cpu->pool);
+    runFluidThreadPool(cpu->pool, subtractFluidCPUGradientJob, cpu);
+}
+
+//----------------------------------------------------------------------------------
+// Sparse tiles
+//----------------------------------------------------------------------------------
+
+// Picks this substep's tiles: ones that moved last time or have a neighbour that did,
+// ones an emitter is over and ones something was drawn into. A tile that goes to
+// sleep still has the older substep in the back field, so it's copied across once.
+// Tiles solid all over come out of a step as they went in, so they only ever get
+// that copy.
+static void scheduleFluidCPUTiles(FluidCPU* cpu) {
+    int tiles_x = cpu->sleep_tiles_x;
+    int tiles_y = cpu->sleep_tiles_y;
+
+    // Emitters don't wrap, a cell either side covers the stencil
+    for (int i = 0; i < cpu->emitter_count; i++) {
+        Rectangle bounds = getFluidEmitterBounds(&cpu->emitters[i]);
+        if (bounds.x + bounds.width < -1 || bounds.y + bounds.height < -1 || bounds.x > cpu->width || bounds.y > cpu->height) continue;
+        int x0 = (int)fmaxf(floorf(bounds.x) - 1, 0)/FLUID_CPU_SLEEP_TILE;
+        int y0 = (int)fmaxf(floorf(bounds.y) - 1, 0)/FLUID_CPU_SLEEP_TILE;
+        int x1 = (int)fminf(ceilf(bounds.x + bounds.width) + 1, cpu->width - 1)/FLUID_CPU_SLEEP_TILE;
+        int y1 = (int)fminf(ceilf(bounds.y + bounds.height) + 1, cpu->height - 1)/FLUID_CPU_SLEEP_TILE;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) cpu->sleep_state[y*tiles_x + x] |= FLUID_CPU_SLEEP_WOKEN;
+        }
+    }
+
+    cpu->sleep_job_count = 0;
+    cpu->awake_tiles = 0;
+    for (int y = 0; y < tiles_y; y++) {
+        for (int x = 0; x < tiles_x; x++) {
+            int tile = y*tiles_x + x;
+            int run = cpu->sleep_state[tile] & FLUID_CPU_SLEEP_WOKEN;
+            for (int dy = -1; dy <= 1; dy++) {
+                int row = wrapFluidCPUIndex(y + dy, tiles_y)*tiles_x;
+                for (int dx = -1; dx <= 1; dx++) run |= cpu->sleep_active[row + wrapFluidCPUIndex(x + dx, tiles_x)];
+            }
+
+            if (run && !cpu->solid_tiles[tile]) {
+                cpu->sleep_jobs[cpu->sleep_job_count++] = tile;
+                cpu->sleep_state[tile] = 0;
+                cpu->awake_tiles++;
+            } else if (!(cpu->sleep_state[tile] & FLUID_CPU_SLEEP_SYNCED)) {
+                cpu->sleep_jobs[cpu->sleep_job_count++] = -tile - 1;
+                cpu->sleep_state[tile] = FLUID_CPU_SLEEP_SYNCED;
+            }
+        }
+    }
+
+    // Neighbours have seen whatever a solid tile did before it went solid, from now
+    // on it doesn't change
+    for (int i = 0; i < tiles_x*tiles_y; i++) {
+        if (cpu->solid_tiles[i]) cpu->sleep_active[i] = 0;
+    }
+}
+
+// Workers take every workers-th tile so busy areas get spread out. Stepped tiles
+// note whether they're still moving for the next schedule.
+static void stepFluidCPUTileJob(void* arg, int worker, int workers) {
+    FluidCPUStep* step = (FluidCPUStep*)arg;
+    FluidCPU* cpu = step->cpu;
+    int width = cpu->width;
+    int height = cpu->height;
+    FluidCPUBand src = getFluidCPUFieldBand(cpu, step->src);
+    FluidCPUField* dst = &cpu->field[step->dst];
+    float* scratch = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS;
+
+    for (int j = worker; j < cpu->sleep_job_count; j += workers) {
+        int job = cpu->sleep_jobs[j];
+        int tile = (job < 0) ? -job - 1 : job;
+        int x0 = (tile % cpu->sleep_tiles_x)*FLUID_CPU_SLEEP_TILE;
+        int y0 = (tile / cpu->sleep_tiles_x)*FLUID_CPU_SLEEP_TILE;
+        int x1 = (x0 + FLUID_CPU_SLEEP_TILE < width) ? x0 + FLUID_CPU_SLEEP_TILE : width;
+        int y1 = (y0 + FLUID_CPU_SLEEP_TILE < height) ? y0 + FLUID_CPU_SLEEP_TILE : height;
+
+        float speed = 0;
+        float change = 0;
+        for (int y = y0; y < y1; y++) {
+            size_t row = (size_t)y*width;
+            float* out[4] = {dst->x + row, dst->y + row, dst->z + row, dst->w + row};
+            const float* c[4];
+            getFluidCPUBandRow(&src, width, y, c);
+
+            if (job < 0) {
+                for (int i = 0; i < 4; i++) memcpy(out[i] + x0, c[i] + x0, (x1 - x0)*sizeof(float));
+                continue;
+            }
+
+            const float* u[4];
+            const float* d[4];
+            getFluidCPUBandRow(&src, width, wrapFluidCPUIndex(y + 1, height), u);
+            getFluidCPUBandRow(&src, width, wrapFluidCPUIndex(y - 1, height), d);
+            stepFluidCPUSpan(cpu, step->kernel, &src, y, c, u, d, out, scratch, x0, x1);
+
+            for (int x = x0; x < x1; x++) {
+                speed = fmaxf(speed, fmaxf(fabsf(out[0][x]), fabsf(out[1][x])));
+                change = fmaxf(change, fmaxf(fabsf(out[2][x] - c[2][x]), fabsf(out[3][x] - c[3][x])));
+            }
+        }
+        if (job >= 0) cpu->sleep_active[tile] = (speed > cpu->sleep_speed) || (change > cpu->sleep_change);
+    }
+}
+
+// Skips calm tiles from now on, or goes back to stepping everything. Only float
+// storage steps sparsely, the others always step the whole field. The thresholds
+// are sleep_speed and sleep_change, with both at 0 only tiles that would come out
+// exactly the same are skipped.
+void setFluidCPUSparse(FluidCPU* cpu, int sparse) {
+    cpu->sparse = sparse;
+    wakeFluidCPUTiles(cpu);
+}
+
+// Cells the last substep stepped, all of them unless it was sparse
+size_t getFluidCPUAwakeCells(const FluidCPU* cpu) {
+    if (cpu->awake_tiles == cpu->sleep_tiles_x*cpu->sleep_tiles_y) return (size_t)cpu->width*cpu->height;
+    return (size_t)cpu->awake_tiles*FLUID_CPU_SLEEP_TILE*FLUID_CPU_SLEEP_TILE;
+}
+
+// Runs one pass of fluid_comp.glsl from the front field into the back field
+void stepFluidCPU(FluidCPU* cpu) {
+    updateFluidCPUSolid(cpu);
+
+    FluidCPUStep step = {
+        .cpu = cpu,
+        .src = cpu->front,
+        .dst = 1 - cpu->front,
+        .kernel = getFluidRowKernel(),
+    };
+
+    // The first substeps reset everything. A projection changes every cell, so there's
+    // nothing calm to skip.
+    int project = cpu->params.pressure == FLUID_PRESSURE_PROJECTION;
+    if (cpu->sparse && !project && cpu->storage == FLUID_CPU_STORAGE_F32 && cpu->time >= 0.1) {
+        scheduleFluidCPUTiles(cpu);
+        runFluidThreadPool(cpu->pool, stepFluidCPUTileJob, &step);
+    } else {
+        runFluidThreadPool(cpu->pool, stepFluidCPUJob, &step);
+        wakeFluidCPUTiles(cpu);
+    }
+    cpu->front = 1 - cpu->front;
+
+    if (project && cpu->time >= 0.1) projectFluidCPU(cpu);
+}
+
+//----------------------------------------------------------------------------------
+// Temporal blocking
+//----------------------------------------------------------------------------------
+
+#define FLUID_CPU_BLOCK_REACH (4)   // Rows advection can look back in a substep, 4 is what emitters move
+#define FLUID_CPU_BLOCK_HALO (FLUID_CPU_BLOCK_REACH + 1)    // Plus bilinear's second row, covers the stencil too
+
+typedef struct NV_FluidCPUBlock {
+    FluidCPU* cpu;
+    int src;
+    int dst;
+    FluidRowKernel kernel;
+    int substeps;
+    int escaped;
+} FluidCPUBlock;
+
+// Every substep steps the band plus a halo that shrinks by FLUID_CPU_BLOCK_HALO rows
+// each time, reading what the last substep left in the worker's own two buffers
+static void stepFluidCPUBlockJob(void* arg, int worker, int workers) {
+    FluidCPUBlock* block = (FluidCPUBlock*)arg;
+    FluidCPU* cpu = block->cpu;
+    FluidCPUField* dst = &cpu->field[block->dst];
+    int width = cpu->width;
+    int height = cpu->height;
+    int substeps = block->substeps;
+    int halo = FLUID_CPU_BLOCK_HALO;
+    int reach = substeps*halo;
+
+    float* scratch = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS;
+    size_t plane = (size_t)(cpu->block_rows + 2*reach)*width;
+    float* buffers = cpu->block_scratch + (size_t)worker*8*plane;
+    FluidCPUField local[2];
+    for (int i = 0; i < 2; i++) {
+        local[i] = (FluidCPUField){buffers + (4*i)*plane, buffers + (4*i + 1)*plane, buffers + (4*i + 2)*plane, buffers + (4*i + 3)*plane};
+    }
+
+    int y0, y1;
+    getFluidThreadRange(height, worker, workers, &y0, &y1);
+    FluidCPUBand field = getFluidCPUFieldBand(cpu, block->src);
+
+    for (int b0 = y0; b0 < y1; b0 += cpu->block_rows) {
+        int b1 = (b0 + cpu->block_rows < y1) ? b0 + cpu->block_rows : y1;
+        int lo = b0 - reach;   // Field row of buffer row 0, before wrapping
+
+        for (int s = 1; s <= substeps; s++) {
+            int r0 = b0 - (substeps - s)*halo;
+            int r1 = b1 + (substeps - s)*halo;
+            FluidCPUField* next = &local[s & 1];
+
+            // The first substep reads the field, the rest what the one before stepped
+            FluidCPUBand src = field;
+            if (s > 1) {
+                FluidCPUField* prev = &local[(s - 1) & 1];
+                size_t offset = (size_t)(r0 - halo - lo)*width;
+                src.rows = (FluidCPUField){prev->x + offset, prev->y + offset, prev->z + offset, prev->w + offset};
+                src.first = wrapFluidCPUIndex(r0 - halo, height);
+                src.count = r1 - r0 + 2*halo;
+            }
+
+            for (int y = r0; y < r1; y++) {
+                int row_y = wrapFluidCPUIndex(y, height);
+                int row = (s > 1) ? y - (r0 - halo) : row_y;
+                int up = (s > 1) ? row + 1 : wrapFluidCPUIndex(y + 1, height);
+                int down = (s > 1) ? row - 1 : wrapFluidCPUIndex(y - 1, height);
+
+                size_t out_row = (s == substeps) ? (size_t)row_y*width : (size_t)(y - lo)*width;
+                FluidCPUField* out_field = (s == substeps) ? dst : next;
+                float* out[4] = {out_field->x + out_row, out_field->y + out_row, out_field->z + out_row, out_field->w + out_row};
+
+                const float* c[4];
+                const float* u[4];
+                const float* d[4];
+                getFluidCPUBandRow(&src, width, row, c);
+                getFluidCPUBandRow(&src, width, up, u);
+                getFluidCPUBandRow(&src, width, down, d);
+                stepFluidCPURow(cpu, block->kernel, &src, row_y, c, u, d, out, scratch);
+            }
+
+            // Whatever advection read outside the band is wrong, the frame gets run again
+            if (src.escaped) {
+                __atomic_store_n(&block->escaped, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+    }
+}
+
+// Runs several substeps at once. With block_rows set, each worker takes its rows a
+// band at a time through every substep, so the band and its halo stay in cache
+// instead of the whole field going through memory once per substep. Halos get
+// stepped more than once, and if advection reaches past one the frame is run again
+// unblocked, so the result is always the same as calling stepFluidCPU that many times.
+// Half and tiled storage, sparse stepping and projection go a substep at a time.
+void stepFluidCPUSubsteps(FluidCPU* cpu, int substeps) {
+    updateFluidCPUSolid(cpu);
+
+    int reach = substeps*FLUID_CPU_BLOCK_HALO;
+    if (cpu->storage != FLUID_CPU_STORAGE_F32 || cpu->sparse || cpu->params.pressure == FLUID_PRESSURE_PROJECTION || cpu->block_rows <= 0 || substeps < 2 || cpu->time < 0.1 || cpu->block_rows + 2*reach >= cpu->height) {
+        for (int i = 0; i < substeps; i++) stepFluidCPU(cpu);
+        return;
+    }
+
+    size_t size = (size_t)cpu->pool->count*8*(cpu->block_rows + 2*reach)*cpu->width;
+    if (size > cpu->block_scratch_size) {
+        free(cpu->block_scratch);
+        cpu->block_scratch = malloc(size*sizeof(float));
+        cpu->block_scratch_size = size;
+    }
+
+    FluidCPUBlock block = {
+        .cpu = cpu,
+        .src = cpu->front,
+        .dst = 1 - cpu->front,
+        .kernel = getFluidRowKernel(),
+        .substeps = substeps,
+    };
+    runFluidThreadPool(cpu->pool, stepFluidCPUBlockJob, &block);
+
+    if (block.escaped) {
+        cpu->block_fallbacks++;
+        for (int i = 0; i < substeps; i++) stepFluidCPU(cpu);
+        return;
+    }
+    wakeFluidCPUTiles(cpu);
+
+    // The result is in the back field, an even count has to end up where it started
+    if (substeps % 2 == 0) {
+        FluidCPUField front = cpu->field[cpu->front];
+        cpu->field[cpu->front] = cpu->field[1 - cpu->front];
+        cpu->field[1 - cpu->front] = front;
+    } else {
+        cpu->front = 1 - cpu->front;
+    }
+}
+
+// Channel 0 to 3 (x, y, z, w) of cell x, y of field 0 or 1, however it's stored
+static inline float getFluidCPUChannel(const FluidCPU* cpu, int index, int channel, int x, int y) {
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) return convertFloat16ToNativeFloat(cpu->half[index][((size_t)y*cpu->width + x)*4 + channel]);
+
+    const FluidCPUField* field = &cpu->field[index];
+    const float* planes[4] = {field->x, field->y, field->z, field->w};
+    if (cpu->storage == FLUID_CPU_STORAGE_F32_TILES) return planes[channel][getFluidCPUTileIndex(getFluidCPUTilesX(cpu->width), x, y)];
+    return planes[channel][(size_t)y*cpu->width + x];
+}
+
+// Reads a cell, x and y in image coordinates
+Vector4 getFluidCPUValue(FluidCPU* cpu, int x, int y) {
+    int front = cpu->front;
+    return (Vector4){
+        getFluidCPUChannel(cpu, front, 0, x, y),
+        getFluidCPUChannel(cpu, front, 1, x, y),
+        getFluidCPUChannel(cpu, front, 2, x, y),
+        getFluidCPUChannel(cpu, front, 3, x, y)
+    };
+}
+
+typedef struct NV_FluidCPUResize {
+    FluidCPU* cpu;
+    const FluidCPU* old;
+} FluidCPUResize;
+
+// Bilinear and wrapping like the GL texture, so both backends resample the same way
+static inline float sampleFluidCPUPlane(const FluidCPU* cpu, int channel, float sx, float sy) {
+    int width = cpu->width;
+    int height = cpu->height;
+    float fx = floorf(sx);
+    float fy = floorf(sy);
+    float tx = sx - fx;
+    float ty = sy - fy;
+
+    int x0 = wrapFluidCPUIndex((int)fx, width);
+    int y0 = wrapFluidCPUIndex((int)fy, height);
+    int x1 = (x0 + 1 == width) ? 0 : x0 + 1;
+    int y1 = (y0 + 1 == height) ? 0 : y0 + 1;
+
+    int front = cpu->front;
+    return (getFluidCPUChannel(cpu, front, channel, x0, y0)*(1 - tx) + getFluidCPUChannel(cpu, front, channel, x1, y0)*tx)*(1 - ty) +
+           (getFluidCPUChannel(cpu, front, channel, x0, y1)*(1 - tx) + getFluidCPUChannel(cpu, front, channel, x1, y1)*tx)*ty;
+}
+
+// Resamples the old front field into the new one, after clearFluidCPUJob has
+// zeroed it so the padding of tiled storage is too
+static void resizeFluidCPUJob(void* arg, int worker, int workers) {
+    FluidCPUResize* resize = (FluidCPUResize*)arg;
+    FluidCPU* cpu = resize->cpu;
+    const FluidCPU* old = resize->old;
+    int width = cpu->width;
+
+    int y0, y1;
+    getFluidThreadRange(cpu->height, worker, workers, &y0, &y1);
+
+    // Rows get staged in the worker's scratch and stored however the field is kept
+    float* scratch = cpu->row_scratch + (size_t)worker*width*FLUID_CPU_WORKER_ROWS;
+    float* row[4];
+    for (int c = 0; c < 4; c++) row[c] = scratch + (size_t)(FLUID_CPU_SCRATCH_ROWS + c)*width;
+
+    // Texel centers line up, same as drawing the old texture over the new one
+    float scale_x = (float)old->width / width;
+    float scale_y = (float)old->height / cpu->height;
+
+    for (int y = y0; y < y1; y++) {
+        float sy = (y + 0.5f)*scale_y - 0.5f;
+        for (int x = 0; x < width; x++) {
+            float sx = (x + 0.5f)*scale_x - 0.5f;
+            for (int c = 0; c < 4; c++) row[c][x] = sampleFluidCPUPlane(old, c, sx, sy);
+        }
+        storeFluidCPURow(cpu, 0, y, (const float* const*)row);
+    }
+
+    memset(scratch, 0, (size_t)width*FLUID_CPU_WORKER_ROWS*sizeof(float));
+}
+
+// Changes the grid size, keeping the flow. Velocity is in reference texels so it
+// carries over as it is. Boundaries are cleared and have to be drawn again.
+void resizeFluidCPU(FluidCPU* cpu, int width, int height) {
+    FluidCPU old = *cpu;
+
+    cpu->width = width;
+    cpu->height = height;
+    allocFluidCPUStorage(cpu);
+    cpu->front = 0;
+    cpu->boundary = malloc((size_t)width * height * sizeof(Color));
+    cpu->row_scratch = malloc((size_t)cpu->pool->count * width * FLUID_CPU_WORKER_ROWS * sizeof(float));
+    cpu->params.cell_size = (float)FLUID_REFERENCE_WIDTH / width;
+    cpu->clip_x0 = cpu->clip_y0 = 0;
+    cpu->clip_x1 = width;
+    cpu->clip_y1 = height;
+    allocFluidCPUSleep(cpu);
+    allocFluidCPUSolid(cpu);
+
+    // Tile rows and row bands don't line up, so everything's zeroed before any gets stored
+    FluidCPUResize resize = {cpu, &old};
+    runFluidThreadPool(cpu->pool, clearFluidCPUJob, cpu);
+    runFluidThreadPool(cpu->pool, resizeFluidCPUJob, &resize);
+
+    // Pool carries over, everything else of the old size goes. The multigrid gets
+    // made again for the new one when it's next used.
+    unloadFluidMultigrid(&cpu->multigrid);
+    freeFluidCPUStorage(&old);
+    freeFluidCPUSleep(&old);
+    free(old.boundary);
+    free(old.solid);
+    free(old.solid_tiles);
+    free(old.row_scratch);
+}
+
+// Switches how the field is kept, converting the front one. Halves are what the GL
+// texture holds, half the memory and traffic of floats, rounded every substep.
+// Tiles keep floats but put each FLUID_CPU_TILE square together for advection.
+void setFluidCPUStorage(FluidCPU* cpu, FluidCPUStorage storage) {
+    if (storage == cpu->storage) return;
+    if (storage == FLUID_CPU_STORAGE_F16) getFluidHalfTable();    // Advection samples through it
+
+    FluidCPU old = *cpu;
+    for (int i = 0; i < 2; i++) {
+        cpu->field[i] = (FluidCPUField){ 0 };
+        cpu->half[i] = NULL;
+    }
+    cpu->storage = storage;
+    allocFluidCPUStorage(cpu);
+
+    // Goes through the first worker's staging rows, same as a step would
+    int width = cpu->width;
+    float* row[4];
+    for (int c = 0; c < 4; c++) row[c] = cpu->row_scratch + (size_t)(FLUID_CPU_SCRATCH_ROWS + c)*width;
+    clearFluidCPUFieldRange(cpu, 0, 0, 1);    // Padding of tiles never gets stored to
+    for (int y = 0; y < cpu->height; y++) {
+        loadFluidCPURow(&old, old.front, y, row);
+        storeFluidCPURow(cpu, 0, y, (const float* const*)row);
+    }
+    clearFluidCPUFieldRange(cpu, 1, 0, 1);
+
+    freeFluidCPUStorage(&old);
+    cpu->front = 0;
+    wakeFluidCPUTiles(cpu);
+}
+
+// Bytes both fields take, tiles round the grid up to whole tiles
+size_t getFluidCPUFieldBytes(const FluidCPU* cpu) {
+    size_t cell = (cpu->storage == FLUID_CPU_STORAGE_F16) ? 4*sizeof(unsigned short) : 4*sizeof(float);
+    return 2*getFluidCPUPlaneSize(cpu)*cell;
+}
+
+//----------------------------------------------------------------------------------
+// Drawing
+//----------------------------------------------------------------------------------
+
+// Like a scissor rectangle, draws after this only touch cells inside it. Draw space
+// like the draws themselves, so y counts down from the top row.
+void clipFluidCPUDraws(FluidCPU* cpu, int x, int y, int width, int height) {
+    cpu->clip_x0 = (x < 0) ? 0 : x;
+    cpu->clip_y0 = (y < 0) ? 0 : y;
+    cpu->clip_x1 = (x + width > cpu->width) ? cpu->width : x + width;
+    cpu->clip_y1 = (y + height > cpu->height) ? cpu->height : y + height;
+}
+
+void unclipFluidCPUDraws(FluidCPU* cpu) {
+    clipFluidCPUDraws(cpu, 0, 0, cpu->width, cpu->height);
+}
+
+// Clears the solids inside the clip rectangle so they can be drawn again, waking
+// the tiles under it like drawing does
+void clearFluidCPUBoundaryClip(FluidCPU* cpu) {
+    if (cpu->clip_x1 <= cpu->clip_x0 || cpu->clip_y1 <= cpu->clip_y0) return;
+
+    for (int py = cpu->clip_y0; py < cpu->clip_y1; py++) {
+        int row = (cpu->height - 1 - py)*cpu->width;
+        memset(cpu->boundary + row + cpu->clip_x0, 0, (size_t)(cpu->clip_x1 - cpu->clip_x0)*sizeof(Color));
+    }
+    markFluidCPUSolidDraw(cpu, cpu->clip_x0, cpu->clip_y0, cpu->clip_x1, cpu->clip_y1);
+
+    int tx0 = cpu->clip_x0/FLUID_CPU_SLEEP_TILE;
+    int tx1 = (cpu->clip_x1 - 1)/FLUID_CPU_SLEEP_TILE;
+    int ty0 = (cpu->height - cpu->clip_y1)/FLUID_CPU_SLEEP_TILE;
+    int ty1 = (cpu->height - 1 - cpu->clip_y0)/FLUID_CPU_SLEEP_TILE;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) cpu->sleep_state[ty*cpu->sleep_tiles_x + tx] = FLUID_CPU_SLEEP_WOKEN;
+    }
+}
+
+// Same blending as BLEND_ALPHA into the float render texture
+static inline void blendFluidCPUCell(FluidCPU* cpu, int i, Color color) {
+    // Solids change how the cell steps, colors change the cell, either way it has to wake
+    int tile = (i / cpu->width)/FLUID_CPU_SLEEP_TILE*cpu->sleep_tiles_x + (i % cpu->width)/FLUID_CPU_SLEEP_TILE;
+    cpu->sleep_state[tile] = FLUID_CPU_SLEEP_WOKEN;
+
+    if (cpu->draw_target == FLUID_CPU_TARGET_BOUNDARY) {
+        cpu->boundary[i] = color;
+        return;
+    }
+
+    // Draws always land in fluid_tex on the GL side, field 0 mirrors that
+    float a = color.a / 255.0f;
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) {
+        unsigned short* half = cpu->half[0] + (size_t)i*4;
+        float w = convertFloat16ToNativeFloat(half[3]);
+        half[0] = convertNativeFloatToFloat16((color.r / 255.0f)*a + convertFloat16ToNativeFloat(half[0])*(1 - a));
+        half[1] = convertNativeFloatToFloat16((color.g / 255.0f)*a + convertFloat16ToNativeFloat(half[1])*(1 - a));
+        half[2] = convertNativeFloatToFloat16((color.b / 255.0f)*a + convertFloat16ToNativeFloat(half[2])*(1 - a));
+        half[3] = convertNativeFloatToFloat16(a*a + w*(1 - a));
+        return;
+    }
+
+    size_t j = i;
+    if (cpu->storage == FLUID_CPU_STORAGE_F32_TILES) j = getFluidCPUTileIndex(getFluidCPUTilesX(cpu->width), i % cpu->width, i / cpu->width);
+
+    FluidCPUField* field = &cpu->field[0];
+    field->x[j] = (color.r / 255.0f)*a + field->x[j]*(1 - a);
+    field->y[j] = (color.g / 255.0f)*a + field->y[j]*(1 - a);
+    field->z[j] = (color.b / 255.0f)*a + field->z[j]*(1 - a);
+    field->w[j] = a*a + field->w[j]*(1 - a);
+}
+
+// Fills a convex polygon given in texture mode screen coordinates (y down)
+static void fillFluidCPUConvex(FluidCPU* cpu, const Vector2* points, int count, Color color) {
+    float min_x = points[0].x, max_x = points[0].x;
+    float min_y = points[0].y, max_y = points[0].y;
+    float area = 0;
+    for (int i = 0; i < count; i++) {
+        const Vector2 a = points[i];
+        const Vector2 b = points[(i + 1) % count];
+        min_x = fminf(min_x, a.x);
+        max_x = fmaxf(max_x, a.x);
+        min_y = fminf(min_y, a.y);
+        max_y = fmaxf(max_y, a.y);
+        area += a.x*b.y - b.x*a.y;
+    }
+    float winding = (area < 0) ? -1.0f : 1.0f;
+
+    int x0 = (int)fmaxf(cpu->clip_x0, floorf(min_x));
+    int x1 = (int)fminf(cpu->clip_x1 - 1, ceilf(max_x));
+    int y0 = (int)fmaxf(cpu->clip_y0, floorf(min_y));
+    int y1 = (int)fminf(cpu->clip_y1 - 1, ceilf(max_y));
+    if (cpu->draw_target == FLUID_CPU_TARGET_BOUNDARY) markFluidCPUSolidDraw(cpu, x0, y0, x1 + 1, y1 + 1);
+
+    for (int py = y0; py <= y1; py++) {
+        int row = (cpu->height - 1 - py)*cpu->width;
+        for (int px = x0; px <= x1; px++) {
+            float cx = px + 0.5f;
+            float cy = py + 0.5f;
+            int inside = 1;
+            for (int i = 0; i < count && inside; i++) {
+                const Vector2 a = points[i];
+                const Vector2 b = points[(i + 1) % count];
+                inside = winding*((b.x - a.x)*(cy - a.y) - (b.y - a.y)*(cx - a.x)) >= 0;
+            }
+            if (inside) blendFluidCPUCell(cpu, row + px, color);
+        }
+    }
+}
+
+// Matches DrawRectanglePro
+void drawFluidCPURectanglePro(FluidCPU* cpu, Rectangle rec, Vector2 origin, float rotation, Color color) {
+    float s = sinf(rotation*DEG2RAD);
+    float c = cosf(rotation*DEG2RAD);
+    float dx = -origin.x;
+    float dy = -origin.y;
+
+    Vector2 points[4] = {
+        {rec.x + dx*c - dy*s, rec.y + dx*s + dy*c},
+        {rec.x + (dx + rec.width)*c - dy*s, rec.y + (dx + rec.width)*s + dy*c},
+        {rec.x + (dx + rec.width)*c - (dy + rec.height)*s, rec.y + (dx + rec.width)*s + (dy + rec.height)*c},
+        {rec.x + dx*c - (dy + rec.height)*s, rec.y + dx*s + (dy + rec.height)*c},
+    };
+    fillFluidCPUConvex(cpu, points, 4, color);
+}
+
+// Matches DrawRectangle
+void drawFluidCPURectangle(FluidCPU* cpu, int x, int y, int width, int height, Color color) {
+    drawFluidCPURectanglePro(cpu, (Rectangle){x, y, width, height}, (Vector2){0, 0}, 0, color);
+}
+
+// Matches DrawCircle
+void drawFluidCPUCircle(FluidCPU* cpu, int center_x, int center_y, float radius, Color color) {
+    int x0 = (int)fmaxf(cpu->clip_x0, floorf(center_x - radius));
+    int x1 = (int)fminf(cpu->clip_x1 - 1, ceilf(center_x + radius));
+    int y0 = (int)fmaxf(cpu->clip_y0, floorf(center_y - radius));
+    int y1 = (int)fminf(cpu->clip_y1 - 1, ceilf(center_y + radius));
+    if (cpu->draw_target == FLUID_CPU_TARGET_BOUNDARY) markFluidCPUSolidDraw(cpu, x0, y0, x1 + 1, y1 + 1);
+
+    for (int py = y0; py <= y1; py++) {
+        int row = (cpu->height - 1 - py)*cpu->width;
+        float dy = py + 0.5f - center_y;
+        for (int px = x0; px <= x1; px++) {
+            float dx = px + 0.5f - center_x;
+            if (dx*dx + dy*dy <= radius*radius) blendFluidCPUCell(cpu, row + px, color);
+        }
+    }
+}
+
+// Matches DrawPoly
+void drawFluidCPUPoly(FluidCPU* cpu, Vector2 center, int sides, float radius, float rotation, Color color) {
+    if (sides < 3) sides = 3;
+    if (sides > 64) sides = 64;
+
+    Vector2 points[64];
+    for (int i = 0; i < sides; i++) {
+        float angle = (rotation + i*360.0f/sides)*DEG2RAD;
+        points[i] = (Vector2){center.x + cosf(angle)*radius, center.y + sinf(angle)*radius};
+    }
+    fillFluidCPUConvex(cpu, points, sides, color);
+}
+
+//----------------------------------------------------------------------------------
+// Conversion
+//----------------------------------------------------------------------------------
+
+// Writes the front field into an RGBA16F image, the same format LoadImageFromTexture gives
+void exportFluidCPUImage(FluidCPU* cpu, Image* image) {
+    size_t count = (size_t)cpu->width * cpu->height;
+    if (image->data == NULL) {
+        image->data = malloc(count*4*sizeof(unsigned short));
+        image->width = cpu->width;
+        image->height = cpu->height;
+        image->mipmaps = 1;
+        image->format = PIXELFORMAT_UNCOMPRESSED_R16G16B16A16;
+    }
+
+    // Half storage already is the image
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) {
+        memcpy(image->data, cpu->half[cpu->front], count*4*sizeof(unsigned short));
+        return;
+    }
+
+    FluidCPUBand front = getFluidCPUFieldBand(cpu, cpu->front);
+    unsigned short* out = (unsigned short*)image->data;
+    float* staged[4];
+    for (int c = 0; c < 4; c++) staged[c] = cpu->row_scratch + (size_t)(FLUID_CPU_SCRATCH_ROWS + c)*cpu->width;
+    for (int y = 0; y < cpu->height; y++) {
+        const float* row[4];
+        if (cpu->storage == FLUID_CPU_STORAGE_F32_TILES) {
+            loadFluidCPURow(cpu, cpu->front, y, staged);
+            for (int c = 0; c < 4; c++) row[c] = staged[c];
+        } else {
+            getFluidCPUBandRow(&front, cpu->width, y, row);
+        }
+        encodeFluidHalfRow(row, out + (size_t)y*cpu->width*4, cpu->width);
+    }
+}
+
+// Front field as row major RGBA floats, for readers that want floats without
+// knowing the layout. rgba has to fit width*height cells.
+void exportFluidCPUFloats(FluidCPU* cpu, float* rgba) {
+    int width = cpu->width;
+    float* staged[4];
+    for (int c = 0; c < 4; c++) staged[c] = cpu->row_scratch + (size_t)(FLUID_CPU_SCRATCH_ROWS + c)*width;
+    for (int y = 0; y < cpu->height; y++) {
+        loadFluidCPURow(cpu, cpu->front, y, staged);
+        float* out = rgba + (size_t)y*width*4;
+        for (int x = 0; x < width; x++) {
+            out[x*4] = staged[0][x];
+            out[x*4 + 1] = staged[1][x];
+            out[x*4 + 2] = staged[2][x];
+            out[x*4 + 3] = staged[3][x];
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Max speed, see fluid_speed.h
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidSpeedJob {
+    const FluidCPU* cpu;
+    float* speeds;          // One per worker
+} FluidSpeedJob;
+
+// Tiles get reduced padding and all, it's zeroed with the rest of the field and the
+// steps never store to it
+static void maxFluidCPUSpeedJob(void* arg, int worker, int workers) {
+    FluidSpeedJob* job = (FluidSpeedJob*)arg;
+    const FluidCPU* cpu = job->cpu;
+    size_t count = getFluidCPUPlaneSize(cpu);
+    size_t start = count*worker/workers;
+    size_t end = count*(worker + 1)/workers;
+
+    if (cpu->storage == FLUID_CPU_STORAGE_F16) {
+        job->speeds[worker] = maxFluidSpeedHalves(cpu->half[cpu->front] + start*4, end - start);
+    } else {
+        const FluidCPUField* field = &cpu->field[cpu->front];
+        job->speeds[worker] = maxFluidSpeedPlanes(field->x + start, field->y + start, end - start);
+    }
+}
+
+// Fastest the front field is moving along either axis
+float getFluidCPUMaxSpeed(FluidCPU* cpu) {
+    // Picks the ISA before the workers start so they don't race to do it
+    getFluidRowKernel();
+
+    FluidSpeedJob job = {cpu, cpu->worker_results};
+    runFluidThreadPool(cpu->pool, maxFluidCPUSpeedJob, &job);
+
+    // A NaN half means the field has blown up, as fast as it gets
+    float speed = 0;
+    for (int i = 0; i < cpu->pool->count; i++) {
+        if (isnan(job.speeds[i])) speed = INFINITY;
+        else speed = fmaxf(speed, job.speeds[i]);
+    }
+    return speed;
+}
+
+#endif
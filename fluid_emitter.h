@@ -0,0 +1,111 @@
+#ifndef NVST_FLUID_EMITTER
+#define NVST_FLUID_EMITTER
+
+#include <math.h>
+
+#include "raylib.h"
+
+// Emitters as shapes instead of pixels drawn into the fluid. The game fills a list
+// once a frame and every substep reads it straight from the solver, a loop on the
+// CPU and a uniform array in fluid_comp.glsl. Cells inside an emitter get its force
+// added to their velocity every substep, as a float where drawing them used to
+// squeeze it through 8 bit color. Holding emitters set the velocity to it instead,
+// like the opaque shapes that used to be drawn straight over the field. Every shape is a line from a to b grown by radius: a capsule has round ends, a
+// box has square ones, and a disc is a capsule with a on b. Positions are texels
+// with row 0 at the bottom, same as the texture and the CPU field.
+
+#define FLUID_MAX_EMITTERS (64)     // Has to match MAX_EMITTERS in fluid_comp.glsl
+#define FLUID_EMITTER_LIFT (1.0f)   // Upward force on top of every push, what the old color encoding added
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef enum NV_FluidEmitterShape {
+    FLUID_EMITTER_CAPSULE = 0,
+    FLUID_EMITTER_BOX = 1,
+    FLUID_EMITTER_HOLD = 2      // Added to either shape, see holdFluidEmitter
+} FluidEmitterShape;
+
+// Two vec4s as it is, so the list uploads without repacking
+typedef struct NV_FluidEmitter {
+    Vector2 a;
+    Vector2 b;
+    float radius;
+    float shape;            // FluidEmitterShape, a float to fit in the vec4
+    Vector2 force;          // Same scale as the field's velocity, or the velocity itself when holding
+} FluidEmitter;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Same test as emitterAt in fluid_comp.glsl
+static inline int isFluidEmitterCovering(const FluidEmitter* emitter, float px, float py) {
+    float ab_x = emitter->b.x - emitter->a.x;
+    float ab_y = emitter->b.y - emitter->a.y;
+    float ap_x = px - emitter->a.x;
+    float ap_y = py - emitter->a.y;
+    float len2 = ab_x*ab_x + ab_y*ab_y;
+    float t = (len2 > 0) ? (ap_x*ab_x + ap_y*ab_y)/len2 : 0;
+
+    if ((int)emitter->shape & FLUID_EMITTER_BOX) {
+        if (t < 0 || t > 1) return 0;
+    } else {
+        t = fminf(fmaxf(t, 0), 1);
+    }
+
+    float d_x = ap_x - ab_x*t;
+    float d_y = ap_y - ab_y*t;
+    return d_x*d_x + d_y*d_y <= emitter->radius*emitter->radius;
+}
+
+static inline int isFluidEmitterHolding(const FluidEmitter* emitter) {
+    return ((int)emitter->shape & FLUID_EMITTER_HOLD) != 0;
+}
+
+// Texels the emitter can touch, for skipping rows and columns it can't
+static inline Rectangle getFluidEmitterBounds(const FluidEmitter* emitter) {
+    float x0 = fminf(emitter->a.x, emitter->b.x) - emitter->radius;
+    float y0 = fminf(emitter->a.y, emitter->b.y) - emitter->radius;
+    float x1 = fmaxf(emitter->a.x, emitter->b.x) + emitter->radius;
+    float y1 = fmaxf(emitter->a.y, emitter->b.y) + emitter->radius;
+    return (Rectangle){x0, y0, x1 - x0, y1 - y0};
+}
+
+// Draw space has y going down from the top like the drawFluid* functions, emitters
+// are built from there so they line up with everything else drawn into the fluid
+static inline Vector2 convertFluidDrawPoint(Vector2 point, int height) {
+    return (Vector2){point.x, height - point.y};
+}
+
+// The rectangle DrawRectanglePro would fill, as a box along its middle
+FluidEmitter createFluidEmitterRectanglePro(int height, Rectangle rec, Vector2 origin, float rotation, Vector2 force) {
+    float s = sinf(rotation*DEG2RAD);
+    float c = cosf(rotation*DEG2RAD);
+    float dx = -origin.x;
+    float dy = rec.height/2 - origin.y;
+
+    Vector2 a = {rec.x + dx*c - dy*s, rec.y + dx*s + dy*c};
+    Vector2 b = {rec.x + (dx + rec.width)*c - dy*s, rec.y + (dx + rec.width)*s + dy*c};
+
+    return (FluidEmitter){
+        convertFluidDrawPoint(a, height),
+        convertFluidDrawPoint(b, height),
+        rec.height/2,
+        FLUID_EMITTER_BOX,
+        force
+    };
+}
+
+FluidEmitter createFluidEmitterCapsule(int height, Vector2 a, Vector2 b, float radius, Vector2 force) {
+    return (FluidEmitter){
+        convertFluidDrawPoint(a, height),
+        convertFluidDrawPoint(b, height),
+        radius,
+        FLUID_EMITTER_CAPSULE,
+        force
+    };
+}
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef NVST_FLUID_GL
+#define NVST_FLUID_GL
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The few raw GL calls raylib doesn't wrap. Pointers are loaded through the
+// same GLFW context raylib makes, so nothing else needs linking.
+
+//----------------------------------------------------------------------------------
+// Types and enums
+//----------------------------------------------------------------------------------
+
+#if defined(_WIN32)
+#define FLUID_GL_API __stdcall
+#else
+#define FLUID_GL_API
+#endif
+
+typedef struct __GLsync* FluidGLSync;
+typedef void (*FluidGLProc)(void);
+
+#define GL_RGBA 0x1908
+#define GL_FLOAT 0x1406
+#define GL_HALF_FLOAT 0x140B
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_READ_FRAMEBUFFER_BINDING 0x8CAA
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_STREAM_READ 0x88E1
+#define GL_MAP_READ_BIT 0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_TIME_ELAPSED 0x88BF
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#define GL_MAJOR_VERSION 0x821B
+#define GL_MINOR_VERSION 0x821C
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#define GL_DRAW_FRAMEBUFFER_BINDING 0x8CA6
+#define GL_VIEWPORT 0x0BA2
+#define GL_BLEND 0x0BE2
+#define GL_TRIANGLES 0x0004
+#define GL_TEXTURE0 0x84C0
+#define GL_TEXTURE_2D 0x0DE1
+#define GL_RGBA16F 0x881A
+#define GL_WRITE_ONLY 0x88B9
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_DISPATCH_INDIRECT_BUFFER 0x90EE
+#define GL_DYNAMIC_COPY 0x88EA
+
+typedef struct NV_FluidGL {
+    int loaded;
+
+    void (FLUID_GL_API *GetIntegerv)(unsigned int pname, int* data);
+    void (FLUID_GL_API *ReadPixels)(int x, int y, int width, int height, unsigned int format, unsigned int type, void* pixels);
+    void (FLUID_GL_API *BindFramebuffer)(unsigned int target, unsigned int framebuffer);
+
+    void (FLUID_GL_API *GenBuffers)(int n, unsigned int* buffers);
+    void (FLUID_GL_API *DeleteBuffers)(int n, const unsigned int* buffers);
+    void (FLUID_GL_API *BindBuffer)(unsigned int target, unsigned int buffer);
+    void (FLUID_GL_API *BufferData)(unsigned int target, ptrdiff_t size, const void* data, unsigned int usage);
+    void (FLUID_GL_API *BufferSubData)(unsigned int target, ptrdiff_t offset, ptrdiff_t size, const void* data);
+    void (FLUID_GL_API *BindBufferBase)(unsigned int target, unsigned int index, unsigned int buffer);
+    void* (FLUID_GL_API *MapBufferRange)(unsigned int target, ptrdiff_t offset, ptrdiff_t length, unsigned int access);
+    unsigned char (FLUID_GL_API *UnmapBuffer)(unsigned int target);
+
+    FluidGLSync (FLUID_GL_API *FenceSync)(unsigned int condition, unsigned int flags);
+    unsigned int (FLUID_GL_API *ClientWaitSync)(FluidGLSync sync, unsigned int flags, uint64_t timeout);
+    void (FLUID_GL_API *DeleteSync)(FluidGLSync sync);
+
+    void (FLUID_GL_API *GenQueries)(int n, unsigned int* ids);
+    void (FLUID_GL_API *DeleteQueries)(int n, const unsigned int* ids);
+    void (FLUID_GL_API *BeginQuery)(unsigned int target, unsigned int id);
+    void (FLUID_GL_API *EndQuery)(unsigned int target);
+    void (FLUID_GL_API *GetQueryObjectiv)(unsigned int id, unsigned int pname, int* params);
+    void (FLUID_GL_API *GetQueryObjectui64v)(unsigned int id, unsigned int pname, uint64_t* params);
+
+    // Solver programs, see fluid_pass.h. raylib only wraps compute when it's built for GL 4.3.
+    unsigned int (FLUID_GL_API *CreateShader)(unsigned int type);
+    void (FLUID_GL_API *ShaderSource)(unsigned int shader, int count, const char* const* string, const int* length);
+    void (FLUID_GL_API *CompileShader)(unsigned int shader);
+    void (FLUID_GL_API *GetShaderiv)(unsigned int shader, unsigned int pname, int* params);
+    void (FLUID_GL_API *GetShaderInfoLog)(unsigned int shader, int max_length, int* length, char* log);
+    void (FLUID_GL_API *DeleteShader)(unsigned int shader);
+    unsigned int (FLUID_GL_API *CreateProgram)(void);
+    void (FLUID_GL_API *AttachShader)(unsigned int program, unsigned int shader);
+    void (FLUID_GL_API *LinkProgram)(unsigned int program);
+    void (FLUID_GL_API *GetProgramiv)(unsigned int program, unsigned int pname, int* params);
+    void (FLUID_GL_API *GetProgramInfoLog)(unsigned int program, int max_length, int* length, char* log);
+    void (FLUID_GL_API *DeleteProgram)(unsigned int program);
+    void (FLUID_GL_API *UseProgram)(unsigned int program);
+    int (FLUID_GL_API *GetUniformLocation)(unsigned int program, const char* name);
+    void (FLUID_GL_API *Uniform1i)(int location, int v0);
+    void (FLUID_GL_API *Uniform1f)(int location, float v0);
+    void (FLUID_GL_API *Uniform2i)(int location, int v0, int v1);
+    void (FLUID_GL_API *Uniform2f)(int location, float v0, float v1);
+    void (FLUID_GL_API *Uniform4fv)(int location, int count, const float* value);
+    void (FLUID_GL_API *ActiveTexture)(unsigned int texture);
+    void (FLUID_GL_API *BindTexture)(unsigned int target, unsigned int texture);
+    void (FLUID_GL_API *GenVertexArrays)(int n, unsigned int* arrays);
+    void (FLUID_GL_API *DeleteVertexArrays)(int n, const unsigned int* arrays);
+    void (FLUID_GL_API *BindVertexArray)(unsigned int array);
+    void (FLUID_GL_API *DrawArrays)(unsigned int mode, int first, int count);
+    void (FLUID_GL_API *Viewport)(int x, int y, int width, int height);
+    void (FLUID_GL_API *Enable)(unsigned int cap);
+    void (FLUID_GL_API *Disable)(unsigned int cap);
+    void (FLUID_GL_API *BindImageTexture)(unsigned int unit, unsigned int texture, int level, unsigned char layered, int layer, unsigned int access, unsigned int format);
+    void (FLUID_GL_API *DispatchCompute)(unsigned int x, unsigned int y, unsigned int z);
+    void (FLUID_GL_API *DispatchComputeIndirect)(ptrdiff_t offset);
+    void (FLUID_GL_API *MemoryBarrier)(unsigned int barriers);
+} FluidGL;
+
+static FluidGL fluid_gl = { 0 };
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// raylib's desktop build links GLFW, define this before including to load from somewhere else
+#ifndef FLUID_GL_GET_PROC_ADDRESS
+FluidGLProc glfwGetProcAddress(const char* name);
+#define FLUID_GL_GET_PROC_ADDRESS glfwGetProcAddress
+#endif
+
+static void loadFluidGLProc(void* target, const char* name) {
+    FluidGLProc proc = FLUID_GL_GET_PROC_ADDRESS(name);
+    memcpy(target, &proc, sizeof(proc));
+}
+
+#define FLUID_GL_LOAD(name) loadFluidGLProc(&fluid_gl.name, "gl" #name)
+
+// Needs a current context, only does anything the first time
+void loadFluidGL(void) {
+    if (fluid_gl.loaded) return;
+
+    FLUID_GL_LOAD(GetIntegerv);
+    FLUID_GL_LOAD(ReadPixels);
+    FLUID_GL_LOAD(BindFramebuffer);
+
+    FLUID_GL_LOAD(GenBuffers);
+    FLUID_GL_LOAD(DeleteBuffers);
+    FLUID_GL_LOAD(BindBuffer);
+    FLUID_GL_LOAD(BufferData);
+    FLUID_GL_LOAD(BufferSubData);
+    FLUID_GL_LOAD(BindBufferBase);
+    FLUID_GL_LOAD(MapBufferRange);
+    FLUID_GL_LOAD(UnmapBuffer);
+
+    FLUID_GL_LOAD(FenceSync);
+    FLUID_GL_LOAD(ClientWaitSync);
+    FLUID_GL_LOAD(DeleteSync);
+
+    FLUID_GL_LOAD(GenQueries);
+    FLUID_GL_LOAD(DeleteQueries);
+    FLUID_GL_LOAD(BeginQuery);
+    FLUID_GL_LOAD(EndQuery);
+    FLUID_GL_LOAD(GetQueryObjectiv);
+    FLUID_GL_LOAD(GetQueryObjectui64v);
+
+    FLUID_GL_LOAD(CreateShader);
+    FLUID_GL_LOAD(ShaderSource);
+    FLUID_GL_LOAD(CompileShader);
+    FLUID_GL_LOAD(GetShaderiv);
+    FLUID_GL_LOAD(GetShaderInfoLog);
+    FLUID_GL_LOAD(DeleteShader);
+    FLUID_GL_LOAD(CreateProgram);
+    FLUID_GL_LOAD(AttachShader);
+    FLUID_GL_LOAD(LinkProgram);
+    FLUID_GL_LOAD(GetProgramiv);
+    FLUID_GL_LOAD(GetProgramInfoLog);
+    FLUID_GL_LOAD(DeleteProgram);
+    FLUID_GL_LOAD(UseProgram);
+    FLUID_GL_LOAD(GetUniformLocation);
+    FLUID_GL_LOAD(Uniform1i);
+    FLUID_GL_LOAD(Uniform1f);
+    FLUID_GL_LOAD(Uniform2i);
+    FLUID_GL_LOAD(Uniform2f);
+    FLUID_GL_LOAD(Uniform4fv);
+    FLUID_GL_LOAD(ActiveTexture);
+    FLUID_GL_LOAD(BindTexture);
+    FLUID_GL_LOAD(GenVertexArrays);
+    FLUID_GL_LOAD(DeleteVertexArrays);
+    FLUID_GL_LOAD(BindVertexArray);
+    FLUID_GL_LOAD(DrawArrays);
+    FLUID_GL_LOAD(Viewport);
+    FLUID_GL_LOAD(Enable);
+    FLUID_GL_LOAD(Disable);
+    FLUID_GL_LOAD(BindImageTexture);
+    FLUID_GL_LOAD(DispatchCompute);
+    FLUID_GL_LOAD(DispatchComputeIndirect);
+    FLUID_GL_LOAD(MemoryBarrier);
+
+    fluid_gl.loaded = 1;
+}
+
+#undef FLUID_GL_LOAD
+
+#endif
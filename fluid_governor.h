@@ -0,0 +1,182 @@
+#ifndef NVST_FLUID_GOVERNOR
+#define NVST_FLUID_GOVERNOR
+
+// Picks the fluid's grid size and substep count from how long the solver has
+// been taking. Levels go from best looking to cheapest. It drops a level once
+// the smoothed time has been over budget for a while, and only climbs back if
+// the better level is predicted to fit with room to spare for a lot longer.
+// After any change it waits out a cooldown, and if it has to drop right after
+// climbing it waits twice as long before trying to climb again.
+
+#define FLUID_GOVERNOR_HISTORY (32)         // Decisions kept for getFluidGovernorHistory
+#define FLUID_GOVERNOR_SMOOTHING (0.1f)     // Weight of each new time in the moving average
+#define FLUID_GOVERNOR_DOWN_FRAMES (20)     // Frames over budget before dropping
+#define FLUID_GOVERNOR_UP_FRAMES (120)      // Frames with headroom before climbing
+#define FLUID_GOVERNOR_UP_MAX_FRAMES (1920) // Backoff never waits longer than this
+#define FLUID_GOVERNOR_HEADROOM (0.75f)     // Better level has to be predicted under this much of budget
+#define FLUID_GOVERNOR_COOLDOWN (60)        // Frames after a change before looking again
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidLevel {
+    int x_resolution;
+    int y_resolution;
+    int substeps;
+} FluidLevel;
+
+typedef struct NV_FluidGovernorDecision {
+    long long frame;
+    int from;
+    int to;
+    float smoothed_ms;      // What it saw when it decided
+    float budget_ms;
+} FluidGovernorDecision;
+
+typedef struct NV_FluidGovernorStats {
+    int level;
+    int level_count;
+    FluidLevel current;
+    float solver_ms;        // Last time it was given
+    float smoothed_ms;
+    float budget_ms;
+    long long frames;
+    long long changes;
+    int up_frames;          // How long it currently waits before climbing
+} FluidGovernorStats;
+
+typedef struct NV_FluidGovernor {
+    const FluidLevel* levels;
+    int level_count;
+    int level;
+    float budget_ms;
+
+    float solver_ms;
+    float smoothed_ms;      // Negative until the first time comes in
+    long long frame;
+    long long cooldown_until;
+    long long last_up;      // Frame of the last climb, -1 for never
+    int over_frames;
+    int under_frames;
+    int up_frames;
+
+    FluidGovernorDecision history[FLUID_GOVERNOR_HISTORY];
+    long long changes;      // Also where the next decision goes in history
+} FluidGovernor;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Levels aren't copied so they have to outlive the governor, it starts on the first
+FluidGovernor createFluidGovernor(const FluidLevel* levels, int level_count, float budget_ms) {
+    FluidGovernor governor = { 0 };
+    governor.levels = levels;
+    governor.level_count = level_count;
+    governor.budget_ms = budget_ms;
+    governor.smoothed_ms = -1;
+    governor.last_up = -1;
+    governor.up_frames = FLUID_GOVERNOR_UP_FRAMES;
+    return governor;
+}
+
+static inline float getFluidLevelCost(const FluidLevel* level) {
+    return (float)level->x_resolution*level->y_resolution*level->substeps;
+}
+
+static void setFluidGovernorLevel(FluidGovernor* governor, int level) {
+    FluidGovernorDecision* decision = &governor->history[governor->changes % FLUID_GOVERNOR_HISTORY];
+    decision->frame = governor->frame;
+    decision->from = governor->level;
+    decision->to = level;
+    decision->smoothed_ms = governor->smoothed_ms;
+    decision->budget_ms = governor->budget_ms;
+    governor->changes++;
+
+    // Dropping right after a climb means the climb was a mistake, so wait longer next time
+    if (level > governor->level) {
+        if (governor->last_up >= 0 && governor->frame - governor->last_up < 2*governor->up_frames) {
+            governor->up_frames *= 2;
+            if (governor->up_frames > FLUID_GOVERNOR_UP_MAX_FRAMES) governor->up_frames = FLUID_GOVERNOR_UP_MAX_FRAMES;
+        }
+    } else {
+        governor->last_up = governor->frame;
+    }
+
+    // Guess the new time from the change in work until real ones come in
+    governor->smoothed_ms *= getFluidLevelCost(&governor->levels[level]) / getFluidLevelCost(&governor->levels[governor->level]);
+    governor->level = level;
+    governor->over_frames = 0;
+    governor->under_frames = 0;
+    governor->cooldown_until = governor->frame + FLUID_GOVERNOR_COOLDOWN;
+}
+
+// Call once a frame with the solver's time. Returns 1 if the level changed.
+int updateFluidGovernor(FluidGovernor* governor, float solver_ms) {
+    governor->frame++;
+    governor->solver_ms = solver_ms;
+    if (governor->smoothed_ms < 0) governor->smoothed_ms = solver_ms;
+    governor->smoothed_ms += (solver_ms - governor->smoothed_ms)*FLUID_GOVERNOR_SMOOTHING;
+
+    if (governor->frame < governor->cooldown_until) return 0;
+
+    // Over budget
+    if (governor->smoothed_ms > governor->budget_ms) {
+        governor->under_frames = 0;
+        if (++governor->over_frames >= FLUID_GOVERNOR_DOWN_FRAMES && governor->level + 1 < governor->level_count) {
+            setFluidGovernorLevel(governor, governor->level + 1);
+            return 1;
+        }
+        return 0;
+    }
+    governor->over_frames = 0;
+
+    // Under budget, but only worth climbing if the better level would be too
+    if (governor->level == 0) return 0;
+    const FluidLevel* current = &governor->levels[governor->level];
+    const FluidLevel* better = &governor->levels[governor->level - 1];
+    float predicted = governor->smoothed_ms * getFluidLevelCost(better) / getFluidLevelCost(current);
+
+    if (predicted > governor->budget_ms*FLUID_GOVERNOR_HEADROOM) {
+        governor->under_frames = 0;
+        return 0;
+    }
+    if (++governor->under_frames >= governor->up_frames) {
+        setFluidGovernorLevel(governor, governor->level - 1);
+        return 1;
+    }
+    return 0;
+}
+
+FluidLevel getFluidGovernorLevel(const FluidGovernor* governor) {
+    return governor->levels[governor->level];
+}
+
+FluidGovernorStats getFluidGovernorStats(const FluidGovernor* governor) {
+    FluidGovernorStats stats = { 0 };
+    stats.level = governor->level;
+    stats.level_count = governor->level_count;
+    stats.current = governor->levels[governor->level];
+    stats.solver_ms = governor->solver_ms;
+    stats.smoothed_ms = (governor->smoothed_ms < 0) ? 0 : governor->smoothed_ms;
+    stats.budget_ms = governor->budget_ms;
+    stats.frames = governor->frame;
+    stats.changes = governor->changes;
+    stats.up_frames = governor->up_frames;
+    return stats;
+}
+
+// Copies up to max of the latest decisions, oldest first. Returns how many.
+int getFluidGovernorHistory(const FluidGovernor* governor, FluidGovernorDecision* decisions, int max) {
+    long long kept = (governor->changes < FLUID_GOVERNOR_HISTORY) ? governor->changes : FLUID_GOVERNOR_HISTORY;
+    int count = (kept < max) ? (int)kept : max;
+
+    for (int i = 0; i < count; i++) {
+        long long index = governor->changes - count + i;
+        decisions[i] = governor->history[index % FLUID_GOVERNOR_HISTORY];
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef NVST_FLUID_HALF
+#define NVST_FLUID_HALF
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fluid_simd.h"
+
+// Half float conversion for everything that keeps the fluid as RGBA16F, the format
+// of the GL texture. Rows convert between interleaved halves and four float planes
+// so the CPU row kernels can run on them, four cells at a time with F16C. Both
+// directions round the same way as the scalar versions and give the same bits.
+
+//----------------------------------------------------------------------------------
+// Scalar
+//----------------------------------------------------------------------------------
+
+// Conversion shit
+union FP32
+{
+    uint32_t u;
+    float f;
+};
+
+float convertFloat16ToNativeFloat(short int value)
+{
+    const union FP32 magic = { (254UL - 15UL) << 23 };
+    const union FP32 was_inf_nan = { (127UL + 16UL) << 23 };
+    union FP32 out;
+
+    out.u = (value & 0x7FFFU) << 13;
+    out.f *= magic.f;
+    if (out.f >= was_inf_nan.f)
+    {
+        out.u |= 255UL << 23;
+    }
+    out.u |= (value & 0x8000UL) << 16;
+
+    return out.f;
+}
+
+// Round to nearest even, the inverse of convertFloat16ToNativeFloat
+unsigned short convertNativeFloatToFloat16(float value) {
+    union { uint32_t u; float f; } in = { .f = value };
+    uint32_t sign = (in.u >> 16) & 0x8000U;
+    uint32_t exponent = (in.u >> 23) & 0xFFU;
+    uint32_t mantissa = in.u & 0x7FFFFFU;
+
+    // Inf and NaN
+    if (exponent == 0xFF) return sign | 0x7C00U | (mantissa ? 0x200U : 0);
+
+    int half_exponent = (int)exponent - 127 + 15;
+    if (half_exponent >= 31) return sign | 0x7C00U;
+
+    // Subnormal or zero
+    if (half_exponent <= 0) {
+        if (half_exponent < -10) return sign;
+        mantissa |= 0x800000U;
+        int shift = 14 - half_exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1U << shift) - 1);
+        uint32_t halfway = 1U << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return sign | half;
+    }
+
+    uint32_t half = ((uint32_t)half_exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFFU;
+    if (rest > 0x1000U || (rest == 0x1000U && (half & 1))) half++;
+    return sign | half;
+}
+
+// Every half as a float, for lookups that land anywhere like bilinear taps. 256 KB,
+// built by the first call, so make that before any workers use it.
+static float* fluid_half_table = NULL;
+
+const float* getFluidHalfTable(void) {
+    if (fluid_half_table == NULL) {
+        fluid_half_table = malloc(65536*sizeof(float));
+        for (int i = 0; i < 65536; i++) fluid_half_table[i] = convertFloat16ToNativeFloat(i);
+    }
+    return fluid_half_table;
+}
+
+static void decodeFluidHalfRowScalar(const unsigned short* src, float* const dst[4], int start, int count) {
+    for (int i = start; i < count; i++) {
+        dst[0][i] = convertFloat16ToNativeFloat(src[i*4]);
+        dst[1][i] = convertFloat16ToNativeFloat(src[i*4 + 1]);
+        dst[2][i] = convertFloat16ToNativeFloat(src[i*4 + 2]);
+        dst[3][i] = convertFloat16ToNativeFloat(src[i*4 + 3]);
+    }
+}
+
+static void encodeFluidHalfRowScalar(const float* const src[4], unsigned short* dst, int start, int count) {
+    for (int i = start; i < count; i++) {
+        dst[i*4] = convertNativeFloatToFloat16(src[0][i]);
+        dst[i*4 + 1] = convertNativeFloatToFloat16(src[1][i]);
+        dst[i*4 + 2] = convertNativeFloatToFloat16(src[2][i]);
+        dst[i*4 + 3] = convertNativeFloatToFloat16(src[3][i]);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// F16C
+//----------------------------------------------------------------------------------
+#if FLUID_SIMD_X86
+
+#define FLUID_HALF_TARGET __attribute__((target("avx,f16c")))
+
+// A cell is four halves, which convert to one vector, and four of those transpose to planes
+static FLUID_HALF_TARGET void decodeFluidHalfRowF16C(const unsigned short* src, float* const dst[4], int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i*4)));
+        __m128 b = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i*4 + 4)));
+        __m128 c = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i*4 + 8)));
+        __m128 d = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i*4 + 12)));
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storeu_ps(dst[0] + i, a);
+        _mm_storeu_ps(dst[1] + i, b);
+        _mm_storeu_ps(dst[2] + i, c);
+        _mm_storeu_ps(dst[3] + i, d);
+    }
+    decodeFluidHalfRowScalar(src, dst, i, count);
+}
+
+static FLUID_HALF_TARGET void encodeFluidHalfRowF16C(const float* const src[4], unsigned short* dst, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_loadu_ps(src[0] + i);
+        __m128 b = _mm_loadu_ps(src[1] + i);
+        __m128 c = _mm_loadu_ps(src[2] + i);
+        __m128 d = _mm_loadu_ps(src[3] + i);
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storel_epi64((__m128i*)(dst + i*4), _mm_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storel_epi64((__m128i*)(dst + i*4 + 4), _mm_cvtps_ph(b, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storel_epi64((__m128i*)(dst + i*4 + 8), _mm_cvtps_ph(c, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storel_epi64((__m128i*)(dst + i*4 + 12), _mm_cvtps_ph(d, _MM_FROUND_TO_NEAREST_INT));
+    }
+    encodeFluidHalfRowScalar(src, dst, i, count);
+}
+
+#undef FLUID_HALF_TARGET
+
+#endif
+
+//----------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------
+
+// Follows setFluidCPUISA like the samplers do, so forcing scalar there also forces it here
+static inline int useFluidHalfF16C(void) {
+#if FLUID_SIMD_X86
+    getFluidRowKernel();
+    return (fluid_cpu_isa >= FLUID_ISA_AVX2) && __builtin_cpu_supports("f16c");
+#else
+    return 0;
+#endif
+}
+
+// count RGBA16F cells into x, y, z and w planes
+void decodeFluidHalfRow(const unsigned short* src, float* const dst[4], int count) {
+#if FLUID_SIMD_X86
+    if (useFluidHalfF16C()) {
+        decodeFluidHalfRowF16C(src, dst, count);
+        return;
+    }
+#endif
+    decodeFluidHalfRowScalar(src, dst, 0, count);
+}
+
+void encodeFluidHalfRow(const float* const src[4], unsigned short* dst, int count) {
+#if FLUID_SIMD_X86
+    if (useFluidHalfF16C()) {
+        encodeFluidHalfRowF16C(src, dst, count);
+        return;
+    }
+#endif
+    encodeFluidHalfRowScalar(src, dst, 0, count);
+}
+
+#endif
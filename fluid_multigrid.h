@@ -0,0 +1,457 @@
+#ifndef NVST_FLUID_MULTIGRID
+#define NVST_FLUID_MULTIGRID
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fluid_threads.h"
+
+// Geometric multigrid for the pressure of a projection, see projectFluidCPU. The
+// field's divergence goes in as rhs and V-cycles find p with lap(p) = rhs, so taking
+// the gradient of p off the velocity leaves it divergence free. Cells are centred,
+// every level has half the cells of the one above each way (rounded up) at twice the
+// spacing, and wraps round like the field. After an odd size the last cell of a
+// level only covers what's left, see getFluidMultigridSpan.
+//
+// Solids are in how open each cell's faces are. On the top level a face is 1 between
+// two fluid cells and 0 if either is solid, so a wall is somewhere nothing flows
+// through. A coarse face is how much of it is open over how far apart the centres
+// either side are, against the fine faces along it. For whole cells that's the mean
+// of the two, which keeps a wall half way across a coarse cell half a wall. Cells
+// with no open faces drop out.
+//
+// Smoothing is red-black Gauss-Seidel. Residuals go down a level as a quarter of the
+// sum under each cell, which with the faces above is the same equation over the
+// bigger cell, whatever its size. The correction comes back up bilinear between the
+// centres, leaving out coarse cells that don't take part. fluid_projection.glsl runs
+// the same passes on GL.
+//
+// A solid thinner than a coarse cell isn't there on that level, so near one the
+// coarse levels can't fix the jump in p across it and cycles slow down to taking
+// about a third off the residual each. Solves run until the residual is down to a
+// tolerance rather than a set number of cycles.
+
+#define FLUID_MULTIGRID_LEVELS (12)
+#define FLUID_MULTIGRID_MAX_CYCLES (32)
+#define FLUID_MULTIGRID_CYCLES (16)         // Most V-cycles a solve runs unless told otherwise
+#define FLUID_MULTIGRID_TOLERANCE (0.01f)   // Solves stop once the RMS residual is this much of where it started
+#define FLUID_MULTIGRID_SMOOTH (2)          // Red-black sweeps either side of the next level down
+#define FLUID_MULTIGRID_COARSEST_SMOOTH (16)
+#define FLUID_MULTIGRID_COARSEST (8)        // Stops halving once both sides are this or less
+#define FLUID_MULTIGRID_PARALLEL_CELLS (1 << 16)    // Smaller levels aren't worth waking the pool for
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidMultigridLevel {
+    int width;
+    int height;
+    float h;                // Cell spacing in reference texels, like FluidParams cell_size
+    float* p;
+    float* rhs;
+    float* right;           // How open the face to the next cell across is, 0 to 1
+    float* up;              // Same for the next row
+} FluidMultigridLevel;
+
+typedef struct NV_FluidMultigrid {
+    FluidMultigridLevel levels[FLUID_MULTIGRID_LEVELS];
+    int level_count;        // 0 until it's been made
+    int cycles;             // Most per solve, up to FLUID_MULTIGRID_MAX_CYCLES
+    float tolerance;        // Of the starting RMS residual a solve stops at, 0 runs every cycle
+
+    // RMS residual each solve started with and the one after every cycle it ran
+    float residuals[FLUID_MULTIGRID_MAX_CYCLES + 1];
+    int residual_count;
+} FluidMultigrid;
+
+typedef struct NV_FluidMultigridJob FluidMultigridJob;
+typedef void (*FluidMultigridRows)(FluidMultigridJob* job, int y0, int y1);
+typedef void (*FluidMultigridSumRows)(FluidMultigridJob* job, int y0, int y1, double sums[2]);
+
+struct NV_FluidMultigridJob {
+    FluidMultigrid* mg;
+    FluidMultigridRows rows;            // Passes that write the level
+    FluidMultigridSumRows sum_rows;     // Or ones that add things up, a pair of sums per worker
+    int level;
+    int color;              // Which cells a sweep updates, (x + y) & 1
+    double* sums;
+    const double* totals;   // What the pass before added up
+};
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Sizes of the levels for a width by height field, top first. Returns how many.
+int getFluidMultigridSizes(int width, int height, int* widths, int* heights) {
+    int count = 0;
+    while (count < FLUID_MULTIGRID_LEVELS) {
+        widths[count] = width;
+        heights[count] = height;
+        count++;
+
+        if (width <= FLUID_MULTIGRID_COARSEST && height <= FLUID_MULTIGRID_COARSEST) break;
+        width = (width + 1)/2;
+        height = (height + 1)/2;
+    }
+    return count;
+}
+
+FluidMultigrid createFluidMultigrid(int width, int height, float cell_size) {
+    FluidMultigrid mg = { 0 };
+    mg.cycles = FLUID_MULTIGRID_CYCLES;
+    mg.tolerance = FLUID_MULTIGRID_TOLERANCE;
+
+    int widths[FLUID_MULTIGRID_LEVELS];
+    int heights[FLUID_MULTIGRID_LEVELS];
+    mg.level_count = getFluidMultigridSizes(width, height, widths, heights);
+    for (int i = 0; i < mg.level_count; i++) {
+        FluidMultigridLevel* level = &mg.levels[i];
+        size_t count = (size_t)widths[i]*heights[i];
+        level->width = widths[i];
+        level->height = heights[i];
+        level->h = cell_size*(float)(1 << i);
+        level->p = calloc(count, sizeof(float));
+        level->rhs = calloc(count, sizeof(float));
+        level->right = calloc(count, sizeof(float));
+        level->up = calloc(count, sizeof(float));
+    }
+    return mg;
+}
+
+void unloadFluidMultigrid(FluidMultigrid* mg) {
+    for (int i = 0; i < mg->level_count; i++) {
+        free(mg->levels[i].p);
+        free(mg->levels[i].rhs);
+        free(mg->levels[i].right);
+        free(mg->levels[i].up);
+    }
+    mg->level_count = 0;
+}
+
+// Top level cells cell x of a level covers along an axis top cells long, 1 << level
+// for all of them but the last, which gets what's left after an odd size above
+static inline int getFluidMultigridSpan(int top, int count, int level, int x) {
+    return (x + 1 == count) ? top - (x << level) : 1 << level;
+}
+
+// Twice how far it is in top level cells from the centre of cell x to the next one
+// along, round the wrap for the last
+static inline int getFluidMultigridGap(int top, int count, int level, int x) {
+    int next = (x + 1 == count) ? 0 : x + 1;
+    return getFluidMultigridSpan(top, count, level, x) + getFluidMultigridSpan(top, count, level, next);
+}
+
+// The cells of the level below either side of the centre of cell x of level along an
+// axis, and how far it is from lo to hi. Centres are doubled so they stay whole.
+static inline void getFluidMultigridLerp(int top, int count, int coarse_count, int level, int x, int* lo, int* hi, float* t) {
+    int centre = (2*x << level) + getFluidMultigridSpan(top, count, level, x);
+    int c = x/2;
+    int a = c;
+    if (centre < (2*c << (level + 1)) + getFluidMultigridSpan(top, coarse_count, level + 1, c)) a = c - 1;
+
+    // Past either end it's the cell round the wrap, a whole field further along
+    int b = a + 1;
+    int shift_a = (a < 0) ? -2*top : 0;
+    int shift_b = (b == coarse_count) ? 2*top : 0;
+    *lo = (a < 0) ? coarse_count - 1 : a;
+    *hi = (b == coarse_count) ? 0 : b;
+    int centre_a = (2*(*lo) << (level + 1)) + getFluidMultigridSpan(top, coarse_count, level + 1, *lo) + shift_a;
+    int centre_b = (2*(*hi) << (level + 1)) + getFluidMultigridSpan(top, coarse_count, level + 1, *hi) + shift_b;
+    *t = (float)(centre - centre_a)/(float)(centre_b - centre_a);
+}
+
+static inline void getFluidMultigridRows(const FluidMultigridLevel* level, int y, size_t* row, size_t* up, size_t* down) {
+    *row = (size_t)y*level->width;
+    *up = (size_t)((y + 1 == level->height) ? 0 : y + 1)*level->width;
+    *down = (size_t)((y == 0) ? level->height - 1 : y - 1)*level->width;
+}
+
+// Sum of p over the cells next to x in row weighted by how open the face to each
+// is, and the sum of the weights. Left, right, below, above, same order as
+// fluid_projection.glsl.
+static inline float sumFluidMultigridNeighbours(const FluidMultigridLevel* level, size_t row, size_t up, size_t down, int x, float* open) {
+    int left = (x == 0) ? level->width - 1 : x - 1;
+    int right = (x + 1 == level->width) ? 0 : x + 1;
+    const float* p = level->p;
+
+    float wl = level->right[row + left];
+    float wr = level->right[row + x];
+    float wd = level->up[down + x];
+    float wu = level->up[row + x];
+    *open = wl + wr + wd + wu;
+    return wl*p[row + left] + wr*p[row + right] + wd*p[down + x] + wu*p[up + x];
+}
+
+// rhs - lap(p) at x, 0 for cells that are shut in
+static inline float getFluidMultigridResidual(const FluidMultigridLevel* level, size_t row, size_t up, size_t down, int x) {
+    float open;
+    float sum = sumFluidMultigridNeighbours(level, row, up, down, x, &open);
+    if (open == 0) return 0;
+    return level->rhs[row + x] - (sum - open*level->p[row + x])/(level->h*level->h);
+}
+
+// Every cell of one color in these rows solves for itself against the others
+static void smoothFluidMultigridRange(FluidMultigridLevel* level, int color, int y0, int y1) {
+    float h2 = level->h*level->h;
+
+    for (int y = y0; y < y1; y++) {
+        size_t row, up, down;
+        getFluidMultigridRows(level, y, &row, &up, &down);
+        for (int x = (y + color) & 1; x < level->width; x += 2) {
+            float open;
+            float sum = sumFluidMultigridNeighbours(level, row, up, down, x, &open);
+            if (open > 0) level->p[row + x] = (sum - h2*level->rhs[row + x])/open;
+        }
+    }
+}
+
+// Half a sweep. With an odd number of rows the last one wraps onto row 0 in the same
+// color, and two workers would be writing next to each other, so it's left for
+// smoothFluidMultigrid to do after.
+static void smoothFluidMultigridRows(FluidMultigridJob* job, int y0, int y1) {
+    FluidMultigridLevel* level = &job->mg->levels[job->level];
+    int even = level->height & ~1;
+    smoothFluidMultigridRange(level, job->color, y0, (y1 < even) ? y1 : even);
+}
+
+// Rows of the level below: a quarter of the residual of the cells under each one
+// becomes its rhs and its correction starts at 0. A cell past an odd edge has fewer
+// under it, but it's smaller too, and dividing by how many there are would stop the
+// rhs adding up to 0. Its faces are the fine faces along them added up, scaled by
+// how much further apart the coarse centres across them are than the fine ones. With
+// whole cells either side that's half, the mean.
+static void restrictFluidMultigridRows(FluidMultigridJob* job, int y0, int y1) {
+    const FluidMultigridLevel* fine = &job->mg->levels[job->level];
+    FluidMultigridLevel* coarse = &job->mg->levels[job->level + 1];
+    int top_width = job->mg->levels[0].width;
+    int top_height = job->mg->levels[0].height;
+    int level = job->level;
+
+    for (int y = y0; y < y1; y++) {
+        int fy1 = (2*y + 1 < fine->height) ? 2*y + 1 : 2*y;
+        float up_scale = (float)getFluidMultigridGap(top_height, fine->height, level, fy1)
+            / (float)getFluidMultigridGap(top_height, coarse->height, level + 1, y);
+        for (int x = 0; x < coarse->width; x++) {
+            int fx1 = (2*x + 1 < fine->width) ? 2*x + 1 : 2*x;
+            float right_scale = (float)getFluidMultigridGap(top_width, fine->width, level, fx1)
+                / (float)getFluidMultigridGap(top_width, coarse->width, level + 1, x);
+            float residual = 0;
+            float right = 0;
+            float up = 0;
+            for (int fy = 2*y; fy < 2*y + 2 && fy < fine->height; fy++) {
+                size_t row, above, below;
+                getFluidMultigridRows(fine, fy, &row, &above, &below);
+                right += fine->right[row + fx1];
+                for (int fx = 2*x; fx < 2*x + 2 && fx < fine->width; fx++) {
+                    residual += getFluidMultigridResidual(fine, row, above, below, fx);
+                    if (fy == fy1) up += fine->up[row + fx];
+                }
+            }
+
+            size_t i = (size_t)y*coarse->width + x;
+            coarse->rhs[i] = residual*0.25f;
+            coarse->right[i] = right*right_scale;
+            coarse->up[i] = up*up_scale;
+            coarse->p[i] = 0;
+        }
+    }
+}
+
+// Open faces of a cell, the ones with none don't take part
+static inline float getFluidMultigridOpen(const FluidMultigridLevel* level, int x, int y) {
+    size_t row, up, down;
+    getFluidMultigridRows(level, y, &row, &up, &down);
+    int left = (x == 0) ? level->width - 1 : x - 1;
+    return level->right[row + left] + level->right[row + x] + level->up[down + x] + level->up[row + x];
+}
+
+// Adds the level below's correction to these rows, bilinear between the coarse
+// centres round each cell that take part, one with no open faces has nothing to
+// say about p. Shut cells get it too, nothing reads them.
+static void prolongFluidMultigridRows(FluidMultigridJob* job, int y0, int y1) {
+    FluidMultigridLevel* fine = &job->mg->levels[job->level];
+    const FluidMultigridLevel* coarse = &job->mg->levels[job->level + 1];
+    int cw = coarse->width;
+    int top_width = job->mg->levels[0].width;
+    int top_height = job->mg->levels[0].height;
+    int level = job->level;
+
+    for (int y = y0; y < y1; y++) {
+        int y_lo, y_hi;
+        float ty;
+        getFluidMultigridLerp(top_height, fine->height, coarse->height, level, y, &y_lo, &y_hi, &ty);
+        size_t row = (size_t)y*fine->width;
+
+        for (int x = 0; x < fine->width; x++) {
+            int x_lo, x_hi;
+            float tx;
+            getFluidMultigridLerp(top_width, fine->width, coarse->width, level, x, &x_lo, &x_hi, &tx);
+
+            float w[4] = {(1 - tx)*(1 - ty), tx*(1 - ty), (1 - tx)*ty, tx*ty};
+            int cx[4] = {x_lo, x_hi, x_lo, x_hi};
+            int cy[4] = {y_lo, y_lo, y_hi, y_hi};
+            float sum = 0;
+            float weight = 0;
+            for (int k = 0; k < 4; k++) {
+                if (getFluidMultigridOpen(coarse, cx[k], cy[k]) == 0) continue;
+                sum += coarse->p[(size_t)cy[k]*cw + cx[k]]*w[k];
+                weight += w[k];
+            }
+            if (weight > 0) fine->p[row + x] += sum/weight;
+        }
+    }
+}
+
+// Squared residual and cells that take part
+static void sumFluidMultigridResidualRows(FluidMultigridJob* job, int y0, int y1, double sums[2]) {
+    const FluidMultigridLevel* level = &job->mg->levels[job->level];
+    double sum = 0;
+    double cells = 0;
+    for (int y = y0; y < y1; y++) {
+        size_t row, up, down;
+        getFluidMultigridRows(level, y, &row, &up, &down);
+        for (int x = 0; x < level->width; x++) {
+            float open;
+            sumFluidMultigridNeighbours(level, row, up, down, x, &open);
+            if (open == 0) continue;
+            float r = getFluidMultigridResidual(level, row, up, down, x);
+            sum += (double)r*r;
+            cells++;
+        }
+    }
+    sums[0] = sum;
+    sums[1] = cells;
+}
+
+// rhs and cells that take part
+static void sumFluidMultigridRHSRows(FluidMultigridJob* job, int y0, int y1, double sums[2]) {
+    const FluidMultigridLevel* level = &job->mg->levels[job->level];
+    double sum = 0;
+    double cells = 0;
+    for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < level->width; x++) {
+            if (getFluidMultigridOpen(level, x, y) == 0) continue;
+            sum += level->rhs[(size_t)y*level->width + x];
+            cells++;
+        }
+    }
+    sums[0] = sum;
+    sums[1] = cells;
+}
+
+// Takes totals[0] off the rhs of every cell that takes part and starts p at 0
+static void balanceFluidMultigridRows(FluidMultigridJob* job, int y0, int y1) {
+    FluidMultigridLevel* level = &job->mg->levels[job->level];
+    float mean = (float)job->totals[0];
+    for (int y = y0; y < y1; y++) {
+        for (int x = 0; x < level->width; x++) {
+            size_t i = (size_t)y*level->width + x;
+            if (getFluidMultigridOpen(level, x, y) > 0) level->rhs[i] -= mean;
+            level->p[i] = 0;
+        }
+    }
+}
+
+static void runFluidMultigridJob(void* arg, int worker, int workers) {
+    FluidMultigridJob* job = (FluidMultigridJob*)arg;
+
+    // Restriction goes over the rows of the level below
+    int height = job->mg->levels[job->level].height;
+    if (job->rows == restrictFluidMultigridRows) height = job->mg->levels[job->level + 1].height;
+
+    int y0, y1;
+    getFluidThreadRange(height, worker, workers, &y0, &y1);
+    if (job->sum_rows) job->sum_rows(job, y0, y1, &job->sums[2*worker]);
+    else job->rows(job, y0, y1);
+}
+
+// Over the pool if the level is big enough, otherwise right here as worker 0.
+// Returns how many workers it went over.
+static int startFluidMultigridJob(FluidThreadPool* pool, FluidMultigridJob* job) {
+    const FluidMultigridLevel* size = &job->mg->levels[job->level];
+    if ((size_t)size->width*size->height >= FLUID_MULTIGRID_PARALLEL_CELLS && pool->count > 1) {
+        runFluidThreadPool(pool, runFluidMultigridJob, job);
+        return pool->count;
+    }
+    runFluidMultigridJob(job, 0, 1);
+    return 1;
+}
+
+// Rows can read totals, what a pass before added up
+static void runFluidMultigridRows(FluidMultigrid* mg, FluidThreadPool* pool, FluidMultigridRows rows, int level, int color, const double* totals) {
+    FluidMultigridJob job = {mg, rows, NULL, level, color, NULL, totals};
+    startFluidMultigridJob(pool, &job);
+}
+
+// Adds up what rows find over the level into totals
+static void sumFluidMultigridRows(FluidMultigrid* mg, FluidThreadPool* pool, FluidMultigridSumRows rows, int level, double totals[2]) {
+    double sums[2*pool->count];
+    memset(sums, 0, sizeof(sums));
+    FluidMultigridJob job = {mg, NULL, rows, level, 0, sums, NULL};
+    int workers = startFluidMultigridJob(pool, &job);
+
+    totals[0] = totals[1] = 0;
+    for (int i = 0; i < workers; i++) {
+        totals[0] += sums[2*i];
+        totals[1] += sums[2*i + 1];
+    }
+}
+
+static void smoothFluidMultigrid(FluidMultigrid* mg, FluidThreadPool* pool, int level, int sweeps) {
+    FluidMultigridLevel* rows = &mg->levels[level];
+    for (int i = 0; i < sweeps; i++) {
+        runFluidMultigridRows(mg, pool, smoothFluidMultigridRows, level, 0, NULL);
+        runFluidMultigridRows(mg, pool, smoothFluidMultigridRows, level, 1, NULL);
+        if (rows->height & 1) {
+            smoothFluidMultigridRange(rows, 0, rows->height - 1, rows->height);
+            smoothFluidMultigridRange(rows, 1, rows->height - 1, rows->height);
+        }
+    }
+}
+
+// RMS residual over the top level
+float getFluidMultigridRMS(FluidMultigrid* mg, FluidThreadPool* pool) {
+    double totals[2];
+    sumFluidMultigridRows(mg, pool, sumFluidMultigridResidualRows, 0, totals);
+    return (totals[1] > 0) ? (float)sqrt(totals[0]/totals[1]) : 0;
+}
+
+// One V-cycle from level down
+static void cycleFluidMultigrid(FluidMultigrid* mg, FluidThreadPool* pool, int level) {
+    if (level == mg->level_count - 1) {
+        smoothFluidMultigrid(mg, pool, level, FLUID_MULTIGRID_COARSEST_SMOOTH);
+        return;
+    }
+
+    smoothFluidMultigrid(mg, pool, level, FLUID_MULTIGRID_SMOOTH);
+    runFluidMultigridRows(mg, pool, restrictFluidMultigridRows, level, 0, NULL);
+    cycleFluidMultigrid(mg, pool, level + 1);
+    runFluidMultigridRows(mg, pool, prolongFluidMultigridRows, level, 0, NULL);
+    smoothFluidMultigrid(mg, pool, level, FLUID_MULTIGRID_SMOOTH);
+}
+
+// Solves for p on the top level from 0, with rhs and the faces already filled in.
+// The field wraps, so p is only known up to a constant and rhs has to add up to 0
+// for there to be an answer at all. Its mean is taken off first. Runs V-cycles until
+// the RMS residual is down to tolerance of where it started, or cycles of them.
+void solveFluidMultigrid(FluidMultigrid* mg, FluidThreadPool* pool) {
+    double totals[2];
+    sumFluidMultigridRows(mg, pool, sumFluidMultigridRHSRows, 0, totals);
+    if (totals[1] > 0) totals[0] /= totals[1];
+    runFluidMultigridRows(mg, pool, balanceFluidMultigridRows, 0, 0, totals);
+
+    int cycles = (mg->cycles < FLUID_MULTIGRID_MAX_CYCLES) ? mg->cycles : FLUID_MULTIGRID_MAX_CYCLES;
+    float target = getFluidMultigridRMS(mg, pool);
+    mg->residuals[0] = target;
+    mg->residual_count = 1;
+    target *= mg->tolerance;
+    for (int i = 0; i < cycles && mg->residuals[i] > target; i++) {
+        cycleFluidMultigrid(mg, pool, 0);
+        mg->residuals[mg->residual_count++] = getFluidMultigridRMS(mg, pool);
+    }
+}
+
+#endif
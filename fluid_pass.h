@@ -0,0 +1,233 @@
+#ifndef NVST_FLUID_PASS
+#define NVST_FLUID_PASS
+
+#include "raylib.h"
+
+#include "fluid_gl.h"
+#include "fluid_simd.h"
+#include "fluid_emitter.h"
+
+// Runs fluid_comp.glsl straight through GL instead of raylib's batch. A substep is
+// a framebuffer bind, a texture bind and one triangle that covers the target, so
+// nothing gets cleared, flushed or flipped in between. Uniform locations are looked
+// up once and values go up once for all of a frame's substeps. The solver programs
+// share their uniform names, so fluid_compute.h sets its uniforms the same way.
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidSolverUniforms {
+    int fluid;
+    int solid;
+    int resolution;         // Compute only
+    int texel_size;
+    int substeps;           // Compute only
+    int time;
+    int dt;
+    int k;
+    int viscosity;
+    int cell_size;
+    int advection;
+    int emitters;
+    int emitter_count;
+    int sparse;             // Compute only, from here on
+    int sleep_speed;
+    int sleep_change;
+    int tiles;              // Tile list only, see fluid_tiles.glsl
+} FluidSolverUniforms;
+
+typedef struct NV_FluidPass {
+    unsigned int program;   // 0 if it didn't build
+    unsigned int vao;       // Empty, the triangle comes from gl_VertexID
+    FluidSolverUniforms uniforms;
+} FluidPass;
+
+// What a batch of passes has to put back for raylib
+typedef struct NV_FluidPassState {
+    int framebuffer;
+    int viewport[4];
+} FluidPassState;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// fragTexCoord matches what DrawTexturePro gave the solver before
+static const char* fluid_pass_vertex_shader =
+    "#version 330\n"
+    "out vec2 fragTexCoord;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    vec2 p = vec2(float(gl_VertexID & 1)*4.0 - 1.0, float(gl_VertexID & 2)*2.0 - 1.0);\n"
+    "    fragTexCoord = p*0.5 + 0.5;\n"
+    "    fragColor = vec4(1.0);\n"
+    "    gl_Position = vec4(p, 0.0, 1.0);\n"
+    "}\n";
+
+static unsigned int compileFluidShader(unsigned int type, const char* code) {
+    unsigned int shader = fluid_gl.CreateShader(type);
+    fluid_gl.ShaderSource(shader, 1, &code, NULL);
+    fluid_gl.CompileShader(shader);
+
+    int ok = 0;
+    fluid_gl.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        fluid_gl.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        TraceLog(LOG_WARNING, "FLUID: Shader failed to compile: %s", log);
+        fluid_gl.DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Takes the shaders, they're deleted either way. Returns 0 on failure.
+static unsigned int linkFluidProgram(const unsigned int* shaders, int count) {
+    unsigned int program = fluid_gl.CreateProgram();
+    int ok = 1;
+    for (int i = 0; i < count; i++) {
+        if (shaders[i] == 0) ok = 0;
+        else fluid_gl.AttachShader(program, shaders[i]);
+    }
+
+    if (ok) {
+        fluid_gl.LinkProgram(program);
+        fluid_gl.GetProgramiv(program, GL_LINK_STATUS, &ok);
+        if (!ok) {
+            char log[1024];
+            fluid_gl.GetProgramInfoLog(program, sizeof(log), NULL, log);
+            TraceLog(LOG_WARNING, "FLUID: Shader failed to link: %s", log);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (shaders[i]) fluid_gl.DeleteShader(shaders[i]);
+    }
+    if (!ok) {
+        fluid_gl.DeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Looks the names up and points the samplers at units 0 and 1
+FluidSolverUniforms getFluidSolverUniforms(unsigned int program) {
+    FluidSolverUniforms uniforms = { 0 };
+    uniforms.fluid = fluid_gl.GetUniformLocation(program, "uFluid");
+    uniforms.solid = fluid_gl.GetUniformLocation(program, "uSolid");
+    uniforms.resolution = fluid_gl.GetUniformLocation(program, "uResolution");
+    uniforms.texel_size = fluid_gl.GetUniformLocation(program, "uTexelSize");
+    uniforms.substeps = fluid_gl.GetUniformLocation(program, "uSubsteps");
+    uniforms.time = fluid_gl.GetUniformLocation(program, "uTime");
+    uniforms.dt = fluid_gl.GetUniformLocation(program, "uDt");
+    uniforms.k = fluid_gl.GetUniformLocation(program, "uK");
+    uniforms.viscosity = fluid_gl.GetUniformLocation(program, "uViscosity");
+    uniforms.cell_size = fluid_gl.GetUniformLocation(program, "uCellSize");
+    uniforms.advection = fluid_gl.GetUniformLocation(program, "uAdvection");
+    uniforms.emitters = fluid_gl.GetUniformLocation(program, "uEmitters");
+    uniforms.emitter_count = fluid_gl.GetUniformLocation(program, "uEmitterCount");
+    uniforms.sparse = fluid_gl.GetUniformLocation(program, "uSparse");
+    uniforms.sleep_speed = fluid_gl.GetUniformLocation(program, "uSleepSpeed");
+    uniforms.sleep_change = fluid_gl.GetUniformLocation(program, "uSleepChange");
+    uniforms.tiles = fluid_gl.GetUniformLocation(program, "uTiles");
+
+    fluid_gl.UseProgram(program);
+    fluid_gl.Uniform1i(uniforms.fluid, 0);
+    fluid_gl.Uniform1i(uniforms.solid, 1);
+    fluid_gl.UseProgram(0);
+
+    return uniforms;
+}
+
+// These expect the program to be in use
+void setFluidSolverParams(const FluidSolverUniforms* uniforms, FluidParams params, float time, int width, int height) {
+    fluid_gl.Uniform2i(uniforms->resolution, width, height);
+    fluid_gl.Uniform2f(uniforms->texel_size, 1.0f/width, 1.0f/height);
+    fluid_gl.Uniform1f(uniforms->time, time);
+    fluid_gl.Uniform1f(uniforms->dt, params.dt);
+    fluid_gl.Uniform1f(uniforms->k, params.k);
+    fluid_gl.Uniform1f(uniforms->viscosity, params.viscosity);
+    fluid_gl.Uniform1f(uniforms->cell_size, params.cell_size);
+    fluid_gl.Uniform1i(uniforms->advection, params.advection);
+}
+
+void setFluidSolverEmitters(const FluidSolverUniforms* uniforms, const FluidEmitter* emitters, int count) {
+    if (count > 0) fluid_gl.Uniform4fv(uniforms->emitters, 2*count, (const float*)emitters);
+    fluid_gl.Uniform1i(uniforms->emitter_count, count);
+}
+
+// Needs a current context. Check program before using it.
+FluidPass loadFluidPass(const char* path) {
+    FluidPass pass = { 0 };
+    loadFluidGL();
+
+    char* code = LoadFileText(path);
+    if (code == NULL) return pass;
+    unsigned int shaders[2] = {
+        compileFluidShader(GL_VERTEX_SHADER, fluid_pass_vertex_shader),
+        compileFluidShader(GL_FRAGMENT_SHADER, code)
+    };
+    UnloadFileText(code);
+
+    pass.program = linkFluidProgram(shaders, 2);
+    if (pass.program == 0) return pass;
+
+    pass.uniforms = getFluidSolverUniforms(pass.program);
+    fluid_gl.GenVertexArrays(1, &pass.vao);
+    return pass;
+}
+
+void unloadFluidPass(FluidPass* pass) {
+    if (pass->program) fluid_gl.DeleteProgram(pass->program);
+    if (pass->vao) fluid_gl.DeleteVertexArrays(1, &pass->vao);
+    *pass = (FluidPass){ 0 };
+}
+
+// What endFluidPasses puts back
+FluidPassState getFluidPassState(void) {
+    FluidPassState state = { 0 };
+    fluid_gl.GetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &state.framebuffer);
+    fluid_gl.GetIntegerv(GL_VIEWPORT, state.viewport);
+    return state;
+}
+
+// Binds everything the passes share, again after something else drew in between
+void bindFluidPasses(FluidPass* pass, unsigned int solid, int width, int height) {
+    fluid_gl.UseProgram(pass->program);
+    fluid_gl.BindVertexArray(pass->vao);
+    fluid_gl.Viewport(0, 0, width, height);
+    // Emitter cells come out with w at 0, which can't get blended away
+    fluid_gl.Disable(GL_BLEND);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 1);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, solid);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+}
+
+// Binds everything the passes share and remembers what raylib had
+FluidPassState beginFluidPasses(FluidPass* pass, unsigned int solid, int width, int height) {
+    FluidPassState state = getFluidPassState();
+    bindFluidPasses(pass, solid, width, height);
+    return state;
+}
+
+// One substep, source is the front texture and target the back framebuffer
+void runFluidPass(unsigned int source, unsigned int target) {
+    fluid_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, source);
+    fluid_gl.DrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void endFluidPasses(FluidPassState state) {
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 1);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+    fluid_gl.Enable(GL_BLEND);
+    fluid_gl.BindVertexArray(0);
+    fluid_gl.UseProgram(0);
+    fluid_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, state.framebuffer);
+    fluid_gl.Viewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#version 450
+
+// Input vertex attributes (from vertex shader)
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+// Uniforms
+uniform sampler2D uFluid;
+uniform vec4 uProbes[64];   // Center x, center y, half width, half height in texels
+
+// Output fragment color
+out vec4 finalColor;
+
+// Outside the fluid counts as zero, same as getCPUImgValue
+vec4 fetch(ivec2 p) {
+    ivec2 size = textureSize(uFluid, 0);
+    if (any(lessThan(p, ivec2(0))) || any(greaterThanEqual(p, size))) {
+        return vec4(0.0);
+    }
+    return texelFetch(uFluid, p, 0);
+}
+
+// One pixel per probe, the average of its center and four corners
+void main() {
+    vec4 probe = uProbes[int(gl_FragCoord.x)];
+    ivec2 c = ivec2(probe.xy);
+    ivec2 h = ivec2(probe.zw);
+
+    vec4 sum = fetch(c);
+    sum += fetch(c + ivec2(h.x, h.y));
+    sum += fetch(c + ivec2(-h.x, h.y));
+    sum += fetch(c + ivec2(h.x, -h.y));
+    sum += fetch(c + ivec2(-h.x, -h.y));
+
+    finalColor = sum / 5.0;
+}
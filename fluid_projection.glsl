@@ -0,0 +1,265 @@
+#version 330
+
+// Input vertex attributes (from vertex shader)
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+// Uniforms
+uniform sampler2D uInput;       // The level a pass works on: p, rhs, right and up faces
+uniform sampler2D uSolid;         // Flags, see fluid_solid.glsl
+uniform sampler2D uField;       // Divergence and gradient only
+uniform sampler2D uCoarse;      // The level below, prolongation only
+uniform int uPass;
+uniform int uColor;             // Cells a sweep updates, (x + y) & 1. Totals from the top level when 1, the cycle for history.
+uniform int uLevel;             // Which level uInput is
+uniform float uCellSize;        // Spacing of the level being read
+
+// Output fragment color
+out vec4 finalColor;
+
+// The passes of fluid_multigrid.h, see runFluidProjection. Every level is a pair of
+// RGBA32F targets and a pass draws all of one from the other. Cells are texels and
+// wrap like the field does, z and w are how open the faces to the next cell across
+// and up are. Before the cycles the rhs and cells that take part are added up down
+// the levels, and the top level's mean rhs comes off. After them and every cycle
+// the squared residual gets added up the same way into a texel of the history.
+#define PASS_DIVERGENCE 0
+#define PASS_SMOOTH 1
+#define PASS_RESTRICT 2
+#define PASS_PROLONG 3
+#define PASS_TOTAL 4
+#define PASS_BALANCE 5
+#define PASS_PROJECT 6
+#define PASS_RESIDUAL 7
+#define PASS_HISTORY 8
+
+ivec2 wrapCell(ivec2 p, ivec2 size) {
+    return (p + size) % size;
+}
+
+// Same as FLUID_SOLID_*
+#define SOLID_SELF 1
+#define SOLID_LEFT 2
+#define SOLID_RIGHT 4
+#define SOLID_DOWN 8
+#define SOLID_UP 16
+
+int solidAt(ivec2 p) {
+    return int(texelFetch(uSolid, p, 0).r*255.0 + 0.5);
+}
+
+vec4 fetchCell(sampler2D level, ivec2 p, ivec2 size) {
+    return texelFetch(level, wrapCell(p, size), 0);
+}
+
+// Sum of p over the cells next to c weighted by how open the face to each is, and
+// the sum of the weights. Left, right, below, above, like sumFluidMultigridNeighbours.
+float sumNeighbours(vec4 cell, ivec2 c, ivec2 size, out float open) {
+    vec4 l = fetchCell(uInput, c + ivec2(-1, 0), size);
+    vec4 r = fetchCell(uInput, c + ivec2(1, 0), size);
+    vec4 d = fetchCell(uInput, c + ivec2(0, -1), size);
+    vec4 u = fetchCell(uInput, c + ivec2(0, 1), size);
+    open = l.z + cell.z + d.w + cell.w;
+    return l.z*l.x + cell.z*r.x + d.w*d.x + cell.w*u.x;
+}
+
+// Same as getFluidMultigridSpan, Gap and Lerp along one axis, top is the field's size
+int getSpan(int top, int count, int level, int x) {
+    return (x + 1 == count) ? top - (x << level) : 1 << level;
+}
+
+int getGap(int top, int count, int level, int x) {
+    int next = (x + 1 == count) ? 0 : x + 1;
+    return getSpan(top, count, level, x) + getSpan(top, count, level, next);
+}
+
+void getLerp(int top, int count, int coarse_count, int level, int x, out int lo, out int hi, out float t) {
+    int centre = ((2*x) << level) + getSpan(top, count, level, x);
+    int c = x/2;
+    int a = c;
+    if (centre < ((2*c) << (level + 1)) + getSpan(top, coarse_count, level + 1, c)) a = c - 1;
+
+    int b = a + 1;
+    int shift_a = (a < 0) ? -2*top : 0;
+    int shift_b = (b == coarse_count) ? 2*top : 0;
+    lo = (a < 0) ? coarse_count - 1 : a;
+    hi = (b == coarse_count) ? 0 : b;
+    int centre_a = ((2*lo) << (level + 1)) + getSpan(top, coarse_count, level + 1, lo) + shift_a;
+    int centre_b = ((2*hi) << (level + 1)) + getSpan(top, coarse_count, level + 1, hi) + shift_b;
+    t = float(centre - centre_a)/float(centre_b - centre_a);
+}
+
+float getOpen(sampler2D level, ivec2 c, ivec2 size) {
+    vec4 cell = fetchCell(level, c, size);
+    return fetchCell(level, c + ivec2(-1, 0), size).z + cell.z + fetchCell(level, c + ivec2(0, -1), size).w + cell.w;
+}
+
+float residual(ivec2 c, ivec2 size) {
+    vec4 cell = texelFetch(uInput, c, 0);
+    float open;
+    float sum = sumNeighbours(cell, c, size, open);
+    if (open == 0.0) return 0.0;
+    return cell.y - (sum - open*cell.x)/(uCellSize*uCellSize);
+}
+
+// Solid neighbours don't move
+vec4 divergence(ivec2 c) {
+    ivec2 size = textureSize(uField, 0);
+    int solid = solidAt(c);
+    if ((solid & SOLID_SELF) != 0) return vec4(0.0);
+
+    ivec2 left = wrapCell(c + ivec2(-1, 0), size);
+    ivec2 right = wrapCell(c + ivec2(1, 0), size);
+    ivec2 down = wrapCell(c + ivec2(0, -1), size);
+    ivec2 up = wrapCell(c + ivec2(0, 1), size);
+    float vl = ((solid & SOLID_LEFT) != 0) ? 0.0 : texelFetch(uField, left, 0).x;
+    float vr = ((solid & SOLID_RIGHT) != 0) ? 0.0 : texelFetch(uField, right, 0).x;
+    float vd = ((solid & SOLID_DOWN) != 0) ? 0.0 : texelFetch(uField, down, 0).y;
+    float vu = ((solid & SOLID_UP) != 0) ? 0.0 : texelFetch(uField, up, 0).y;
+    float div = (vr - vl + vu - vd)*0.5/uCellSize;
+    return vec4(0.0, div, ((solid & SOLID_RIGHT) != 0) ? 0.0 : 1.0, ((solid & SOLID_UP) != 0) ? 0.0 : 1.0);
+}
+
+vec4 smoothCell(ivec2 c) {
+    ivec2 size = textureSize(uInput, 0);
+    vec4 cell = texelFetch(uInput, c, 0);
+    if (((c.x + c.y) & 1) != uColor) return cell;
+
+    float open;
+    float sum = sumNeighbours(cell, c, size, open);
+    if (open > 0.0) cell.x = (sum - uCellSize*uCellSize*cell.y)/open;
+    return cell;
+}
+
+// Drawn at the size of the level below: a quarter of the residual under each cell,
+// and the fine faces along its own scaled by how much further apart the centres are
+vec4 restrictCell(ivec2 c) {
+    ivec2 size = textureSize(uInput, 0);
+    ivec2 top = textureSize(uField, 0);
+    ivec2 coarse = (size + 1)/2;
+    ivec2 last = min(2*c + 1, size - 1);
+    float r = 0.0;
+    vec2 faces = vec2(0.0);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            ivec2 p = 2*c + ivec2(x, y);
+            if (any(greaterThanEqual(p, size))) continue;
+            r += residual(p, size);
+            vec4 cell = texelFetch(uInput, p, 0);
+            if (p.x == last.x) faces.x += cell.z;
+            if (p.y == last.y) faces.y += cell.w;
+        }
+    }
+    vec2 scale = vec2(
+        float(getGap(top.x, size.x, uLevel, last.x))/float(getGap(top.x, coarse.x, uLevel + 1, c.x)),
+        float(getGap(top.y, size.y, uLevel, last.y))/float(getGap(top.y, coarse.y, uLevel + 1, c.y))
+    );
+    return vec4(0.0, 0.25*r, faces*scale);
+}
+
+// Bilinear between the coarse centres round this one that take part
+vec4 prolongCell(ivec2 c) {
+    vec4 cell = texelFetch(uInput, c, 0);
+    ivec2 fine = textureSize(uInput, 0);
+    ivec2 size = textureSize(uCoarse, 0);
+    ivec2 top = textureSize(uField, 0);
+    ivec2 lo, hi;
+    vec2 t;
+    getLerp(top.x, fine.x, size.x, uLevel, c.x, lo.x, hi.x, t.x);
+    getLerp(top.y, fine.y, size.y, uLevel, c.y, lo.y, hi.y, t.y);
+
+    ivec2 at[4] = ivec2[4](lo, ivec2(hi.x, lo.y), ivec2(lo.x, hi.y), hi);
+    vec4 w = vec4((1.0 - t.x)*(1.0 - t.y), t.x*(1.0 - t.y), (1.0 - t.x)*t.y, t.x*t.y);
+    float sum = 0.0;
+    float weight = 0.0;
+    for (int i = 0; i < 4; i++) {
+        if (getOpen(uCoarse, at[i], size) == 0.0) continue;
+        sum += texelFetch(uCoarse, at[i], 0).x*w[i];
+        weight += w[i];
+    }
+    if (weight > 0.0) cell.x += sum/weight;
+    return cell;
+}
+
+// Drawn at the size of the level below, rhs and cells that take part under each
+// cell. The levels are overwritten by the first restriction anyway.
+vec4 totalCell(ivec2 c) {
+    ivec2 size = textureSize(uInput, 0);
+    vec2 total = vec2(0.0);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            ivec2 p = 2*c + ivec2(x, y);
+            if (any(greaterThanEqual(p, size))) continue;
+            if (uColor == 0) total += texelFetch(uInput, p, 0).xy;
+            else if (getOpen(uInput, p, size) > 0.0) total += vec2(texelFetch(uInput, p, 0).y, 1.0);
+        }
+    }
+    return vec4(total, 0.0, 0.0);
+}
+
+// Drawn at the size of the level below from the top one, squared residual and
+// cells that take part under each cell. TOTAL takes them down from there.
+vec4 residualCell(ivec2 c) {
+    ivec2 size = textureSize(uInput, 0);
+    vec2 total = vec2(0.0);
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            ivec2 p = 2*c + ivec2(x, y);
+            if (any(greaterThanEqual(p, size)) || getOpen(uInput, p, size) == 0.0) continue;
+            float r = residual(p, size);
+            total += vec2(r*r, 1.0);
+        }
+    }
+    return vec4(total, 0.0, 0.0);
+}
+
+// The coarsest level's totals are few enough to add up in every cell
+vec2 getCoarsestTotal() {
+    ivec2 coarsest = textureSize(uCoarse, 0);
+    vec2 total = vec2(0.0);
+    for (int y = 0; y < coarsest.y; y++) {
+        for (int x = 0; x < coarsest.x; x++) total += texelFetch(uCoarse, ivec2(x, y), 0).xy;
+    }
+    return total;
+}
+
+vec4 balanceCell(ivec2 c) {
+    vec2 total = getCoarsestTotal();
+    ivec2 size = textureSize(uInput, 0);
+    vec4 cell = texelFetch(uInput, c, 0);
+    if (total.y > 0.0 && getOpen(uInput, c, size) > 0.0) cell.y -= total.x/total.y;
+    return cell;
+}
+
+// A shut face has the cell's own pressure on the other side, so nothing gets pushed
+// into walls
+vec4 projectCell(ivec2 c) {
+    ivec2 size = textureSize(uInput, 0);
+    vec4 data = texelFetch(uField, c, 0);
+    if ((solidAt(c) & SOLID_SELF) != 0) return data;
+
+    vec4 cell = texelFetch(uInput, c, 0);
+    vec4 l = fetchCell(uInput, c + ivec2(-1, 0), size);
+    vec4 r = fetchCell(uInput, c + ivec2(1, 0), size);
+    vec4 d = fetchCell(uInput, c + ivec2(0, -1), size);
+    vec4 u = fetchCell(uInput, c + ivec2(0, 1), size);
+    float pl = (l.z > 0.0) ? l.x : cell.x;
+    float pr = (cell.z > 0.0) ? r.x : cell.x;
+    float pd = (d.w > 0.0) ? d.x : cell.x;
+    float pu = (cell.w > 0.0) ? u.x : cell.x;
+    data.xy -= vec2(pr - pl, pu - pd)*0.5/uCellSize;
+    return data;
+}
+
+void main() {
+    ivec2 c = ivec2(gl_FragCoord.xy);
+    if (uPass == PASS_DIVERGENCE) finalColor = divergence(c);
+    else if (uPass == PASS_SMOOTH) finalColor = smoothCell(c);
+    else if (uPass == PASS_RESTRICT) finalColor = restrictCell(c);
+    else if (uPass == PASS_PROLONG) finalColor = prolongCell(c);
+    else if (uPass == PASS_TOTAL) finalColor = totalCell(c);
+    else if (uPass == PASS_BALANCE) finalColor = balanceCell(c);
+    else if (uPass == PASS_RESIDUAL) finalColor = residualCell(c);
+    else if (uPass == PASS_HISTORY) finalColor = vec4(getCoarsestTotal(), float(uColor), 0.0);
+    else finalColor = projectCell(c);
+}
@@ -0,0 +1,253 @@
+#ifndef NVST_FLUID_PROJECTION
+#define NVST_FLUID_PROJECTION
+
+#include "raylib.h"
+
+#include "fluid_gl.h"
+#include "fluid_pass.h"
+#include "fluid_readback.h"
+#include "fluid_multigrid.h"
+
+// FLUID_PRESSURE_PROJECTION on GL. fluid_projection.glsl runs the passes of
+// fluid_multigrid.h one full screen triangle at a time, straight through GL like
+// fluid_pass.h: the divergence into the top level, V-cycles down the levels, then
+// the gradient off the field into the back texture. Every level is two RGBA32F
+// targets holding p, rhs and how open its faces are, and each pass draws one from
+// the other. The targets belong to whoever owns the field, fluid.h only makes them
+// once a body switches to projection.
+//
+// The residual can't be checked between cycles without stalling, so its RMS after
+// each one goes into a texel of history and gets read back like the probes. The
+// next projection runs as many cycles as the newest one that landed needed to get
+// down to tolerance, one more if it never did.
+
+// Same as PASS_* in fluid_projection.glsl
+#define FLUID_PROJECTION_DIVERGENCE (0)
+#define FLUID_PROJECTION_SMOOTH (1)
+#define FLUID_PROJECTION_RESTRICT (2)
+#define FLUID_PROJECTION_PROLONG (3)
+#define FLUID_PROJECTION_TOTAL (4)
+#define FLUID_PROJECTION_BALANCE (5)
+#define FLUID_PROJECTION_PROJECT (6)
+#define FLUID_PROJECTION_RESIDUAL (7)
+#define FLUID_PROJECTION_HISTORY (8)
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidProjectionUniforms {
+    int pass;
+    int color;
+    int level;
+    int cell_size;
+} FluidProjectionUniforms;
+
+typedef struct NV_FluidProjection {
+    unsigned int program;   // 0 if it didn't build
+    unsigned int vao;       // Empty, same as FluidPass
+    FluidProjectionUniforms uniforms;
+    int cycles;             // Most V-cycles a projection, FLUID_MULTIGRID_CYCLES to start with
+    float tolerance;        // Same as FluidMultigrid's
+    int needed;             // Cycles the next projection runs, from the history
+
+    // Sized by getFluidMultigridSizes, level_count is 0 until they're made
+    RenderTexture2D levels[FLUID_MULTIGRID_LEVELS][2];
+    int current[FLUID_MULTIGRID_LEVELS];    // Which of the two holds the level
+    int level_count;
+
+    // Made with the levels. Texel k has the squared residual, cells and k after k
+    // cycles, ones past the last cycle still have cycle 0's.
+    RenderTexture2D history;
+    FluidReadback history_readback;
+} FluidProjection;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Needs a current context. Check program before using it.
+FluidProjection loadFluidProjection(const char* path) {
+    FluidProjection projection = { 0 };
+    projection.cycles = FLUID_MULTIGRID_CYCLES;
+    projection.tolerance = FLUID_MULTIGRID_TOLERANCE;
+    projection.needed = FLUID_MULTIGRID_CYCLES;
+    loadFluidGL();
+
+    char* code = LoadFileText(path);
+    if (code == NULL) return projection;
+    unsigned int shaders[2] = {
+        compileFluidShader(GL_VERTEX_SHADER, fluid_pass_vertex_shader),
+        compileFluidShader(GL_FRAGMENT_SHADER, code)
+    };
+    UnloadFileText(code);
+
+    projection.program = linkFluidProgram(shaders, 2);
+    if (projection.program == 0) return projection;
+
+    unsigned int program = projection.program;
+    projection.uniforms.pass = fluid_gl.GetUniformLocation(program, "uPass");
+    projection.uniforms.color = fluid_gl.GetUniformLocation(program, "uColor");
+    projection.uniforms.level = fluid_gl.GetUniformLocation(program, "uLevel");
+    projection.uniforms.cell_size = fluid_gl.GetUniformLocation(program, "uCellSize");
+
+    fluid_gl.UseProgram(program);
+    fluid_gl.Uniform1i(fluid_gl.GetUniformLocation(program, "uInput"), 0);
+    fluid_gl.Uniform1i(fluid_gl.GetUniformLocation(program, "uSolid"), 1);
+    fluid_gl.Uniform1i(fluid_gl.GetUniformLocation(program, "uField"), 2);
+    fluid_gl.Uniform1i(fluid_gl.GetUniformLocation(program, "uCoarse"), 3);
+    fluid_gl.UseProgram(0);
+
+    fluid_gl.GenVertexArrays(1, &projection.vao);
+    return projection;
+}
+
+// Only the program, the level targets are left to whoever made them
+void unloadFluidProjection(FluidProjection* projection) {
+    if (projection->program) fluid_gl.DeleteProgram(projection->program);
+    if (projection->vao) fluid_gl.DeleteVertexArrays(1, &projection->vao);
+    projection->program = 0;
+    projection->vao = 0;
+}
+
+// Draws level output from level input. Prolongation also reads the level below
+// input, and balancing the coarsest.
+static void drawFluidProjectionPass(FluidProjection* projection, int pass, int input, int output, int color, float cell_size) {
+    fluid_gl.BindTexture(GL_TEXTURE_2D, projection->levels[input][projection->current[input]].texture.id);
+    int coarse = (pass == FLUID_PROJECTION_BALANCE) ? projection->level_count - 1 : input + 1;
+    if (pass == FLUID_PROJECTION_PROLONG || pass == FLUID_PROJECTION_BALANCE) {
+        fluid_gl.ActiveTexture(GL_TEXTURE0 + 3);
+        fluid_gl.BindTexture(GL_TEXTURE_2D, projection->levels[coarse][projection->current[coarse]].texture.id);
+        fluid_gl.ActiveTexture(GL_TEXTURE0);
+    }
+
+    RenderTexture2D* target = &projection->levels[output][!projection->current[output]];
+    fluid_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, target->id);
+    fluid_gl.Viewport(0, 0, target->texture.width, target->texture.height);
+    fluid_gl.Uniform1i(projection->uniforms.pass, pass);
+    fluid_gl.Uniform1i(projection->uniforms.color, color);
+    fluid_gl.Uniform1i(projection->uniforms.level, input);
+    fluid_gl.Uniform1f(projection->uniforms.cell_size, cell_size);
+    fluid_gl.DrawArrays(GL_TRIANGLES, 0, 3);
+    projection->current[output] = !projection->current[output];
+
+    // Level below gets drawn into next, it can't be left bound
+    if (pass == FLUID_PROJECTION_PROLONG || pass == FLUID_PROJECTION_BALANCE) {
+        fluid_gl.ActiveTexture(GL_TEXTURE0 + 3);
+        fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+        fluid_gl.ActiveTexture(GL_TEXTURE0);
+    }
+}
+
+static void smoothFluidProjection(FluidProjection* projection, int level, int sweeps, float cell_size) {
+    for (int i = 0; i < sweeps; i++) {
+        drawFluidProjectionPass(projection, FLUID_PROJECTION_SMOOTH, level, level, 0, cell_size);
+        drawFluidProjectionPass(projection, FLUID_PROJECTION_SMOOTH, level, level, 1, cell_size);
+    }
+}
+
+// Same as cycleFluidMultigrid
+static void cycleFluidProjection(FluidProjection* projection, int level, float cell_size) {
+    if (level == projection->level_count - 1) {
+        smoothFluidProjection(projection, level, FLUID_MULTIGRID_COARSEST_SMOOTH, cell_size);
+        return;
+    }
+
+    smoothFluidProjection(projection, level, FLUID_MULTIGRID_SMOOTH, cell_size);
+    drawFluidProjectionPass(projection, FLUID_PROJECTION_RESTRICT, level, level + 1, 0, cell_size);
+    cycleFluidProjection(projection, level + 1, 2*cell_size);
+    drawFluidProjectionPass(projection, FLUID_PROJECTION_PROLONG, level, level, 0, cell_size);
+    smoothFluidProjection(projection, level, FLUID_MULTIGRID_SMOOTH, cell_size);
+}
+
+// Adds up the top level's squared residual down the levels into texel cycle of the
+// history. They're all drawn again by the next restriction. The first texel covers
+// the whole row, so what's there from the last projection goes.
+static void recordFluidProjection(FluidProjection* projection, int cycle, float cell_size) {
+    drawFluidProjectionPass(projection, FLUID_PROJECTION_RESIDUAL, 0, 1, 0, cell_size);
+    for (int i = 1; i + 1 < projection->level_count; i++) {
+        drawFluidProjectionPass(projection, FLUID_PROJECTION_TOTAL, i, i + 1, 0, cell_size);
+    }
+
+    int coarsest = projection->level_count - 1;
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 3);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, projection->levels[coarsest][projection->current[coarsest]].texture.id);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+    fluid_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, projection->history.id);
+    fluid_gl.Viewport(cycle, 0, (cycle == 0) ? projection->history.texture.width : 1, 1);
+    fluid_gl.Uniform1i(projection->uniforms.pass, FLUID_PROJECTION_HISTORY);
+    fluid_gl.Uniform1i(projection->uniforms.color, cycle);
+    fluid_gl.DrawArrays(GL_TRIANGLES, 0, 3);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 3);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+}
+
+// Cycles the newest history that landed says it took to get to tolerance, or one
+// more than it ran if it didn't get there. At least one, a frame later the field
+// has moved on.
+static int getFluidProjectionCycles(const FluidProjection* projection) {
+    const float* history = projection->history_readback.data;
+    if (history == NULL || history[1] == 0) return projection->needed;
+
+    float target = history[0]/history[1]*projection->tolerance*projection->tolerance;
+    int last = 0;
+    for (int k = 0; k < projection->history_readback.width; k++) {
+        const float* texel = &history[4*k];
+        if (k > 0 && (int)texel[2] != k) break;
+        if (texel[1] > 0 && texel[0]/texel[1] <= target) return (k > 0) ? k : 1;
+        last = k;
+    }
+    return last + 1;
+}
+
+// Takes the divergence out of field into target, which has to be another texture of
+// the same size. Solids come from the flags the solver reads. Leaves its own
+// program, framebuffer and viewport bound and blending off, so the caller puts back
+// whatever it had.
+void runFluidProjection(FluidProjection* projection, unsigned int field, unsigned int target, unsigned int solid, float cell_size) {
+    fluid_gl.UseProgram(projection->program);
+    fluid_gl.BindVertexArray(projection->vao);
+    fluid_gl.Disable(GL_BLEND);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 1);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, solid);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 2);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, field);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+
+    // Same as solveFluidMultigrid, the mean rhs comes off first
+    drawFluidProjectionPass(projection, FLUID_PROJECTION_DIVERGENCE, 0, 0, 0, cell_size);
+    for (int i = 0; i + 1 < projection->level_count; i++) {
+        drawFluidProjectionPass(projection, FLUID_PROJECTION_TOTAL, i, i + 1, i == 0, cell_size);
+    }
+    if (projection->level_count > 1) drawFluidProjectionPass(projection, FLUID_PROJECTION_BALANCE, 0, 0, 0, cell_size);
+
+    // A single level has nowhere to add the residual up, it just runs every cycle
+    int track = projection->level_count > 1;
+    if (track && pollFluidReadback(&projection->history_readback)) {
+        projection->needed = getFluidProjectionCycles(projection);
+    }
+    int cycles = (projection->needed < projection->cycles && track) ? projection->needed : projection->cycles;
+    if (cycles > FLUID_MULTIGRID_MAX_CYCLES) cycles = FLUID_MULTIGRID_MAX_CYCLES;
+    if (track) recordFluidProjection(projection, 0, cell_size);
+    for (int i = 0; i < cycles; i++) {
+        cycleFluidProjection(projection, 0, cell_size);
+        if (track) recordFluidProjection(projection, i + 1, cell_size);
+    }
+    if (track) queueFluidReadback(&projection->history_readback, projection->history.id);
+
+    const Texture2D* top = &projection->levels[0][projection->current[0]].texture;
+    fluid_gl.BindTexture(GL_TEXTURE_2D, top->id);
+    fluid_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    fluid_gl.Viewport(0, 0, top->width, top->height);
+    fluid_gl.Uniform1i(projection->uniforms.pass, FLUID_PROJECTION_PROJECT);
+    fluid_gl.Uniform1f(projection->uniforms.cell_size, cell_size);
+    fluid_gl.DrawArrays(GL_TRIANGLES, 0, 3);
+
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.ActiveTexture(GL_TEXTURE0 + 2);
+    fluid_gl.BindTexture(GL_TEXTURE_2D, 0);
+    fluid_gl.ActiveTexture(GL_TEXTURE0);
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef NVST_FLUID_READBACK
+#define NVST_FLUID_READBACK
+
+#include "fluid_gl.h"
+
+// Reads the fluid back to the CPU without stalling. Every frame glReadPixels goes
+// into a free pixel buffer with a fence behind it, and the newest buffer whose
+// fence has passed gets mapped. The mapped buffer is what the CPU reads until a
+// newer one lands, so data is usually a frame or two old. If every buffer is
+// still busy the frame's read is skipped rather than waited on.
+
+#define FLUID_READBACK_RING (3)
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidReadback {
+    int width;
+    int height;
+    unsigned int type;                          // GL_HALF_FLOAT or GL_FLOAT, always RGBA
+    int pixel_size;
+    unsigned int pbo[FLUID_READBACK_RING];
+    FluidGLSync fence[FLUID_READBACK_RING];     // Set while a read is in flight
+    int head;                                   // Next buffer to read into, also the oldest in flight
+    int mapped;                                 // Buffer the CPU is reading, -1 for none
+    const void* data;                           // Bottom row first, NULL until the first read lands
+    long long issued;                           // Reads started
+    long long landed;                           // Reads that made it to the CPU
+} FluidReadback;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+FluidReadback createFluidReadback(int width, int height, unsigned int type) {
+    FluidReadback readback = { 0 };
+    readback.width = width;
+    readback.height = height;
+    readback.type = type;
+    readback.pixel_size = (type == GL_FLOAT) ? 4*sizeof(float) : 4*sizeof(unsigned short);
+    readback.mapped = -1;
+
+    loadFluidGL();
+    fluid_gl.GenBuffers(FLUID_READBACK_RING, readback.pbo);
+    for (int i = 0; i < FLUID_READBACK_RING; i++) {
+        fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo[i]);
+        fluid_gl.BufferData(GL_PIXEL_PACK_BUFFER, (ptrdiff_t)width*height*readback.pixel_size, NULL, GL_STREAM_READ);
+    }
+    fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return readback;
+}
+
+void unloadFluidReadback(FluidReadback* readback) {
+    if (readback->mapped >= 0) {
+        fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo[readback->mapped]);
+        fluid_gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    for (int i = 0; i < FLUID_READBACK_RING; i++) {
+        if (readback->fence[i]) fluid_gl.DeleteSync(readback->fence[i]);
+    }
+    fluid_gl.DeleteBuffers(FLUID_READBACK_RING, readback->pbo);
+
+    readback->mapped = -1;
+    readback->data = NULL;
+}
+
+// Maps the newest finished read, never waits. Returns 1 if data changed.
+int pollFluidReadback(FluidReadback* readback) {
+    int newest = -1;
+
+    // Fences pass in order, so walk from the oldest and stop at the first busy one
+    for (int i = 0; i < FLUID_READBACK_RING; i++) {
+        int slot = (readback->head + i) % FLUID_READBACK_RING;
+        if (!readback->fence[slot]) continue;
+
+        unsigned int status = fluid_gl.ClientWaitSync(readback->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        fluid_gl.DeleteSync(readback->fence[slot]);
+        readback->fence[slot] = NULL;
+        newest = slot;
+    }
+
+    if (newest < 0) return 0;
+
+    // Older finished reads are skipped, they just go back to being free
+    if (readback->mapped >= 0) {
+        fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo[readback->mapped]);
+        fluid_gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo[newest]);
+    readback->data = fluid_gl.MapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0,
+        (ptrdiff_t)readback->width*readback->height*readback->pixel_size,
+        GL_MAP_READ_BIT
+    );
+    fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback->mapped = readback->data ? newest : -1;
+    readback->landed++;
+
+    return 1;
+}
+
+// Starts reading the framebuffer's first color attachment. Returns 0 if every buffer was busy.
+int queueFluidReadback(FluidReadback* readback, unsigned int framebuffer) {
+    int slot = readback->head;
+    if (readback->fence[slot] || readback->mapped == slot) return 0;
+
+    int previous_framebuffer = 0;
+    fluid_gl.GetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_framebuffer);
+
+    fluid_gl.BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo[slot]);
+    fluid_gl.ReadPixels(0, 0, readback->width, readback->height, GL_RGBA, readback->type, NULL);
+    fluid_gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fluid_gl.BindFramebuffer(GL_READ_FRAMEBUFFER, previous_framebuffer);
+
+    readback->fence[slot] = fluid_gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback->head = (slot + 1) % FLUID_READBACK_RING;
+    readback->issued++;
+
+    return 1;
+}
+
+#endif
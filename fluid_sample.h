@@ -0,0 +1,235 @@
+#ifndef NVST_FLUID_SAMPLE
+#define NVST_FLUID_SAMPLE
+
+#include <stddef.h>
+
+#include "fluid_half.h"
+
+// Batched velocity lookups for anything on the CPU that reads the fluid. Positions
+// are in texels with rows counted like getCPUImgValue, and texel centers sit on whole
+// numbers so an integer position gives back that texel. Velocity is blended between
+// the four nearest texels, anything off the field counts as zero. With AVX2 and F16C
+// eight positions go at once using gathers, and half floats are converted in hardware.
+// Both paths run the same operations in the same order and give the same bits.
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+// Where velocities come from, either an RGBA16F readback or float32 x and y
+typedef struct NV_FluidSampleSource {
+    const unsigned short* half;     // RGBA16F, used if set
+    const float* x;
+    const float* y;
+    int stride;                     // Floats from one texel to the next, 4 for RGBA32F, 1 for planes
+    int width;
+    int height;
+} FluidSampleSource;
+
+// Scalar has to round like the AVX2 path to match it, which only exists on x86
+#if FLUID_SIMD_X86
+    #define FLUID_SAMPLE_SCALAR __attribute__((FLUID_SIMD_NO_CONTRACT))
+#else
+    #define FLUID_SAMPLE_SCALAR
+#endif
+
+//----------------------------------------------------------------------------------
+// Scalar
+//----------------------------------------------------------------------------------
+
+static inline Vector2 fetchFluidSampleTexel(const FluidSampleSource* source, int x, int y) {
+    if (x < 0 || x >= source->width || y < 0 || y >= source->height) return (Vector2){0, 0};
+
+    size_t i = (size_t)y*source->width + x;
+    if (source->half) {
+        return (Vector2){
+            convertFloat16ToNativeFloat(source->half[i*4]),
+            convertFloat16ToNativeFloat(source->half[i*4 + 1])
+        };
+    }
+    return (Vector2){source->x[i*source->stride], source->y[i*source->stride]};
+}
+
+static FLUID_SAMPLE_SCALAR void sampleFluidVelocityScalar(
+    const FluidSampleSource* source, const Vector2* positions, Vector2* velocities, int start, int count
+) {
+    for (int i = start; i < count; i++) {
+        // Far off the field is all zeros anyway, clamping keeps the int conversion in range
+        float px = fminf(fmaxf(positions[i].x, -2.0f), source->width + 1.0f);
+        float py = fminf(fmaxf(positions[i].y, -2.0f), source->height + 1.0f);
+        float fx0 = floorf(px);
+        float fy0 = floorf(py);
+        float fx = px - fx0;
+        float fy = py - fy0;
+        int x0 = (int)fx0;
+        int y0 = (int)fy0;
+
+        float w00 = (1.0f - fx)*(1.0f - fy);
+        float w10 = fx*(1.0f - fy);
+        float w01 = (1.0f - fx)*fy;
+        float w11 = fx*fy;
+
+        Vector2 c00 = fetchFluidSampleTexel(source, x0, y0);
+        Vector2 c10 = fetchFluidSampleTexel(source, x0 + 1, y0);
+        Vector2 c01 = fetchFluidSampleTexel(source, x0, y0 + 1);
+        Vector2 c11 = fetchFluidSampleTexel(source, x0 + 1, y0 + 1);
+
+        velocities[i].x = c00.x*w00 + c10.x*w10 + c01.x*w01 + c11.x*w11;
+        velocities[i].y = c00.y*w00 + c10.y*w10 + c01.y*w01 + c11.y*w11;
+    }
+}
+
+static void decodeFluidHalfScalar(const unsigned short* src, float* dst, size_t start, size_t count) {
+    for (size_t i = start; i < count; i++) {
+        dst[i] = convertFloat16ToNativeFloat(src[i]);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// AVX2 + F16C
+//----------------------------------------------------------------------------------
+#if FLUID_SIMD_X86
+
+#define FLUID_SAMPLE_TARGET __attribute__((target("avx2,f16c"), FLUID_SIMD_NO_CONTRACT))
+
+// Texel indices and in-bounds masks for one corner of eight positions
+static inline FLUID_SAMPLE_TARGET __m256i getFluidSampleIndex(
+    __m256i x, __m256i y, __m256i width, __m256i height, __m256i* mask
+) {
+    __m256i inside_x = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), x), _mm256_cmpgt_epi32(width, x));
+    __m256i inside_y = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), y), _mm256_cmpgt_epi32(height, y));
+    *mask = _mm256_and_si256(inside_x, inside_y);
+    return _mm256_add_epi32(_mm256_mullo_epi32(y, width), x);
+}
+
+static FLUID_SAMPLE_TARGET void sampleFluidVelocityAVX2(
+    const FluidSampleSource* source, const Vector2* positions, Vector2* velocities, int count
+) {
+    const __m256i width = _mm256_set1_epi32(source->width);
+    const __m256i height = _mm256_set1_epi32(source->height);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i pair_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i pair_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // Split eight interleaved x, y pairs into x and y
+        __m256 a = _mm256_permutevar8x32_ps(_mm256_loadu_ps(&positions[i].x), deinterleave);
+        __m256 b = _mm256_permutevar8x32_ps(_mm256_loadu_ps(&positions[i + 4].x), deinterleave);
+        __m256 px = _mm256_permute2f128_ps(a, b, 0x20);
+        __m256 py = _mm256_permute2f128_ps(a, b, 0x31);
+
+        px = _mm256_min_ps(_mm256_max_ps(px, _mm256_set1_ps(-2.0f)), _mm256_set1_ps(source->width + 1.0f));
+        py = _mm256_min_ps(_mm256_max_ps(py, _mm256_set1_ps(-2.0f)), _mm256_set1_ps(source->height + 1.0f));
+        __m256 fx0 = _mm256_floor_ps(px);
+        __m256 fy0 = _mm256_floor_ps(py);
+        __m256 fx = _mm256_sub_ps(px, fx0);
+        __m256 fy = _mm256_sub_ps(py, fy0);
+        __m256i x0 = _mm256_cvttps_epi32(fx0);
+        __m256i y0 = _mm256_cvttps_epi32(fy0);
+        __m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(1));
+        __m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(1));
+
+        __m256 w[4] = {
+            _mm256_mul_ps(_mm256_sub_ps(one, fx), _mm256_sub_ps(one, fy)),
+            _mm256_mul_ps(fx, _mm256_sub_ps(one, fy)),
+            _mm256_mul_ps(_mm256_sub_ps(one, fx), fy),
+            _mm256_mul_ps(fx, fy),
+        };
+        __m256i mask[4];
+        __m256i index[4] = {
+            getFluidSampleIndex(x0, y0, width, height, &mask[0]),
+            getFluidSampleIndex(x1, y0, width, height, &mask[1]),
+            getFluidSampleIndex(x0, y1, width, height, &mask[2]),
+            getFluidSampleIndex(x1, y1, width, height, &mask[3]),
+        };
+
+        if (source->half) {
+            // Each gather pulls a texel's x and y halves as one 32 bit value, which
+            // converts straight into interleaved x, y floats four texels at a time
+            __m256 out_lo = _mm256_setzero_ps();
+            __m256 out_hi = _mm256_setzero_ps();
+            for (int c = 0; c < 4; c++) {
+                __m256i xy = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)source->half, index[c], mask[c], 8);
+                __m256 v_lo = _mm256_cvtph_ps(_mm256_castsi256_si128(xy));
+                __m256 v_hi = _mm256_cvtph_ps(_mm256_extracti128_si256(xy, 1));
+                __m256 t_lo = _mm256_mul_ps(v_lo, _mm256_permutevar8x32_ps(w[c], pair_lo));
+                __m256 t_hi = _mm256_mul_ps(v_hi, _mm256_permutevar8x32_ps(w[c], pair_hi));
+                out_lo = (c == 0) ? t_lo : _mm256_add_ps(out_lo, t_lo);
+                out_hi = (c == 0) ? t_hi : _mm256_add_ps(out_hi, t_hi);
+            }
+            _mm256_storeu_ps(&velocities[i].x, out_lo);
+            _mm256_storeu_ps(&velocities[i + 4].x, out_hi);
+        } else {
+            __m256i stride = _mm256_set1_epi32(source->stride);
+            __m256 vx = _mm256_setzero_ps();
+            __m256 vy = _mm256_setzero_ps();
+            for (int c = 0; c < 4; c++) {
+                __m256i offset = _mm256_mullo_epi32(index[c], stride);
+                __m256 m = _mm256_castsi256_ps(mask[c]);
+                __m256 gx = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), source->x, offset, m, 4);
+                __m256 gy = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), source->y, offset, m, 4);
+                __m256 tx = _mm256_mul_ps(gx, w[c]);
+                __m256 ty = _mm256_mul_ps(gy, w[c]);
+                vx = (c == 0) ? tx : _mm256_add_ps(vx, tx);
+                vy = (c == 0) ? ty : _mm256_add_ps(vy, ty);
+            }
+            __m256 lo = _mm256_unpacklo_ps(vx, vy);
+            __m256 hi = _mm256_unpackhi_ps(vx, vy);
+            _mm256_storeu_ps(&velocities[i].x, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(&velocities[i + 4].x, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+    }
+
+    sampleFluidVelocityScalar(source, positions, velocities, i, count);
+}
+
+static FLUID_SAMPLE_TARGET void decodeFluidHalfF16C(const unsigned short* src, float* dst, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+    }
+    decodeFluidHalfScalar(src, dst, i, count);
+}
+
+#undef FLUID_SAMPLE_TARGET
+
+#endif
+
+//----------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------
+
+// Follows setFluidCPUISA, so forcing scalar there also forces it here
+static int useFluidSampleSIMD(void) {
+#if FLUID_SIMD_X86
+    getFluidRowKernel();
+    return (fluid_cpu_isa >= FLUID_ISA_AVX2) && __builtin_cpu_supports("f16c");
+#else
+    return 0;
+#endif
+}
+
+void sampleFluidVelocityBatch(const FluidSampleSource* source, const Vector2* positions, Vector2* velocities, int count) {
+#if FLUID_SIMD_X86
+    if (useFluidSampleSIMD()) {
+        sampleFluidVelocityAVX2(source, positions, velocities, count);
+        return;
+    }
+#endif
+    sampleFluidVelocityScalar(source, positions, velocities, 0, count);
+}
+
+// Half floats to float32, count is the number of halves
+void decodeFluidHalfImage(const unsigned short* src, float* dst, size_t count) {
+#if FLUID_SIMD_X86
+    if (useFluidSampleSIMD()) {
+        decodeFluidHalfF16C(src, dst, count);
+        return;
+    }
+#endif
+    decodeFluidHalfScalar(src, dst, 0, count);
+}
+
+#endif
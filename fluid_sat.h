@@ -0,0 +1,201 @@
+#ifndef NVST_FLUID_SAT
+#define NVST_FLUID_SAT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fluid_sample.h"
+#include "fluid_threads.h"
+
+// Summed-area tables of vx, vy and |v|^2, so the mean over any rectangle is four
+// lookups no matter how big it is. Tables are one bigger than the field each way
+// with a zero first row and column, and the sums over the whole field are kept in
+// double precision. Built in two passes over the thread pool: every band of rows
+// does its own running sums, then every strip of columns adds each row to the
+// one below it, four columns per instruction with AVX2.
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidSAT {
+    int width;              // Of the field, the tables are (width + 1)*(height + 1)
+    int height;
+    double* vx;
+    double* vy;
+    double* energy;
+    float* scratch;         // One decoded RGBA16F row per worker
+    FluidThreadPool* pool;
+    long long built;        // How many times it's been built, 0 means it's empty
+} FluidSAT;
+
+// Means over a region, anything off the field counts as zero
+typedef struct NV_FluidRegion {
+    Vector2 velocity;
+    float energy;           // Mean of |v|^2
+    int cells;
+} FluidRegion;
+
+typedef struct NV_FluidSATBuild {
+    FluidSAT* sat;
+    const FluidSampleSource* source;
+} FluidSATBuild;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// threads <= 0 uses every core
+FluidSAT createFluidSAT(int width, int height, int threads) {
+    FluidSAT sat = { 0 };
+    size_t count = (size_t)(width + 1)*(height + 1);
+
+    sat.width = width;
+    sat.height = height;
+    sat.vx = calloc(count, sizeof(double));
+    sat.vy = calloc(count, sizeof(double));
+    sat.energy = calloc(count, sizeof(double));
+    sat.pool = createFluidThreadPool(threads);
+    sat.scratch = malloc((size_t)sat.pool->count*width*4*sizeof(float));
+
+    return sat;
+}
+
+void unloadFluidSAT(FluidSAT* sat) {
+    unloadFluidThreadPool(sat->pool);
+    free(sat->vx);
+    free(sat->vy);
+    free(sat->energy);
+    free(sat->scratch);
+}
+
+// Running sums along each row of the band
+static void buildFluidSATRowsJob(void* arg, int worker, int workers) {
+    FluidSATBuild* build = (FluidSATBuild*)arg;
+    FluidSAT* sat = build->sat;
+    const FluidSampleSource* source = build->source;
+    int width = sat->width;
+    int stride = (width + 1);
+
+    int y0, y1;
+    getFluidThreadRange(sat->height, worker, workers, &y0, &y1);
+
+    float* decoded = sat->scratch + (size_t)worker*width*4;
+
+    for (int y = y0; y < y1; y++) {
+        const float* x_in;
+        const float* y_in;
+        int step;
+
+        if (source->half) {
+            decodeFluidHalfImage(source->half + (size_t)y*width*4, decoded, (size_t)width*4);
+            x_in = decoded;
+            y_in = decoded + 1;
+            step = 4;
+        } else {
+            x_in = source->x + (size_t)y*width*source->stride;
+            y_in = source->y + (size_t)y*width*source->stride;
+            step = source->stride;
+        }
+
+        double* out_x = sat->vx + (size_t)(y + 1)*stride;
+        double* out_y = sat->vy + (size_t)(y + 1)*stride;
+        double* out_e = sat->energy + (size_t)(y + 1)*stride;
+        double sum_x = 0, sum_y = 0, sum_e = 0;
+
+        out_x[0] = 0;
+        out_y[0] = 0;
+        out_e[0] = 0;
+        for (int x = 0; x < width; x++) {
+            double vx = x_in[x*step];
+            double vy = y_in[x*step];
+            sum_x += vx;
+            sum_y += vy;
+            sum_e += vx*vx + vy*vy;
+            out_x[x + 1] = sum_x;
+            out_y[x + 1] = sum_y;
+            out_e[x + 1] = sum_e;
+        }
+    }
+}
+
+static void addFluidSATRowsScalar(double* row, const double* above, int x0, int x1) {
+    for (int x = x0; x < x1; x++) {
+        row[x] += above[x];
+    }
+}
+
+#if FLUID_SIMD_X86
+static __attribute__((target("avx2"))) void addFluidSATRowsAVX2(double* row, const double* above, int x0, int x1) {
+    int x = x0;
+    for (; x + 4 <= x1; x += 4) {
+        _mm256_storeu_pd(row + x, _mm256_add_pd(_mm256_loadu_pd(row + x), _mm256_loadu_pd(above + x)));
+    }
+    addFluidSATRowsScalar(row, above, x, x1);
+}
+#endif
+
+// Adds every row into the one below it, within the worker's strip of columns
+static void buildFluidSATColumnsJob(void* arg, int worker, int workers) {
+    FluidSATBuild* build = (FluidSATBuild*)arg;
+    FluidSAT* sat = build->sat;
+    int stride = sat->width + 1;
+
+    // Strips are whole vectors wide so neighbours never share one
+    int x0, x1;
+    getFluidThreadRange((stride + 3) / 4, worker, workers, &x0, &x1);
+    x0 *= 4;
+    x1 = (x1*4 < stride) ? x1*4 : stride;
+
+    void (*add)(double*, const double*, int, int) = addFluidSATRowsScalar;
+#if FLUID_SIMD_X86
+    if (fluid_cpu_isa >= FLUID_ISA_AVX2) add = addFluidSATRowsAVX2;
+#endif
+
+    double* planes[3] = {sat->vx, sat->vy, sat->energy};
+    for (int y = 2; y <= sat->height; y++) {
+        for (int p = 0; p < 3; p++) {
+            add(planes[p] + (size_t)y*stride, planes[p] + (size_t)(y - 1)*stride, x0, x1);
+        }
+    }
+}
+
+// Source has to be the same size as the table
+void buildFluidSAT(FluidSAT* sat, const FluidSampleSource* source) {
+    if (source->width != sat->width || source->height != sat->height) return;
+
+    // Picks the ISA before the workers start so they don't race to do it
+    getFluidRowKernel();
+
+    FluidSATBuild build = {sat, source};
+    runFluidThreadPool(sat->pool, buildFluidSATRowsJob, &build);
+    runFluidThreadPool(sat->pool, buildFluidSATColumnsJob, &build);
+    sat->built++;
+}
+
+static inline double sumFluidSAT(const double* table, int stride, int x0, int y0, int x1, int y1) {
+    return table[(size_t)y1*stride + x1] - table[(size_t)y0*stride + x1] - table[(size_t)y1*stride + x0] + table[(size_t)y0*stride + x0];
+}
+
+// Texels x to x + width - 1 and y to y + height - 1, rows counted like getCPUImgValue
+FluidRegion queryFluidSAT(const FluidSAT* sat, int x, int y, int width, int height) {
+    FluidRegion region = { 0 };
+    if (width <= 0 || height <= 0 || sat->built == 0) return region;
+
+    // Off the field adds nothing, so clamp to it but still divide by the whole area
+    int x0 = (x < 0) ? 0 : (x > sat->width) ? sat->width : x;
+    int y0 = (y < 0) ? 0 : (y > sat->height) ? sat->height : y;
+    int x1 = (x + width < 0) ? 0 : (x + width > sat->width) ? sat->width : x + width;
+    int y1 = (y + height < 0) ? 0 : (y + height > sat->height) ? sat->height : y + height;
+    int stride = sat->width + 1;
+    double cells = (double)width*height;
+
+    region.velocity.x = sumFluidSAT(sat->vx, stride, x0, y0, x1, y1) / cells;
+    region.velocity.y = sumFluidSAT(sat->vy, stride, x0, y0, x1, y1) / cells;
+    region.energy = sumFluidSAT(sat->energy, stride, x0, y0, x1, y1) / cells;
+    region.cells = width*height;
+
+    return region;
+}
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef NVST_FLUID_SIMD
+#define NVST_FLUID_SIMD
+
+#include <math.h>
+
+#include "raylib.h"
+
+// Row kernels for the CPU fluid step. Everything in fluid_comp.glsl except the
+// advection lookup runs here: the 5-point stencil, Laplacian, curl, vorticity,
+// decay, clamps and boundaries. Each ISA gets its own copy of the same kernel
+// body (fluid_simd_kernel.h), and the scalar path runs the same operations in
+// the same order, so every variant gives bit-identical results as long as the
+// scalar code isn't built with FMA contraction (-ffp-contract=off with -march=native).
+
+// Defaults for both backends
+#define FLUID_DEFAULT_DT (0.1f)
+#define FLUID_DEFAULT_K (0.03f)
+#define FLUID_DEFAULT_VISCOSITY (0.19f)
+
+// Velocities are in texels of a grid this wide whatever the real resolution is,
+// so emitters and forces mean the same thing at every size
+#define FLUID_REFERENCE_WIDTH (1920)
+
+// One byte a cell the solver reads instead of the boundary colors around it, built
+// from them whenever they change. Same as SOLID_* in the shaders.
+#define FLUID_SOLID_SELF (1)        // Red in the boundaries, the cell keeps what it has
+#define FLUID_SOLID_LEFT (2)        // Same for the neighbours, those block the velocity towards them
+#define FLUID_SOLID_RIGHT (4)
+#define FLUID_SOLID_DOWN (8)
+#define FLUID_SOLID_UP (16)
+#define FLUID_SOLID_CLEAR (32)      // Mostly green, the cell is emptied every step
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define FLUID_SIMD_X86 1
+    #include <immintrin.h>
+#else
+    #define FLUID_SIMD_X86 0
+#endif
+
+// GCC fuses the intrinsics into FMAs when it can, which would break the match with scalar
+#if defined(__GNUC__) && !defined(__clang__)
+    #define FLUID_SIMD_NO_CONTRACT optimize("fp-contract=off")
+#else
+    #define FLUID_SIMD_NO_CONTRACT
+#endif
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+// How advection finds what moved into a cell, see setFluidAdvection
+typedef enum NV_FluidAdvection {
+    FLUID_ADVECTION_SEMI_LAGRANGIAN,    // One bilinear lookup back along the flow
+    FLUID_ADVECTION_MACCORMACK,         // Plus a clamped correction for what that smeared
+} FluidAdvection;
+
+// What keeps the flow from bunching up, see setFluidPressure
+typedef enum NV_FluidPressure {
+    FLUID_PRESSURE_DENSITY,             // Only the push down the density gradient, k
+    FLUID_PRESSURE_PROJECTION,          // Plus a multigrid solve that takes the divergence out
+} FluidPressure;
+
+// Same as the uniforms of fluid_comp.glsl
+typedef struct NV_FluidParams {
+    float dt;
+    float k;
+    float viscosity;
+    float cell_size;        // Reference texels per texel, 1 at FLUID_REFERENCE_WIDTH
+    int advection;          // FluidAdvection
+    int pressure;           // FluidPressure
+} FluidParams;
+
+typedef enum NV_FluidCPUISA {
+    FLUID_ISA_SCALAR,
+    FLUID_ISA_SSE4,
+    FLUID_ISA_AVX2,
+    FLUID_ISA_AVX512,
+    FLUID_ISA_COUNT
+} FluidCPUISA;
+
+// Everything a kernel needs for one row, already offset to the start of the row
+typedef struct NV_FluidCPURow {
+    const float* c[4];      // x, y, z, w of this row
+    const float* u[4];      // Row above
+    const float* d[4];      // Row below
+    const unsigned char* solid;     // FLUID_SOLID_* flags of this row
+    const float* adv_x;     // Advected velocity
+    const float* adv_y;
+    const float* ext_x;     // Emitter force, 0 outside of emitters
+    const float* ext_y;
+    const float* emit;      // 1 where an emitter covers the cell
+    float* out[4];
+    const FluidParams* params;
+} FluidCPURow;
+
+typedef void (*FluidRowKernel)(const FluidCPURow* row, int x0, int x1);
+
+//----------------------------------------------------------------------------------
+// Scalar
+//----------------------------------------------------------------------------------
+
+static inline float signFluidCPU(float x) {
+    return (x > 0) - (x < 0);
+}
+
+static inline float clampFluidCPU(float x, float lo, float hi) {
+    return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+// One cell, l and r are the columns of the left and right neighbours
+static inline void stepFluidCPUCell(const FluidCPURow* row, int x, int l, int r) {
+    const float dt = row->params->dt;
+    const float K = row->params->k;
+    const float v = row->params->viscosity;
+    const float k_dt = K/dt;
+    const float inv_h = 1.0f/row->params->cell_size;
+    const float inv_h2 = inv_h*inv_h;
+    const unsigned char solid = row->solid[x];
+
+    // Solids don't step at all
+    if (solid & FLUID_SOLID_SELF) {
+        for (int i = 0; i < 4; i++) row->out[i][x] = row->c[i][x];
+        return;
+    }
+
+    float data_x = row->c[0][x];
+    float data_y = row->c[1][x];
+    float data_z = row->c[2][x];
+
+    float dx_x = (row->c[0][r] - row->c[0][l])*0.5f*inv_h;
+    float dx_z = (row->c[2][r] - row->c[2][l])*0.5f*inv_h;
+    float dy_y = (row->u[1][x] - row->d[1][x])*0.5f*inv_h;
+    float dy_z = (row->u[2][x] - row->d[2][x])*0.5f*inv_h;
+
+    // Density
+    data_z = data_z - dt*(dx_z*data_x + dy_z*data_y + (dx_x + dy_y)*data_z);
+
+    float lap_x = (row->u[0][x] + row->d[0][x] + row->c[0][r] + row->c[0][l] - 4.0f*data_x)*inv_h2;
+    float lap_y = (row->u[1][x] + row->d[1][x] + row->c[1][r] + row->c[1][l] - 4.0f*data_y)*inv_h2;
+    float visc_x = v*lap_x;
+    float visc_y = v*lap_y;
+
+    // Advection, emitters zero the density
+    data_x = row->adv_x[x];
+    data_y = row->adv_y[x];
+    if (row->emit[x] > 0) data_z = 0;
+
+    // Velocity
+    data_x = data_x + dt*(visc_x - k_dt*dx_z + 8.0f*row->ext_x[x]);
+    data_y = data_y + dt*(visc_y - k_dt*dy_z + 8.0f*row->ext_y[x]);
+    data_x = fmaxf(0, fabsf(data_x) - 0.0008f)*signFluidCPU(data_x);
+    data_y = fmaxf(0, fabsf(data_y) - 0.0008f)*signFluidCPU(data_y);
+
+    // Vorticity
+    float curl = (row->c[1][r] - row->c[1][l] - row->u[0][x] + row->d[0][x])*inv_h;
+    float vort_x = fabsf(row->u[3][x]) - fabsf(row->d[3][x]);
+    float vort_y = fabsf(row->c[3][l]) - fabsf(row->c[3][r]);
+    float vort_len_x = vort_x + 1e-9f;
+    float vort_len_y = vort_y + 1e-9f;
+    float vort_scale = -0.2f/sqrtf(vort_len_x*vort_len_x + vort_len_y*vort_len_y)*curl;
+    data_x = data_x + vort_x*vort_scale;
+    data_y = data_y + vort_y*vort_scale;
+
+    data_x = clampFluidCPU(data_x, -100000, 100000);
+    data_y = clampFluidCPU(data_y, -100000, 100000);
+    data_z = clampFluidCPU(data_z, 0.5f, 15.0f);
+
+    // Boundaries
+    if (solid & (FLUID_SOLID_LEFT | FLUID_SOLID_RIGHT)) data_x = 0;
+    if (solid & (FLUID_SOLID_DOWN | FLUID_SOLID_UP)) data_y = 0;
+
+    float keep = (solid & FLUID_SOLID_CLEAR) ? 0.0f : 1.0f;
+    row->out[0][x] = data_x*keep;
+    row->out[1][x] = data_y*keep;
+    row->out[2][x] = data_z*keep;
+    row->out[3][x] = 1 - row->emit[x];
+}
+
+static void stepFluidRowScalar(const FluidCPURow* row, int x0, int x1) {
+    for (int x = x0; x < x1; x++) {
+        stepFluidCPUCell(row, x, x - 1, x + 1);
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Vector kernels
+//----------------------------------------------------------------------------------
+
+#if FLUID_SIMD_X86
+
+// SSE4.1, 4 cells per instruction
+#define FLUID_SIMD_NAME stepFluidRowSSE4
+#define FLUID_SIMD_TARGET __attribute__((target("sse4.1"), FLUID_SIMD_NO_CONTRACT))
+#define FLUID_SIMD_WIDTH 4
+#define VF __m128
+#define VM __m128
+#define VSET(a) _mm_set1_ps(a)
+#define VLOAD(p) _mm_loadu_ps(p)
+#define VSTORE(p, a) _mm_storeu_ps(p, a)
+#define VADD(a, b) _mm_add_ps(a, b)
+#define VSUB(a, b) _mm_sub_ps(a, b)
+#define VMUL(a, b) _mm_mul_ps(a, b)
+#define VDIV(a, b) _mm_div_ps(a, b)
+#define VSQRT(a) _mm_sqrt_ps(a)
+#define VABS(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define VMAX(a, b) _mm_max_ps(a, b)
+#define VLT(a, b) _mm_cmplt_ps(a, b)
+#define VGT(a, b) _mm_cmpgt_ps(a, b)
+#define VOR(a, b) _mm_or_ps(a, b)
+#define VSELECT(m, a, b) _mm_blendv_ps(a, b, m)
+#define VONES(m) _mm_and_ps(m, _mm_set1_ps(1.0f))
+#define VSOLID(p, bits) _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p))), _mm_set1_epi32(bits)), _mm_setzero_si128()))
+#include "fluid_simd_kernel.h"
+
+// AVX2, 8 cells per instruction
+#define FLUID_SIMD_NAME stepFluidRowAVX2
+#define FLUID_SIMD_TARGET __attribute__((target("avx2"), FLUID_SIMD_NO_CONTRACT))
+#define FLUID_SIMD_WIDTH 8
+#define VF __m256
+#define VM __m256
+#define VSET(a) _mm256_set1_ps(a)
+#define VLOAD(p) _mm256_loadu_ps(p)
+#define VSTORE(p, a) _mm256_storeu_ps(p, a)
+#define VADD(a, b) _mm256_add_ps(a, b)
+#define VSUB(a, b) _mm256_sub_ps(a, b)
+#define VMUL(a, b) _mm256_mul_ps(a, b)
+#define VDIV(a, b) _mm256_div_ps(a, b)
+#define VSQRT(a) _mm256_sqrt_ps(a)
+#define VABS(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define VMAX(a, b) _mm256_max_ps(a, b)
+#define VLT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define VGT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define VOR(a, b) _mm256_or_ps(a, b)
+#define VSELECT(m, a, b) _mm256_blendv_ps(a, b, m)
+#define VONES(m) _mm256_and_ps(m, _mm256_set1_ps(1.0f))
+#define VSOLID(p, bits) _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p))), _mm256_set1_epi32(bits)), _mm256_setzero_si256()))
+#include "fluid_simd_kernel.h"
+
+// AVX-512, 16 cells per instruction
+#define FLUID_SIMD_NAME stepFluidRowAVX512
+#define FLUID_SIMD_TARGET __attribute__((target("avx512f"), FLUID_SIMD_NO_CONTRACT))
+#define FLUID_SIMD_WIDTH 16
+#define VF __m512
+#define VM __mmask16
+#define VSET(a) _mm512_set1_ps(a)
+#define VLOAD(p) _mm512_loadu_ps(p)
+#define VSTORE(p, a) _mm512_storeu_ps(p, a)
+#define VADD(a, b) _mm512_add_ps(a, b)
+#define VSUB(a, b) _mm512_sub_ps(a, b)
+#define VMUL(a, b) _mm512_mul_ps(a, b)
+#define VDIV(a, b) _mm512_div_ps(a, b)
+#define VSQRT(a) _mm512_sqrt_ps(a)
+#define VABS(a) _mm512_abs_ps(a)
+#define VMAX(a, b) _mm512_max_ps(a, b)
+#define VLT(a, b) _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)
+#define VGT(a, b) _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ)
+#define VOR(a, b) ((__mmask16)((a) | (b)))
+#define VSELECT(m, a, b) _mm512_mask_blend_ps(m, a, b)
+#define VONES(m) _mm512_maskz_mov_ps(m, _mm512_set1_ps(1.0f))
+#define VSOLID(p, bits) _mm512_test_epi32_mask(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(p))), _mm512_set1_epi32(bits))
+#include "fluid_simd_kernel.h"
+
+#endif
+
+//----------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------
+
+static FluidRowKernel fluid_row_kernel = NULL;
+static FluidCPUISA fluid_cpu_isa = FLUID_ISA_SCALAR;
+
+const char* fluidCPUISAName(FluidCPUISA isa) {
+    switch (isa) {
+        case (FLUID_ISA_SSE4): return "sse4.1";
+        case (FLUID_ISA_AVX2): return "avx2";
+        case (FLUID_ISA_AVX512): return "avx512";
+        default: return "scalar";
+    }
+}
+
+// Best instruction set this machine can run
+FluidCPUISA detectFluidCPUISA(void) {
+#if FLUID_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return FLUID_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return FLUID_ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return FLUID_ISA_SSE4;
+#endif
+    return FLUID_ISA_SCALAR;
+}
+
+// Picks the kernel, anything the machine can't run falls back to the best it can
+FluidCPUISA setFluidCPUISA(FluidCPUISA isa) {
+    FluidCPUISA best = detectFluidCPUISA();
+    if (isa > best) isa = best;
+
+    switch (isa) {
+#if FLUID_SIMD_X86
+        case (FLUID_ISA_SSE4): fluid_row_kernel = stepFluidRowSSE4; break;
+        case (FLUID_ISA_AVX2): fluid_row_kernel = stepFluidRowAVX2; break;
+        case (FLUID_ISA_AVX512): fluid_row_kernel = stepFluidRowAVX512; break;
+#endif
+        default: isa = FLUID_ISA_SCALAR; fluid_row_kernel = stepFluidRowScalar; break;
+    }
+    fluid_cpu_isa = isa;
+
+    return isa;
+}
+
+FluidRowKernel getFluidRowKernel(void) {
+    if (fluid_row_kernel == NULL) setFluidCPUISA(FLUID_ISA_COUNT);
+    return fluid_row_kernel;
+}
+
+#endif
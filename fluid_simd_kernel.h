@@ -0,0 +1,124 @@
+// Vector body of stepFluidCPUCell. Included by fluid_simd.h once per instruction
+// set with the V* macros defined, no include guard on purpose. Operations are
+// in the same order as the scalar version so both give the same bits.
+
+static FLUID_SIMD_TARGET void FLUID_SIMD_NAME(const FluidCPURow* row, int x0, int x1) {
+    const VF dt = VSET(row->params->dt);
+    const VF k_dt = VSET(row->params->k/row->params->dt);
+    const VF v = VSET(row->params->viscosity);
+    const float inv_h_scalar = 1.0f/row->params->cell_size;
+    const VF inv_h = VSET(inv_h_scalar);
+    const VF inv_h2 = VSET(inv_h_scalar*inv_h_scalar);
+    const VF zero = VSET(0.0f);
+    const VF one = VSET(1.0f);
+    const VF half = VSET(0.5f);
+
+    int x = x0;
+    for (; x + FLUID_SIMD_WIDTH <= x1; x += FLUID_SIMD_WIDTH) {
+        VF data_x = VLOAD(row->c[0] + x);
+        VF data_y = VLOAD(row->c[1] + x);
+        VF data_z = VLOAD(row->c[2] + x);
+        VF emit = VLOAD(row->emit + x);
+
+        VF r_x = VLOAD(row->c[0] + x + 1);
+        VF l_x = VLOAD(row->c[0] + x - 1);
+        VF r_y = VLOAD(row->c[1] + x + 1);
+        VF l_y = VLOAD(row->c[1] + x - 1);
+        VF u_x = VLOAD(row->u[0] + x);
+        VF d_x = VLOAD(row->d[0] + x);
+        VF u_y = VLOAD(row->u[1] + x);
+        VF d_y = VLOAD(row->d[1] + x);
+
+        // 5-point stencil
+        VF dx_x = VMUL(VMUL(VSUB(r_x, l_x), half), inv_h);
+        VF dx_z = VMUL(VMUL(VSUB(VLOAD(row->c[2] + x + 1), VLOAD(row->c[2] + x - 1)), half), inv_h);
+        VF dy_y = VMUL(VMUL(VSUB(u_y, d_y), half), inv_h);
+        VF dy_z = VMUL(VMUL(VSUB(VLOAD(row->u[2] + x), VLOAD(row->d[2] + x)), half), inv_h);
+
+        // Density
+        VF div = VADD(VADD(VMUL(dx_z, data_x), VMUL(dy_z, data_y)), VMUL(VADD(dx_x, dy_y), data_z));
+        data_z = VSUB(data_z, VMUL(dt, div));
+
+        // Laplacian
+        VF lap_x = VMUL(VSUB(VADD(VADD(VADD(u_x, d_x), r_x), l_x), VMUL(VSET(4.0f), data_x)), inv_h2);
+        VF lap_y = VMUL(VSUB(VADD(VADD(VADD(u_y, d_y), r_y), l_y), VMUL(VSET(4.0f), data_y)), inv_h2);
+        VF visc_x = VMUL(v, lap_x);
+        VF visc_y = VMUL(v, lap_y);
+
+        // Advection, emitters zero the density
+        data_x = VLOAD(row->adv_x + x);
+        data_y = VLOAD(row->adv_y + x);
+        data_z = VSELECT(VGT(emit, zero), data_z, zero);
+
+        // Velocity
+        VF ext_x = VMUL(VSET(8.0f), VLOAD(row->ext_x + x));
+        VF ext_y = VMUL(VSET(8.0f), VLOAD(row->ext_y + x));
+        data_x = VADD(data_x, VMUL(dt, VADD(VSUB(visc_x, VMUL(k_dt, dx_z)), ext_x)));
+        data_y = VADD(data_y, VMUL(dt, VADD(VSUB(visc_y, VMUL(k_dt, dy_z)), ext_y)));
+
+        // Linear decay, max(0, |v| - 0.0008)*sign(v)
+        VF sign_x = VSUB(VONES(VGT(data_x, zero)), VONES(VLT(data_x, zero)));
+        VF sign_y = VSUB(VONES(VGT(data_y, zero)), VONES(VLT(data_y, zero)));
+        data_x = VMUL(VMAX(VSUB(VABS(data_x), VSET(0.0008f)), zero), sign_x);
+        data_y = VMUL(VMAX(VSUB(VABS(data_y), VSET(0.0008f)), zero), sign_y);
+
+        // Curl and vorticity
+        VF curl = VMUL(VADD(VSUB(VSUB(r_y, l_y), u_x), d_x), inv_h);
+        VF vort_x = VSUB(VABS(VLOAD(row->u[3] + x)), VABS(VLOAD(row->d[3] + x)));
+        VF vort_y = VSUB(VABS(VLOAD(row->c[3] + x - 1)), VABS(VLOAD(row->c[3] + x + 1)));
+        VF vort_len_x = VADD(vort_x, VSET(1e-9f));
+        VF vort_len_y = VADD(vort_y, VSET(1e-9f));
+        VF vort_len = VSQRT(VADD(VMUL(vort_len_x, vort_len_x), VMUL(vort_len_y, vort_len_y)));
+        VF vort_scale = VMUL(VDIV(VSET(-0.2f), vort_len), curl);
+        data_x = VADD(data_x, VMUL(vort_x, vort_scale));
+        data_y = VADD(data_y, VMUL(vort_y, vort_scale));
+
+        // Clamps
+        data_x = VSELECT(VGT(data_x, VSET(100000)), data_x, VSET(100000));
+        data_x = VSELECT(VLT(data_x, VSET(-100000)), data_x, VSET(-100000));
+        data_y = VSELECT(VGT(data_y, VSET(100000)), data_y, VSET(100000));
+        data_y = VSELECT(VLT(data_y, VSET(-100000)), data_y, VSET(-100000));
+        data_z = VSELECT(VGT(data_z, VSET(15.0f)), data_z, VSET(15.0f));
+        data_z = VSELECT(VLT(data_z, VSET(0.5f)), data_z, VSET(0.5f));
+
+        // Boundaries, all from one byte a cell
+        VM block_x = VSOLID(row->solid + x, FLUID_SOLID_LEFT | FLUID_SOLID_RIGHT);
+        VM block_y = VSOLID(row->solid + x, FLUID_SOLID_DOWN | FLUID_SOLID_UP);
+        data_x = VSELECT(block_x, data_x, zero);
+        data_y = VSELECT(block_y, data_y, zero);
+
+        // Solids keep what they had, the scalar path skips them
+        VF keep = VSELECT(VSOLID(row->solid + x, FLUID_SOLID_CLEAR), one, zero);
+        VM self = VSOLID(row->solid + x, FLUID_SOLID_SELF);
+        VSTORE(row->out[0] + x, VSELECT(self, VMUL(data_x, keep), VLOAD(row->c[0] + x)));
+        VSTORE(row->out[1] + x, VSELECT(self, VMUL(data_y, keep), VLOAD(row->c[1] + x)));
+        VSTORE(row->out[2] + x, VSELECT(self, VMUL(data_z, keep), VLOAD(row->c[2] + x)));
+        VSTORE(row->out[3] + x, VSELECT(self, VSUB(one, emit), VLOAD(row->c[3] + x)));
+    }
+
+    for (; x < x1; x++) {
+        stepFluidCPUCell(row, x, x - 1, x + 1);
+    }
+}
+
+#undef FLUID_SIMD_NAME
+#undef FLUID_SIMD_TARGET
+#undef FLUID_SIMD_WIDTH
+#undef VF
+#undef VM
+#undef VSET
+#undef VLOAD
+#undef VSTORE
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VABS
+#undef VMAX
+#undef VLT
+#undef VGT
+#undef VOR
+#undef VSELECT
+#undef VONES
+#undef VSOLID
@@ -0,0 +1,41 @@
+#version 330
+
+// Input vertex attributes (from vertex shader)
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+// Uniforms
+uniform sampler2D uBoundaries;
+
+// Output fragment color
+out vec4 finalColor;
+
+// Same as FLUID_SOLID_*
+#define SOLID_SELF 1
+#define SOLID_LEFT 2
+#define SOLID_RIGHT 4
+#define SOLID_DOWN 8
+#define SOLID_UP 16
+#define SOLID_CLEAR 32
+
+// Packs what the solver needs from the boundaries into one byte a texel, see
+// updateFluidSolid. Red is solid, for the cell and the four next to it, and mostly
+// green clears the cell. Neighbours wrap like the field.
+bool solidAt(ivec2 p, ivec2 size) {
+    return texelFetch(uBoundaries, (p + size) % size, 0).r > 0.0;
+}
+
+void main() {
+    ivec2 size = textureSize(uBoundaries, 0);
+    ivec2 c = ivec2(gl_FragCoord.xy);
+
+    int flags = 0;
+    if (solidAt(c, size)) flags |= SOLID_SELF;
+    if (solidAt(c + ivec2(-1, 0), size)) flags |= SOLID_LEFT;
+    if (solidAt(c + ivec2(1, 0), size)) flags |= SOLID_RIGHT;
+    if (solidAt(c + ivec2(0, -1), size)) flags |= SOLID_DOWN;
+    if (solidAt(c + ivec2(0, 1), size)) flags |= SOLID_UP;
+    if (texelFetch(uBoundaries, c, 0).g >= 0.5) flags |= SOLID_CLEAR;
+
+    finalColor = vec4(float(flags)/255.0, 0.0, 0.0, 1.0);
+}
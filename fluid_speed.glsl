@@ -0,0 +1,32 @@
+#version 330
+
+// Input vertex attributes (from vertex shader)
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+// Uniforms
+uniform sampler2D uInput;   // The field, then the pass before
+
+// Output fragment color
+out vec4 finalColor;
+
+// One pass of the max speed reduction, see reduceFluidSpeed. Each pixel is the
+// fastest |x| or |y| of a 4x4 block of the input, and the passes go down a chain
+// of targets a quarter the size each way until there's one pixel. Later passes
+// only have x set, so reading them the same way works.
+void main() {
+    ivec2 size = textureSize(uInput, 0);
+    ivec2 base = ivec2(gl_FragCoord.xy)*4;
+
+    float speed = 0.0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            ivec2 p = base + ivec2(x, y);
+            if (any(greaterThanEqual(p, size))) continue;
+            vec2 v = abs(texelFetch(uInput, p, 0).xy);
+            speed = max(speed, max(v.x, v.y));
+        }
+    }
+
+    finalColor = vec4(speed, 0.0, 0.0, 1.0);
+}
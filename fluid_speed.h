@@ -0,0 +1,126 @@
+#ifndef NVST_FLUID_SPEED
+#define NVST_FLUID_SPEED
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "fluid_half.h"
+
+// Fastest the fluid is moving along either axis, and how many substeps a frame
+// needs because of it. A substep carries the flow dt*speed/cell_size texels, and
+// the CFL number is how far that's allowed to go. Eight floats at a time with AVX2,
+// getFluidCPUMaxSpeed runs these over the CPU field on its thread pool. Half storage
+// is never converted: with the sign bit cleared a bigger half is also a bigger 16 bit
+// integer, so the halves are compared as they are. fluid.h does the same on GL with
+// fluid_speed.glsl.
+
+//----------------------------------------------------------------------------------
+// Scalar
+//----------------------------------------------------------------------------------
+
+// NaN never wins, same as _mm256_max_ps with the running max second
+static float maxFluidSpeedPlanesScalar(const float* x, const float* y, size_t start, size_t end, float speed) {
+    for (size_t i = start; i < end; i++) {
+        float ax = fabsf(x[i]);
+        float ay = fabsf(y[i]);
+        speed = (ax > speed) ? ax : speed;
+        speed = (ay > speed) ? ay : speed;
+    }
+    return speed;
+}
+
+// Returns the half's bits, only x and y of each RGBA16F cell count
+static unsigned short maxFluidSpeedHalvesScalar(const unsigned short* half, size_t start, size_t end, unsigned short speed) {
+    for (size_t i = start; i < end; i++) {
+        unsigned short ax = half[i*4] & 0x7FFF;
+        unsigned short ay = half[i*4 + 1] & 0x7FFF;
+        speed = (ax > speed) ? ax : speed;
+        speed = (ay > speed) ? ay : speed;
+    }
+    return speed;
+}
+
+//----------------------------------------------------------------------------------
+// AVX2
+//----------------------------------------------------------------------------------
+#if FLUID_SIMD_X86
+
+static __attribute__((target("avx2"))) float maxFluidSpeedPlanesAVX2(const float* x, const float* y, size_t start, size_t end) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 speed = _mm256_setzero_ps();
+    size_t i = start;
+    for (; i + 8 <= end; i += 8) {
+        speed = _mm256_max_ps(_mm256_andnot_ps(sign, _mm256_loadu_ps(x + i)), speed);
+        speed = _mm256_max_ps(_mm256_andnot_ps(sign, _mm256_loadu_ps(y + i)), speed);
+    }
+
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(speed), _mm256_extractf128_ps(speed, 1));
+    half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+    return maxFluidSpeedPlanesScalar(x, y, i, end, _mm_cvtss_f32(half));
+}
+
+// Four cells a vector, z and w masked off
+static __attribute__((target("avx2"))) unsigned short maxFluidSpeedHalvesAVX2(const unsigned short* half, size_t start, size_t end) {
+    const __m256i mask = _mm256_set1_epi64x(0x7FFF7FFFLL);
+    __m256i speed = _mm256_setzero_si256();
+    size_t i = start;
+    for (; i + 4 <= end; i += 4) {
+        __m256i cells = _mm256_loadu_si256((const __m256i*)(half + i*4));
+        speed = _mm256_max_epu16(speed, _mm256_and_si256(cells, mask));
+    }
+
+    __m128i lanes = _mm_max_epu16(_mm256_castsi256_si128(speed), _mm256_extracti128_si256(speed, 1));
+    lanes = _mm_max_epu16(lanes, _mm_srli_si128(lanes, 8));
+    lanes = _mm_max_epu16(lanes, _mm_srli_si128(lanes, 4));
+    lanes = _mm_max_epu16(lanes, _mm_srli_si128(lanes, 2));
+    return maxFluidSpeedHalvesScalar(half, i, end, (unsigned short)_mm_extract_epi16(lanes, 0));
+}
+
+#endif
+
+//----------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------
+
+// Follows setFluidCPUISA like the samplers do
+static int useFluidSpeedAVX2(void) {
+#if FLUID_SIMD_X86
+    getFluidRowKernel();
+    return fluid_cpu_isa >= FLUID_ISA_AVX2;
+#else
+    return 0;
+#endif
+}
+
+// Largest |x| or |y| of count cells
+float maxFluidSpeedPlanes(const float* x, const float* y, size_t count) {
+#if FLUID_SIMD_X86
+    if (useFluidSpeedAVX2()) return maxFluidSpeedPlanesAVX2(x, y, 0, count);
+#endif
+    return maxFluidSpeedPlanesScalar(x, y, 0, count, 0);
+}
+
+// Same for count RGBA16F cells, as a float. NaN comes out as NaN.
+float maxFluidSpeedHalves(const unsigned short* half, size_t count) {
+#if FLUID_SIMD_X86
+    if (useFluidSpeedAVX2()) return convertFloat16ToNativeFloat(maxFluidSpeedHalvesAVX2(half, 0, count));
+#endif
+    return convertFloat16ToNativeFloat(maxFluidSpeedHalvesScalar(half, 0, count, 0));
+}
+
+//----------------------------------------------------------------------------------
+// Substeps
+//----------------------------------------------------------------------------------
+
+// Fewest substeps that share frame_dt without any of them moving speed more than
+// cfl texels, kept between min_substeps and max_substeps
+int getFluidCFLSubsteps(float speed, float frame_dt, float cell_size, float cfl, int min_substeps, int max_substeps) {
+    float texels = speed*frame_dt/cell_size;
+    if (!(texels < cfl*max_substeps)) return max_substeps;
+
+    int substeps = (int)ceilf(texels/cfl);
+    return (substeps < min_substeps) ? min_substeps : substeps;
+}
+
+#endif
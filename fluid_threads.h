@@ -0,0 +1,178 @@
+#ifndef NVST_FLUID_THREADS
+#define NVST_FLUID_THREADS
+
+#include <stdlib.h>
+
+// Persistent worker pool for the CPU fluid. Threads are made once with the fluid
+// and sleep between jobs, a job wakes them, every worker (the calling thread is
+// worker 0) runs its share, then the caller waits until the rest have finished.
+// Only needs a mutex and condition variables, which is all macOS has. Without
+// pthreads (MSVC) the pool is just the calling thread.
+#ifndef FLUID_THREADS
+    #if defined(__unix__) || defined(__APPLE__) || defined(__MINGW32__)
+        #define FLUID_THREADS (1)
+    #else
+        #define FLUID_THREADS (0)
+    #endif
+#endif
+
+#if FLUID_THREADS
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+// worker goes from 0 to workers - 1
+typedef void (*FluidThreadJob)(void* arg, int worker, int workers);
+
+typedef struct NV_FluidThreadPool FluidThreadPool;
+
+typedef struct NV_FluidThreadWorker {
+    FluidThreadPool* pool;
+    int index;
+} FluidThreadWorker;
+
+struct NV_FluidThreadPool {
+    int count;                  // Workers, including the thread that runs jobs
+#if FLUID_THREADS
+    pthread_t* threads;
+    FluidThreadWorker* workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    int running;                // Workers still on the current job, the caller waits for 0
+
+    FluidThreadJob job;
+    void* arg;
+    unsigned long generation;   // Bumped for every job so workers know there's new work
+    int quit;
+#endif
+};
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+int getFluidCPUCoreCount(void) {
+#if FLUID_THREADS
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (int)cores : 1;
+#else
+    return 1;
+#endif
+}
+
+#if FLUID_THREADS
+
+static void* runFluidThreadWorker(void* data) {
+    FluidThreadWorker* worker = (FluidThreadWorker*)data;
+    FluidThreadPool* pool = worker->pool;
+    unsigned long seen = 0;
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        FluidThreadJob job = pool->job;
+        void* arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        job(arg, worker->index, pool->count);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+#endif
+
+// count <= 0 uses every core
+FluidThreadPool* createFluidThreadPool(int count) {
+    if (count <= 0 || !FLUID_THREADS) count = getFluidCPUCoreCount();
+
+    FluidThreadPool* pool = calloc(1, sizeof(FluidThreadPool));
+    pool->count = count;
+
+#if FLUID_THREADS
+    pool->threads = calloc(count, sizeof(pthread_t));
+    pool->workers = calloc(count, sizeof(FluidThreadWorker));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // Worker 0 is whoever calls runFluidThreadPool
+    for (int i = 1; i < count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pthread_create(&pool->threads[i], NULL, runFluidThreadWorker, &pool->workers[i]);
+    }
+#endif
+
+    return pool;
+}
+
+void unloadFluidThreadPool(FluidThreadPool* pool) {
+#if FLUID_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->workers);
+#endif
+    free(pool);
+}
+
+// Runs job on every worker and returns once they have all finished
+void runFluidThreadPool(FluidThreadPool* pool, FluidThreadJob job, void* arg) {
+    if (pool->count == 1) {
+        job(arg, 0, 1);
+        return;
+    }
+
+#if FLUID_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->arg = arg;
+    pool->running = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    job(arg, 0, pool->count);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+// Contiguous share of n items for a worker, so each thread keeps the same rows every step
+static inline void getFluidThreadRange(int n, int worker, int workers, int* start, int* end) {
+    *start = (int)((long long)n * worker / workers);
+    *end = (int)((long long)n * (worker + 1) / workers);
+}
+
+#endif
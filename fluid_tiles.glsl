@@ -0,0 +1,83 @@
+#version 430
+
+// Picks the tiles fluid_compute.glsl steps next when it runs sparse, one thread per
+// tile. A tile runs if it or a neighbour was still moving after the last dispatch,
+// or an emitter is near it. Calm ones sleep, but the back texture still has the
+// substep before, so a tile going to sleep is listed once more to be copied across.
+// The list and its group count feed straight into an indirect dispatch.
+//
+// A dispatch can carry a change REACH texels, which is less than a tile, so only
+// the neighbours matter. The last tile across or down can be narrower than that,
+// and then the tile past it counts as a neighbour too.
+
+#define TILE_SIZE 34                // Same as FLUID_COMPUTE_TILE
+#define REACH 15                    // MAX_SUBSTEPS*STEP_HALO in fluid_compute.glsl
+#define COPY_BIT 0x80000000u
+
+layout(local_size_x = 64) in;
+
+// Uniforms
+uniform ivec2 uTiles;               // Tiles across and down
+uniform ivec2 uResolution;
+
+#define MAX_EMITTERS 64             // Same as FLUID_MAX_EMITTERS
+uniform vec4 uEmitters[2*MAX_EMITTERS];
+uniform int uEmitterCount = 0;
+
+layout(std430, binding = 0) writeonly buffer TileList { uint uTileList[]; };
+layout(std430, binding = 1) readonly buffer TileActive { uint uTileActive[]; };
+layout(std430, binding = 2) buffer TileSynced { uint uTileSynced[]; };
+layout(std430, binding = 3) buffer TileDispatch { uint uGroups[3]; };
+
+// Box round each emitter's line against the tile and as far round it as a dispatch
+// reaches. That can go over an edge and come back on the other side.
+bool emitterNear(ivec2 tile) {
+    vec2 lo = vec2(tile*TILE_SIZE - REACH);
+    vec2 hi = vec2((tile + 1)*TILE_SIZE + REACH);
+
+    for (int i = 0; i < uEmitterCount; i++) {
+        vec4 line = uEmitters[2*i];
+        float radius = uEmitters[2*i + 1].x;
+        vec2 a = min(line.xy, line.zw) - radius;
+        vec2 b = max(line.xy, line.zw) + radius;
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                vec2 shift = vec2(x, y)*vec2(uResolution);
+                if (all(lessThanEqual(a + shift, hi)) && all(greaterThanEqual(b + shift, lo))) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Whether a change d tiles away along one axis can get here in a dispatch. The field
+// wraps, so the narrow last tile can be on either side.
+bool inReach(int tile, int d, int tiles, int resolution) {
+    if (abs(d) <= 1) return true;
+    int between = (tile + sign(d) + tiles) % tiles;
+    return resolution - between*TILE_SIZE < REACH;
+}
+
+void main() {
+    int index = int(gl_GlobalInvocationID.x);
+    if (index >= uTiles.x*uTiles.y) return;
+    ivec2 tile = ivec2(index % uTiles.x, index / uTiles.x);
+
+    bool run = emitterNear(tile);
+    for (int dy = -2; dy <= 2; dy++) {
+        if (!inReach(tile.y, dy, uTiles.y, uResolution.y)) continue;
+        for (int dx = -2; dx <= 2; dx++) {
+            if (!inReach(tile.x, dx, uTiles.x, uResolution.x)) continue;
+            ivec2 n = (tile + ivec2(dx, dy) + 2*uTiles) % uTiles;
+            if (uTileActive[n.y*uTiles.x + n.x] != 0u) run = true;
+        }
+    }
+
+    if (run) {
+        uTileSynced[index] = 0u;
+        uTileList[atomicAdd(uGroups[0], 1u)] = uint(index);
+    } else if (uTileSynced[index] == 0u) {
+        uTileSynced[index] = 1u;
+        uTileList[atomicAdd(uGroups[0], 1u)] = uint(index) | COPY_BIT;
+    }
+}
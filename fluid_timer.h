@@ -0,0 +1,108 @@
+#ifndef NVST_FLUID_TIMER
+#define NVST_FLUID_TIMER
+
+#include <time.h>
+
+#include "fluid_gl.h"
+
+// Times a stretch of fluid work. On the CPU that's just the wall clock, on GL
+// it's a GL_TIME_ELAPSED query so it measures the GPU and not how long it took
+// to queue the draws. Queries go round a ring like fluid_readback.h and are
+// only read once their result is in, so ms is a frame or two old on GL.
+
+#define FLUID_TIMER_RING (3)
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+typedef struct NV_FluidTimer {
+    int gpu;                                // 0 times the CPU, needs no GL context
+    unsigned int query[FLUID_TIMER_RING];
+    int pending[FLUID_TIMER_RING];          // 1 while a query is in flight, -1 while it's still open
+    int head;                               // Next query to use, also the oldest in flight
+    struct timespec start;
+    float ms;                               // Latest result, 0 until the first lands
+    long long landed;                       // Results that have come back
+} FluidTimer;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+FluidTimer createFluidTimer(int gpu) {
+    FluidTimer timer = { 0 };
+    timer.gpu = gpu;
+
+    if (gpu) {
+        loadFluidGL();
+        fluid_gl.GenQueries(FLUID_TIMER_RING, timer.query);
+    }
+
+    return timer;
+}
+
+void unloadFluidTimer(FluidTimer* timer) {
+    if (timer->gpu) fluid_gl.DeleteQueries(FLUID_TIMER_RING, timer->query);
+}
+
+// Picks up every finished query, never waits
+static void pollFluidTimer(FluidTimer* timer) {
+    for (int i = 0; i < FLUID_TIMER_RING; i++) {
+        int slot = (timer->head + i) % FLUID_TIMER_RING;
+        if (timer->pending[slot] != 1) continue;
+
+        int available = 0;
+        fluid_gl.GetQueryObjectiv(timer->query[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        uint64_t ns = 0;
+        fluid_gl.GetQueryObjectui64v(timer->query[slot], GL_QUERY_RESULT, &ns);
+        timer->pending[slot] = 0;
+        timer->ms = ns*1e-6;
+        timer->landed++;
+    }
+}
+
+// Monotonic where there's clock_gettime, C11's clock otherwise (MSVC)
+static void readFluidTimerClock(struct timespec* now) {
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, now);
+#else
+    timespec_get(now, TIME_UTC);
+#endif
+}
+
+// Returns 0 if every query was still busy, that stretch just doesn't get timed
+int beginFluidTimer(FluidTimer* timer) {
+    if (!timer->gpu) {
+        readFluidTimerClock(&timer->start);
+        return 1;
+    }
+
+    pollFluidTimer(timer);
+    if (timer->pending[timer->head]) return 0;
+
+    fluid_gl.BeginQuery(GL_TIME_ELAPSED, timer->query[timer->head]);
+    timer->pending[timer->head] = -1;
+    return 1;
+}
+
+void endFluidTimer(FluidTimer* timer) {
+    if (!timer->gpu) {
+        struct timespec end;
+        readFluidTimerClock(&end);
+        timer->ms = (end.tv_sec - timer->start.tv_sec)*1e3 + (end.tv_nsec - timer->start.tv_nsec)*1e-6;
+        timer->landed++;
+        return;
+    }
+
+    // Only a query this timer started, -1 until it's ended
+    if (timer->pending[timer->head] != -1) return;
+
+    fluid_gl.EndQuery(GL_TIME_ELAPSED);
+    timer->pending[timer->head] = 1;
+    timer->head = (timer->head + 1) % FLUID_TIMER_RING;
+}
+
+#endif
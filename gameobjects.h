@@ -1,12 +1,17 @@
 #ifndef NVST_GAMEOBJECTS
 #define NVST_GAMEOBJECTS
 
+#include <stdlib.h>
+
 #include "raylib.h"
 
 #define PHYSAC_IMPLEMENTATION
 #include "physac.h"
+#include "physac_broadphase.h"
 
 #include "fluid.h"
+#include "scene_arena.h"
+#include "spatial_hash.h"
 
 #define PLAYER_WIDTH (25)
 #define PLAYER_HEIGHT (75)
@@ -26,6 +31,17 @@ typedef struct NV_InputCollection {
     int slam_key;
 } InputCollection;
 
+// One frame of controls for a player, read from a gamepad or made up by a script
+typedef struct NV_PlayerInput {
+    int connected;
+    Vector2 left_stick;
+    Vector2 right_stick;
+    float left_trigger;
+    float right_trigger;
+    int dash_pressed;
+    int block_down;
+} PlayerInput;
+
 // Player
 typedef struct NV_Player {
     int player_id;
@@ -36,6 +52,7 @@ typedef struct NV_Player {
     InputCollection controls; // Obselete
 
     int p_colliding;
+    int fluid_probe;    // Samples the fluid around the player, see addFluidProbe
 
     // Flame thrower
     float flamethower_force;
@@ -52,46 +69,38 @@ typedef struct NV_Player {
     int dash_timer;
 } Player;
 
-// Box object
-typedef struct NV_BoxObj {
-    float width;
-    float height;
-    PhysicsBody physics;
-} BoxObj;
-
-// Circle Objct
-typedef struct NV_CircleObj {
-    float radius;
-    PhysicsBody physics;
-} CircleObj;
-
-// Polygon
-typedef struct NV_PolygonObj {
-    int sides;
-    float radius;
-    PhysicsBody physics;
-} PolygonObj;
-
-
-typedef struct NV_EnvironmentObj {
-    // Enum to keep track of what type the object is
-    enum NV_ObjType {
-        BOX,
-        CIRCLE,
-        POLYGON
-    } obj_type;
-
-    // The object itself
-    union NV_ObjUnion {
-        BoxObj box;
-        CircleObj circle;
-        PolygonObj polygon;
-    } obj;
-
-    // Other data
-    Color color;
-
-} EnvironmentObj;
+typedef enum NV_EnvironmentKind {
+    ENVIRONMENT_BOX,
+    ENVIRONMENT_CIRCLE,
+    ENVIRONMENT_POLYGON,
+    ENVIRONMENT_KINDS
+} EnvironmentKind;
+
+// Every object of one kind, a column per field so the loops over them each frame
+// only stream through what they read. Boxes have size, circles radius, polygons
+// radius and sides, the columns a kind doesn't use stay NULL. Physac owns the
+// bodies, their pose gets copied out once a frame by syncEnvironmentTable.
+typedef struct NV_EnvironmentTable {
+    EnvironmentKind kind;
+    int count;
+    int capacity;
+
+    PhysicsBody* physics;
+    Vector2* position;
+    float* orient;
+    Vector2* size;
+    float* radius;
+    int* sides;
+    Color* color;
+
+    // Pose each was last drawn into the fluid with and the texels that covered, see
+    // markEnvironmentTableFluid
+    Vector2* fluid_position;
+    float* fluid_orient;
+    Rectangle* fluid_rect;
+
+    int* found;     // Indices the last find* scan picked out
+} EnvironmentTable;
 
 //----------------------------------------------------------------------------------
 // Functions (I'm too lazy to make a c file)
@@ -159,8 +168,50 @@ float joystickDeadzone(float x) {
     return 0;
 }
 
+// Current state of the player's gamepad
+PlayerInput readGamepadInput(int player_id) {
+    PlayerInput input = { 0 };
+
+    if (!IsGamepadAvailable(player_id)) return input;
+
+    input.connected = 1;
+    input.left_stick.x = GetGamepadAxisMovement(player_id, GAMEPAD_AXIS_LEFT_X);
+    input.left_stick.y = GetGamepadAxisMovement(player_id, GAMEPAD_AXIS_LEFT_Y);
+    input.right_stick.x = GetGamepadAxisMovement(player_id, GAMEPAD_AXIS_RIGHT_X);
+    input.right_stick.y = GetGamepadAxisMovement(player_id, GAMEPAD_AXIS_RIGHT_Y);
+    input.left_trigger = GetGamepadAxisMovement(player_id, GAMEPAD_AXIS_LEFT_TRIGGER);
+    input.right_trigger = GetGamepadAxisMovement(player_id, GAMEPAD_AXIS_RIGHT_TRIGGER);
+    input.dash_pressed = IsGamepadButtonPressed(player_id, GAMEPAD_BUTTON_RIGHT_TRIGGER_1);
+    input.block_down = IsGamepadButtonDown(player_id, GAMEPAD_BUTTON_LEFT_TRIGGER_1);
+
+    return input;
+}
+
+// Fake player for headless runs. Walks back and forth, hops, sweeps its aim around,
+// and every 8 seconds goes through flamethrower, death beam, block and dash.
+// Only depends on the frame so every run plays out the same.
+PlayerInput scriptedPlayerInput(int player_id, long long t) {
+    PlayerInput input = { 0 };
+    input.connected = 1;
+
+    long long phase = (t + 120*player_id) % 480;
+    float aim = t*0.03f + player_id*PI;
+
+    input.left_stick.x = sinf(t*0.02f + player_id*PI);
+    input.left_stick.y = ((t + 37*player_id) % 90 == 0) ? -1 : 0;
+    input.right_stick.x = cosf(aim);
+    input.right_stick.y = sinf(aim);
+
+    input.right_trigger = (phase < 180) ? 1 : 0;
+    input.left_trigger = (phase >= 200 && phase < 290) ? 1 : 0;
+    input.block_down = (phase >= 300 && phase < 360);
+    input.dash_pressed = (phase == 400);
+
+    return input;
+}
+
 // TODO: Make more dashy and fun
-void updatePlayerMovement(Player* player) {
+void updatePlayerMovement(Player* player, PlayerInput input) {
     /*
     // Old system
     if (IsKeyDown(player->controls.left_key)) {
@@ -192,12 +243,12 @@ void updatePlayerMovement(Player* player) {
     */
     player->dash_timer = max(player->dash_timer - 1, 0);
 
-    if (!IsGamepadAvailable(player->player_id)) return;
+    if (!input.connected) return;
 
     // Basic movement
     float charge_inhibit = max(0.0, 1.0 / (0.008*player->death_charge + 1.0));
-    float x_left = joystickDeadzone(GetGamepadAxisMovement(player->player_id, GAMEPAD_AXIS_LEFT_X));
-    float y_left = joystickDeadzone(GetGamepadAxisMovement(player->player_id, GAMEPAD_AXIS_LEFT_Y));
+    float x_left = joystickDeadzone(input.left_stick.x);
+    float y_left = joystickDeadzone(input.left_stick.y);
     player->physics->velocity.x = lerp(
         player->physics->velocity.x, 
         x_left*HORIZ_VELOCITY*charge_inhibit, 
@@ -208,8 +259,8 @@ void updatePlayerMovement(Player* player) {
     }
 
     // Direction setting
-    float x_right = GetGamepadAxisMovement(player->player_id, GAMEPAD_AXIS_RIGHT_X);
-    float y_right = GetGamepadAxisMovement(player->player_id, GAMEPAD_AXIS_RIGHT_Y);
+    float x_right = input.right_stick.x;
+    float y_right = input.right_stick.y;
     float norm = sqrt((x_right*x_right + y_right*y_right));
     
     if (norm > 0.8) {
@@ -218,7 +269,7 @@ void updatePlayerMovement(Player* player) {
     }
 
     // Dash
-    if (IsGamepadButtonPressed(player->player_id, GAMEPAD_BUTTON_RIGHT_TRIGGER_1) && player->dash_timer <= 0) {
+    if (input.dash_pressed && player->dash_timer <= 0) {
         
         PhysicsAddForce(
             player->physics,
@@ -230,10 +281,10 @@ void updatePlayerMovement(Player* player) {
     }
 
     // Flamethrower
-    player->flamethower_force = GetGamepadAxisMovement(player->player_id, GAMEPAD_AXIS_RIGHT_TRIGGER);
+    player->flamethower_force = input.right_trigger;
 
     // Deathbeam
-    float left_trigger = GetGamepadAxisMovement(player->player_id, GAMEPAD_AXIS_LEFT_TRIGGER);
+    float left_trigger = input.left_trigger;
     if (left_trigger > 0.1) {
         player->death_charge += left_trigger;
     }
@@ -244,70 +295,89 @@ void updatePlayerMovement(Player* player) {
     }
 
     // Block
-    if (IsGamepadButtonDown(player->player_id, GAMEPAD_BUTTON_LEFT_TRIGGER_1)) {
+    if (input.block_down) {
         player->block_enabled = 1;
     } else {
         player->block_enabled = 0;
     }
 }
 
-// Create a box
-EnvironmentObj createEnvironmentBox(
-    Vector2 position, 
-    int width, 
-    int height, 
+// Only the columns the kind uses
+EnvironmentTable createEnvironmentTable(SceneArena* arena, EnvironmentKind kind, int capacity) {
+    EnvironmentTable table = { 0 };
+    table.kind = kind;
+    table.capacity = capacity;
+
+    table.physics = pushSceneArena(arena, capacity*sizeof(PhysicsBody));
+    table.position = pushSceneArena(arena, capacity*sizeof(Vector2));
+    table.orient = pushSceneArena(arena, capacity*sizeof(float));
+    if (kind == ENVIRONMENT_BOX) table.size = pushSceneArena(arena, capacity*sizeof(Vector2));
+    if (kind != ENVIRONMENT_BOX) table.radius = pushSceneArena(arena, capacity*sizeof(float));
+    if (kind == ENVIRONMENT_POLYGON) table.sides = pushSceneArena(arena, capacity*sizeof(int));
+    table.color = pushSceneArena(arena, capacity*sizeof(Color));
+    table.fluid_position = pushSceneArena(arena, capacity*sizeof(Vector2));
+    table.fluid_orient = pushSceneArena(arena, capacity*sizeof(float));
+    table.fluid_rect = pushSceneArena(arena, capacity*sizeof(Rectangle));
+    table.found = pushSceneArena(arena, capacity*sizeof(int));
+
+    return table;
+}
+
+// Fills the columns every kind has, the caller checks there's room
+static int pushEnvironmentObj(EnvironmentTable* table, PhysicsBody body, Color color) {
+    int i = table->count++;
+    table->physics[i] = body;
+    table->position[i] = body->position;
+    table->orient[i] = body->orient;
+    table->color[i] = color;
+    return i;
+}
+
+// Add a box, returns its index or -1 if the table's full
+int addEnvironmentBox(
+    EnvironmentTable* table,
+    Vector2 position,
+    int width,
+    int height,
     float rotation,
     float density,
     bool enabled,
     Color color
 ) {
-    // Create object and set parameters
-    EnvironmentObj obj;
-    obj.obj_type = BOX;
-    obj.color = color;
-
-    // Create the box
-    BoxObj box = { 0 };
-    box.width = width;
-    box.height = height;
-    box.physics = CreatePhysicsBodyRectangle(position, width, height, density);
-    box.physics->orient = rotation;
-    box.physics->enabled = enabled;
-
-    // Set the box
-    obj.obj.box = box;
-
-    return obj;
+    if (table->count >= table->capacity) return -1;
+
+    PhysicsBody body = CreatePhysicsBodyRectangle(position, width, height, density);
+    body->orient = rotation;
+    body->enabled = enabled;
+
+    int i = pushEnvironmentObj(table, body, color);
+    table->size[i] = (Vector2){width, height};
+    return i;
 }
 
-// Create a circle
-EnvironmentObj createEnvironmentCircle(
-    Vector2 position, 
+// Add a circle
+int addEnvironmentCircle(
+    EnvironmentTable* table,
+    Vector2 position,
     float radius,
     float density,
     bool enabled,
     Color color
 ) {
-    // Create object and set parameters
-    EnvironmentObj obj;
-    obj.obj_type = CIRCLE;
-    obj.color = color;
-
-    // Create the box
-    CircleObj circle = { 0 };
-    circle.radius = radius;
-    circle.physics = CreatePhysicsBodyCircle(position, radius, density);
-    circle.physics->enabled = false;
+    if (table->count >= table->capacity) return -1;
 
-    // Set the box
-    obj.obj.circle = circle;
+    PhysicsBody body = CreatePhysicsBodyCircle(position, radius, density);
+    body->enabled = enabled;
 
-    return obj;
+    int i = pushEnvironmentObj(table, body, color);
+    table->radius[i] = radius;
+    return i;
 }
 
-// Create a polygon
-EnvironmentObj createEnvironmentPolygon(
-    Vector2 position, 
+// Add a polygon
+int addEnvironmentPolygon(
+    EnvironmentTable* table,
+    Vector2 position,
     int sides,
     float radius,
     float rotation,
@@ -315,40 +385,23 @@ EnvironmentObj createEnvironmentPolygon(
     bool enabled,
     Color color
 ) {
-    // Create object and set parameters
-    EnvironmentObj obj;
-    obj.obj_type = POLYGON;
-    obj.color = color;
-
-    // Create the box
-    PolygonObj polygon = { 0 };
-    polygon.radius = radius;
-    polygon.sides = sides;
-    polygon.physics = CreatePhysicsBodyPolygon(position, radius, sides, density);
-    polygon.physics->orient = rotation;
-    polygon.physics->enabled = enabled;
-
-    // Set the box
-    obj.obj.polygon = polygon;
-
-    return obj;
+    if (table->count >= table->capacity) return -1;
+
+    PhysicsBody body = CreatePhysicsBodyPolygon(position, radius, sides, density);
+    body->orient = rotation;
+    body->enabled = enabled;
+
+    int i = pushEnvironmentObj(table, body, color);
+    table->radius[i] = radius;
+    table->sides[i] = sides;
+    return i;
 }
 
-// Helper function to get the position
-Vector2 getObjPosition(EnvironmentObj* obj) {
-    switch(obj->obj_type) {
-        case(BOX): {
-            return obj->obj.box.physics->position;
-        } break;
-        case(CIRCLE): {
-            return obj->obj.circle.physics->position;
-        } break;
-        case(POLYGON): {
-            return obj->obj.polygon.physics->position;
-        } break;
-        default: {
-            return (Vector2){-999999, -99999};
-        }
+// Copies where physics has moved everything to, once a frame before anything reads it
+void syncEnvironmentTable(EnvironmentTable* table) {
+    for (int i = 0; i < table->count; i++) {
+        table->position[i] = table->physics[i]->position;
+        table->orient[i] = table->physics[i]->orient;
     }
 }
 
@@ -431,40 +484,44 @@ static void drawPlayer(Player* player, long long int t) {
 }
 
 // Environment drawing
-static void drawEnvironmentObj(EnvironmentObj* obj) {
-    Vector2 pos = getObjPosition(obj);
-
-    switch (obj->obj_type) {
+static void drawEnvironmentTable(EnvironmentTable* table) {
+    switch (table->kind) {
         default: return;
 
         // Box drawing
-        case (BOX): {
-            Rectangle rect = {pos.x, pos.y, obj->obj.box.width, obj->obj.box.height};
-            DrawRectanglePro(
-                rect,
-                (Vector2) {obj->obj.box.width / 2, obj->obj.box.height / 2},
-                obj->obj.box.physics->orient * 180/PI,
-                obj->color
-            );
+        case (ENVIRONMENT_BOX): {
+            for (int i = 0; i < table->count; i++) {
+                Vector2 size = table->size[i];
+                DrawRectanglePro(
+                    (Rectangle){table->position[i].x, table->position[i].y, size.x, size.y},
+                    (Vector2) {size.x / 2, size.y / 2},
+                    table->orient[i] * 180/PI,
+                    table->color[i]
+                );
+            }
         } break;
 
-        case (CIRCLE): {
-            DrawCircle(
-                pos.x,
-                pos.y,
-                obj->obj.circle.radius,
-                obj->color
-            );
+        case (ENVIRONMENT_CIRCLE): {
+            for (int i = 0; i < table->count; i++) {
+                DrawCircle(
+                    table->position[i].x,
+                    table->position[i].y,
+                    table->radius[i],
+                    table->color[i]
+                );
+            }
         } break;
 
-        case (POLYGON): {
-            DrawPoly(
-                pos,
-                obj->obj.polygon.sides,
-                obj->obj.polygon.radius,
-                obj->obj.polygon.physics->orient * 180/PI, 
-                obj->color
-            );
+        case (ENVIRONMENT_POLYGON): {
+            for (int i = 0; i < table->count; i++) {
+                DrawPoly(
+                    table->position[i],
+                    table->sides[i],
+                    table->radius[i],
+                    table->orient[i] * 180/PI,
+                    table->color[i]
+                );
+            }
         } break;
     }
 }
@@ -493,52 +550,133 @@ static Vector2 fluidAspect(FluidBody* fluid) {
     return aspects;
 }
 
-static void drawEnvironmentObjToFluid(EnvironmentObj* obj, FluidBody* fluid) {
-    Vector2 pos = getObjPosition(obj);
-    Vector2 aspects = fluidAspect(fluid);
+// Emitter sizes are in texels of a FLUID_REFERENCE_WIDTH grid, this turns them into
+// real ones so they cover the same part of the arena at any resolution
+static float fluidTexels(FluidBody* fluid, float reference_texels) {
+    return reference_texels * fluid->x_resolution / FLUID_REFERENCE_WIDTH;
+}
 
-    pos = environmentToFluidCoords(pos, fluid);
-    // TODO: This only works at full resolution, figure out why the scaling gets fucked at half or quarter
+// Draws the listed objects into the fluid, all of them if list is NULL
+static void drawEnvironmentTableToFluid(EnvironmentTable* table, FluidBody* fluid, const int* list, int count) {
+    Vector2 aspects = fluidAspect(fluid);
 
-    switch (obj->obj_type) {
+    switch (table->kind) {
         default: return;
-        
+
         // Box drawing
-        case (BOX): {
-            Rectangle rect = {
-                pos.x, 
-                pos.y, 
-                obj->obj.box.width / aspects.x, 
-                obj->obj.box.height / aspects.y
-            };
-            DrawRectanglePro(
-                rect,
-                (Vector2) 
-                {rect.width / 2, rect.height / 2},
-                obj->obj.box.physics->orient * 180/PI,
-                RED
-            );
+        case (ENVIRONMENT_BOX): {
+            for (int j = 0; j < count; j++) {
+                int i = list ? list[j] : j;
+                Vector2 pos = environmentToFluidCoords(table->position[i], fluid);
+                Rectangle rect = {
+                    pos.x,
+                    pos.y,
+                    table->size[i].x / aspects.x,
+                    table->size[i].y / aspects.y
+                };
+                drawFluidRectanglePro(
+                    fluid,
+                    rect,
+                    (Vector2) {rect.width / 2, rect.height / 2},
+                    table->orient[i] * 180/PI,
+                    RED
+                );
+            }
         } break;
 
-        case (CIRCLE): {
-            DrawCircle(
-                pos.x,
-                pos.y,
-                obj->obj.circle.radius / aspects.x,
-                RED
-            );
+        case (ENVIRONMENT_CIRCLE): {
+            for (int j = 0; j < count; j++) {
+                int i = list ? list[j] : j;
+                Vector2 pos = environmentToFluidCoords(table->position[i], fluid);
+                drawFluidCircle(fluid, pos.x, pos.y, table->radius[i] / aspects.x, RED);
+            }
         } break;
 
-        case (POLYGON): {
-            DrawPoly(
-                pos,
-                obj->obj.polygon.sides,
-                obj->obj.polygon.radius / aspects.x,
-                obj->obj.polygon.physics->orient * 180/PI, 
-                RED
-            );
+        case (ENVIRONMENT_POLYGON): {
+            for (int j = 0; j < count; j++) {
+                int i = list ? list[j] : j;
+                Vector2 pos = environmentToFluidCoords(table->position[i], fluid);
+                drawFluidPoly(
+                    fluid,
+                    pos,
+                    table->sides[i],
+                    table->radius[i] / aspects.x,
+                    table->orient[i] * 180/PI,
+                    RED
+                );
+            }
         } break;
     }
 }
 
+// Remembers the pose the listed objects are in the fluid with, after drawing them,
+// and the bounding box of what that covered in fluid draw space. A texel bigger all
+// round since the fills round outwards.
+static void markEnvironmentTableFluid(EnvironmentTable* table, FluidBody* fluid, const int* list, int count) {
+    Vector2 aspects = fluidAspect(fluid);
+
+    for (int j = 0; j < count; j++) {
+        int i = list ? list[j] : j;
+        Vector2 pos = environmentToFluidCoords(table->position[i], fluid);
+        Vector2 extent;
+        if (table->kind == ENVIRONMENT_BOX) {
+            float s = fabsf(sinf(table->orient[i]));
+            float c = fabsf(cosf(table->orient[i]));
+            float half_width = table->size[i].x / aspects.x / 2;
+            float half_height = table->size[i].y / aspects.y / 2;
+            extent = (Vector2){c*half_width + s*half_height, s*half_width + c*half_height};
+        } else {
+            float radius = table->radius[i] / aspects.x;
+            extent = (Vector2){radius, radius};
+        }
+
+        table->fluid_position[i] = table->position[i];
+        table->fluid_orient[i] = table->orient[i];
+        table->fluid_rect[i] = (Rectangle){pos.x - extent.x - 1, pos.y - extent.y - 1, 2*extent.x + 2, 2*extent.y + 2};
+    }
+}
+
+// Picks out what's moved since markEnvironmentTableFluid into found, returns how many
+static int findEnvironmentTableMoved(EnvironmentTable* table) {
+    int found = 0;
+    for (int i = 0; i < table->count; i++) {
+        table->found[found] = i;
+        found += (table->position[i].x != table->fluid_position[i].x)
+            | (table->position[i].y != table->fluid_position[i].y)
+            | (table->orient[i] != table->fluid_orient[i]);
+    }
+    return found;
+}
+
+// Puts what every object covered in the fluid into hash, one kind after another, for
+// findEnvironmentFluid
+static void hashEnvironmentFluid(EnvironmentTable* tables, SpatialHash* hash) {
+    int count = 0;
+    for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+        memcpy(hash->bounds + count, tables[k].fluid_rect, tables[k].count*sizeof(Rectangle));
+        count += tables[k].count;
+    }
+    buildSpatialHash(hash, count);
+}
+
+// Objects that covered any of region in the fluid into each table's found, with how
+// many in found_counts
+static void findEnvironmentFluid(EnvironmentTable* tables, SpatialHash* hash, Rectangle region, int* found_counts) {
+    int starts[ENVIRONMENT_KINDS];
+    int start = 0;
+    for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+        starts[k] = start;
+        start += tables[k].count;
+        found_counts[k] = 0;
+    }
+
+    int found = querySpatialHash(hash, region);
+    for (int f = 0; f < found; f++) {
+        int item = hash->found[f];
+        int k = 0;
+        for (int m = 1; m < ENVIRONMENT_KINDS; m++) k += item >= starts[m];
+        tables[k].found[found_counts[k]++] = item - starts[k];
+    }
+}
+
 #endif
\ No newline at end of file
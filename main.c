@@ -1,5 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+// 1 runs the simulation without a window as fast as it can, see runHeadless
+#ifndef HEADLESS_MODE
+#define HEADLESS_MODE (0)
+#endif
+#define HEADLESS_FRAMES (3600)      // Default frame count, the first argument overrides it
+#define HEADLESS_PHYSICS_STEPS (10) // Physac steps per 60 Hz frame at its default time step
+
+// Loose bodies scattered over the level on top of the platforms, see addSceneDebris
+#define SCENE_DEBRIS (0)
+
+// Steps Physac over the pairs a spatial hash of the bodies finds instead of every
+// pair, see physac_broadphase.h. Its thread would step every pair, so the game steps
+// it instead at the same rate. Only worth it once there's debris, the level alone is
+// a handful of bodies and stays on Physac's thread.
+#define PHYSICS_BROADPHASE (SCENE_DEBRIS >= 32)
+#define PHYSICS_HASH_CELL (64.0f)       // World units, a few bits of debris across
+#define PHYSICS_HASH_PAIRS (8)          // Candidate pairs per body there's room for
+#define PHYSICS_STEP_TIME (1.0f / (60*HEADLESS_PHYSICS_STEPS))
+#define PHYSICS_MAX_STEPS (4*HEADLESS_PHYSICS_STEPS)    // A frame, past that it falls behind
+
+// Headless steps physics itself so it doesn't run on a wall-clock thread
+#if HEADLESS_MODE || PHYSICS_BROADPHASE
+#define PHYSAC_NO_THREADS
+#endif
+
+// Physac keeps its bodies and manifolds in fixed arrays, room for the debris and the
+// rest, and for two manifolds per pair the broadphase can hand it
+#define PHYSAC_MAX_BODIES (64 + SCENE_DEBRIS)
+#define PHYSAC_MAX_MANIFOLDS (4096 + 2*PHYSICS_HASH_PAIRS*SCENE_DEBRIS)
+
+// 1 runs the fluid on the CPU with a window too. Headless always does, otherwise the
+// CPU solver and its threads are left out of the build.
+#define FLUID_USE_CPU (0)
+#define FLUID_CPU_BACKEND (HEADLESS_MODE || FLUID_USE_CPU)
 
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
@@ -14,6 +50,48 @@
 
 #define DEBUG_MODE (0)
 
+#define SCENE_MAX_OBJECTS (32)          // Of each kind, on top of the debris
+// Dirty rectangles a frame before redrawing all the boundaries is cheaper, see
+// ./nvst_bench boundary
+#define SCENE_MAX_BOUNDARY_REGIONS (48)
+#define SCENE_FLUID_HASH_CELL (16.0f)   // Texels, for finding what's under a dirty rectangle
+
+#define FLUID_BACKEND (FLUID_USE_CPU ? FLUID_BACKEND_CPU : FLUID_BACKEND_GL)
+// FLUID_CPU_STORAGE_F32, FLUID_CPU_STORAGE_F16 or FLUID_CPU_STORAGE_F32_TILES. F16
+// keeps the CPU field in halves like the GL texture, tiles keep floats in 8x8 blocks
+#define FLUID_CPU_STORAGE (FLUID_CPU_STORAGE_F32)
+// Skips calm parts of the fluid, see setFluidSparse
+#define FLUID_SPARSE (1)
+// FLUID_ADVECTION_SEMI_LAGRANGIAN or FLUID_ADVECTION_MACCORMACK, which keeps more
+// detail for twice the lookups, see setFluidAdvection
+#define FLUID_ADVECTION (FLUID_ADVECTION_SEMI_LAGRANGIAN)
+// FLUID_PRESSURE_DENSITY or FLUID_PRESSURE_PROJECTION, which solves for a divergence
+// free flow with multigrid, see setFluidPressure
+#define FLUID_PRESSURE (FLUID_PRESSURE_DENSITY)
+
+// Trades fluid resolution and substeps for frame time, see fluid_governor.h. Off in
+// headless so runs stay comparable.
+#define FLUID_GOVERNOR (!HEADLESS_MODE)
+#define FLUID_BUDGET_MS (6.0f)      // Solver time per frame it tries to stay under
+#define FLUID_SUBSTEPS (6)          // At the best level, fewer substeps take longer ones
+#define EMITTER_FORCE (50.0f)       // Push of a full strength emitter, what full 8 bit color used to give
+
+// Substeps follow the fastest flow instead of the level's fixed count, see
+// pickFluidSubsteps. A level's count is what a death beam's flow needs at FLUID_CFL, calm
+// frames go as low as FLUID_MIN_SUBSTEPS and fast ones up to twice the level's.
+#define FLUID_ADAPTIVE_SUBSTEPS (1)
+#define FLUID_CFL (4.0f)            // Texels a substep, ADVECT_REACH in fluid_compute.glsl
+#define FLUID_MIN_SUBSTEPS (1)
+
+// Best first, substeps drop with the resolution so every step moves the same distance in texels
+static const FluidLevel fluid_levels[] = {
+    {1920, 1080, FLUID_SUBSTEPS},
+    {1600, 900, 5},
+    {1280, 720, 4},
+    {960, 540, 3},
+    {640, 360, 2},
+};
+
 //----------------------------------------------------------------------------------
 // Structs
 //----------------------------------------------------------------------------------
@@ -25,14 +103,22 @@ typedef struct Scene {
     // Camera
     Camera2D* camera;
 
+    // Everything below that's per level comes out of here, see allocSceneTables
+    SceneArena arena;
+
     // Players
-    Player players[4];
+    Player* players;
     int player_count;
 
     // Environment
     FluidBody fluid;
-    EnvironmentObj environment[50]; // Arbitrary limit because I don't want to deal with dynamic memory allocation
-    int environment_obj_count;
+    FluidGovernor governor;
+    EnvironmentTable environment[ENVIRONMENT_KINDS];
+
+    // Physac's bodies for the broadphase, and what the objects covered in the fluid
+    SpatialHash physics_hash;
+    SpatialHash fluid_hash;
+    float physics_time;     // Not stepped yet, see frameStepPhysics
 } Scene;
 
 //----------------------------------------------------------------------------------
@@ -42,11 +128,20 @@ static void initScene(Scene* scene, int player_count);
 static void unloadScene(Scene* scene);
 
 static void update(Scene* scene);                   // Full Frame Update Loop
+static void updateHeadless(Scene* scene);           // Frame update without drawing
+static int runHeadless(int frames);                 // Simulate frames and report the speed
 static void frameUpdateInputs(Scene* scene);        // Use input
 // static void frameUpdateState(Scene* scene);     // Updates between menus and screens
 static void frameUpdateCamera(Scene* scene);        // Update the camera position and rotation
 static void frameUpdateFluid(Scene* scene);         // Update the fluid
 static void frameUpdatePhysics(Scene* scene);   // Update the physics of all objects
+static void frameUpdateFluidBuffer(Scene* scene);   // Collect emitters and step the fluid
+static void frameUpdateFluidLevel(Scene* scene);    // Let the governor pick the fluid's size
+static void drawSceneFluidBoundaries(Scene* scene); // Rasterize the environment into the fluid
+static void frameUpdateFluidBoundaries(Scene* scene); // Redraw the parts of it that moved
+static void frameUpdateEnvironment(Scene* scene);   // Copy the bodies' poses into the tables
+static void stepScenePhysics(Scene* scene);         // One Physac step
+static void frameStepPhysics(Scene* scene, float dt); // As many as dt covers
 static void frameDrawPhysicsBodies(Scene* scene);   // A debug mode to draw all hitboxes
 static void frameDrawDebugGUI(Scene* scene);
 static void frameDrawFrame(Scene* scene);           // Draw frame objects
@@ -57,8 +152,12 @@ int toggle = 1;
 //----------------------------------------------------------------------------------
 // Main entry point
 //----------------------------------------------------------------------------------
-int main()
+int main(int argc, char** argv)
 {
+    if (HEADLESS_MODE) {
+        return runHeadless((argc > 1) ? atoi(argv[1]) : HEADLESS_FRAMES);
+    }
+
     // Initialization
     //--------------------------------------------------------------------------------------
 
@@ -87,10 +186,45 @@ int main()
     return 0;
 }
 
+// Where the level's memory goes. Run once on an arena that only counts and again on
+// the real one, so the block is exactly what it needs.
+static void allocSceneTables(Scene* scene, SceneArena* arena, int player_count) {
+    scene->players = pushSceneArena(arena, player_count*sizeof(Player));
+    for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+        scene->environment[k] = createEnvironmentTable(arena, k, SCENE_MAX_OBJECTS + SCENE_DEBRIS);
+    }
+    scene->physics_hash = createSpatialHash(
+        arena, PHYSAC_MAX_BODIES, PHYSICS_HASH_PAIRS*PHYSAC_MAX_BODIES, PHYSICS_HASH_CELL
+    );
+    scene->fluid_hash = createSpatialHash(
+        arena, ENVIRONMENT_KINDS*(SCENE_MAX_OBJECTS + SCENE_DEBRIS), 0, SCENE_FLUID_HASH_CELL
+    );
+}
+
+// Loose bits scattered over the arena, circles and polygons in turn. Placed off the
+// index so every run gets the same ones.
+static void addSceneDebris(Scene* scene, int count) {
+    for (int i = 0; i < count; i++) {
+        unsigned int h = (unsigned int)i*2654435761u;
+        Vector2 position = {(float)(h % 2400) - 1200, -200 - (float)((h >> 12) % 1200)};
+        float radius = 6 + (h >> 24) % 10;
+        Color color = {90, 90, 100, 255};
+
+        if (i % 2) {
+            addEnvironmentPolygon(
+                &scene->environment[ENVIRONMENT_POLYGON],
+                position, 3 + (h >> 8) % 4, radius, 0, 1, true, color
+            );
+        } else {
+            addEnvironmentCircle(&scene->environment[ENVIRONMENT_CIRCLE], position, radius, 1, true, color);
+        }
+    }
+}
+
 // Initialize camera, objects, players, etc
 static void initScene(Scene* scene, int player_count) {
     // Camera
-    Camera2D* camera = malloc(sizeof(Camera*));
+    Camera2D* camera = malloc(sizeof(Camera2D));
     
     camera->target = (Vector2){};
     camera->offset = (Vector2){SCREEN_WIDTH / 2, 2*SCREEN_HEIGHT / 3};
@@ -103,70 +237,181 @@ static void initScene(Scene* scene, int player_count) {
     InitPhysics();
     SetPhysicsGravity(0, GRAVITY);
 
-    // Scene Objects
-    EnvironmentObj mainplatform = createEnvironmentBox(
-        (Vector2){0, 100},
-        2000, 20, 0, 1, false, BLUE
-    );
-    scene->environment[0] = mainplatform;
-    EnvironmentObj secondleft = createEnvironmentBox(
-        (Vector2){500, -100},
-        400, 20, 0, 1, false, BLUE
-    );
-    scene->environment[1] = secondleft;
-    EnvironmentObj secondright = createEnvironmentBox(
-        (Vector2){-500, -100},
-        400, 20, 0, 1, false, BLUE
-    );
-    scene->environment[2] = secondright;
-    EnvironmentObj thirdleft = createEnvironmentBox(
-        (Vector2){1000, -500},
-        300, 20, 0, 1, false, BLUE
-    );
-    scene->environment[3] = thirdleft;
-    EnvironmentObj thirdright = createEnvironmentBox(
-        (Vector2){-1000, -500},
-        300, 20, 0, 1, false, BLUE
-    );
-    scene->environment[4] = thirdright;
-    EnvironmentObj topplatform = createEnvironmentBox(
-        (Vector2){0, -300},
-        500, 20, 0, 1, false, BLUE
-    );
-    scene->environment[5] = topplatform;
-    EnvironmentObj toptopplatform = createEnvironmentBox(
-        (Vector2){0, -700},
-        250, 20, 0, 1, false, BLUE
-    );
-    scene->environment[6] = toptopplatform;
+    // Level memory
+    SceneArena counter = { 0 };
+    allocSceneTables(scene, &counter, player_count);
+    scene->arena = createSceneArena(counter.used);
+    allocSceneTables(scene, &scene->arena, player_count);
 
-    scene->environment_obj_count = 7;
+    // Scene Objects
+    EnvironmentTable* boxes = &scene->environment[ENVIRONMENT_BOX];
+    addEnvironmentBox(boxes, (Vector2){0, 100}, 2000, 20, 0, 1, false, BLUE);
+    addEnvironmentBox(boxes, (Vector2){500, -100}, 400, 20, 0, 1, false, BLUE);
+    addEnvironmentBox(boxes, (Vector2){-500, -100}, 400, 20, 0, 1, false, BLUE);
+    addEnvironmentBox(boxes, (Vector2){1000, -500}, 300, 20, 0, 1, false, BLUE);
+    addEnvironmentBox(boxes, (Vector2){-1000, -500}, 300, 20, 0, 1, false, BLUE);
+    addEnvironmentBox(boxes, (Vector2){0, -300}, 500, 20, 0, 1, false, BLUE);
+    addEnvironmentBox(boxes, (Vector2){0, -700}, 250, 20, 0, 1, false, BLUE);
+    addSceneDebris(scene, SCENE_DEBRIS);
 
     // Fluid
+    scene->governor = createFluidGovernor(
+        fluid_levels,
+        sizeof(fluid_levels) / sizeof(fluid_levels[0]),
+        FLUID_BUDGET_MS
+    );
     scene->fluid = createFluidBody(
-        1920, 1080, 0, -500, 
-        SCREEN_WIDTH*3, SCREEN_HEIGHT*3
+        fluid_levels[0].x_resolution, fluid_levels[0].y_resolution, 0, -500, 
+        SCREEN_WIDTH*3, SCREEN_HEIGHT*3,
+        HEADLESS_MODE ? FLUID_BACKEND_CPU : FLUID_BACKEND
     );
-
-    // Draw fluid boundaries
-    BeginTextureMode(scene->fluid.boundary_tex);
-        for (int i = 0; i < scene->environment_obj_count; i++) {
-            drawEnvironmentObjToFluid(&scene->environment[i], &scene->fluid);
-        }
-    EndTextureMode();
+#if FLUID_CPU_BACKEND
+    setFluidStorage(&scene->fluid, FLUID_CPU_STORAGE);
+#endif
+    setFluidSparse(&scene->fluid, FLUID_SPARSE);
+    setFluidAdvection(&scene->fluid, FLUID_ADVECTION);
+    setFluidPressure(&scene->fluid, FLUID_PRESSURE);
+    drawSceneFluidBoundaries(scene);
 
     // Players
     scene->player_count = player_count;
     for (int i = 0; i < player_count; i++) {
         scene->players[i] = createPlayer((Vector2){4*PLAYER_WIDTH*i, 0}, i);
+        scene->players[i].fluid_probe = addFluidProbe(&scene->fluid);
     }
 
     // Time
     scene->t = 0;
+    scene->physics_time = 0;
+}
+
+// Draw fluid boundaries, again whenever the fluid changes size
+static void drawSceneFluidBoundaries(Scene* scene) {
+    beginFluidBoundaries(&scene->fluid);
+        for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+            EnvironmentTable* table = &scene->environment[k];
+            drawEnvironmentTableToFluid(table, &scene->fluid, NULL, table->count);
+            markEnvironmentTableFluid(table, &scene->fluid, NULL, table->count);
+        }
+    endFluidBoundaries(&scene->fluid);
+}
+
+// Only what moved gets redrawn. Each moved object dirties where it was and where it
+// is now, one rectangle if they overlap, and every object over a dirty rectangle is
+// drawn into it again. Past SCENE_MAX_BOUNDARY_REGIONS the whole grid is one
+// region instead, drawSceneFluidBoundaries doesn't clear what was there.
+static void frameUpdateFluidBoundaries(Scene* scene) {
+    Rectangle dirty[SCENE_MAX_BOUNDARY_REGIONS];
+    int dirty_count = 0;
+
+    for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+        EnvironmentTable* table = &scene->environment[k];
+        int moved = findEnvironmentTableMoved(table);
+        if (dirty_count + 2*moved > SCENE_MAX_BOUNDARY_REGIONS) {
+            for (int m = 0; m < ENVIRONMENT_KINDS; m++) {
+                markEnvironmentTableFluid(&scene->environment[m], &scene->fluid, NULL, scene->environment[m].count);
+            }
+            dirty[0] = (Rectangle){0, 0, scene->fluid.x_resolution, scene->fluid.y_resolution};
+            dirty_count = 1;
+            break;
+        }
+
+        for (int j = 0; j < moved; j++) {
+            int i = table->found[j];
+            Rectangle was = table->fluid_rect[i];
+            markEnvironmentTableFluid(table, &scene->fluid, &i, 1);
+            Rectangle now = table->fluid_rect[i];
+            if (CheckCollisionRecs(was, now)) {
+                float x0 = fminf(was.x, now.x);
+                float y0 = fminf(was.y, now.y);
+                float x1 = fmaxf(was.x + was.width, now.x + now.width);
+                float y1 = fmaxf(was.y + was.height, now.y + now.height);
+                dirty[dirty_count++] = (Rectangle){x0, y0, x1 - x0, y1 - y0};
+            } else {
+                dirty[dirty_count++] = was;
+                dirty[dirty_count++] = now;
+            }
+        }
+    }
+
+    if (dirty_count == 0) return;
+    hashEnvironmentFluid(scene->environment, &scene->fluid_hash);
+
+    for (int j = 0; j < dirty_count; j++) {
+        int found[ENVIRONMENT_KINDS];
+        findEnvironmentFluid(scene->environment, &scene->fluid_hash, dirty[j], found);
+
+        beginFluidBoundaryRegion(&scene->fluid, dirty[j]);
+            for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+                EnvironmentTable* table = &scene->environment[k];
+                drawEnvironmentTableToFluid(table, &scene->fluid, table->found, found[k]);
+            }
+        endFluidBoundaryRegion(&scene->fluid);
+    }
+}
+
+static void stepScenePhysics(Scene* scene) {
+    if (PHYSICS_BROADPHASE) stepPhysacBroadphase(&scene->physics_hash);
+    else PhysicsStep();
+}
+
+// Fixed steps like Physac's thread took, whatever the frame rate. A slow frame runs at
+// most PHYSICS_MAX_STEPS and drops the rest rather than falling further behind.
+static void frameStepPhysics(Scene* scene, float dt) {
+    scene->physics_time += dt;
+    int steps = 0;
+    while (scene->physics_time >= PHYSICS_STEP_TIME && steps < PHYSICS_MAX_STEPS) {
+        stepScenePhysics(scene);
+        scene->physics_time -= PHYSICS_STEP_TIME;
+        steps++;
+    }
+    if (scene->physics_time >= PHYSICS_STEP_TIME) scene->physics_time = 0;
+}
+
+// Copy where physics moved everything, the rest of the frame reads the tables
+static void frameUpdateEnvironment(Scene* scene) {
+    for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+        syncEnvironmentTable(&scene->environment[k]);
+    }
 }
 
 static void unloadScene(Scene* scene) {
     unloadFluidBody(&scene->fluid);
+    unloadSceneArena(&scene->arena);
+    free(scene->camera);
+}
+
+// Runs the game loop with no window or GL context and prints simulated frames per
+// second, with the substeps it averaged since those set most of the cost
+static int runHeadless(int frames) {
+    Scene scene;
+    initScene(&scene, 2);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long long substeps = 0;
+    for (int i = 0; i < frames; i++) {
+        updateHeadless(&scene);
+        substeps += getFluidSubsteps(&scene.fluid);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+
+    printf(
+        "%d frames in %.2f s, %.1f simulated FPS (%.2fx realtime), %.2f substeps a frame\n",
+        frames,
+        seconds,
+        frames / seconds,
+        frames / seconds / 60.0,
+        (double)substeps / frames
+    );
+
+    unloadScene(&scene);
+    ClosePhysics();
+
+    return 0;
 }
 
 float ReverseFloat( const float inFloat )
@@ -196,11 +441,15 @@ static void update(Scene* scene)
     if (scene->t > 10) {
         frameUpdatePhysics(scene);  // Update the physics
     }
+    frameUpdateEnvironment(scene);
 
     // Draw 
     //----------------------------------------------------------------------------------
     BeginDrawing();
 
+    // Fluid steps before the rest of the frame gets drawn
+    frameUpdateFluidBuffer(scene);
+
     // DrawText(TextFormat("%i", scene->t), 100, 100, 25, BLUE);
 
     frameDrawFrame(scene);
@@ -215,6 +464,31 @@ static void update(Scene* scene)
     EndDrawing();
     //----------------------------------------------------------------------------------
 
+    // Without the broadphase Physac's thread does this
+    if (PHYSICS_BROADPHASE) frameStepPhysics(scene, GetFrameTime());
+
+    for (int i = 0; i < scene->player_count; i++) {
+        scene->players[i].p_colliding = scene->players[i].physics->isColliding;
+    }
+}
+
+// Same order as update, minus the camera and anything drawn to the screen
+static void updateHeadless(Scene* scene) {
+    scene->t++;
+
+    frameUpdateInputs(scene);
+    frameUpdateFluid(scene);
+    if (scene->t > 10) {
+        frameUpdatePhysics(scene);
+    }
+    frameUpdateEnvironment(scene);
+    frameUpdateFluidBuffer(scene);
+
+    // Forces get cleared by the first step, same as on the physics thread
+    for (int i = 0; i < HEADLESS_PHYSICS_STEPS; i++) {
+        stepScenePhysics(scene);
+    }
+
     for (int i = 0; i < scene->player_count; i++) {
         scene->players[i].p_colliding = scene->players[i].physics->isColliding;
     }
@@ -225,7 +499,10 @@ static void frameUpdateInputs(Scene* scene) {
 
     // Update player movements
     for (int i = 0; i < scene->player_count; i++) {
-        updatePlayerMovement(&scene->players[i]);
+        PlayerInput input = HEADLESS_MODE ?
+            scriptedPlayerInput(i, scene->t) :
+            readGamepadInput(i);
+        updatePlayerMovement(&scene->players[i], input);
     }
 }
 
@@ -275,8 +552,6 @@ static void frameUpdateCamera(Scene* scene) {
 static void frameUpdateFluid(Scene* scene) {
     float time = (float)scene->t / 60.0;
     setFluidUniforms(&scene->fluid, &time);
-    // Need to set this each frame for unknown reasons
-    SetShaderValueTexture(scene->fluid.shader, scene->fluid.boundary_uniform, scene->fluid.boundary_tex.texture);
 }
 
 // Clamping with sigmoid
@@ -316,32 +591,11 @@ static void frameUpdatePhysics(Scene* scene) {
         
         int x = player_pos.x;
         int y = (scene->fluid.y_resolution-1) - player_pos.y;
-        Vector4 center = getCPUImgValue(&scene->fluid, x, y);
-        Vector4 top_left = getCPUImgValue(
-            &scene->fluid, 
-            x + adj_width, 
-            y + adj_height
-        );
-        Vector4 top_right = getCPUImgValue(
-            &scene->fluid, 
-            x - adj_width, 
-            y + adj_height
-        );
-        Vector4 bottom_left = getCPUImgValue(
-            &scene->fluid, 
-            x + adj_width,
-            y - adj_height
-        );
-        Vector4 bottom_right = getCPUImgValue(
-            &scene->fluid, 
-            x - adj_width,
-            y - adj_height
-        );
 
-        Vector2 calc_force = {
-            (center.x + top_left.x + top_right.x + bottom_left.x + bottom_right.x) / 5.0,
-            (center.y + top_left.y + top_right.y + bottom_left.y + bottom_right.y) / 5.0,
-        };
+        // Center and corners averaged by the probe, a frame or two behind on GL
+        setFluidProbe(&scene->fluid, scene->players[i].fluid_probe, x, y, adj_width, adj_height);
+        Vector4 probe = getFluidProbe(&scene->fluid, scene->players[i].fluid_probe);
+        Vector2 calc_force = {probe.x, probe.y};
         
         PhysicsAddForce(
             scene->players[i].physics,
@@ -424,11 +678,21 @@ static void frameDrawDebugGUI(Scene* scene) {
     );
 
     if (GuiButton((Rectangle){40, 140, 120, 20}, "Recompile Shaders")) {
-        scene->fluid.shader = LoadShader(0, "fluid_comp.glsl");
-        scene->fluid.render_shader = LoadShader(0, "fluid_render.glsl");
+        reloadFluidShaders(&scene->fluid);
         scene->t = 0;
     }
 
+    FluidGovernorStats stats = getFluidGovernorStats(&scene->governor);
+    DrawText(
+        TextFormat(
+            "Fluid %dx%d, %d substeps at speed %.1f, %.2f/%.2f ms, %.3f ms to submit, %lld changes",
+            stats.current.x_resolution, stats.current.y_resolution, getFluidSubsteps(&scene->fluid),
+            getFluidMaxSpeed(&scene->fluid), stats.smoothed_ms, stats.budget_ms,
+            getFluidSubmitTime(&scene->fluid), stats.changes
+        ),
+        40, 180, 20, WHITE
+    );
+
     return;
 }
 
@@ -439,7 +703,9 @@ void playerHandleFlamethrower(Scene* scene, int player_id) {
     );
     Vector2 aspect = fluidAspect(&scene->fluid);
 
-    int radius = PLAYER_WIDTH;
+    float radius = fluidTexels(&scene->fluid, PLAYER_WIDTH);
+    float thickness = fmaxf(fluidTexels(&scene->fluid, 4), 1);
+    float spread = fluidTexels(&scene->fluid, 8);
     float x_dir = scene->players[player_id].direction.x;
     float y_dir = scene->players[player_id].direction.y;
     float flame_force = scene->players[player_id].flamethower_force;
@@ -453,42 +719,43 @@ void playerHandleFlamethrower(Scene* scene, int player_id) {
     dot_pos.x += x_dir * 70 / aspect.x;
     dot_pos.y -= y_dir * 70 / aspect.y;
 
-    Color flame_direction = {
-        x_dir * 127.5 * flame_force + 127,
-        y_dir * 127.5 * flame_force + 127,
-        0,
-        254
+    Vector2 flame_push = {
+        x_dir * flame_force * EMITTER_FORCE,
+        y_dir * flame_force * EMITTER_FORCE
     };
 
     if (flame_force > 0.05) {
-        DrawRectanglePro(
-            (Rectangle){dot_pos.x, dot_pos.y, radius, 4},
-            (Vector2){0, 2},
+        addFluidEmitterRectanglePro(
+            &scene->fluid,
+            (Rectangle){dot_pos.x, dot_pos.y, radius, thickness},
+            (Vector2){0, thickness/2},
             -player_rot,
-            flame_direction
+            flame_push
         );
         // Focus beam
-        DrawRectanglePro(
+        addFluidEmitterRectanglePro(
+            &scene->fluid,
             (Rectangle){
-                dot_pos.x + 8*y_dir, 
-                dot_pos.y + 8*x_dir, 
+                dot_pos.x + spread*y_dir, 
+                dot_pos.y + spread*x_dir, 
                 radius, 
-                4
+                thickness
             },
-            (Vector2){0, 2},
+            (Vector2){0, thickness/2},
             -player_rot - 15,
-            flame_direction
+            flame_push
         );
-        DrawRectanglePro(
+        addFluidEmitterRectanglePro(
+            &scene->fluid,
             (Rectangle){
-                dot_pos.x - 8*y_dir, 
-                dot_pos.y - 8*x_dir, 
+                dot_pos.x - spread*y_dir, 
+                dot_pos.y - spread*x_dir, 
                 radius, 
-                4
+                thickness
             },
-            (Vector2){0, 2},
+            (Vector2){0, thickness/2},
             -player_rot + 15,
-            flame_direction
+            flame_push
         );
     }
 }
@@ -509,20 +776,21 @@ void playerHandleBlock(Scene* scene, int player_id) {
     block_pos.x += scene->players[player_id].direction.x * 65 / aspect.x;
     block_pos.y -= scene->players[player_id].direction.y * 65 / aspect.y;
 
-    Color flame_direction = {
-        (scene->players[player_id].direction.x * 0.001 * 127.5) + 127,
-        (scene->players[player_id].direction.y * 0.001 * 127.5) + 127,
-        0,
-        255
+    // Holds the fluid nearly still, so it stops whatever flows into it
+    Vector2 block_velocity = {
+        scene->players[player_id].direction.x * 0.001 * EMITTER_FORCE,
+        scene->players[player_id].direction.y * 0.001 * EMITTER_FORCE
     };
 
     if (scene->players[player_id].block_enabled) {
-        DrawRectanglePro(
-            (Rectangle){block_pos.x, block_pos.y, 3, 40},
-            (Vector2){0, 20},
+        int block = addFluidEmitterRectanglePro(
+            &scene->fluid,
+            (Rectangle){block_pos.x, block_pos.y, fmaxf(fluidTexels(&scene->fluid, 3), 1), fluidTexels(&scene->fluid, 40)},
+            (Vector2){0, fluidTexels(&scene->fluid, 20)},
             -player_rot,
-            flame_direction
+            block_velocity
         );
+        holdFluidEmitter(&scene->fluid, block);
     }
 }
 
@@ -541,60 +809,63 @@ void playerHandleDeathbeam(Scene* scene, int player_id) {
     float player_rot = atan2(y_dir, x_dir) * 180 / PI;
     Vector2 beam_pos = {
         new_pos.x, 
-        new_pos.y + PLAYER_HEIGHT / aspect.y / 5 + 3
+        new_pos.y + PLAYER_HEIGHT / aspect.y / 5 + fluidTexels(&scene->fluid, 3)
     };
     beam_pos.x += x_dir * 50 / aspect.x;
     beam_pos.y -= y_dir * 50 / aspect.y;
 
+    // Jitters the fluid under it rather than pushing
     if ((scene->players[player_id].death_charge > 0.01) && !scene->players[player_id].death_enabled) {
-        DrawCircle(
+        int charge = addFluidEmitterCircle(
+            &scene->fluid,
             beam_pos.x,
             beam_pos.y,
             PLAYER_WIDTH / aspect.x / 2,
-            (Color){GetRandomValue(0, 255), GetRandomValue(0, 255), 0, 255}
+            (Vector2){GetRandomValue(0, 255) / 255.0f, GetRandomValue(0, 255) / 255.0f}
         );
+        holdFluidEmitter(&scene->fluid, charge);
     }
 
     // If it's enabled, draw a fucking death beam
     if (scene->players[player_id].death_enabled) {
-        Color flame_direction = {
-            x_dir * 127.5 + 127,
-            y_dir * 127.5 + 127,
-            0,
-            254
-        };
-        scene->players[player_id].death_charge = max(0, scene->players[player_id].death_charge - 1);
+        Vector2 beam_push = {x_dir * EMITTER_FORCE, y_dir * EMITTER_FORCE};
+        // Drains at the same rate as when this ran every substep
+        scene->players[player_id].death_charge = max(0, scene->players[player_id].death_charge - FLUID_SUBSTEPS);
+        float thickness = fmaxf(fluidTexels(&scene->fluid, 4), 1);
 
         // Main rectangle
-        DrawRectanglePro(
-            (Rectangle){beam_pos.x, beam_pos.y, 100, 4},
-            (Vector2){0, 2},
+        addFluidEmitterRectanglePro(
+            &scene->fluid,
+            (Rectangle){beam_pos.x, beam_pos.y, fluidTexels(&scene->fluid, 100), thickness},
+            (Vector2){0, thickness/2},
             -player_rot,
-            flame_direction
+            beam_push
         );
         
         // Focus beam
-        DrawRectanglePro(
+        addFluidEmitterRectanglePro(
+            &scene->fluid,
             (Rectangle){
-                beam_pos.x + 12*y_dir, 
-                beam_pos.y + 12*x_dir, 
-                50, 
-                4
+                beam_pos.x + fluidTexels(&scene->fluid, 12)*y_dir, 
+                beam_pos.y + fluidTexels(&scene->fluid, 12)*x_dir, 
+                fluidTexels(&scene->fluid, 50), 
+                thickness
             },
-            (Vector2){0, 2},
+            (Vector2){0, thickness/2},
             -player_rot - 15,
-            flame_direction
+            beam_push
         );
-        DrawRectanglePro(
+        addFluidEmitterRectanglePro(
+            &scene->fluid,
             (Rectangle){
-                beam_pos.x - 10*y_dir, 
-                beam_pos.y - 10*x_dir, 
-                50, 
-                4
+                beam_pos.x - fluidTexels(&scene->fluid, 10)*y_dir, 
+                beam_pos.y - fluidTexels(&scene->fluid, 10)*x_dir, 
+                fluidTexels(&scene->fluid, 50), 
+                thickness
             },
-            (Vector2){0, 2},
+            (Vector2){0, thickness/2},
             -player_rot + 15,
-            flame_direction
+            beam_push
         );
 
         if (scene->players[player_id].death_charge == 0) {
@@ -603,6 +874,83 @@ void playerHandleDeathbeam(Scene* scene, int player_id) {
     }
 }
 
+// Collect the frame's emitters and run the substeps, which all read the same list
+static void frameUpdateFluidBuffer(Scene* scene) {
+    FluidLevel level = getFluidGovernorLevel(&scene->governor);
+    int substeps = level.substeps;
+
+    frameUpdateFluidBoundaries(scene);
+    clearFluidEmitters(&scene->fluid);
+
+    for (int j = 0; j < scene->player_count; j++) {
+        playerHandleFlamethrower(scene, j);
+        playerHandleDeathbeam(scene, j);
+        playerHandleBlock(scene, j);
+    }
+
+    if (IsKeyDown(KEY_E)) {
+        Vector2 new_pos = environmentToFluidCoords(
+            scene->players[1].physics->position,
+            &scene->fluid
+        );
+        addFluidEmitterRectangle(
+            &scene->fluid,
+            new_pos.x + fluidTexels(&scene->fluid, 15),
+            new_pos.y - fluidTexels(&scene->fluid, 3), 
+            fluidTexels(&scene->fluid, 30), fmaxf(fluidTexels(&scene->fluid, 2), 1), 
+            (Vector2){EMITTER_FORCE, 0}
+        );
+    }
+    if (IsKeyDown(KEY_Q)) {
+        Vector2 new_pos = environmentToFluidCoords(
+            scene->players[1].physics->position,
+            &scene->fluid
+        );
+        addFluidEmitterRectangle(
+            &scene->fluid,
+            new_pos.x - fluidTexels(&scene->fluid, 25),
+            new_pos.y - fluidTexels(&scene->fluid, 3), 
+            fluidTexels(&scene->fluid, 30), fmaxf(fluidTexels(&scene->fluid, 2), 1), 
+            (Vector2){-EMITTER_FORCE, 0}
+        );
+    }
+
+    if (FLUID_ADAPTIVE_SUBSTEPS) {
+        substeps = pickFluidSubsteps(
+            &scene->fluid,
+            FLUID_DEFAULT_DT * FLUID_SUBSTEPS,
+            FLUID_CFL,
+            FLUID_MIN_SUBSTEPS,
+            2 * level.substeps
+        );
+    }
+
+    beginFluidSolverTiming(&scene->fluid);
+    updateFluidBufferSubsteps(&scene->fluid, substeps);
+    endFluidSolverTiming(&scene->fluid);
+
+    if (FLUID_GOVERNOR) frameUpdateFluidLevel(scene);
+}
+
+static void frameUpdateFluidLevel(Scene* scene) {
+    if (!updateFluidGovernor(&scene->governor, getFluidSolverTime(&scene->fluid))) return;
+
+    FluidLevel level = getFluidGovernorLevel(&scene->governor);
+    resizeFluidBody(&scene->fluid, level.x_resolution, level.y_resolution);
+    drawSceneFluidBoundaries(scene);
+
+    // Adaptive substeps share out the frame's time step themselves, the level only
+    // caps how many they get. Otherwise fewer substeps take longer ones so the fluid
+    // keeps the same speed
+    if (FLUID_ADAPTIVE_SUBSTEPS) return;
+    setFluidParams(
+        &scene->fluid,
+        FLUID_DEFAULT_DT * FLUID_SUBSTEPS / level.substeps,
+        scene->fluid.params.k,
+        scene->fluid.params.viscosity
+    );
+}
+
 // Draw the frame
 static void frameDrawFrame(Scene* scene) {
     // Clear
@@ -613,58 +961,12 @@ static void frameDrawFrame(Scene* scene) {
     // int tmp = scene->players[0].physics->isColliding;
     // DrawText(TextFormat("Is colliding? %i", tmp), 20, 140, 20, GREEN);
 
-    // Update the fluid buffer
-    for (int i = 0; i < 6; i++) {
-        BeginTextureMode(scene->fluid.fluid_tex);
-        
-        for (int j = 0; j < scene->player_count; j++) {
-            playerHandleFlamethrower(scene, j);
-            playerHandleDeathbeam(scene, j);
-            playerHandleBlock(scene, j);
-        }
-
-        if (IsKeyDown(KEY_E)) {
-            Vector2 new_pos = environmentToFluidCoords(
-                scene->players[1].physics->position,
-                &scene->fluid
-            );
-            DrawRectangle(
-                new_pos.x + 15,
-                new_pos.y - 3, 
-                30, 2, 
-                (Color){255, 127, 0, 254}
-            );
-        }
-        if (IsKeyDown(KEY_Q)) {
-            Vector2 new_pos = environmentToFluidCoords(
-                scene->players[1].physics->position,
-                &scene->fluid
-            );
-            DrawRectangle(
-                new_pos.x - 25,
-                new_pos.y - 3, 
-                30, 2, 
-                (Color){0, 127, 0, 254}
-            );
-        }
-
-        EndTextureMode();
-        SetShaderValueTexture(
-            scene->fluid.shader, 
-            scene->fluid.fluid_uniform, 
-            scene->fluid.fluid_tex.texture
-        );
-
-
-        updateFluidBuffer(&scene->fluid);
-    }
-
     // Scene 2D objects
     BeginMode2D(*scene->camera);
 
     // Draw scene
-    for (int i = 0; i < scene->environment_obj_count; i++) {
-        drawEnvironmentObj(&scene->environment[i]);
+    for (int k = 0; k < ENVIRONMENT_KINDS; k++) {
+        drawEnvironmentTable(&scene->environment[k]);
     }
 
     // Draw players
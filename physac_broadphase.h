@@ -0,0 +1,139 @@
+#ifndef NVST_PHYSAC_BROADPHASE
+#define NVST_PHYSAC_BROADPHASE
+
+#include "raylib.h"
+
+#include "spatial_hash.h"
+
+// Physac checks every pair of bodies each step, making a manifold for each and solving
+// it. This steps it over only the pairs a SpatialHash of the bodies' bounding boxes
+// says could touch, and otherwise follows PhysicsStep. A pair whose boxes don't touch
+// would only have given Physac a manifold without contacts, which moves nothing. It's
+// built on Physac's internals, so it has to be included right after physac.h with
+// PHYSAC_IMPLEMENTATION, which can't be included twice. Physac's own thread has to be
+// off (PHYSAC_NO_THREADS) so this is the only thing stepping.
+
+#define PHYSAC_BROADPHASE_MARGIN (1.0f)     // Grown onto every box so rounding can't lose a contact
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Bounding box of the shape the narrowphase sees: the polygon's vertices through its
+// transform, or the circle
+static Rectangle getPhysacBodyBounds(PhysicsBody body) {
+    Vector2 min = body->position;
+    Vector2 max = body->position;
+
+    if (body->shape.type == PHYSICS_CIRCLE) {
+        min.x -= body->shape.radius;
+        min.y -= body->shape.radius;
+        max.x += body->shape.radius;
+        max.y += body->shape.radius;
+    } else {
+        Matrix2x2 m = body->shape.transform;
+        min = (Vector2){INFINITY, INFINITY};
+        max = (Vector2){-INFINITY, -INFINITY};
+        for (unsigned int i = 0; i < body->shape.vertexData.vertexCount; i++) {
+            Vector2 v = body->shape.vertexData.positions[i];
+            float x = body->position.x + m.m00*v.x + m.m01*v.y;
+            float y = body->position.y + m.m10*v.x + m.m11*v.y;
+            min.x = fminf(min.x, x);
+            min.y = fminf(min.y, y);
+            max.x = fmaxf(max.x, x);
+            max.y = fmaxf(max.y, y);
+        }
+    }
+
+    float margin = PHYSAC_BROADPHASE_MARGIN;
+    return (Rectangle){min.x - margin, min.y - margin, max.x - min.x + 2*margin, max.y - min.y + 2*margin};
+}
+
+// PhysicsStep with the pairs it checks handed in, each packed the way SpatialHash does
+// with the lower index first. Same manifold pool as PhysicsStep builds for those pairs:
+// every pair keeps its manifold, and one with contacts gets a copy added after it,
+// which Physac resolves along with the first.
+void stepPhysacPairs(const unsigned int* pairs, int count) {
+    stepsCount++;
+
+    for (int i = physicsManifoldsCount - 1; i >= 0; i--) {
+        if (contacts[i] != NULL) DestroyPhysicsManifold(contacts[i]);
+    }
+    for (unsigned int i = 0; i < physicsBodiesCount; i++) {
+        if (bodies[i] != NULL) bodies[i]->isGrounded = false;
+    }
+
+    for (int p = 0; p < count; p++) {
+        PhysicsBody a = bodies[pairs[p] >> 16];
+        PhysicsBody b = bodies[pairs[p] & 0xffff];
+        if (a == NULL || b == NULL) continue;
+        if (a->inverseMass == 0 && b->inverseMass == 0) continue;
+
+        PhysicsManifold manifold = CreatePhysicsManifold(a, b);
+        SolvePhysicsManifold(manifold);
+        if (manifold->contactsCount > 0) {
+            PhysicsManifold copy = CreatePhysicsManifold(a, b);
+            copy->penetration = manifold->penetration;
+            copy->normal = manifold->normal;
+            copy->contacts[0] = manifold->contacts[0];
+            copy->contacts[1] = manifold->contacts[1];
+            copy->contactsCount = manifold->contactsCount;
+            copy->restitution = manifold->restitution;
+            copy->dynamicFriction = manifold->dynamicFriction;
+            copy->staticFriction = manifold->staticFriction;
+        }
+    }
+
+    for (unsigned int i = 0; i < physicsBodiesCount; i++) {
+        if (bodies[i] != NULL) IntegratePhysicsForces(bodies[i]);
+    }
+    for (unsigned int i = 0; i < physicsManifoldsCount; i++) {
+        if (contacts[i] != NULL) InitializePhysicsManifolds(contacts[i]);
+    }
+    for (int k = 0; k < PHYSAC_COLLISION_ITERATIONS; k++) {
+        for (unsigned int i = 0; i < physicsManifoldsCount; i++) {
+            if (contacts[i] != NULL) IntegratePhysicsImpulses(contacts[i]);
+        }
+    }
+    for (unsigned int i = 0; i < physicsBodiesCount; i++) {
+        if (bodies[i] != NULL) IntegratePhysicsVelocity(bodies[i]);
+    }
+    for (unsigned int i = 0; i < physicsManifoldsCount; i++) {
+        if (contacts[i] != NULL) CorrectPhysicsPositions(contacts[i]);
+    }
+
+    for (unsigned int i = 0; i < physicsBodiesCount; i++) {
+        if (bodies[i] == NULL) continue;
+        bodies[i]->force = PHYSAC_VECTOR_ZERO;
+        bodies[i]->torque = 0;
+    }
+}
+
+// Hashes every body's bounds, items are Physac's body indices
+void hashPhysacBodies(SpatialHash* hash) {
+    int count = (int)physicsBodiesCount;
+    for (int i = 0; i < count; i++) {
+        if (bodies[i] != NULL) hash->bounds[i] = getPhysacBodyBounds(bodies[i]);
+        else hash->bounds[i] = (Rectangle){ INFINITY, INFINITY, 0, 0 };
+    }
+    buildSpatialHash(hash, count);
+}
+
+// One step over the pairs the hash finds. Falls back to Physac's own step if there
+// are more bodies or pairs than it has room for, that's slow but nothing gets missed.
+// A pair of candidates takes up to two manifolds, so PHYSAC_MAX_MANIFOLDS wants to be
+// twice the hash's pair_capacity.
+void stepPhysacBroadphase(SpatialHash* hash) {
+    if ((int)physicsBodiesCount > hash->capacity) {
+        PhysicsStep();
+        return;
+    }
+
+    hashPhysacBodies(hash);
+    findSpatialHashPairs(hash);
+
+    if (hash->pair_overflow) PhysicsStep();
+    else stepPhysacPairs(hash->pairs, hash->pair_count);
+}
+
+#endif
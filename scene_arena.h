@@ -0,0 +1,49 @@
+#ifndef NVST_SCENE_ARENA
+#define NVST_SCENE_ARENA
+
+#include <stdlib.h>
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+// Everything a level keeps comes out of one block made when it loads and freed with
+// it, so nothing gets allocated while it runs. One with no memory only counts, which
+// is how a level finds out how big its block has to be.
+typedef struct NV_SceneArena {
+    unsigned char* memory;
+    size_t size;
+    size_t used;
+} SceneArena;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Zeroed, calloc hands out 16 byte aligned blocks and every push keeps to that
+SceneArena createSceneArena(size_t size) {
+    SceneArena arena = { 0 };
+    arena.memory = calloc(size, 1);
+    arena.size = size;
+    return arena;
+}
+
+void unloadSceneArena(SceneArena* arena) {
+    free(arena->memory);
+    *arena = (SceneArena){ 0 };
+}
+
+// NULL if it's full, or only counting
+void* pushSceneArena(SceneArena* arena, size_t size) {
+    size_t start = (arena->used + 15) & ~(size_t)15;
+    if (arena->memory == NULL) {
+        arena->used = start + size;
+        return NULL;
+    }
+    if (start + size > arena->size) return NULL;
+
+    arena->used = start + size;
+    return arena->memory + start;
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef NVST_SPATIAL_HASH
+#define NVST_SPATIAL_HASH
+
+#include <math.h>
+#include <string.h>
+
+#include "raylib.h"
+
+#include "scene_arena.h"
+
+// A uniform grid of square cells hashed into buckets, rebuilt from scratch every time
+// from a column of bounding boxes. Building is a counting sort of every cell a box
+// covers by bucket, so there's nothing to clear or free between builds. A pair of
+// boxes that share cells would come up in each of them, and unrelated cells can share
+// a bucket, so a pair only counts in the one cell holding the corner where their
+// overlap starts. Same for a box against a query. Boxes over more than
+// SPATIAL_HASH_MAX_CELLS cells (platforms) aren't put in the grid, they're checked
+// against everything instead, there's only ever a few.
+
+#define SPATIAL_HASH_MAX_CELLS (16)     // A box covering more is checked against everything
+#define SPATIAL_HASH_MAX_COORD (1 << 24)    // Cells past this clamp to it, NaN goes to the low end
+
+//----------------------------------------------------------------------------------
+// Structs
+//----------------------------------------------------------------------------------
+
+// Entries are one per cell a box covers
+typedef struct NV_SpatialHashEntry {
+    int item;
+    int cell_x;
+    int cell_y;
+} SpatialHashEntry;
+
+typedef struct NV_SpatialHash {
+    float cell_size;
+    int capacity;           // Boxes
+    int bucket_mask;        // Buckets are a power of two, at least twice the boxes
+
+    // Filled in by the caller before buildSpatialHash
+    Rectangle* bounds;
+    int count;
+
+    int* starts;            // Entries of bucket b are starts[b] to starts[b + 1] - 1
+    SpatialHashEntry* entries;
+    unsigned char* large;   // Left out of the grid
+    int* large_items;
+    int large_count;
+
+    // Both items of a pair packed as a << 16 | b with a < b, see findSpatialHashPairs
+    unsigned int* pairs;
+    unsigned int* pair_scratch;
+    int pair_capacity;
+    int pair_count;
+    int pair_overflow;      // More pairs than pair_capacity, the rest were dropped
+
+    int* found;             // Items the last querySpatialHash found
+} SpatialHash;
+
+//----------------------------------------------------------------------------------
+// Functions
+//----------------------------------------------------------------------------------
+
+// Items are indices below capacity, which has to stay under 65536 for the pairs
+SpatialHash createSpatialHash(SceneArena* arena, int capacity, int pair_capacity, float cell_size) {
+    SpatialHash hash = { 0 };
+    hash.cell_size = cell_size;
+    hash.capacity = capacity;
+    hash.pair_capacity = pair_capacity;
+
+    int buckets = 16;
+    while (buckets < 2*capacity) buckets *= 2;
+    hash.bucket_mask = buckets - 1;
+
+    hash.bounds = pushSceneArena(arena, capacity*sizeof(Rectangle));
+    hash.starts = pushSceneArena(arena, (buckets + 1)*sizeof(int));
+    hash.entries = pushSceneArena(arena, (size_t)capacity*SPATIAL_HASH_MAX_CELLS*sizeof(SpatialHashEntry));
+    hash.large = pushSceneArena(arena, capacity);
+    hash.large_items = pushSceneArena(arena, capacity*sizeof(int));
+    hash.pairs = pushSceneArena(arena, pair_capacity*sizeof(unsigned int));
+    hash.pair_scratch = pushSceneArena(arena, pair_capacity*sizeof(unsigned int));
+    hash.found = pushSceneArena(arena, capacity*sizeof(int));
+
+    return hash;
+}
+
+static inline int getSpatialHashCell(const SpatialHash* hash, float v) {
+    float cell = floorf(v / hash->cell_size);
+    return (int)fminf(fmaxf(cell, -SPATIAL_HASH_MAX_COORD), SPATIAL_HASH_MAX_COORD);
+}
+
+static inline int getSpatialHashBucket(const SpatialHash* hash, int cell_x, int cell_y) {
+    return (int)(((unsigned int)cell_x*73856093u ^ (unsigned int)cell_y*19349663u) & (unsigned int)hash->bucket_mask);
+}
+
+// Touching counts, so nothing the narrowphase could call a contact gets missed
+static inline int isSpatialHashOverlap(Rectangle a, Rectangle b) {
+    return (a.x <= b.x + b.width) & (b.x <= a.x + a.width) & (a.y <= b.y + b.height) & (b.y <= a.y + a.height);
+}
+
+// Sorts the first count bounds into the grid
+void buildSpatialHash(SpatialHash* hash, int count) {
+    hash->count = count;
+    hash->large_count = 0;
+    memset(hash->starts, 0, (hash->bucket_mask + 2)*sizeof(int));
+
+    // Count each bucket's entries, as the end of its range once summed
+    for (int i = 0; i < count; i++) {
+        Rectangle box = hash->bounds[i];
+        int x0 = getSpatialHashCell(hash, box.x);
+        int y0 = getSpatialHashCell(hash, box.y);
+        int x1 = getSpatialHashCell(hash, box.x + box.width);
+        int y1 = getSpatialHashCell(hash, box.y + box.height);
+
+        hash->large[i] = (long long)(x1 - x0 + 1)*(y1 - y0 + 1) > SPATIAL_HASH_MAX_CELLS;
+        if (hash->large[i]) {
+            hash->large_items[hash->large_count++] = i;
+            continue;
+        }
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) hash->starts[getSpatialHashBucket(hash, x, y)]++;
+        }
+    }
+    int total = 0;
+    for (int b = 0; b <= hash->bucket_mask; b++) {
+        total += hash->starts[b];
+        hash->starts[b] = total;
+    }
+    hash->starts[hash->bucket_mask + 1] = total;
+
+    // Filling each bucket from its end leaves starts at the beginnings
+    for (int i = 0; i < count; i++) {
+        if (hash->large[i]) continue;
+        Rectangle box = hash->bounds[i];
+        int x0 = getSpatialHashCell(hash, box.x);
+        int y0 = getSpatialHashCell(hash, box.y);
+        int x1 = getSpatialHashCell(hash, box.x + box.width);
+        int y1 = getSpatialHashCell(hash, box.y + box.height);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                int entry = --hash->starts[getSpatialHashBucket(hash, x, y)];
+                hash->entries[entry] = (SpatialHashEntry){i, x, y};
+            }
+        }
+    }
+}
+
+static inline void addSpatialHashPair(SpatialHash* hash, int a, int b) {
+    if (hash->pair_count >= hash->pair_capacity) {
+        hash->pair_overflow = 1;
+        return;
+    }
+    hash->pairs[hash->pair_count++] = (a < b) ? ((unsigned int)a << 16 | b) : ((unsigned int)b << 16 | a);
+}
+
+// Sorts the pairs so the lower item goes first, then the higher, with 8 bits a pass
+static void sortSpatialHashPairs(SpatialHash* hash) {
+    unsigned int* from = hash->pairs;
+    unsigned int* to = hash->pair_scratch;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        int counts[257] = { 0 };
+        for (int i = 0; i < hash->pair_count; i++) counts[((from[i] >> shift) & 255) + 1]++;
+        for (int d = 0; d < 256; d++) counts[d + 1] += counts[d];
+        for (int i = 0; i < hash->pair_count; i++) to[counts[(from[i] >> shift) & 255]++] = from[i];
+
+        unsigned int* swap = from;
+        from = to;
+        to = swap;
+    }
+}
+
+// Every pair of boxes that overlap or touch, each once, sorted. Check pair_overflow.
+void findSpatialHashPairs(SpatialHash* hash) {
+    hash->pair_count = 0;
+    hash->pair_overflow = 0;
+
+    for (int b = 0; b <= hash->bucket_mask; b++) {
+        int end = hash->starts[b + 1];
+        for (int e = hash->starts[b]; e < end; e++) {
+            SpatialHashEntry first = hash->entries[e];
+            Rectangle a = hash->bounds[first.item];
+
+            for (int f = e + 1; f < end; f++) {
+                SpatialHashEntry second = hash->entries[f];
+                if (second.cell_x != first.cell_x || second.cell_y != first.cell_y) continue;
+
+                Rectangle c = hash->bounds[second.item];
+                if (!isSpatialHashOverlap(a, c)) continue;
+                if (getSpatialHashCell(hash, fmaxf(a.x, c.x)) != first.cell_x) continue;
+                if (getSpatialHashCell(hash, fmaxf(a.y, c.y)) != first.cell_y) continue;
+                addSpatialHashPair(hash, first.item, second.item);
+            }
+        }
+    }
+
+    // Large ones against everything, each large pair from the first of the two
+    for (int l = 0; l < hash->large_count; l++) {
+        int item = hash->large_items[l];
+        Rectangle a = hash->bounds[item];
+        for (int i = 0; i < hash->count; i++) {
+            if (i == item || (hash->large[i] && i < item)) continue;
+            if (isSpatialHashOverlap(a, hash->bounds[i])) addSpatialHashPair(hash, item, i);
+        }
+    }
+
+    sortSpatialHashPairs(hash);
+}
+
+// Every box that overlaps or touches area into found, each once, returns how many.
+// An area bigger than the grid holds just scans every box.
+int querySpatialHash(SpatialHash* hash, Rectangle area) {
+    int found = 0;
+    int x0 = getSpatialHashCell(hash, area.x);
+    int y0 = getSpatialHashCell(hash, area.y);
+    int x1 = getSpatialHashCell(hash, area.x + area.width);
+    int y1 = getSpatialHashCell(hash, area.y + area.height);
+
+    if ((long long)(x1 - x0 + 1)*(y1 - y0 + 1) > hash->bucket_mask + 1) {
+        for (int i = 0; i < hash->count; i++) {
+            hash->found[found] = i;
+            found += isSpatialHashOverlap(hash->bounds[i], area);
+        }
+        return found;
+    }
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            int b = getSpatialHashBucket(hash, x, y);
+            for (int e = hash->starts[b]; e < hash->starts[b + 1]; e++) {
+                SpatialHashEntry entry = hash->entries[e];
+                if (entry.cell_x != x || entry.cell_y != y) continue;
+
+                Rectangle box = hash->bounds[entry.item];
+                if (!isSpatialHashOverlap(box, area)) continue;
+                if (getSpatialHashCell(hash, fmaxf(box.x, area.x)) != x) continue;
+                if (getSpatialHashCell(hash, fmaxf(box.y, area.y)) != y) continue;
+                hash->found[found++] = entry.item;
+            }
+        }
+    }
+    for (int l = 0; l < hash->large_count; l++) {
+        int item = hash->large_items[l];
+        hash->found[found] = item;
+        found += isSpatialHashOverlap(hash->bounds[item], area);
+    }
+
+    return found;
+}
+
+#endif